@@ -0,0 +1,120 @@
+// compiler.rs — compiler-throughput benchmarks (criterion).
+//
+// Times each front-end and back-end stage on synthetic modules of 100 and
+// 1000 functions: Lexer, AstBuilder, SemanticAnalyzer, IRBuilder and
+// CodeGenC (after monomorphization).  Every stage starts from the output
+// of the previous one, prepared outside the timed loop.
+//
+// Usage:
+//   cargo bench --bench compiler
+//   cargo bench --bench compiler -- --save-baseline main
+//   cargo bench --bench compiler -- --baseline main
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use gobol::ast::Program;
+use gobol::ast_builder::AstBuilder;
+use gobol::codegen_c::CodeGenC;
+use gobol::ir::{IRBuilder, Monomorphizer};
+use gobol::lexer::Lexer;
+use gobol::semantic_analyzer::SemanticAnalyzer;
+use gobol::token::TokenType;
+use std::fmt::Write;
+use std::hint::black_box;
+
+const SIZES: [usize; 2] = [100, 1000];
+
+/// A module of `n` functions mixing the constructs real programs lean on:
+/// structs and methods, loops over ranges and arrays, format strings and
+/// calls between functions.
+fn synthetic_module(n: usize) -> String {
+    let mut src = String::from("struct Pair {\n    a: int,\n    b: int,\n};\n\n");
+    src.push_str("impl Pair {\n    func total(self): int {\n        self.a + self.b\n    }\n}\n\n");
+    for i in 0..n {
+        let _ = write!(src, "func f{i}(x: int, y: int): int {{
+    var acc = x;
+    var items: int[] = [];
+    for k in 0..y {{
+        if k % 3 == 0 {{
+            acc = acc + k * {i};
+        }} else {{
+            acc = acc - 1;
+        }}
+        items.add(acc);
+    }}
+    var p = Pair(acc, items.len());
+    var label = @\"f{i}: {{acc}}\";
+    while acc > 1000 {{
+        acc = acc / 2;
+    }}
+    return p.total() + acc;
+}}
+
+");
+    }
+    src.push_str("func main() {\n    var sum = 0;\n");
+    for i in 0..n {
+        let _ = writeln!(src, "    sum = sum + f{i}({i}, 10);");
+    }
+    src.push_str("}\n");
+    src
+}
+
+fn parse(src: &str) -> Box<Program> {
+    let mut builder = AstBuilder::new(Lexer::new(src));
+    let prog = builder.build().expect("synthetic module parses");
+    assert!(!builder.has_error(), "synthetic module parses cleanly");
+    prog
+}
+
+/// An analyzer set up like the driver's: `range` and friends come from
+/// std/__setup__.gbl.
+fn analyzer() -> SemanticAnalyzer {
+    let root = env!("CARGO_MANIFEST_DIR");
+    let mut analyzer = SemanticAnalyzer::new();
+    analyzer.set_main_file(&format!("{}/benches/synthetic.gbl", root));
+    analyzer.set_lib_paths(vec![format!("{}/std", root)]);
+    analyzer
+}
+
+fn bench_stages(c: &mut Criterion) {
+    let mut group = c.benchmark_group("compiler");
+    group.sample_size(20);
+    for &n in &SIZES {
+        let src = synthetic_module(n);
+        let prog = parse(&src);
+        assert!(analyzer().analyze(&prog), "synthetic module passes analysis");
+        let ir = IRBuilder::new().build(&prog).expect("synthetic module lowers");
+        let concrete = Monomorphizer::new().monomorphize(&ir);
+        group.throughput(Throughput::Bytes(src.len() as u64));
+
+        group.bench_with_input(BenchmarkId::new("lexer", n), &src, |b, src| {
+            b.iter(|| {
+                let mut lexer = Lexer::new(src.as_str());
+                let mut count = 0usize;
+                while lexer.get_next_token().r#type != TokenType::EndOfFile {
+                    count += 1;
+                }
+                black_box(count)
+            })
+        });
+        group.bench_with_input(BenchmarkId::new("ast_builder", n), &src, |b, src| {
+            b.iter(|| black_box(AstBuilder::new(Lexer::new(src.as_str())).build()))
+        });
+        group.bench_with_input(BenchmarkId::new("semantic_analyzer", n), &prog, |b, prog| {
+            b.iter(|| black_box(analyzer().analyze(prog)))
+        });
+        group.bench_with_input(BenchmarkId::new("ir_builder", n), &prog, |b, prog| {
+            b.iter(|| black_box(IRBuilder::new().build(prog)))
+        });
+        group.bench_with_input(BenchmarkId::new("monomorphizer", n), &ir, |b, ir| {
+            b.iter(|| black_box(Monomorphizer::new().monomorphize(ir)))
+        });
+        group.bench_with_input(BenchmarkId::new("codegen_c", n), &concrete, |b, ir| {
+            b.iter(|| black_box(CodeGenC::new().generate(ir)))
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_stages);
+criterion_main!(benches);
@@ -0,0 +1,151 @@
+// runtime.rs — runtime benchmarks over the gobol programs in
+// benches/programs.
+//
+// Each program is compiled once with `gobol --release`, run once to warm
+// up, then timed over repeated runs.  The median and minimum wall times
+// are written to target/gobol-bench/latest.tsv and compared against
+// target/gobol-bench/baseline.tsv when one exists.
+//
+// Usage:
+//   cargo bench --bench runtime                       run and compare
+//   cargo bench --bench runtime -- --save-baseline    store as baseline
+//   cargo bench --bench runtime -- --check            exit 1 on regression
+//   cargo bench --bench runtime -- sort fib           only matching names
+//
+// GOBOL_BENCH_RUNS sets the number of timed runs (default 10) and
+// GOBOL_BENCH_THRESHOLD the slowdown in percent reported as a regression
+// (default 5).
+
+use std::collections::HashMap;
+use std::env;
+use std::fs;
+use std::path::{Path, PathBuf};
+use std::process::{self, Command, Stdio};
+use std::time::{Duration, Instant};
+
+struct Timing {
+    name: String,
+    median: Duration,
+    min: Duration,
+}
+
+fn main() {
+    let args: Vec<String> = env::args().skip(1).collect();
+    let save_baseline = args.iter().any(|a| a == "--save-baseline");
+    let check = args.iter().any(|a| a == "--check");
+    // cargo bench passes --bench; any other bare word filters by name
+    let filters: Vec<&String> = args.iter().filter(|a| !a.starts_with("--")).collect();
+    let runs: usize = env::var("GOBOL_BENCH_RUNS").ok().and_then(|n| n.parse().ok()).unwrap_or(10).max(1);
+    let threshold: f64 = env::var("GOBOL_BENCH_THRESHOLD").ok().and_then(|n| n.parse().ok()).unwrap_or(5.0);
+
+    let root = PathBuf::from(env!("CARGO_MANIFEST_DIR"));
+    let target = env::var("CARGO_TARGET_DIR").map(PathBuf::from).unwrap_or_else(|_| root.join("target"));
+    let out_dir = target.join("gobol-bench");
+    fs::create_dir_all(&out_dir).expect("cannot create target/gobol-bench");
+
+    let mut programs: Vec<PathBuf> = fs::read_dir(root.join("benches").join("programs"))
+        .expect("cannot read benches/programs")
+        .flatten()
+        .map(|e| e.path())
+        .filter(|p| p.extension().map_or(false, |e| e == "gbl"))
+        .filter(|p| filters.is_empty() || filters.iter().any(|f| stem(p).contains(f.as_str())))
+        .collect();
+    programs.sort();
+
+    let mut results = Vec::new();
+    for program in &programs {
+        let name = stem(program);
+        let binary = out_dir.join(&name);
+        compile(program, &binary, &root, &out_dir);
+        run(&binary); // warm up caches and the page cache
+        let mut times: Vec<Duration> = (0..runs).map(|_| run(&binary)).collect();
+        times.sort();
+        results.push(Timing { name, median: times[times.len() / 2], min: times[0] });
+    }
+
+    let baseline = read_results(&out_dir.join("baseline.tsv"));
+    let mut regressed = 0;
+    println!("{:<20} {:>12} {:>12} {:>10}", "program", "median ms", "min ms", "vs base");
+    for r in &results {
+        let change = baseline.get(&r.name).map(|base| {
+            (r.median.as_secs_f64() / base.as_secs_f64().max(1e-9) - 1.0) * 100.0
+        });
+        let note = match change {
+            Some(c) if c > threshold => { regressed += 1; format!("{:+9.1}%  REGRESSED", c) }
+            Some(c) => format!("{:+9.1}%", c),
+            None => "-".to_string(),
+        };
+        println!("{:<20} {:>12.3} {:>12.3} {:>10}", r.name, ms(r.median), ms(r.min), note);
+    }
+
+    let latest = out_dir.join("latest.tsv");
+    write_results(&latest, &results);
+    if save_baseline {
+        write_results(&out_dir.join("baseline.tsv"), &results);
+        println!("baseline saved to {}", out_dir.join("baseline.tsv").display());
+    }
+    if check && regressed > 0 {
+        eprintln!("{} program(s) regressed by more than {}%", regressed, threshold);
+        process::exit(1);
+    }
+}
+
+fn stem(path: &Path) -> String {
+    path.file_stem().and_then(|s| s.to_str()).unwrap_or("program").to_string()
+}
+
+fn compile(program: &Path, binary: &Path, root: &Path, work_dir: &Path) {
+    let status = Command::new(env!("CARGO_BIN_EXE_gobol"))
+        .arg(program)
+        .arg("-o").arg(binary)
+        .arg("--lib-path").arg(root.join("std"))
+        .args(["--release", "-c"])
+        .current_dir(work_dir)
+        .status()
+        .expect("cannot run gobol");
+    if !status.success() {
+        eprintln!("failed to compile {}", program.display());
+        process::exit(1);
+    }
+}
+
+fn run(binary: &Path) -> Duration {
+    let start = Instant::now();
+    let status = Command::new(binary)
+        .stdout(Stdio::null())
+        .status()
+        .unwrap_or_else(|e| panic!("cannot run {}: {}", binary.display(), e));
+    let elapsed = start.elapsed();
+    if !status.success() {
+        eprintln!("{} exited with {}", binary.display(), status);
+        process::exit(1);
+    }
+    elapsed
+}
+
+fn ms(d: Duration) -> f64 {
+    d.as_secs_f64() * 1000.0
+}
+
+/// One `name<TAB>median_ns<TAB>min_ns` line per program.
+fn write_results(path: &Path, results: &[Timing]) {
+    let text: String = results.iter()
+        .map(|r| format!("{}\t{}\t{}\n", r.name, r.median.as_nanos(), r.min.as_nanos()))
+        .collect();
+    if let Err(e) = fs::write(path, text) {
+        eprintln!("cannot write {}: {}", path.display(), e);
+    }
+}
+
+/// Median time per program from a results file; empty when there is none.
+fn read_results(path: &Path) -> HashMap<String, Duration> {
+    let text = fs::read_to_string(path).unwrap_or_default();
+    text.lines()
+        .filter_map(|line| {
+            let mut cols = line.split('\t');
+            let name = cols.next()?.to_string();
+            let median: u64 = cols.next()?.parse().ok()?;
+            Some((name, Duration::from_nanos(median)))
+        })
+        .collect()
+}
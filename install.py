@@ -80,6 +80,25 @@ def install_std(target_dir):
     return True
 
 
+def build_runtime(target_dir):
+    """Prebuild the runtime library so the first gobol run doesn't compile it"""
+    gobol = target_dir / get_binaries()[0]
+    if not gobol.exists():
+        print("[WARN] gobol not installed, skipping runtime build")
+        return False
+    result = subprocess.run(
+        [str(gobol), "--build-runtime", "--lib-path", str(target_dir / "std")],
+        capture_output=True, text=True
+    )
+    if result.returncode != 0:
+        print("[WARN] Runtime build failed; it will be built on first use", file=sys.stderr)
+        if result.stderr:
+            print(result.stderr, file=sys.stderr)
+        return False
+    print(f"[ OK ] runtime -> {result.stdout.strip()}")
+    return True
+
+
 # ==================== Add PATH (Cross-platform) ====================
 
 def add_path_unix(target_dir):
@@ -237,6 +256,7 @@ if __name__ == "__main__":
     print("[INFO] Installing binaries...")
     install_binaries(target_dir)
     install_std(target_dir)
+    build_runtime(target_dir)
 
     print("")
     print("[INFO] Adding to PATH...")
@@ -1,155 +1,368 @@
 #![allow(dead_code)]
 
-use std::any::Any;
+use std::ops::Index;
 
-// ==================== Visitor ====================
+// ==================== Arena ====================
 
-pub trait AstVisitor {
-    #[allow(dead_code)]
-    fn visit_ast_node(&mut self, _node: &dyn AstNode) {}
-    fn visit_program(&mut self, _node: &Program) {}
-    #[allow(dead_code)]
-    fn visit_statement(&mut self, _node: &dyn Statement) {}
-    #[allow(dead_code)]
-    fn visit_expression(&mut self, _node: &dyn Expression) {}
-    fn visit_block(&mut self, _node: &Block) {}
-    fn visit_function(&mut self, _node: &Function) {}
-    fn visit_parameter(&mut self, _node: &Parameter) {}
-    fn visit_basic_type(&mut self, _node: &BasicType) {}
-    #[allow(dead_code)]
-    fn visit_type(&mut self, _node: &dyn Type) {}
-    fn visit_array_type(&mut self, _node: &ArrayType) {}
-    fn visit_if_statement(&mut self, _node: &IfStatement) {}
-    fn visit_while_statement(&mut self, _node: &WhileStatement) {}
-    fn visit_for_statement(&mut self, _node: &ForStatement) {}
-    fn visit_return_statement(&mut self, _node: &ReturnStatement) {}
-    fn visit_break_statement(&mut self, _node: &BreakStatement) {}
-    fn visit_continue_statement(&mut self, _node: &ContinueStatement) {}
-    fn visit_declaration(&mut self, _node: &Declaration) {}
-    fn visit_expression_statement(&mut self, _node: &ExpressionStatement) {}
-    fn visit_import_statement(&mut self, _node: &ImportStatement) {}
-    fn visit_export_statement(&mut self, _node: &ExportStatement) {}
-    fn visit_struct_definition(&mut self, _node: &StructDefinition) {}
-    fn visit_impl_block(&mut self, _node: &ImplBlock) {}
-    fn visit_binary_expression(&mut self, _node: &BinaryExpression) {}
-    fn visit_unary_expression(&mut self, _node: &UnaryExpression) {}
-    fn visit_cast_expression(&mut self, _node: &CastExpression) {}
-    fn visit_function_call(&mut self, _node: &FunctionCall) {}
-    fn visit_member_access(&mut self, _node: &MemberAccess) {}
-    fn visit_array_index(&mut self, _node: &ArrayIndex) {}
-    fn visit_grouped_expression(&mut self, _node: &GroupedExpression) {}
-    fn visit_identifier(&mut self, _node: &Identifier) {}
-    fn visit_number_literal(&mut self, _node: &NumberLiteral) {}
-    fn visit_string_literal(&mut self, _node: &StringLiteral) {}
-    fn visit_boolean_literal(&mut self, _node: &BooleanLiteral) {}
-    fn visit_null_literal(&mut self, _node: &NullLiteral) {}
-    fn visit_format_string(&mut self, _node: &FormatString) {}
-    fn visit_range_expression(&mut self, _node: &RangeExpression) {}
-    fn visit_array_literal(&mut self, _node: &ArrayLiteral) {}
-    fn visit_struct_literal(&mut self, _node: &StructLiteral) {}
-    fn visit_match_expression(&mut self, _node: &MatchExpression) {}
-}
-
-// ==================== Node ====================
-
-pub trait AstNode {
-    fn accept(&self, visitor: &mut dyn AstVisitor);
-    fn as_any(&self) -> &dyn Any;
-}
-
-// ==================== Statement ====================
-
-pub trait Statement: AstNode {
-    fn as_statement(&self) -> &dyn Statement;
-}
-
-// ==================== Expression ====================
-
-pub trait Expression: AstNode {
-    fn as_expression(&self) -> &dyn Expression;
-}
-
-// ==================== Type trait ====================
-
-pub trait Type: AstNode {
-    fn get_name(&self) -> &str;
-    #[allow(dead_code)]
-    fn as_type(&self) -> &dyn Type;
-    fn as_type_any(&self) -> &dyn Any;
+/// Index of an expression in its program's `Ast`
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct ExprId(u32);
+
+/// Index of a statement in its program's `Ast`
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct StmtId(u32);
+
+/// Every node of one parsed module, in two typed arenas. `AstBuilder`
+/// fills them once; afterwards nodes refer to their children by id, so
+/// walking the tree is a bounds-checked index and a `match`, with no
+/// per-node allocation or dynamic dispatch.
+#[derive(Default)]
+pub struct Ast {
+    exprs: Vec<ExprNode>,
+    stmts: Vec<StmtNode>,
 }
 
-// ==================== BasicType ====================
+impl Ast {
+    pub fn new() -> Self {
+        Ast::default()
+    }
 
-#[derive(Debug, Clone)]
-pub struct BasicType {
-    pub name: String,
+    pub fn add_expr(&mut self, node: impl Into<ExprNode>) -> ExprId {
+        self.exprs.push(node.into());
+        ExprId((self.exprs.len() - 1) as u32)
+    }
+
+    pub fn add_stmt(&mut self, node: impl Into<StmtNode>) -> StmtId {
+        self.stmts.push(node.into());
+        StmtId((self.stmts.len() - 1) as u32)
+    }
+
+    pub fn expr(&self, id: ExprId) -> &ExprNode {
+        &self.exprs[id.0 as usize]
+    }
+
+    pub fn stmt(&self, id: StmtId) -> &StmtNode {
+        &self.stmts[id.0 as usize]
+    }
+
+    pub fn expr_count(&self) -> usize {
+        self.exprs.len()
+    }
+
+    pub fn stmt_count(&self) -> usize {
+        self.stmts.len()
+    }
+
+    /// Calls the visitor method for the expression's kind
+    pub fn walk_expr<V: AstVisitor + ?Sized>(&self, id: ExprId, visitor: &mut V) {
+        match self.expr(id) {
+            ExprNode::Binary(n) => visitor.visit_binary_expression(self, n),
+            ExprNode::Unary(n) => visitor.visit_unary_expression(self, n),
+            ExprNode::Cast(n) => visitor.visit_cast_expression(self, n),
+            ExprNode::Call(n) => visitor.visit_function_call(self, n),
+            ExprNode::Member(n) => visitor.visit_member_access(self, n),
+            ExprNode::Index(n) => visitor.visit_array_index(self, n),
+            ExprNode::Grouped(n) => visitor.visit_grouped_expression(self, n),
+            ExprNode::Identifier(n) => visitor.visit_identifier(self, n),
+            ExprNode::Number(n) => visitor.visit_number_literal(self, n),
+            ExprNode::Str(n) => visitor.visit_string_literal(self, n),
+            ExprNode::Bool(n) => visitor.visit_boolean_literal(self, n),
+            ExprNode::Null(n) => visitor.visit_null_literal(self, n),
+            ExprNode::Format(n) => visitor.visit_format_string(self, n),
+            ExprNode::Range(n) => visitor.visit_range_expression(self, n),
+            ExprNode::Array(n) => visitor.visit_array_literal(self, n),
+            ExprNode::Struct(n) => visitor.visit_struct_literal(self, n),
+            ExprNode::Match(n) => visitor.visit_match_expression(self, n),
+            ExprNode::Block(n) => visitor.visit_block(self, n),
+            ExprNode::If(n) => visitor.visit_if_statement(self, n),
+        }
+    }
+
+    /// Calls the visitor method for the statement's kind
+    pub fn walk_stmt<V: AstVisitor + ?Sized>(&self, id: StmtId, visitor: &mut V) {
+        match self.stmt(id) {
+            StmtNode::Block(n) => visitor.visit_block(self, n),
+            StmtNode::Function(n) => visitor.visit_function(self, n),
+            StmtNode::Import(n) => visitor.visit_import_statement(self, n),
+            StmtNode::Export(n) => visitor.visit_export_statement(self, n),
+            StmtNode::Struct(n) => visitor.visit_struct_definition(self, n),
+            StmtNode::Impl(n) => visitor.visit_impl_block(self, n),
+            StmtNode::If(n) => visitor.visit_if_statement(self, n),
+            StmtNode::While(n) => visitor.visit_while_statement(self, n),
+            StmtNode::Region(n) => visitor.visit_region_statement(self, n),
+            StmtNode::For(n) => visitor.visit_for_statement(self, n),
+            StmtNode::Return(n) => visitor.visit_return_statement(self, n),
+            StmtNode::Break(n) => visitor.visit_break_statement(self, n),
+            StmtNode::Continue(n) => visitor.visit_continue_statement(self, n),
+            StmtNode::Declaration(n) => visitor.visit_declaration(self, n),
+            StmtNode::Expression(n) => visitor.visit_expression_statement(self, n),
+        }
+    }
+
+    /// Calls the visitor method for the type's kind
+    pub fn walk_type<V: AstVisitor + ?Sized>(&self, tp: &Type, visitor: &mut V) {
+        match tp {
+            Type::Basic(t) => visitor.visit_basic_type(self, t),
+            Type::Array(t) => visitor.visit_array_type(self, t),
+            Type::Nullable(t) => self.walk_type(&t.inner_type, visitor),
+            Type::Generic(t) => {
+                for arg in &t.type_args {
+                    self.walk_type(arg, visitor);
+                }
+            }
+        }
+    }
 }
 
-impl BasicType {
-    pub fn new(name: impl Into<String>) -> Self {
-        BasicType { name: name.into() }
+impl Index<ExprId> for Ast {
+    type Output = ExprNode;
+    fn index(&self, id: ExprId) -> &ExprNode {
+        self.expr(id)
     }
 }
 
-impl AstNode for BasicType {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_basic_type(self);
+impl Index<StmtId> for Ast {
+    type Output = StmtNode;
+    fn index(&self, id: StmtId) -> &StmtNode {
+        self.stmt(id)
     }
-    fn as_any(&self) -> &dyn Any {
-        self
+}
+
+/// Declares a node enum with `From` for each payload and an `as_*`
+/// accessor per variant.
+macro_rules! node_enum {
+    ($(#[$meta:meta])* $enum_name:ident { $($variant:ident($payload:ident) => $as_fn:ident),* $(,)? }) => {
+        $(#[$meta])*
+        pub enum $enum_name {
+            $($variant($payload)),*
+        }
+
+        $(
+            impl From<$payload> for $enum_name {
+                fn from(node: $payload) -> Self {
+                    $enum_name::$variant(node)
+                }
+            }
+        )*
+
+        impl $enum_name {
+            $(
+                pub fn $as_fn(&self) -> Option<&$payload> {
+                    match self {
+                        $enum_name::$variant(n) => Some(n),
+                        _ => None,
+                    }
+                }
+            )*
+        }
+    };
+}
+
+node_enum! {
+    /// Expressions. `Block`, `If` and `Match` also produce values, so they
+    /// can appear here as well as among the statements.
+    ExprNode {
+        Binary(BinaryExpression) => as_binary,
+        Unary(UnaryExpression) => as_unary,
+        Cast(CastExpression) => as_cast,
+        Call(FunctionCall) => as_call,
+        Member(MemberAccess) => as_member,
+        Index(ArrayIndex) => as_index,
+        Grouped(GroupedExpression) => as_grouped,
+        Identifier(Identifier) => as_identifier,
+        Number(NumberLiteral) => as_number,
+        Str(StringLiteral) => as_string,
+        Bool(BooleanLiteral) => as_boolean,
+        Null(NullLiteral) => as_null,
+        Format(FormatString) => as_format_string,
+        Range(RangeExpression) => as_range,
+        Array(ArrayLiteral) => as_array_literal,
+        Struct(StructLiteral) => as_struct_literal,
+        Match(MatchExpression) => as_match,
+        Block(Block) => as_block,
+        If(IfStatement) => as_if,
+    }
+}
+
+node_enum! {
+    StmtNode {
+        Block(Block) => as_block,
+        Function(Function) => as_function,
+        Import(ImportStatement) => as_import,
+        Export(ExportStatement) => as_export,
+        Struct(StructDefinition) => as_struct_definition,
+        Impl(ImplBlock) => as_impl_block,
+        If(IfStatement) => as_if,
+        While(WhileStatement) => as_while,
+        Region(RegionStatement) => as_region,
+        For(ForStatement) => as_for,
+        Return(ReturnStatement) => as_return,
+        Break(BreakStatement) => as_break,
+        Continue(ContinueStatement) => as_continue,
+        Declaration(Declaration) => as_declaration,
+        Expression(ExpressionStatement) => as_expression_statement,
     }
 }
 
-impl Type for BasicType {
-    fn get_name(&self) -> &str {
-        &self.name
+// ==================== Visitor ====================
+
+/// Every method gets the arena its node lives in. `visit_expr` and
+/// `visit_stmt` dispatch by node kind; on a concrete visitor they are
+/// statically resolved.
+pub trait AstVisitor {
+    fn visit_expr(&mut self, ast: &Ast, id: ExprId) {
+        ast.walk_expr(id, self);
+    }
+    fn visit_stmt(&mut self, ast: &Ast, id: StmtId) {
+        ast.walk_stmt(id, self);
+    }
+    fn visit_type(&mut self, ast: &Ast, tp: &Type) {
+        ast.walk_type(tp, self);
+    }
+    fn visit_program(&mut self, _ast: &Ast, _node: &Program) {}
+    fn visit_block(&mut self, _ast: &Ast, _node: &Block) {}
+    fn visit_function(&mut self, _ast: &Ast, _node: &Function) {}
+    fn visit_parameter(&mut self, _ast: &Ast, _node: &Parameter) {}
+    fn visit_basic_type(&mut self, _ast: &Ast, _node: &BasicType) {}
+    fn visit_array_type(&mut self, _ast: &Ast, _node: &ArrayType) {}
+    fn visit_if_statement(&mut self, _ast: &Ast, _node: &IfStatement) {}
+    fn visit_while_statement(&mut self, _ast: &Ast, _node: &WhileStatement) {}
+    fn visit_region_statement(&mut self, _ast: &Ast, _node: &RegionStatement) {}
+    fn visit_for_statement(&mut self, _ast: &Ast, _node: &ForStatement) {}
+    fn visit_return_statement(&mut self, _ast: &Ast, _node: &ReturnStatement) {}
+    fn visit_break_statement(&mut self, _ast: &Ast, _node: &BreakStatement) {}
+    fn visit_continue_statement(&mut self, _ast: &Ast, _node: &ContinueStatement) {}
+    fn visit_declaration(&mut self, _ast: &Ast, _node: &Declaration) {}
+    fn visit_expression_statement(&mut self, _ast: &Ast, _node: &ExpressionStatement) {}
+    fn visit_import_statement(&mut self, _ast: &Ast, _node: &ImportStatement) {}
+    fn visit_export_statement(&mut self, _ast: &Ast, _node: &ExportStatement) {}
+    fn visit_struct_definition(&mut self, _ast: &Ast, _node: &StructDefinition) {}
+    fn visit_impl_block(&mut self, _ast: &Ast, _node: &ImplBlock) {}
+    fn visit_binary_expression(&mut self, _ast: &Ast, _node: &BinaryExpression) {}
+    fn visit_unary_expression(&mut self, _ast: &Ast, _node: &UnaryExpression) {}
+    fn visit_cast_expression(&mut self, _ast: &Ast, _node: &CastExpression) {}
+    fn visit_function_call(&mut self, _ast: &Ast, _node: &FunctionCall) {}
+    fn visit_member_access(&mut self, _ast: &Ast, _node: &MemberAccess) {}
+    fn visit_array_index(&mut self, _ast: &Ast, _node: &ArrayIndex) {}
+    fn visit_grouped_expression(&mut self, _ast: &Ast, _node: &GroupedExpression) {}
+    fn visit_identifier(&mut self, _ast: &Ast, _node: &Identifier) {}
+    fn visit_number_literal(&mut self, _ast: &Ast, _node: &NumberLiteral) {}
+    fn visit_string_literal(&mut self, _ast: &Ast, _node: &StringLiteral) {}
+    fn visit_boolean_literal(&mut self, _ast: &Ast, _node: &BooleanLiteral) {}
+    fn visit_null_literal(&mut self, _ast: &Ast, _node: &NullLiteral) {}
+    fn visit_format_string(&mut self, _ast: &Ast, _node: &FormatString) {}
+    fn visit_range_expression(&mut self, _ast: &Ast, _node: &RangeExpression) {}
+    fn visit_array_literal(&mut self, _ast: &Ast, _node: &ArrayLiteral) {}
+    fn visit_struct_literal(&mut self, _ast: &Ast, _node: &StructLiteral) {}
+    fn visit_match_expression(&mut self, _ast: &Ast, _node: &MatchExpression) {}
+}
+
+// ==================== Type ====================
+
+#[derive(Debug, Clone)]
+pub enum Type {
+    Basic(BasicType),
+    Array(ArrayType),
+    Nullable(NullableType),
+    Generic(GenericType),
+}
+
+impl Type {
+    pub fn basic(name: impl Into<String>) -> Self {
+        Type::Basic(BasicType::new(name))
     }
-    fn as_type(&self) -> &dyn Type {
-        self
+
+    pub fn get_name(&self) -> &str {
+        match self {
+            Type::Basic(t) => &t.name,
+            // 对于数组类型，返回基础类型名；完整类型名见 get_full_name
+            Type::Array(t) => t.get_base_type_name(),
+            Type::Nullable(t) => t.inner_type.get_name(),
+            Type::Generic(t) => &t.base_name,
+        }
     }
-    fn as_type_any(&self) -> &dyn Any {
-        self
+
+    pub fn as_basic(&self) -> Option<&BasicType> {
+        match self {
+            Type::Basic(t) => Some(t),
+            _ => None,
+        }
+    }
+
+    pub fn as_array(&self) -> Option<&ArrayType> {
+        match self {
+            Type::Array(t) => Some(t),
+            _ => None,
+        }
+    }
+
+    pub fn as_nullable(&self) -> Option<&NullableType> {
+        match self {
+            Type::Nullable(t) => Some(t),
+            _ => None,
+        }
+    }
+
+    pub fn as_generic(&self) -> Option<&GenericType> {
+        match self {
+            Type::Generic(t) => Some(t),
+            _ => None,
+        }
+    }
+}
+
+// ==================== BasicType ====================
+
+#[derive(Debug, Clone)]
+pub struct BasicType {
+    pub name: String,
+}
+
+impl BasicType {
+    pub fn new(name: impl Into<String>) -> Self {
+        BasicType { name: name.into() }
     }
 }
 
 // ==================== ArrayType (完整多维数组支持) ====================
 
+#[derive(Debug, Clone)]
 pub struct ArrayType {
-    element_type: Box<dyn Type>,      // 元素类型（可以是基本类型或嵌套数组）
-    size: Option<Box<dyn Expression>>,  // 当前维度的大小
+    element_type: Box<Type>,  // 元素类型（可以是基本类型或嵌套数组）
+    size: Option<ExprId>,     // 当前维度的大小
 }
 
 impl ArrayType {
     /// 创建一维数组类型（基本类型 + 大小）
-    pub fn new_basic(element_name: &str, size: Box<dyn Expression>) -> Self {
+    pub fn new_basic(element_name: &str, size: ExprId) -> Self {
         ArrayType {
-            element_type: Box::new(BasicType::new(element_name)),
+            element_type: Box::new(Type::basic(element_name)),
             size: Some(size),
         }
     }
 
     /// 创建多维数组类型（嵌套 ArrayType + 大小）
-    pub fn new_nested(element_type: Box<dyn Type>, size: Box<dyn Expression>) -> Self {
+    pub fn new_nested(element_type: Type, size: ExprId) -> Self {
         ArrayType {
-            element_type,
+            element_type: Box::new(element_type),
             size: Some(size),
         }
     }
 
     /// 获取元素类型（可能是基本类型或嵌套 ArrayType）
-    pub fn get_element_type(&self) -> &dyn Type {
-        &*self.element_type
+    pub fn get_element_type(&self) -> &Type {
+        &self.element_type
     }
 
     /// 获取当前维度大小表达式
-    pub fn get_size(&self) -> Option<&dyn Expression> {
-        self.size.as_deref().map(|e| e.as_expression())
+    pub fn get_size(&self) -> Option<ExprId> {
+        self.size
     }
 
     /// 获取基础类型（剥掉所有[]后的最内层类型）
-    pub fn get_base_type(&self) -> &dyn Type {
-        let mut current: &dyn Type = &*self.element_type;
-        while let Some(arr) = current.as_type_any().downcast_ref::<ArrayType>() {
+    pub fn get_base_type(&self) -> &Type {
+        let mut current: &Type = &self.element_type;
+        while let Type::Array(arr) = current {
             current = arr.get_element_type();
         }
         current
@@ -163,8 +376,8 @@ impl ArrayType {
     /// 获取数组维度（[]的个数）
     pub fn get_dimension(&self) -> usize {
         let mut dim = 1;
-        let mut current: &dyn Type = &*self.element_type;
-        while let Some(arr) = current.as_type_any().downcast_ref::<ArrayType>() {
+        let mut current: &Type = &self.element_type;
+        while let Type::Array(arr) = current {
             dim += 1;
             current = arr.get_element_type();
         }
@@ -173,7 +386,7 @@ impl ArrayType {
 
     /// 判断是否是多维数组
     pub fn is_multi_dimensional(&self) -> bool {
-        self.element_type.as_type_any().downcast_ref::<ArrayType>().is_some()
+        self.element_type.as_array().is_some()
     }
 
     /// 获取完整类型名（如 "int[][]"）
@@ -184,134 +397,76 @@ impl ArrayType {
     }
 }
 
-impl AstNode for ArrayType {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_array_type(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Type for ArrayType {
-    fn get_name(&self) -> &str {
-        // 对于数组类型，返回完整类型名不方便，使用 get_full_name
-        // 但为了 trait 兼容，返回基础类型名
-        self.get_base_type_name()
-    }
-    fn as_type(&self) -> &dyn Type {
-        self
-    }
-    fn as_type_any(&self) -> &dyn Any {
-        self
-    }
-}
-
 // ==================== NullableType ====================
 
+#[derive(Debug, Clone)]
 pub struct NullableType {
-    pub inner_type: Box<dyn Type>,
+    pub inner_type: Box<Type>,
 }
 
 impl NullableType {
-    pub fn new(inner_type: Box<dyn Type>) -> Self {
-        NullableType { inner_type }
-    }
-
-    pub fn get_inner_type(&self) -> &dyn Type {
-        &*self.inner_type
-    }
-}
-
-impl AstNode for NullableType {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_basic_type(self.inner_type.as_any().downcast_ref::<BasicType>().unwrap_or_else(|| {
-            panic!("NullableType inner must be BasicType");
-        }));
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
+    pub fn new(inner_type: Type) -> Self {
+        NullableType { inner_type: Box::new(inner_type) }
     }
-}
 
-impl Type for NullableType {
-    fn get_name(&self) -> &str {
-        self.inner_type.get_name()
-    }
-    fn as_type(&self) -> &dyn Type {
-        self
-    }
-    fn as_type_any(&self) -> &dyn Any {
-        self
+    pub fn get_inner_type(&self) -> &Type {
+        &self.inner_type
     }
 }
 
 // ==================== GenericType ====================
 
+#[derive(Debug, Clone)]
 pub struct GenericType {
     pub base_name: String,
-    pub type_args: Vec<Box<dyn Type>>,
+    pub type_args: Vec<Type>,
 }
 
 impl GenericType {
-    pub fn new(base_name: impl Into<String>, type_args: Vec<Box<dyn Type>>) -> Self {
+    pub fn new(base_name: impl Into<String>, type_args: Vec<Type>) -> Self {
         GenericType {
             base_name: base_name.into(),
             type_args,
         }
     }
     pub fn get_base_name(&self) -> &str { &self.base_name }
-    pub fn get_type_args(&self) -> &Vec<Box<dyn Type>> { &self.type_args }
-}
-
-impl AstNode for GenericType {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_basic_type(self.type_args.first().map(|t| t.as_any().downcast_ref::<BasicType>().unwrap_or_else(|| panic!("expected BasicType"))).unwrap_or_else(|| panic!("expected type arg")));
-    }
-    fn as_any(&self) -> &dyn Any { self }
-}
-
-impl Type for GenericType {
-    fn get_name(&self) -> &str { &self.base_name }
-    fn as_type(&self) -> &dyn Type { self }
-    fn as_type_any(&self) -> &dyn Any { self }
+    pub fn get_type_args(&self) -> &Vec<Type> { &self.type_args }
 }
 
 // ==================== Program ====================
 
 pub struct Program {
-    statements: Vec<Box<dyn Statement>>,
+    ast: Ast,
+    statements: Vec<StmtId>,
 }
 
 impl Program {
-    pub fn new() -> Self {
-        Program {
-            statements: Vec::new(),
-        }
+    pub fn new(ast: Ast, statements: Vec<StmtId>) -> Self {
+        Program { ast, statements }
     }
 
-    pub fn add_statement(&mut self, stmt: Box<dyn Statement>) {
-        self.statements.push(stmt);
+    pub fn get_ast(&self) -> &Ast {
+        &self.ast
     }
 
-    pub fn get_statements(&self) -> &Vec<Box<dyn Statement>> {
+    pub fn get_statements(&self) -> &Vec<StmtId> {
         &self.statements
     }
-}
 
-impl AstNode for Program {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_program(self);
+    /// Top-level statements with the nodes they refer to
+    pub fn statement_nodes(&self) -> impl Iterator<Item = &StmtNode> {
+        self.statements.iter().map(move |&s| self.ast.stmt(s))
     }
-    fn as_any(&self) -> &dyn Any {
-        self
+
+    pub fn accept<V: AstVisitor + ?Sized>(&self, visitor: &mut V) {
+        visitor.visit_program(&self.ast, self);
     }
 }
 
 // ==================== Block ====================
 
 pub struct Block {
-    statements: Vec<Box<dyn Statement>>,
+    statements: Vec<StmtId>,
 }
 
 impl Block {
@@ -321,45 +476,24 @@ impl Block {
         }
     }
 
-    pub fn add_statement(&mut self, stmt: Box<dyn Statement>) {
+    pub fn add_statement(&mut self, stmt: StmtId) {
         self.statements.push(stmt);
     }
 
-    pub fn get_statements(&self) -> &Vec<Box<dyn Statement>> {
+    pub fn get_statements(&self) -> &Vec<StmtId> {
         &self.statements
     }
 }
 
-impl AstNode for Block {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_block(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Statement for Block {
-    fn as_statement(&self) -> &dyn Statement {
-        self
-    }
-}
-
-impl Expression for Block {
-    fn as_expression(&self) -> &dyn Expression {
-        self
-    }
-}
-
 // ==================== Parameter ====================
 
 pub struct Parameter {
     name: String,
-    r#type: Option<Box<dyn Type>>,
+    r#type: Option<Type>,
 }
 
 impl Parameter {
-    pub fn new(name: impl Into<String>, r#type: Option<Box<dyn Type>>) -> Self {
+    pub fn new(name: impl Into<String>, r#type: Option<Type>) -> Self {
         Parameter {
             name: name.into(),
             r#type,
@@ -370,17 +504,8 @@ impl Parameter {
         &self.name
     }
 
-    pub fn get_type(&self) -> Option<&dyn Type> {
-        self.r#type.as_deref()
-    }
-}
-
-impl AstNode for Parameter {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_parameter(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
+    pub fn get_type(&self) -> Option<&Type> {
+        self.r#type.as_ref()
     }
 }
 
@@ -388,18 +513,20 @@ impl AstNode for Parameter {
 
 pub struct Function {
     name: String,
-    parameters: Option<Vec<Box<Parameter>>>,
-    return_type: Option<Box<dyn Type>>,
-    body: Option<Box<Block>>,
+    parameters: Option<Vec<Parameter>>,
+    return_type: Option<Type>,
+    body: Option<Block>,
     generic_params: Vec<String>,
+    /// Source line of the function name (1-based; 0 when unknown)
+    line: i32,
 }
 
 impl Function {
     pub fn new(
         name: impl Into<String>,
-        parameters: Option<Vec<Box<Parameter>>>,
-        return_type: Option<Box<dyn Type>>,
-        body: Option<Box<Block>>,
+        parameters: Option<Vec<Parameter>>,
+        return_type: Option<Type>,
+        body: Option<Block>,
     ) -> Self {
         Function {
             name: name.into(),
@@ -407,6 +534,7 @@ impl Function {
             return_type,
             body,
             generic_params: Vec::new(),
+            line: 0,
         }
     }
 
@@ -415,11 +543,20 @@ impl Function {
         self
     }
 
+    pub fn with_line(mut self, line: i32) -> Self {
+        self.line = line;
+        self
+    }
+
+    pub fn get_line(&self) -> i32 {
+        self.line
+    }
+
     pub fn get_name(&self) -> &str {
         &self.name
     }
 
-    pub fn get_parameters(&self) -> Option<&Vec<Box<Parameter>>> {
+    pub fn get_parameters(&self) -> Option<&Vec<Parameter>> {
         self.parameters.as_ref()
     }
 
@@ -427,27 +564,12 @@ impl Function {
         &self.generic_params
     }
 
-    pub fn get_return_type(&self) -> Option<&dyn Type> {
-        self.return_type.as_deref()
+    pub fn get_return_type(&self) -> Option<&Type> {
+        self.return_type.as_ref()
     }
 
     pub fn get_body(&self) -> Option<&Block> {
-        self.body.as_deref()
-    }
-}
-
-impl AstNode for Function {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_function(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Statement for Function {
-    fn as_statement(&self) -> &dyn Statement {
-        self
+        self.body.as_ref()
     }
 }
 
@@ -476,21 +598,6 @@ impl ImportStatement {
     }
 }
 
-impl AstNode for ImportStatement {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_import_statement(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Statement for ImportStatement {
-    fn as_statement(&self) -> &dyn Statement {
-        self
-    }
-}
-
 // ==================== ExportStatement ====================
 
 pub struct ExportStatement {
@@ -507,26 +614,11 @@ impl ExportStatement {
     }
 }
 
-impl AstNode for ExportStatement {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_export_statement(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Statement for ExportStatement {
-    fn as_statement(&self) -> &dyn Statement {
-        self
-    }
-}
-
 // ==================== StructDefinition ====================
 
 pub struct StructField {
     pub name: String,
-    pub field_type: Option<Box<dyn Type>>,
+    pub field_type: Option<Type>,
 }
 
 pub struct StructDefinition {
@@ -549,23 +641,12 @@ impl StructDefinition {
     pub fn get_generic_params(&self) -> &Vec<String> { &self.generic_params }
 }
 
-impl AstNode for StructDefinition {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_struct_definition(self);
-    }
-    fn as_any(&self) -> &dyn Any { self }
-}
-
-impl Statement for StructDefinition {
-    fn as_statement(&self) -> &dyn Statement { self }
-}
-
 // ==================== ImplBlock ====================
 
 pub enum ImplItem {
-    Constructor(Box<Function>),
-    Method(Box<Function>),
-    Convert(Box<Function>),
+    Constructor(Function),
+    Method(Function),
+    Convert(Function),
 }
 
 pub struct ImplBlock {
@@ -587,30 +668,19 @@ impl ImplBlock {
     pub fn get_items(&self) -> &Vec<ImplItem> { &self.items }
 }
 
-impl AstNode for ImplBlock {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_impl_block(self);
-    }
-    fn as_any(&self) -> &dyn Any { self }
-}
-
-impl Statement for ImplBlock {
-    fn as_statement(&self) -> &dyn Statement { self }
-}
-
 // ==================== IfStatement ====================
 
 pub struct IfStatement {
-    condition: Option<Box<dyn Expression>>,
-    then_branch: Option<Box<dyn Statement>>,
-    else_branch: Option<Box<dyn Statement>>,
+    condition: Option<ExprId>,
+    then_branch: Option<StmtId>,
+    else_branch: Option<StmtId>,
 }
 
 impl IfStatement {
     pub fn new(
-        condition: Option<Box<dyn Expression>>,
-        then_branch: Option<Box<dyn Statement>>,
-        else_branch: Option<Box<dyn Statement>>,
+        condition: Option<ExprId>,
+        then_branch: Option<StmtId>,
+        else_branch: Option<StmtId>,
     ) -> Self {
         IfStatement {
             condition,
@@ -619,73 +689,55 @@ impl IfStatement {
         }
     }
 
-    pub fn get_condition(&self) -> Option<&dyn Expression> {
-        self.condition.as_deref().map(|e| e.as_expression())
-    }
-
-    pub fn get_then_branch(&self) -> Option<&dyn Statement> {
-        self.then_branch.as_deref().map(|s| s.as_statement())
-    }
-
-    pub fn get_else_branch(&self) -> Option<&dyn Statement> {
-        self.else_branch.as_deref().map(|s| s.as_statement())
+    pub fn get_condition(&self) -> Option<ExprId> {
+        self.condition
     }
-}
 
-impl AstNode for IfStatement {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_if_statement(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Statement for IfStatement {
-    fn as_statement(&self) -> &dyn Statement {
-        self
+    pub fn get_then_branch(&self) -> Option<StmtId> {
+        self.then_branch
     }
-}
 
-impl Expression for IfStatement {
-    fn as_expression(&self) -> &dyn Expression {
-        self
+    pub fn get_else_branch(&self) -> Option<StmtId> {
+        self.else_branch
     }
 }
 
 // ==================== WhileStatement ====================
 
 pub struct WhileStatement {
-    condition: Option<Box<dyn Expression>>,
-    body: Option<Box<dyn Statement>>,
+    condition: Option<ExprId>,
+    body: Option<StmtId>,
 }
 
 impl WhileStatement {
-    pub fn new(condition: Option<Box<dyn Expression>>, body: Option<Box<dyn Statement>>) -> Self {
+    pub fn new(condition: Option<ExprId>, body: Option<StmtId>) -> Self {
         WhileStatement { condition, body }
     }
 
-    pub fn get_condition(&self) -> Option<&dyn Expression> {
-        self.condition.as_deref().map(|e| e.as_expression())
+    pub fn get_condition(&self) -> Option<ExprId> {
+        self.condition
     }
 
-    pub fn get_body(&self) -> Option<&dyn Statement> {
-        self.body.as_deref().map(|s| s.as_statement())
+    pub fn get_body(&self) -> Option<StmtId> {
+        self.body
     }
 }
 
-impl AstNode for WhileStatement {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_while_statement(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
+// ==================== RegionStatement ====================
+
+/// `region { ... }`: strings and arrays allocated in the body are released
+/// together when it exits.
+pub struct RegionStatement {
+    body: Block,
 }
 
-impl Statement for WhileStatement {
-    fn as_statement(&self) -> &dyn Statement {
-        self
+impl RegionStatement {
+    pub fn new(body: Block) -> Self {
+        RegionStatement { body }
+    }
+
+    pub fn get_body(&self) -> &Block {
+        &self.body
     }
 }
 
@@ -693,35 +745,48 @@ impl Statement for WhileStatement {
 
 pub struct ForStatement {
     loop_variables: Vec<String>,
-    iterable: Option<Box<dyn Expression>>,
-    body: Option<Box<Block>>,
+    iterable: Option<ExprId>,
+    body: Option<Block>,
+    parallel: bool,
+    /// `reduce(op: var, ...)` of a `parallel for`, as (op, var)
+    reductions: Vec<(String, String)>,
 }
 
 impl ForStatement {
     pub fn new(
         loop_variable: impl Into<String>,
-        iterable: Option<Box<dyn Expression>>,
-        body: Option<Box<Block>>,
+        iterable: Option<ExprId>,
+        body: Option<Block>,
     ) -> Self {
         ForStatement {
             loop_variables: vec![loop_variable.into()],
             iterable,
             body,
+            parallel: false,
+            reductions: Vec::new(),
         }
     }
 
     pub fn new_multi(
         loop_variables: Vec<String>,
-        iterable: Option<Box<dyn Expression>>,
-        body: Option<Box<Block>>,
+        iterable: Option<ExprId>,
+        body: Option<Block>,
     ) -> Self {
         ForStatement {
             loop_variables,
             iterable,
             body,
+            parallel: false,
+            reductions: Vec::new(),
         }
     }
 
+    /// Marks the loop as a `parallel for` with the given reductions.
+    pub fn set_parallel(&mut self, reductions: Vec<(String, String)>) {
+        self.parallel = true;
+        self.reductions = reductions;
+    }
+
     pub fn get_loop_variable(&self) -> &str {
         &self.loop_variables[0]
     }
@@ -730,58 +795,36 @@ impl ForStatement {
         &self.loop_variables
     }
 
-    pub fn get_iterable(&self) -> Option<&dyn Expression> {
-        self.iterable.as_deref().map(|e| e.as_expression())
+    pub fn get_iterable(&self) -> Option<ExprId> {
+        self.iterable
     }
 
     pub fn get_body(&self) -> Option<&Block> {
-        self.body.as_deref()
+        self.body.as_ref()
     }
-}
 
-impl AstNode for ForStatement {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_for_statement(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
+    pub fn is_parallel(&self) -> bool {
+        self.parallel
     }
-}
 
-impl Statement for ForStatement {
-    fn as_statement(&self) -> &dyn Statement {
-        self
+    pub fn get_reductions(&self) -> &Vec<(String, String)> {
+        &self.reductions
     }
 }
 
 // ==================== ReturnStatement ====================
 
 pub struct ReturnStatement {
-    value: Option<Box<dyn Expression>>,
+    value: Option<ExprId>,
 }
 
 impl ReturnStatement {
-    pub fn new(value: Option<Box<dyn Expression>>) -> Self {
+    pub fn new(value: Option<ExprId>) -> Self {
         ReturnStatement { value }
     }
 
-    pub fn get_value(&self) -> Option<&dyn Expression> {
-        self.value.as_deref().map(|e| e.as_expression())
-    }
-}
-
-impl AstNode for ReturnStatement {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_return_statement(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Statement for ReturnStatement {
-    fn as_statement(&self) -> &dyn Statement {
-        self
+    pub fn get_value(&self) -> Option<ExprId> {
+        self.value
     }
 }
 
@@ -795,21 +838,6 @@ impl BreakStatement {
     }
 }
 
-impl AstNode for BreakStatement {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_break_statement(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Statement for BreakStatement {
-    fn as_statement(&self) -> &dyn Statement {
-        self
-    }
-}
-
 // ==================== ContinueStatement ====================
 
 pub struct ContinueStatement;
@@ -820,36 +848,21 @@ impl ContinueStatement {
     }
 }
 
-impl AstNode for ContinueStatement {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_continue_statement(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Statement for ContinueStatement {
-    fn as_statement(&self) -> &dyn Statement {
-        self
-    }
-}
-
 // ==================== Declaration ====================
 
 pub struct Declaration {
     keyword: String,
     name: String,
-    r#type: Option<Box<dyn Type>>,
-    initializer: Option<Box<dyn Expression>>,
+    r#type: Option<Type>,
+    initializer: Option<ExprId>,
 }
 
 impl Declaration {
     pub fn new(
         keyword: impl Into<String>,
         name: impl Into<String>,
-        r#type: Option<Box<dyn Type>>,
-        initializer: Option<Box<dyn Expression>>,
+        r#type: Option<Type>,
+        initializer: Option<ExprId>,
     ) -> Self {
         Declaration {
             keyword: keyword.into(),
@@ -867,79 +880,49 @@ impl Declaration {
         &self.name
     }
 
-    pub fn get_type(&self) -> Option<&dyn Type> {
-        self.r#type.as_deref()
+    pub fn get_type(&self) -> Option<&Type> {
+        self.r#type.as_ref()
     }
 
-    pub fn get_initializer(&self) -> Option<&dyn Expression> {
-        self.initializer.as_deref().map(|e| e.as_expression())
-    }
-}
-
-impl AstNode for Declaration {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_declaration(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Statement for Declaration {
-    fn as_statement(&self) -> &dyn Statement {
-        self
+    pub fn get_initializer(&self) -> Option<ExprId> {
+        self.initializer
     }
 }
 
 // ==================== ExpressionStatement ====================
 
 pub struct ExpressionStatement {
-    expression: Option<Box<dyn Expression>>,
+    expression: Option<ExprId>,
     pub tail: bool, // true if no semicolon follows (block return value)
 }
 
 impl ExpressionStatement {
-    pub fn new(expression: Option<Box<dyn Expression>>) -> Self {
+    pub fn new(expression: Option<ExprId>) -> Self {
         ExpressionStatement { expression, tail: false }
     }
 
-    pub fn new_tail(expression: Option<Box<dyn Expression>>) -> Self {
+    pub fn new_tail(expression: Option<ExprId>) -> Self {
         ExpressionStatement { expression, tail: true }
     }
 
-    pub fn get_expression(&self) -> Option<&dyn Expression> {
-        self.expression.as_deref().map(|e| e.as_expression())
-    }
-}
-
-impl AstNode for ExpressionStatement {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_expression_statement(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Statement for ExpressionStatement {
-    fn as_statement(&self) -> &dyn Statement {
-        self
+    pub fn get_expression(&self) -> Option<ExprId> {
+        self.expression
     }
 }
 
 // ==================== BinaryExpression ====================
 
 pub struct BinaryExpression {
-    left: Option<Box<dyn Expression>>,
+    left: Option<ExprId>,
     op: String,
-    right: Option<Box<dyn Expression>>,
+    right: Option<ExprId>,
 }
 
 impl BinaryExpression {
     pub fn new(
-        left: Option<Box<dyn Expression>>,
+        left: Option<ExprId>,
         op: impl Into<String>,
-        right: Option<Box<dyn Expression>>,
+        right: Option<ExprId>,
     ) -> Self {
         BinaryExpression {
             left,
@@ -948,31 +931,16 @@ impl BinaryExpression {
         }
     }
 
-    pub fn get_left(&self) -> Option<&dyn Expression> {
-        self.left.as_deref().map(|e| e.as_expression())
+    pub fn get_left(&self) -> Option<ExprId> {
+        self.left
     }
 
     pub fn get_operator(&self) -> &str {
         &self.op
     }
 
-    pub fn get_right(&self) -> Option<&dyn Expression> {
-        self.right.as_deref().map(|e| e.as_expression())
-    }
-}
-
-impl AstNode for BinaryExpression {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_binary_expression(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Expression for BinaryExpression {
-    fn as_expression(&self) -> &dyn Expression {
-        self
+    pub fn get_right(&self) -> Option<ExprId> {
+        self.right
     }
 }
 
@@ -980,11 +948,11 @@ impl Expression for BinaryExpression {
 
 pub struct UnaryExpression {
     op: String,
-    operand: Option<Box<dyn Expression>>,
+    operand: Option<ExprId>,
 }
 
 impl UnaryExpression {
-    pub fn new(op: impl Into<String>, operand: Option<Box<dyn Expression>>) -> Self {
+    pub fn new(op: impl Into<String>, operand: Option<ExprId>) -> Self {
         UnaryExpression {
             op: op.into(),
             operand,
@@ -995,121 +963,73 @@ impl UnaryExpression {
         &self.op
     }
 
-    pub fn get_operand(&self) -> Option<&dyn Expression> {
-        self.operand.as_deref().map(|e| e.as_expression())
-    }
-}
-
-impl AstNode for UnaryExpression {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_unary_expression(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Expression for UnaryExpression {
-    fn as_expression(&self) -> &dyn Expression {
-        self
+    pub fn get_operand(&self) -> Option<ExprId> {
+        self.operand
     }
 }
 
 // ==================== CastExpression ====================
 
 pub struct CastExpression {
-    expression: Option<Box<dyn Expression>>,
-    target_type: Box<dyn Type>,
+    expression: Option<ExprId>,
+    target_type: Type,
 }
 
 impl CastExpression {
-    pub fn new(expression: Option<Box<dyn Expression>>, target_type: Box<dyn Type>) -> Self {
+    pub fn new(expression: Option<ExprId>, target_type: Type) -> Self {
         CastExpression {
             expression,
             target_type,
         }
     }
 
-    pub fn get_expression(&self) -> Option<&dyn Expression> {
-        self.expression.as_deref().map(|e| e.as_expression())
-    }
-
-    pub fn get_target_type(&self) -> &dyn Type {
-        &*self.target_type
-    }
-}
-
-impl AstNode for CastExpression {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_cast_expression(self);
+    pub fn get_expression(&self) -> Option<ExprId> {
+        self.expression
     }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
 
-impl Expression for CastExpression {
-    fn as_expression(&self) -> &dyn Expression {
-        self
+    pub fn get_target_type(&self) -> &Type {
+        &self.target_type
     }
 }
 
 // ==================== FunctionCall ====================
 
 pub struct FunctionCall {
-    callee: Option<Box<dyn Expression>>,
-    arguments: Option<Vec<Box<dyn Expression>>>,
+    callee: Option<ExprId>,
+    arguments: Option<Vec<ExprId>>,
 }
 
 impl FunctionCall {
-    pub fn new(
-        callee: Option<Box<dyn Expression>>,
-        arguments: Option<Vec<Box<dyn Expression>>>,
-    ) -> Self {
+    pub fn new(callee: Option<ExprId>, arguments: Option<Vec<ExprId>>) -> Self {
         FunctionCall { callee, arguments }
     }
 
-    pub fn get_callee(&self) -> Option<&dyn Expression> {
-        self.callee.as_deref().map(|e| e.as_expression())
+    pub fn get_callee(&self) -> Option<ExprId> {
+        self.callee
     }
 
-    pub fn get_arguments(&self) -> Option<&Vec<Box<dyn Expression>>> {
+    pub fn get_arguments(&self) -> Option<&Vec<ExprId>> {
         self.arguments.as_ref()
     }
 }
 
-impl AstNode for FunctionCall {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_function_call(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Expression for FunctionCall {
-    fn as_expression(&self) -> &dyn Expression {
-        self
-    }
-}
-
 // ==================== MemberAccess ====================
 
 pub struct MemberAccess {
-    object: Option<Box<dyn Expression>>,
+    object: Option<ExprId>,
     member: String,
 }
 
 impl MemberAccess {
-    pub fn new(object: Option<Box<dyn Expression>>, member: impl Into<String>) -> Self {
+    pub fn new(object: Option<ExprId>, member: impl Into<String>) -> Self {
         MemberAccess {
             object,
             member: member.into(),
         }
     }
 
-    pub fn get_object(&self) -> Option<&dyn Expression> {
-        self.object.as_deref().map(|e| e.as_expression())
+    pub fn get_object(&self) -> Option<ExprId> {
+        self.object
     }
 
     pub fn get_member(&self) -> &str {
@@ -1117,85 +1037,40 @@ impl MemberAccess {
     }
 }
 
-impl AstNode for MemberAccess {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_member_access(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Expression for MemberAccess {
-    fn as_expression(&self) -> &dyn Expression {
-        self
-    }
-}
-
 // ==================== ArrayIndex ====================
 
 pub struct ArrayIndex {
-    array: Option<Box<dyn Expression>>,
-    index: Option<Box<dyn Expression>>,
+    array: Option<ExprId>,
+    index: Option<ExprId>,
 }
 
 impl ArrayIndex {
-    pub fn new(array: Option<Box<dyn Expression>>, index: Option<Box<dyn Expression>>) -> Self {
+    pub fn new(array: Option<ExprId>, index: Option<ExprId>) -> Self {
         ArrayIndex { array, index }
     }
 
-    pub fn get_array(&self) -> Option<&dyn Expression> {
-        self.array.as_deref().map(|e| e.as_expression())
-    }
-
-    pub fn get_index(&self) -> Option<&dyn Expression> {
-        self.index.as_deref().map(|e| e.as_expression())
-    }
-}
-
-impl AstNode for ArrayIndex {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_array_index(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
+    pub fn get_array(&self) -> Option<ExprId> {
+        self.array
     }
-}
 
-impl Expression for ArrayIndex {
-    fn as_expression(&self) -> &dyn Expression {
-        self
+    pub fn get_index(&self) -> Option<ExprId> {
+        self.index
     }
 }
 
 // ==================== GroupedExpression ====================
 
 pub struct GroupedExpression {
-    expression: Option<Box<dyn Expression>>,
+    expression: Option<ExprId>,
 }
 
 impl GroupedExpression {
-    pub fn new(expression: Option<Box<dyn Expression>>) -> Self {
+    pub fn new(expression: Option<ExprId>) -> Self {
         GroupedExpression { expression }
     }
 
-    pub fn get_expression(&self) -> Option<&dyn Expression> {
-        self.expression.as_deref().map(|e| e.as_expression())
-    }
-}
-
-impl AstNode for GroupedExpression {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_grouped_expression(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Expression for GroupedExpression {
-    fn as_expression(&self) -> &dyn Expression {
-        self
+    pub fn get_expression(&self) -> Option<ExprId> {
+        self.expression
     }
 }
 
@@ -1215,21 +1090,6 @@ impl Identifier {
     }
 }
 
-impl AstNode for Identifier {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_identifier(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Expression for Identifier {
-    fn as_expression(&self) -> &dyn Expression {
-        self
-    }
-}
-
 // ==================== NumberLiteral ====================
 
 pub struct NumberLiteral {
@@ -1246,21 +1106,6 @@ impl NumberLiteral {
     }
 }
 
-impl AstNode for NumberLiteral {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_number_literal(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Expression for NumberLiteral {
-    fn as_expression(&self) -> &dyn Expression {
-        self
-    }
-}
-
 // ==================== StringLiteral ====================
 
 pub struct StringLiteral {
@@ -1307,21 +1152,6 @@ impl StringLiteral {
     }
 }
 
-impl AstNode for StringLiteral {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_string_literal(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Expression for StringLiteral {
-    fn as_expression(&self) -> &dyn Expression {
-        self
-    }
-}
-
 // ==================== BooleanLiteral ====================
 
 pub struct BooleanLiteral {
@@ -1338,21 +1168,6 @@ impl BooleanLiteral {
     }
 }
 
-impl AstNode for BooleanLiteral {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_boolean_literal(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Expression for BooleanLiteral {
-    fn as_expression(&self) -> &dyn Expression {
-        self
-    }
-}
-
 // ==================== NullLiteral ====================
 
 pub struct NullLiteral;
@@ -1363,35 +1178,15 @@ impl NullLiteral {
     }
 }
 
-impl AstNode for NullLiteral {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_null_literal(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Expression for NullLiteral {
-    fn as_expression(&self) -> &dyn Expression {
-        self
-    }
-}
-
 // ==================== FormatString ====================
 
+/// A `{expr}` placeholder; `pos_in_value..end_in_value` is its byte range
+/// (braces included) in the unescaped template.
+#[derive(Clone)]
 pub struct VariablePosition {
     pub pos_in_value: i32,
-    pub value: Option<Box<dyn Expression>>,
-}
-
-impl Clone for VariablePosition {
-    fn clone(&self) -> Self {
-        VariablePosition {
-            pos_in_value: self.pos_in_value,
-            value: None, // Can't clone dyn Expression
-        }
-    }
+    pub end_in_value: i32,
+    pub value: Option<ExprId>,
 }
 
 pub struct FormatString {
@@ -1400,62 +1195,58 @@ pub struct FormatString {
 }
 
 impl FormatString {
-    pub fn new(value: impl Into<String>) -> Self {
-        let value: String = value.into();
+    /// Unescape the template and parse its placeholders in one pass, so
+    /// the recorded ranges index the text consumers actually see. The
+    /// placeholder expressions go into `ast`.
+    pub fn new(ast: &mut Ast, value: impl Into<String>) -> Self {
+        let raw: String = value.into();
+        let mut res = String::with_capacity(raw.len());
         let mut variables = Vec::new();
         let mut var_name = String::new();
         let mut in_brace = false;
-        let mut start_pos: i32 = 0;
-
-        for (i, c) in value.chars().enumerate() {
-            if c == '{' && !in_brace {
-                in_brace = true;
-                var_name.clear();
-                start_pos = i as i32;
-            } else if c == '}' && in_brace {
+        let mut start_pos = 0;
+
+        let mut chars = raw.chars().peekable();
+        while let Some(c) = chars.next() {
+            if in_brace {
+                res.push(c);
+                if c != '}' {
+                    var_name.push(c);
+                    continue;
+                }
                 in_brace = false;
                 if !var_name.is_empty() {
-                    let expr = FormatString::parse_value(&var_name);
-                    if let Some(e) = expr {
+                    if let Some(e) = FormatString::parse_value(ast, &var_name) {
                         variables.push(VariablePosition {
-                            pos_in_value: start_pos,
+                            pos_in_value: start_pos as i32,
+                            end_in_value: res.len() as i32,
                             value: Some(e),
                         });
                     }
                 }
-            } else if in_brace {
-                var_name.push(c);
-            }
-        }
-
-        let mut res = String::new();
-        let chars: Vec<char> = value.chars().collect();
-        let mut i = 0;
-        while i < chars.len() {
-            if chars[i] == '\\' && i + 1 < chars.len() {
-                match chars[i + 1] {
-                    'n' => {
-                        res.push('\n');
-                        i += 1;
-                    }
-                    't' => {
-                        res.push('\t');
-                        i += 1;
-                    }
-                    '\\' => {
-                        res.push('\\');
-                        i += 1;
-                    }
-                    '"' => {
-                        res.push('"');
-                        i += 1;
+            } else if c == '{' {
+                in_brace = true;
+                var_name.clear();
+                start_pos = res.len();
+                res.push(c);
+            } else if c == '\\' {
+                let unescaped = match chars.peek() {
+                    Some('n') => Some('\n'),
+                    Some('t') => Some('\t'),
+                    Some('\\') => Some('\\'),
+                    Some('"') => Some('"'),
+                    _ => None,
+                };
+                match unescaped {
+                    Some(u) => {
+                        res.push(u);
+                        chars.next();
                     }
-                    _ => res.push(chars[i]),
+                    None => res.push(c),
                 }
             } else {
-                res.push(chars[i]);
+                res.push(c);
             }
-            i += 1;
         }
 
         FormatString {
@@ -1472,7 +1263,7 @@ impl FormatString {
         &self.variables
     }
 
-    fn parse_value(var_name: &str) -> Option<Box<dyn Expression>> {
+    fn parse_value(ast: &mut Ast, var_name: &str) -> Option<ExprId> {
         if var_name.is_empty() {
             return None;
         }
@@ -1484,18 +1275,18 @@ impl FormatString {
             if rest.is_empty() {
                 return None;
             }
-            if let Some(operand) = Self::parse_value(rest) {
-                return Some(Box::new(UnaryExpression::new(op, Some(operand))));
+            if let Some(operand) = Self::parse_value(ast, rest) {
+                return Some(ast.add_expr(UnaryExpression::new(op, Some(operand))));
             }
             return None;
         }
-        if let Some(lit) = Self::try_parse_literal(var_name) {
+        if let Some(lit) = Self::try_parse_literal(ast, var_name) {
             return Some(lit);
         }
-        Self::parse_expression(var_name)
+        Self::parse_expression(ast, var_name)
     }
 
-    fn try_parse_literal(s: &str) -> Option<Box<dyn Expression>> {
+    fn try_parse_literal(ast: &mut Ast, s: &str) -> Option<ExprId> {
         let mut is_number = true;
         let mut has_dot = false;
         for c in s.chars() {
@@ -1512,28 +1303,28 @@ impl FormatString {
         }
         if is_number && !s.is_empty() {
             if let Ok(val) = s.parse::<f64>() {
-                return Some(Box::new(NumberLiteral::new(val)));
+                return Some(ast.add_expr(NumberLiteral::new(val)));
             }
         }
         if s.len() >= 2 && s.starts_with('"') && s.ends_with('"') {
             let content = &s[1..s.len() - 1];
-            return Some(Box::new(StringLiteral::new(content)));
+            return Some(ast.add_expr(StringLiteral::new(content)));
         }
         if s == "true" {
-            return Some(Box::new(BooleanLiteral::new(true)));
+            return Some(ast.add_expr(BooleanLiteral::new(true)));
         }
         if s == "false" {
-            return Some(Box::new(BooleanLiteral::new(false)));
+            return Some(ast.add_expr(BooleanLiteral::new(false)));
         }
         None
     }
 
-    fn parse_expression(expr: &str) -> Option<Box<dyn Expression>> {
+    fn parse_expression(ast: &mut Ast, expr: &str) -> Option<ExprId> {
         let expr = expr.trim();
 
         // 处理 new 表达式: new Type(args)
         if expr.starts_with("new ") {
-            return Self::parse_new_in_format(&expr[4..]);
+            return Self::parse_new_in_format(ast, &expr[4..]);
         }
 
         // 处理函数调用: callee(args)
@@ -1545,11 +1336,11 @@ impl FormatString {
                 let callee = if callee_str.is_empty() {
                     return None;
                 } else {
-                    Self::parse_expression(callee_str)?
+                    Self::parse_expression(ast, callee_str)?
                 };
 
-                let args = Self::parse_arg_list(args_str);
-                return Some(Box::new(FunctionCall::new(Some(callee), args)));
+                let args = Self::parse_arg_list(ast, args_str);
+                return Some(ast.add_expr(FunctionCall::new(Some(callee), args)));
             }
         }
 
@@ -1560,10 +1351,10 @@ impl FormatString {
                 if closing_pos == expr.len() - 1 {
                     let array_part = &expr[..last_bracket];
                     let index_part = &expr[last_bracket + 1..closing_pos];
-                    let array = Self::parse_expression(array_part);
-                    let index = Self::parse_value(index_part);
+                    let array = Self::parse_expression(ast, array_part);
+                    let index = Self::parse_value(ast, index_part);
                     if let (Some(a), Some(i)) = (array, index) {
-                        return Some(Box::new(ArrayIndex::new(Some(a), Some(i))));
+                        return Some(ast.add_expr(ArrayIndex::new(Some(a), Some(i))));
                     }
                     return None;
                 }
@@ -1577,9 +1368,9 @@ impl FormatString {
                 .chars()
                 .all(|c| c.is_alphanumeric() || c == '_');
             if valid_member {
-                let object = Self::parse_expression(object_part);
+                let object = Self::parse_expression(ast, object_part);
                 if let Some(o) = object {
-                    return Some(Box::new(MemberAccess::new(Some(o), member_part)));
+                    return Some(ast.add_expr(MemberAccess::new(Some(o), member_part)));
                 }
                 return None;
             }
@@ -1591,9 +1382,9 @@ impl FormatString {
             if !type_name.is_empty()
                 && type_name.chars().all(|c| c.is_alphanumeric() || c == '_')
             {
-                if let Some(lhs_expr) = Self::parse_expression(lhs) {
-                    let tp: Box<dyn Type> = Box::new(BasicType::new(type_name));
-                    return Some(Box::new(CastExpression::new(Some(lhs_expr), tp)));
+                if let Some(lhs_expr) = Self::parse_expression(ast, lhs) {
+                    let tp = Type::basic(type_name);
+                    return Some(ast.add_expr(CastExpression::new(Some(lhs_expr), tp)));
                 }
             }
         }
@@ -1602,7 +1393,7 @@ impl FormatString {
             && (expr.chars().next().unwrap().is_alphabetic() || expr.starts_with('_'))
             && expr.chars().all(|c| c.is_alphanumeric() || c == '_');
         if valid_identifier {
-            return Some(Box::new(Identifier::new(expr)));
+            return Some(ast.add_expr(Identifier::new(expr)));
         }
         None
     }
@@ -1622,7 +1413,7 @@ impl FormatString {
         None
     }
 
-    fn parse_arg_list(s: &str) -> Option<Vec<Box<dyn Expression>>> {
+    fn parse_arg_list(ast: &mut Ast, s: &str) -> Option<Vec<ExprId>> {
         if s.trim().is_empty() {
             return Some(Vec::new());
         }
@@ -1637,7 +1428,7 @@ impl FormatString {
                 ',' if depth == 0 => {
                     let arg = s[start..i].trim();
                     if !arg.is_empty() {
-                        if let Some(expr) = Self::parse_value(arg) {
+                        if let Some(expr) = Self::parse_value(ast, arg) {
                             args.push(expr);
                         }
                     }
@@ -1649,7 +1440,7 @@ impl FormatString {
 
         let arg = s[start..].trim();
         if !arg.is_empty() {
-            if let Some(expr) = Self::parse_value(arg) {
+            if let Some(expr) = Self::parse_value(ast, arg) {
                 args.push(expr);
             }
         }
@@ -1657,7 +1448,7 @@ impl FormatString {
         Some(args)
     }
 
-    fn parse_new_in_format(rest: &str) -> Option<Box<dyn Expression>> {
+    fn parse_new_in_format(ast: &mut Ast, rest: &str) -> Option<ExprId> {
         // "Point(1, 2)" or "Point"
         let rest = rest.trim();
         if let Some((open_idx, close_idx)) = Self::find_matching_parens(rest) {
@@ -1671,11 +1462,9 @@ impl FormatString {
                     return None;
                 }
                 let args_str = &rest[open_idx + 1..close_idx];
-                let args = Self::parse_arg_list(args_str);
-                return Some(Box::new(FunctionCall::new(
-                    Some(Box::new(Identifier::new(type_name))),
-                    args,
-                )));
+                let args = Self::parse_arg_list(ast, args_str);
+                let callee = ast.add_expr(Identifier::new(type_name));
+                return Some(ast.add_expr(FunctionCall::new(Some(callee), args)));
             }
         }
         // new Type (no args)
@@ -1683,99 +1472,52 @@ impl FormatString {
             && (rest.chars().next().unwrap().is_alphabetic() || rest.starts_with('_'))
             && rest.chars().all(|c| c.is_alphanumeric() || c == '_');
         if valid_identifier {
-            return Some(Box::new(FunctionCall::new(
-                Some(Box::new(Identifier::new(rest))),
-                Some(Vec::new()),
-            )));
+            let callee = ast.add_expr(Identifier::new(rest));
+            return Some(ast.add_expr(FunctionCall::new(Some(callee), Some(Vec::new()))));
         }
         None
     }
 }
 
-impl AstNode for FormatString {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_format_string(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Expression for FormatString {
-    fn as_expression(&self) -> &dyn Expression {
-        self
-    }
-}
-
 // ==================== RangeExpression ====================
 
 pub struct RangeExpression {
-    arguments: Vec<Box<dyn Expression>>,
+    arguments: Vec<ExprId>,
 }
 
 impl RangeExpression {
-    pub fn new(arguments: Vec<Box<dyn Expression>>) -> Self {
+    pub fn new(arguments: Vec<ExprId>) -> Self {
         RangeExpression { arguments }
     }
 
-    pub fn get_arguments(&self) -> &Vec<Box<dyn Expression>> {
+    pub fn get_arguments(&self) -> &Vec<ExprId> {
         &self.arguments
     }
 }
 
-impl AstNode for RangeExpression {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_range_expression(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Expression for RangeExpression {
-    fn as_expression(&self) -> &dyn Expression {
-        self
-    }
-}
-
 // ==================== ArrayLiteral ====================
 
 pub struct ArrayLiteral {
-    elements: Vec<Box<dyn Expression>>,
+    elements: Vec<ExprId>,
 }
 
 impl ArrayLiteral {
-    pub fn new(elements: Vec<Box<dyn Expression>>) -> Self {
+    pub fn new(elements: Vec<ExprId>) -> Self {
         ArrayLiteral { elements }
     }
 
-    pub fn get_elements(&self) -> &Vec<Box<dyn Expression>> {
+    pub fn get_elements(&self) -> &Vec<ExprId> {
         &self.elements
     }
 }
 
-impl AstNode for ArrayLiteral {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_array_literal(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Expression for ArrayLiteral {
-    fn as_expression(&self) -> &dyn Expression {
-        self
-    }
-}
-
 // ==================== StructFieldInit ====================
 
 pub enum StructFieldInit {
     /// Named field: `x: 10`
-    Named { name: String, value: Box<dyn Expression> },
+    Named { name: String, value: ExprId },
     /// Positional field: `10` (matched to field by position)
-    Positional(Box<dyn Expression>),
+    Positional(ExprId),
 }
 
 // ==================== StructLiteral ====================
@@ -1802,21 +1544,6 @@ impl StructLiteral {
     }
 }
 
-impl AstNode for StructLiteral {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_struct_literal(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Expression for StructLiteral {
-    fn as_expression(&self) -> &dyn Expression {
-        self
-    }
-}
-
 // ==================== MatchPattern ====================
 
 pub enum MatchPattern {
@@ -1837,47 +1564,26 @@ pub enum RtValueSimple {
 
 pub struct MatchArm {
     pub pattern: MatchPattern,
-    pub body: Option<Box<dyn Statement>>,
+    pub body: Option<StmtId>,
 }
 
 // ==================== MatchExpression ====================
 
 pub struct MatchExpression {
-    scrutinee: Option<Box<dyn Expression>>,
+    scrutinee: Option<ExprId>,
     arms: Vec<MatchArm>,
 }
 
 impl MatchExpression {
-    pub fn new(scrutinee: Option<Box<dyn Expression>>, arms: Vec<MatchArm>) -> Self {
+    pub fn new(scrutinee: Option<ExprId>, arms: Vec<MatchArm>) -> Self {
         MatchExpression { scrutinee, arms }
     }
 
-    pub fn get_scrutinee(&self) -> Option<&dyn Expression> {
-        self.scrutinee.as_deref().map(|e| e.as_expression())
+    pub fn get_scrutinee(&self) -> Option<ExprId> {
+        self.scrutinee
     }
 
     pub fn get_arms(&self) -> &Vec<MatchArm> {
         &self.arms
     }
 }
-
-impl AstNode for MatchExpression {
-    fn accept(&self, visitor: &mut dyn AstVisitor) {
-        visitor.visit_match_expression(self);
-    }
-    fn as_any(&self) -> &dyn Any {
-        self
-    }
-}
-
-impl Statement for MatchExpression {
-    fn as_statement(&self) -> &dyn Statement {
-        self
-    }
-}
-
-impl Expression for MatchExpression {
-    fn as_expression(&self) -> &dyn Expression {
-        self
-    }
-}
@@ -6,8 +6,12 @@ use crate::lexer::Lexer;
 use crate::token::{Token, TokenType};
 
 pub struct AstBuilder {
+    /// Source text the token spans point into
+    source: String,
     tokens: Vec<Token>,
     eof_token: Token,
+    /// Arenas the nodes are built into; moved into the `Program`
+    ast: Ast,
     root: Option<Box<Program>>,
     current_position: usize,
     error_occurred: bool,
@@ -24,8 +28,10 @@ impl AstBuilder {
             tk = lexer.get_next_token();
         }
         AstBuilder {
+            source: lexer.into_source(),
             tokens,
-            eof_token: Token::new(TokenType::EndOfFile, ""),
+            eof_token: tk,
+            ast: Ast::new(),
             root: None,
             current_position: 0,
             error_occurred: false,
@@ -50,6 +56,7 @@ impl AstBuilder {
     }
 
     pub fn reset(&mut self) {
+        self.ast = Ast::new();
         self.root = None;
         self.current_position = 0;
         self.error_occurred = false;
@@ -82,6 +89,14 @@ impl AstBuilder {
         }
     }
 
+    fn current_text(&self) -> &str {
+        self.current_token().text(&self.source)
+    }
+
+    fn peek_text(&self) -> &str {
+        self.peek_next_token().text(&self.source)
+    }
+
     fn advance(&mut self) {
         if self.current_position < self.tokens.len() {
             self.current_position += 1;
@@ -93,7 +108,7 @@ impl AstBuilder {
     }
 
     fn match_value(&self, value: &str) -> bool {
-        self.current_token().value == value
+        self.current_text() == value
     }
 
     fn is_end_of_line(&self) -> bool {
@@ -116,23 +131,23 @@ impl AstBuilder {
 
     fn consume(&mut self, tp: TokenType, error_msg: &str) -> Token {
         if self.match_type(&tp) {
-            let token = self.current_token().clone();
+            let token = *self.current_token();
             self.advance();
             token
         } else {
             self.log_error(error_msg);
-            self.current_token().clone()
+            *self.current_token()
         }
     }
 
     fn consume_value(&mut self, value: &str, error_msg: &str) -> Token {
         if self.match_value(value) {
-            let token = self.current_token().clone();
+            let token = *self.current_token();
             self.advance();
             token
         } else {
             self.log_error(error_msg);
-            self.current_token().clone()
+            *self.current_token()
         }
     }
 
@@ -140,7 +155,7 @@ impl AstBuilder {
         self.error_occurred = true;
         let token = self.current_token();
         if let Some(ref f) = self.error_formatter {
-            let span = if token.value.is_empty() { 1 } else { token.value.len() };
+            let span = if token.span.is_empty() { 1 } else { token.span.len() };
             let formatted = f.format_error(token.line, token.col, span, "error", message, true);
             self.error_message.push(formatted);
         } else {
@@ -151,7 +166,7 @@ impl AstBuilder {
     // ==================== Program ====================
 
     fn parse_program(&mut self) -> Program {
-        let mut program = Program::new();
+        let mut statements = Vec::new();
 
         while !self.match_type(&TokenType::EndOfFile) && !self.error_occurred {
             self.consume_end_of_line();
@@ -162,26 +177,26 @@ impl AstBuilder {
 
             let stmt = self.parse_statement();
             if let Some(s) = stmt {
-                program.add_statement(s);
+                statements.push(s);
             } else {
                 self.advance();
             }
         }
 
-        program
+        Program::new(std::mem::take(&mut self.ast), statements)
     }
 
     // ==================== Statement ====================
 
-    fn parse_statement(&mut self) -> Option<Box<dyn Statement>> {
+    fn parse_statement(&mut self) -> Option<StmtId> {
         if self.match_type(&TokenType::Keyword) {
-            let keyword = self.current_token().value.clone();
+            let keyword = self.current_text().to_string();
 
             match keyword.as_str() {
                 "import" => return self.parse_import(),
                 "func" => return self.parse_function(),
                 "var" | "val" => return self.parse_declaration(),
-                "for" => return self.parse_for_statement(),
+                "for" => return self.parse_for_statement(false),
                 "return" => return self.parse_return_statement(),
                 "module" => {
                     // module keyword is deprecated — skip the line
@@ -190,7 +205,7 @@ impl AstBuilder {
                         self.advance();
                     }
                     self.consume_end_of_line();
-                    return Some(Box::new(ExportStatement::new(vec![])));
+                    return Some(self.ast.add_stmt(ExportStatement::new(vec![])));
                 }
                 "struct" => return self.parse_struct_definition(),
                 "impl" => return self.parse_impl_block(),
@@ -211,15 +226,31 @@ impl AstBuilder {
                         }
                     }
                     self.consume_end_of_line();
-                    return Some(Box::new(ExportStatement::new(vec![])));
+                    return Some(self.ast.add_stmt(ExportStatement::new(vec![])));
                 }
                 "if" => return self.parse_if_statement(),
                 "match" => {
                     let match_expr = self.parse_match_expression()?;
-                    // MatchExpression implements Statement too, go through as_any
-                    return Some(Box::new(ExpressionStatement::new(Some(match_expr))));
+                    // Ending its block, it is the block's value.
+                    if self.is_semicolon() {
+                        self.advance();
+                    }
+                    self.consume_end_of_line();
+                    if self.match_value("}") {
+                        return Some(self.ast.add_stmt(ExpressionStatement::new_tail(Some(match_expr))));
+                    }
+                    return Some(self.ast.add_stmt(ExpressionStatement::new(Some(match_expr))));
                 }
                 "while" => return self.parse_while_statement(),
+                "region" => return self.parse_region_statement(),
+                "parallel" => {
+                    self.advance(); // consume 'parallel'
+                    if !self.match_value("for") {
+                        self.log_error("Expected 'for' after 'parallel'");
+                        return None;
+                    }
+                    return self.parse_for_statement(true);
+                }
                 "break" => return self.parse_break_statement(),
                 "continue" => return self.parse_continue_statement(),
                 _ => {}
@@ -230,11 +261,11 @@ impl AstBuilder {
         // certain keywords (true, false, null, self, if, match, new),
         // and certain operators: (, !, -, +, [, {
         let is_expr_keyword = self.match_type(&TokenType::Keyword) && matches!(
-            self.current_token().value.as_str(),
+            self.current_text(),
             "true" | "false" | "null" | "self" | "if" | "match" | "new"
         );
         let is_expr_operator = self.match_type(&TokenType::Operator) && matches!(
-            self.current_token().value.as_str(),
+            self.current_text(),
             "(" | "!" | "-" | "+" | "[" | "{"
         );
         if self.match_type(&TokenType::Identifier)
@@ -248,16 +279,16 @@ impl AstBuilder {
         }
 
         if self.match_type(&TokenType::Operator)
-            && (self.current_token().value == "}" || self.current_token().value == ")")
+            && (self.current_text() == "}" || self.current_text() == ")")
         {
             return None;
         }
 
-        self.log_error(&format!("Unexpected token: {}", self.current_token().value));
+        self.log_error(&format!("Unexpected token: {}", self.current_text()));
         None
     }
 
-    fn parse_import(&mut self) -> Option<Box<dyn Statement>> {
+    fn parse_import(&mut self) -> Option<StmtId> {
         self.advance(); // consume 'import'
 
         if !self.match_type(&TokenType::Identifier) {
@@ -265,7 +296,7 @@ impl AstBuilder {
             return None;
         }
 
-        let mut path = vec![self.current_token().value.clone()];
+        let mut path = vec![self.current_text().to_string()];
         self.advance();
 
         // Handle "import a.b.c"
@@ -275,18 +306,18 @@ impl AstBuilder {
                 self.log_error("Expected identifier after '.' in import path");
                 return None;
             }
-            path.push(self.current_token().value.clone());
+            path.push(self.current_text().to_string());
             self.advance();
         }
 
         // Handle "import a as b"
-        let alias = if self.match_type(&TokenType::Keyword) && self.current_token().value == "as" {
+        let alias = if self.match_type(&TokenType::Keyword) && self.current_text() == "as" {
             self.advance(); // consume 'as'
             if !self.match_type(&TokenType::Identifier) {
                 self.log_error("Expected identifier after 'as'");
                 return None;
             }
-            let alias = self.current_token().value.clone();
+            let alias = self.current_text().to_string();
             self.advance();
             Some(alias)
         } else {
@@ -295,10 +326,10 @@ impl AstBuilder {
 
         self.consume_end_of_line();
 
-        Some(Box::new(ImportStatement::new(path, alias)))
+        Some(self.ast.add_stmt(ImportStatement::new(path, alias)))
     }
 
-    fn parse_export_statement(&mut self) -> Option<Box<dyn Statement>> {
+    fn parse_export_statement(&mut self) -> Option<StmtId> {
         self.advance(); // consume 'export'
 
         self.consume_value("(", "Expected '(' after 'export'");
@@ -310,7 +341,7 @@ impl AstBuilder {
                 self.log_error("Expected identifier in export list");
                 return None;
             }
-            let mut name = self.current_token().value.clone();
+            let mut name = self.current_text().to_string();
             self.advance();
 
             // Handle dotted names: add.add, io.print, etc.
@@ -321,7 +352,7 @@ impl AstBuilder {
                     return None;
                 }
                 name.push('.');
-                name.push_str(&self.current_token().value);
+                name.push_str(self.current_text());
                 self.advance();
             }
 
@@ -337,10 +368,10 @@ impl AstBuilder {
         self.consume_value(")", "Expected ')' after export list");
         self.consume_end_of_line();
 
-        Some(Box::new(ExportStatement::new(names)))
+        Some(self.ast.add_stmt(ExportStatement::new(names)))
     }
 
-    fn parse_struct_definition(&mut self) -> Option<Box<dyn Statement>> {
+    fn parse_struct_definition(&mut self) -> Option<StmtId> {
         self.advance(); // consume 'struct'
 
         if !self.match_type(&TokenType::Identifier) {
@@ -348,7 +379,7 @@ impl AstBuilder {
             return None;
         }
 
-        let name = self.current_token().value.clone();
+        let name = self.current_text().to_string();
         self.advance();
 
         let mut generic_params = Vec::new();
@@ -356,7 +387,7 @@ impl AstBuilder {
             self.advance();
             loop {
                 if !self.match_type(&TokenType::Identifier) { break; }
-                generic_params.push(self.current_token().value.clone());
+                generic_params.push(self.current_text().to_string());
                 self.advance();
                 if self.match_value(",") { self.advance(); } else { break; }
             }
@@ -376,7 +407,7 @@ impl AstBuilder {
                 self.log_error("Expected field name");
                 break;
             }
-            let field_name = self.current_token().value.clone();
+            let field_name = self.current_text().to_string();
             self.advance();
 
             let field_type = if self.match_value(":") {
@@ -396,10 +427,10 @@ impl AstBuilder {
         self.consume_value("}", "Expected '}' after struct body");
         self.consume_end_of_line();
 
-        Some(Box::new(StructDefinition::new(name, fields, generic_params)))
+        Some(self.ast.add_stmt(StructDefinition::new(name, fields, generic_params)))
     }
 
-    fn parse_impl_block(&mut self) -> Option<Box<dyn Statement>> {
+    fn parse_impl_block(&mut self) -> Option<StmtId> {
         self.advance(); // consume 'impl'
 
         let mut generic_params = Vec::new();
@@ -407,7 +438,7 @@ impl AstBuilder {
             self.advance();
             loop {
                 if !self.match_type(&TokenType::Identifier) { break; }
-                generic_params.push(self.current_token().value.clone());
+                generic_params.push(self.current_text().to_string());
                 self.advance();
                 if self.match_value(",") { self.advance(); } else { break; }
             }
@@ -419,7 +450,7 @@ impl AstBuilder {
             self.log_error("Expected struct name after 'impl'");
             return None;
         }
-        let struct_name = self.current_token().value.clone();
+        let struct_name = self.current_text().to_string();
         self.advance();
 
         // Optionally <T> after struct name
@@ -441,21 +472,21 @@ impl AstBuilder {
             if self.match_value("}") { break; }
 
             if self.match_type(&TokenType::Keyword) {
-                let kw = self.current_token().value.clone();
+                let kw = self.current_text().to_string();
                 match kw.as_str() {
                     "constructor" => {
                         if let Some(func) = self.parse_method("constructor") {
-                            items.push(ImplItem::Constructor(Box::new(func)));
+                            items.push(ImplItem::Constructor(func));
                         }
                     }
                     "func" => {
                         if let Some(func) = self.parse_method("func") {
-                            items.push(ImplItem::Method(Box::new(func)));
+                            items.push(ImplItem::Method(func));
                         }
                     }
                     "convert" => {
                         if let Some(func) = self.parse_method("convert") {
-                            items.push(ImplItem::Convert(Box::new(func)));
+                            items.push(ImplItem::Convert(func));
                         }
                     }
                     "operator" => {
@@ -481,7 +512,7 @@ impl AstBuilder {
             } else if self.match_type(&TokenType::Identifier) {
                 // Method shorthand: name(params): type { body }
                 if let Some(func) = self.parse_method("") {
-                    items.push(ImplItem::Method(Box::new(func)));
+                    items.push(ImplItem::Method(func));
                 }
             } else {
                 break;
@@ -492,13 +523,14 @@ impl AstBuilder {
         self.consume_value("}", "Expected '}' after impl block");
         self.consume_end_of_line();
 
-        Some(Box::new(ImplBlock::new(struct_name, generic_params, items)))
+        Some(self.ast.add_stmt(ImplBlock::new(struct_name, generic_params, items)))
     }
 
     fn parse_method(&mut self, keyword: &str) -> Option<Function> {
         if !keyword.is_empty() {
             self.advance(); // consume keyword (constructor/func/convert)
         }
+        let line = self.current_token().line;
 
         let method_name = if keyword == "constructor" {
             "constructor".to_string()
@@ -508,7 +540,7 @@ impl AstBuilder {
             let name = target.get_name().to_string();
             format!("convert_{}", name)
         } else {
-            let name = self.current_token().value.clone();
+            let name = self.current_text().to_string();
             self.advance();
             name
         };
@@ -547,10 +579,10 @@ impl AstBuilder {
             None
         };
 
-        Some(Function::new(method_name, params, return_type, body))
+        Some(Function::new(method_name, params, return_type, body).with_line(line))
     }
 
-    fn parse_function(&mut self) -> Option<Box<dyn Statement>> {
+    fn parse_function(&mut self) -> Option<StmtId> {
         self.advance(); // consume 'func'
 
         if !self.match_type(&TokenType::Identifier) {
@@ -558,7 +590,8 @@ impl AstBuilder {
             return None;
         }
 
-        let func_name = self.current_token().value.clone();
+        let func_name = self.current_text().to_string();
+        let line = self.current_token().line;
         self.advance();
 
         // Handle <T> generic params on functions
@@ -567,7 +600,7 @@ impl AstBuilder {
             self.advance();
             while !self.match_value(">") && !self.error_occurred {
                 if self.match_type(&TokenType::Identifier) {
-                    generic_params.push(self.current_token().value.clone());
+                    generic_params.push(self.current_text().to_string());
                     self.advance();
                     if self.match_value(",") { self.advance(); }
                 } else if self.match_value("<") || self.match_value(">") {
@@ -606,18 +639,19 @@ impl AstBuilder {
         };
 
         let func = Function::new(func_name, params, return_type, body)
-            .with_generic_params(generic_params);
-        Some(Box::new(func))
+            .with_generic_params(generic_params)
+            .with_line(line);
+        Some(self.ast.add_stmt(func))
     }
 
-    fn parse_parameter_list(&mut self) -> Option<Vec<Box<Parameter>>> {
-        let mut params: Vec<Box<Parameter>> = Vec::new();
+    fn parse_parameter_list(&mut self) -> Option<Vec<Parameter>> {
+        let mut params: Vec<Parameter> = Vec::new();
 
         if !self.match_value(")") {
             loop {
                 let param = self.parse_parameter();
                 if let Some(p) = param {
-                    params.push(Box::new(p));
+                    params.push(p);
                 }
 
                 if self.match_value(",") {
@@ -633,13 +667,13 @@ impl AstBuilder {
 
     fn parse_parameter(&mut self) -> Option<Parameter> {
         if !self.match_type(&TokenType::Identifier)
-            && !(self.match_type(&TokenType::Keyword) && self.current_token().value == "self")
+            && !(self.match_type(&TokenType::Keyword) && self.current_text() == "self")
         {
             self.log_error("Expected parameter name");
             return None;
         }
 
-        let param_name = self.current_token().value.clone();
+        let param_name = self.current_text().to_string();
         self.advance();
 
         let mut param_type = None;
@@ -651,17 +685,17 @@ impl AstBuilder {
         Some(Parameter::new(param_name, param_type))
     }
 
-    fn parse_type(&mut self) -> Option<Box<dyn Type>> {
+    fn parse_type(&mut self) -> Option<Type> {
         if !self.match_type(&TokenType::Keyword) && !self.match_type(&TokenType::Identifier) {
             self.log_error("Expected type name");
             return None;
         }
 
-        let type_name = self.current_token().value.clone();
+        let type_name = self.current_text().to_string();
         self.advance();
 
         // Parse generic type args: vec<int> or map<str,int>
-        let mut type_args: Vec<Box<dyn Type>> = Vec::new();
+        let mut type_args: Vec<Type> = Vec::new();
         if self.match_value("<") {
             self.advance();
             while !self.match_value(">") && !self.error_occurred {
@@ -676,10 +710,10 @@ impl AstBuilder {
             self.consume_value(">", "Expected '>' closing generic type");
         }
 
-        let mut tp: Box<dyn Type> = if !type_args.is_empty() {
-            Box::new(GenericType::new(type_name.clone(), type_args))
+        let mut tp: Type = if !type_args.is_empty() {
+            Type::Generic(GenericType::new(type_name.clone(), type_args))
         } else {
-            Box::new(BasicType::new(type_name))
+            Type::basic(type_name)
         };
 
         while self.match_value("[") {
@@ -687,7 +721,8 @@ impl AstBuilder {
             if self.match_value("]") {
                 // Empty brackets: unsized array (e.g., int[])
                 self.advance();
-                tp = Box::new(ArrayType::new_nested(tp, Box::new(NumberLiteral::new(0.0))));
+                let size = self.ast.add_expr(NumberLiteral::new(0.0));
+                tp = Type::Array(ArrayType::new_nested(tp, size));
             } else {
                 let size = self.parse_expression()?;
                 if !self.match_value("]") {
@@ -695,19 +730,19 @@ impl AstBuilder {
                     return None;
                 }
                 self.advance();
-                tp = Box::new(ArrayType::new_nested(tp, size));
+                tp = Type::Array(ArrayType::new_nested(tp, size));
             }
         }
 
         if self.match_value("?") {
             self.advance();
-            tp = Box::new(NullableType::new(tp));
+            tp = Type::Nullable(NullableType::new(tp));
         }
 
         Some(tp)
     }
 
-    fn parse_block(&mut self) -> Option<Box<Block>> {
+    fn parse_block(&mut self) -> Option<Block> {
         let mut block = Block::new();
 
         while self.match_type(&TokenType::EndOfFile) {
@@ -732,10 +767,10 @@ impl AstBuilder {
             self.consume_end_of_line();
         }
 
-        Some(Box::new(block))
+        Some(block)
     }
 
-    fn parse_array_type(&mut self, element_type_name: &str) -> Option<Box<dyn Type>> {
+    fn parse_array_type(&mut self, element_type_name: &str) -> Option<Type> {
         let first_size = self.parse_expression()?;
 
         if !self.match_value("]") {
@@ -744,8 +779,8 @@ impl AstBuilder {
         }
         self.advance(); // consume ']'
 
-        let mut current_type: Box<dyn Type> =
-            Box::new(ArrayType::new_basic(element_type_name, first_size));
+        let mut current_type: Type =
+            Type::Array(ArrayType::new_basic(element_type_name, first_size));
 
         while self.match_value("[") {
             self.advance(); // consume '['
@@ -758,14 +793,14 @@ impl AstBuilder {
             }
             self.advance(); // consume ']'
 
-            current_type = Box::new(ArrayType::new_nested(current_type, next_size));
+            current_type = Type::Array(ArrayType::new_nested(current_type, next_size));
         }
 
         Some(current_type)
     }
 
-    fn parse_declaration(&mut self) -> Option<Box<dyn Statement>> {
-        let keyword = self.current_token().value.clone();
+    fn parse_declaration(&mut self) -> Option<StmtId> {
+        let keyword = self.current_text().to_string();
         self.advance();
 
         if !self.match_type(&TokenType::Identifier) {
@@ -773,7 +808,7 @@ impl AstBuilder {
             return None;
         }
 
-        let var_name = self.current_token().value.clone();
+        let var_name = self.current_text().to_string();
         self.advance();
 
         let mut var_type = None;
@@ -790,10 +825,10 @@ impl AstBuilder {
 
         self.consume_end_of_line();
 
-        Some(Box::new(Declaration::new(keyword, var_name, var_type, initializer)))
+        Some(self.ast.add_stmt(Declaration::new(keyword, var_name, var_type, initializer)))
     }
 
-    fn parse_expression_statement(&mut self) -> Option<Box<dyn Statement>> {
+    fn parse_expression_statement(&mut self) -> Option<StmtId> {
         let expr = self.parse_expression()?;
         // Check for explicit semicolon terminator
         let has_semi = self.is_semicolon();
@@ -802,14 +837,14 @@ impl AstBuilder {
         }
         self.consume_end_of_line();
         if has_semi {
-            Some(Box::new(ExpressionStatement::new(Some(expr))))
+            Some(self.ast.add_stmt(ExpressionStatement::new(Some(expr))))
         } else {
             // No semicolon → tail expression (value-producing)
-            Some(Box::new(ExpressionStatement::new_tail(Some(expr))))
+            Some(self.ast.add_stmt(ExpressionStatement::new_tail(Some(expr))))
         }
     }
 
-    fn parse_return_statement(&mut self) -> Option<Box<dyn Statement>> {
+    fn parse_return_statement(&mut self) -> Option<StmtId> {
         self.advance(); // consume 'return'
 
         let mut value = None;
@@ -819,10 +854,10 @@ impl AstBuilder {
 
         self.consume_end_of_line();
 
-        Some(Box::new(ReturnStatement::new(value)))
+        Some(self.ast.add_stmt(ReturnStatement::new(value)))
     }
 
-    fn parse_for_statement(&mut self) -> Option<Box<dyn Statement>> {
+    fn parse_for_statement(&mut self, parallel: bool) -> Option<StmtId> {
         self.advance(); // consume 'for'
 
         if !self.match_type(&TokenType::Identifier) {
@@ -830,7 +865,7 @@ impl AstBuilder {
             return None;
         }
 
-        let mut loop_vars = vec![self.current_token().value.clone()];
+        let mut loop_vars = vec![self.current_text().to_string()];
         self.advance();
 
         // Support `for i, v in expr` syntax
@@ -840,11 +875,11 @@ impl AstBuilder {
                 self.log_error("Expected second identifier after ',' in for loop");
                 return None;
             }
-            loop_vars.push(self.current_token().value.clone());
+            loop_vars.push(self.current_text().to_string());
             self.advance();
         }
 
-        if !(self.match_type(&TokenType::Keyword) && self.current_token().value == "in") {
+        if !(self.match_type(&TokenType::Keyword) && self.current_text() == "in") {
             self.log_error("Expected 'in' in for loop");
             return None;
         }
@@ -852,6 +887,34 @@ impl AstBuilder {
 
         let range_expr = self.parse_range_or_iterable()?;
 
+        // `parallel for ... reduce(sum: total, max: best)`; `reduce` is
+        // only special here
+        let mut reductions = Vec::new();
+        if parallel && self.match_type(&TokenType::Identifier) && self.current_text() == "reduce" {
+            self.advance();
+            self.consume_value("(", "Expected '(' after 'reduce'");
+            loop {
+                if !self.match_type(&TokenType::Identifier) {
+                    self.log_error("Expected a reduction (sum, min or max) in reduce(...)");
+                    return None;
+                }
+                let op = self.current_text().to_string();
+                self.advance();
+                self.consume_value(":", "Expected ':' after the reduction in reduce(...)");
+                if !self.match_type(&TokenType::Identifier) {
+                    self.log_error("Expected a variable name in reduce(...)");
+                    return None;
+                }
+                reductions.push((op, self.current_text().to_string()));
+                self.advance();
+                if !self.match_value(",") {
+                    break;
+                }
+                self.advance();
+            }
+            self.consume_value(")", "Expected ')' at end of reduce(...)");
+        }
+
         self.consume_value("{", "Expected '{' at start of loop body");
         self.consume_end_of_line();
 
@@ -860,10 +923,14 @@ impl AstBuilder {
         self.consume_value("}", "Expected '}' at end of loop body");
         self.consume_end_of_line();
 
-        Some(Box::new(ForStatement::new_multi(loop_vars, Some(range_expr), body)))
+        let mut stmt = ForStatement::new_multi(loop_vars, Some(range_expr), body);
+        if parallel {
+            stmt.set_parallel(reductions);
+        }
+        Some(self.ast.add_stmt(stmt))
     }
 
-    fn parse_range_or_iterable(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_range_or_iterable(&mut self) -> Option<ExprId> {
         let start = self.parse_expression()?;
 
         if self.match_value("..") {
@@ -871,37 +938,38 @@ impl AstBuilder {
             let end = self.parse_expression()?;
             
             // 尝试优化：如果两端都是数字，编译时确定步长
-            let step = if let (Some(start_val), Some(end_val)) = (as_number(&start), as_number(&end)) {
+            let step = if let (Some(start_val), Some(end_val)) = (as_number(&self.ast, start), as_number(&self.ast, end)) {
                 let step_val = if start_val > end_val { -1.0 } else { 1.0 };
-                Some(Box::new(NumberLiteral::new(step_val)) as Box<dyn Expression>)
+                Some(self.ast.add_expr(NumberLiteral::new(step_val)))
             } else {
                 // 运行时由 range 函数根据 start 和 end 的大小决定步长
                 None
             };
             
-            let range_func = Box::new(Identifier::new("range"));
+            let range_func = self.ast.add_expr(Identifier::new("range"));
             let mut args = vec![start, end];
             if let Some(s) = step {
                 args.push(s);
             }
             
-            return Some(Box::new(FunctionCall::new(Some(range_func), Some(args))));
+            return Some(self.ast.add_expr(FunctionCall::new(Some(range_func), Some(args))));
         }
 
         Some(start)
         }
 
-    fn parse_format_string(&self, format_str: &str) -> Option<Box<dyn Expression>> {
-        Some(Box::new(FormatString::new(format_str)))
+    fn parse_format_string(&mut self, format_str: &str) -> Option<ExprId> {
+        let format = FormatString::new(&mut self.ast, format_str);
+        Some(self.ast.add_expr(format))
     }
 
     // ==================== Expression parsing ====================
 
-    fn parse_expression(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_expression(&mut self) -> Option<ExprId> {
         self.parse_assignment()
     }
 
-    fn parse_assignment(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_assignment(&mut self) -> Option<ExprId> {
         let mut expr = self.parse_logical_or()?;
 
         if self.match_value("=")
@@ -910,55 +978,55 @@ impl AstBuilder {
             || self.match_value("*=")
             || self.match_value("/=")
         {
-            let op = self.current_token().value.clone();
+            let op = self.current_text().to_string();
             self.advance();
             let value = self.parse_assignment();
-            expr = Box::new(BinaryExpression::new(Some(expr), op, value));
+            expr = self.ast.add_expr(BinaryExpression::new(Some(expr), op, value));
         }
 
         Some(expr)
     }
 
-    fn parse_logical_or(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_logical_or(&mut self) -> Option<ExprId> {
         let mut expr = self.parse_logical_and()?;
 
         while self.match_value("||") {
-            let op = self.current_token().value.clone();
+            let op = self.current_text().to_string();
             self.advance();
             let right = self.parse_logical_and()?;
-            expr = Box::new(BinaryExpression::new(Some(expr), op, Some(right)));
+            expr = self.ast.add_expr(BinaryExpression::new(Some(expr), op, Some(right)));
         }
 
         Some(expr)
     }
 
-    fn parse_logical_and(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_logical_and(&mut self) -> Option<ExprId> {
         let mut expr = self.parse_equality()?;
 
         while self.match_value("&&") {
-            let op = self.current_token().value.clone();
+            let op = self.current_text().to_string();
             self.advance();
             let right = self.parse_equality()?;
-            expr = Box::new(BinaryExpression::new(Some(expr), op, Some(right)));
+            expr = self.ast.add_expr(BinaryExpression::new(Some(expr), op, Some(right)));
         }
 
         Some(expr)
     }
 
-    fn parse_equality(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_equality(&mut self) -> Option<ExprId> {
         let mut expr = self.parse_comparison()?;
 
         while self.match_value("==") || self.match_value("!=") {
-            let op = self.current_token().value.clone();
+            let op = self.current_text().to_string();
             self.advance();
             let right = self.parse_comparison()?;
-            expr = Box::new(BinaryExpression::new(Some(expr), op, Some(right)));
+            expr = self.ast.add_expr(BinaryExpression::new(Some(expr), op, Some(right)));
         }
 
         Some(expr)
     }
 
-    fn parse_comparison(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_comparison(&mut self) -> Option<ExprId> {
         let mut expr = self.parse_additive()?;
 
         while self.match_value("<")
@@ -966,65 +1034,65 @@ impl AstBuilder {
             || self.match_value(">")
             || self.match_value(">=")
         {
-            let op = self.current_token().value.clone();
+            let op = self.current_text().to_string();
             self.advance();
             let right = self.parse_additive()?;
-            expr = Box::new(BinaryExpression::new(Some(expr), op, Some(right)));
+            expr = self.ast.add_expr(BinaryExpression::new(Some(expr), op, Some(right)));
         }
 
         Some(expr)
     }
 
-    fn parse_additive(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_additive(&mut self) -> Option<ExprId> {
         let mut expr = self.parse_multiplicative()?;
 
         while self.match_value("+") || self.match_value("-") {
-            let op = self.current_token().value.clone();
+            let op = self.current_text().to_string();
             self.advance();
             let right = self.parse_multiplicative()?;
-            expr = Box::new(BinaryExpression::new(Some(expr), op, Some(right)));
+            expr = self.ast.add_expr(BinaryExpression::new(Some(expr), op, Some(right)));
         }
 
         Some(expr)
     }
 
-    fn parse_multiplicative(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_multiplicative(&mut self) -> Option<ExprId> {
         let mut expr = self.parse_cast()?;
 
         while self.match_value("*") || self.match_value("/") || self.match_value("%") {
-            let op = self.current_token().value.clone();
+            let op = self.current_text().to_string();
             self.advance();
             let right = self.parse_cast()?;
-            expr = Box::new(BinaryExpression::new(Some(expr), op, Some(right)));
+            expr = self.ast.add_expr(BinaryExpression::new(Some(expr), op, Some(right)));
         }
 
         Some(expr)
     }
 
-    fn parse_cast(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_cast(&mut self) -> Option<ExprId> {
         let mut expr = self.parse_unary()?;
 
-        while self.match_type(&TokenType::Keyword) && self.current_token().value == "as" {
+        while self.match_type(&TokenType::Keyword) && self.current_text() == "as" {
             self.advance(); // consume 'as'
             let target_type = self.parse_type()?;
-            expr = Box::new(CastExpression::new(Some(expr), target_type));
+            expr = self.ast.add_expr(CastExpression::new(Some(expr), target_type));
         }
 
         Some(expr)
     }
 
-    fn parse_unary(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_unary(&mut self) -> Option<ExprId> {
         if self.match_value("!") || self.match_value("-") || self.match_value("+") {
-            let op = self.current_token().value.clone();
+            let op = self.current_text().to_string();
             self.advance();
             let operand = self.parse_unary()?;
-            return Some(Box::new(UnaryExpression::new(op, Some(operand))));
+            return Some(self.ast.add_expr(UnaryExpression::new(op, Some(operand))));
         }
 
         self.parse_postfix()
     }
 
-    fn parse_postfix(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_postfix(&mut self) -> Option<ExprId> {
         let mut expr = self.parse_primary()?;
 
         loop {
@@ -1034,9 +1102,9 @@ impl AstBuilder {
                     self.log_error("Expected identifier after '.'");
                     return Some(expr);
                 }
-                let member = self.current_token().value.clone();
+                let member = self.current_text().to_string();
                 self.advance();
-                expr = Box::new(MemberAccess::new(Some(expr), member));
+                expr = self.ast.add_expr(MemberAccess::new(Some(expr), member));
             } else if self.match_value("[") {
                 self.advance();
                 let index = self.parse_expression()?;
@@ -1045,7 +1113,7 @@ impl AstBuilder {
                     return Some(expr);
                 }
                 self.advance();
-                expr = Box::new(ArrayIndex::new(Some(expr), Some(index)));
+                expr = self.ast.add_expr(ArrayIndex::new(Some(expr), Some(index)));
             } else if self.match_value("(") {
                 expr = self.parse_function_call(expr)?;
             } else {
@@ -1056,57 +1124,58 @@ impl AstBuilder {
         Some(expr)
     }
 
-    fn parse_primary(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_primary(&mut self) -> Option<ExprId> {
         // 标识符 (可能是变量名或结构体类型名)
         if self.match_type(&TokenType::Identifier) {
-            let name = self.current_token().value.clone();
+            let name = self.current_text().to_string();
             self.advance();
             
             // 检查是否是结构体字面量: TypeName { ... }
             // 通过大写开头判断类型名（遵循Go命名约定）
             if self.match_value("{") && name.chars().next().map_or(false, |c| c.is_uppercase()) {
-                return self.parse_struct_literal(Box::new(Identifier::new(name)));
+                let type_expr = self.ast.add_expr(Identifier::new(name));
+                return self.parse_struct_literal(type_expr);
             }
             
-            return Some(Box::new(Identifier::new(name)));
+            return Some(self.ast.add_expr(Identifier::new(name)));
         }
 
         // 数字字面量
         if self.match_type(&TokenType::Number) {
-            let value: f64 = self.current_token().value.parse().unwrap_or(0.0);
+            let value: f64 = self.current_text().parse().unwrap_or(0.0);
             self.advance();
-            return Some(Box::new(NumberLiteral::new(value)));
+            return Some(self.ast.add_expr(NumberLiteral::new(value)));
         }
 
         // 字符串字面量
         if self.match_type(&TokenType::String) {
-            let value = self.current_token().value.clone();
+            let value = self.current_text().to_string();
             self.advance();
-            return Some(Box::new(StringLiteral::new(value)));
+            return Some(self.ast.add_expr(StringLiteral::new(value)));
         }
 
         // 格式化字符串
         if self.match_type(&TokenType::FormatString) {
-            let value = self.current_token().value.clone();
+            let value = self.current_text().to_string();
             self.advance();
             return self.parse_format_string(&value);
         }
 
         // 关键字字面量
         if self.match_type(&TokenType::Keyword) {
-            let value = self.current_token().value.clone();
+            let value = self.current_text().to_string();
             match value.as_str() {
                 "true" | "false" => {
                     self.advance();
-                    return Some(Box::new(BooleanLiteral::new(value == "true")));
+                    return Some(self.ast.add_expr(BooleanLiteral::new(value == "true")));
                 }
                 "null" => {
                     self.advance();
-                    return Some(Box::new(NullLiteral::new()));
+                    return Some(self.ast.add_expr(NullLiteral::new()));
                 }
                 "self" => {
                     self.advance();
-                    return Some(Box::new(Identifier::new("self")));
+                    return Some(self.ast.add_expr(Identifier::new("self")));
                 }
                 "if" => return self.parse_if_expression(),
                 "match" => return self.parse_match_expression(),
@@ -1126,7 +1195,7 @@ impl AstBuilder {
             self.consume_end_of_line();
             let block = self.parse_block();
             self.consume_value("}", "Expected '}' after block expression");
-            return block.map(|b| b as Box<dyn Expression>);
+            return block.map(|b| self.ast.add_expr(b));
         }
 
         // 括号表达式: (1 + 2)
@@ -1139,26 +1208,26 @@ impl AstBuilder {
                 self.parse_expression();
             }
             self.consume_value(")", "Expected ')' after expression");
-            return Some(Box::new(GroupedExpression::new(Some(expr))));
+            return Some(self.ast.add_expr(GroupedExpression::new(Some(expr))));
         }
 
-        self.log_error(&format!("Unexpected token in expression: {}", self.current_token().value));
+        self.log_error(&format!("Unexpected token in expression: {}", self.current_text()));
         None
     }
 
-    fn parse_function_call(&mut self, callee: Box<dyn Expression>) -> Option<Box<dyn Expression>> {
+    fn parse_function_call(&mut self, callee: ExprId) -> Option<ExprId> {
         self.consume_value("(", "Expected '(' in function call");
 
         let args = self.parse_argument_list();
 
         self.consume_value(")", "Expected ')' after arguments");
 
-        Some(Box::new(FunctionCall::new(Some(callee), args)))
+        Some(self.ast.add_expr(FunctionCall::new(Some(callee), args)))
     }
 
-    fn parse_struct_literal(&mut self, type_expr: Box<dyn Expression>) -> Option<Box<dyn Expression>> {
+    fn parse_struct_literal(&mut self, type_expr: ExprId) -> Option<ExprId> {
         // Extract type name from the expression (must be an Identifier)
-        let type_name = if let Some(id) = type_expr.as_any().downcast_ref::<Identifier>() {
+        let type_name = if let Some(id) = self.ast[type_expr].as_identifier() {
             id.get_name().to_string()
         } else {
             self.log_error("Expected type name before '{'");
@@ -1171,8 +1240,8 @@ impl AstBuilder {
 
         while !self.match_value("}") && !self.error_occurred {
             // Peek ahead: if we see `identifier :`, it's a named field
-            if self.match_type(&TokenType::Identifier) && self.peek_next_token().value == ":" {
-                let name = self.current_token().value.clone();
+            if self.match_type(&TokenType::Identifier) && self.peek_text() == ":" {
+                let name = self.current_text().to_string();
                 self.advance(); // consume identifier
                 self.advance(); // consume ':'
                 let value = self.parse_expression()?;
@@ -1192,11 +1261,11 @@ impl AstBuilder {
 
         self.consume_value("}", "Expected '}' after struct literal");
 
-        Some(Box::new(StructLiteral::new(type_name, fields)))
+        Some(self.ast.add_expr(StructLiteral::new(type_name, fields)))
     }
 
-    fn parse_argument_list(&mut self) -> Option<Vec<Box<dyn Expression>>> {
-        let mut args: Vec<Box<dyn Expression>> = Vec::new();
+    fn parse_argument_list(&mut self) -> Option<Vec<ExprId>> {
+        let mut args: Vec<ExprId> = Vec::new();
 
         if !self.match_value(")") {
             loop {
@@ -1216,10 +1285,10 @@ impl AstBuilder {
         Some(args)
     }
 
-    fn parse_array_literal(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_array_literal(&mut self) -> Option<ExprId> {
         self.advance(); // consume '['
 
-        let mut elements: Vec<Box<dyn Expression>> = Vec::new();
+        let mut elements: Vec<ExprId> = Vec::new();
 
         while !self.match_value("]") && !self.error_occurred {
             if self.match_value(",") {
@@ -1243,10 +1312,10 @@ impl AstBuilder {
             }
         }
         self.consume_value("]", "Expected ']' after array literal");
-        Some(Box::new(ArrayLiteral::new(elements)))
+        Some(self.ast.add_expr(ArrayLiteral::new(elements)))
     }
 
-    fn parse_if_expression(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_if_expression(&mut self) -> Option<ExprId> {
         self.advance(); // consume 'if'
         let condition = self.parse_expression()?;
 
@@ -1271,28 +1340,28 @@ impl AstBuilder {
             self.consume_value("}", "Expected '}' at end of else branch");
             self.consume_end_of_line();
 
-            else_block.map(|b| b as Box<dyn Statement>)
+            else_block
         } else {
             None
         };
 
-        Some(Box::new(IfStatement::new(
+        Some(self.ast.add_expr(IfStatement::new(
             Some(condition),
             Some(then_branch),
             else_branch,
         )))
     }
 
-    fn parse_if_expr_branch(&mut self) -> Option<Box<dyn Statement>> {
+    fn parse_if_expr_branch(&mut self) -> Option<StmtId> {
         // Parse an expression and wrap it in a block
         let mut block = Block::new();
         self.consume_end_of_line();
         let stmt = self.parse_statement()?;
         block.add_statement(stmt);
-        Some(Box::new(block))
+        Some(self.ast.add_stmt(block))
     }
 
-    fn parse_match_expression(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_match_expression(&mut self) -> Option<ExprId> {
         self.advance(); // consume 'match'
 
         // Parse scrutinee expression
@@ -1312,7 +1381,7 @@ impl AstBuilder {
                 self.advance();
                 MatchPattern::Wildcard
             } else if self.match_type(&TokenType::Number) {
-                let val = self.current_token().value.clone();
+                let val = self.current_text().to_string();
                 self.advance();
                 if val.contains('.') {
                     MatchPattern::Literal(RtValueSimple::FloatStr(val))
@@ -1320,15 +1389,15 @@ impl AstBuilder {
                     MatchPattern::Literal(RtValueSimple::Int(val.parse().unwrap_or(0)))
                 }
             } else if self.match_type(&TokenType::String) {
-                let val = self.current_token().value.clone();
+                let val = self.current_text().to_string();
                 self.advance();
                 MatchPattern::Literal(RtValueSimple::Str(val))
-            } else if self.match_type(&TokenType::Keyword) && (self.current_token().value == "true" || self.current_token().value == "false") {
-                let val = self.current_token().value == "true";
+            } else if self.match_type(&TokenType::Keyword) && (self.current_text() == "true" || self.current_text() == "false") {
+                let val = self.current_text() == "true";
                 self.advance();
                 MatchPattern::Literal(RtValueSimple::Bool(val))
             } else if self.match_type(&TokenType::Identifier) {
-                let name = self.current_token().value.clone();
+                let name = self.current_text().to_string();
                 self.advance();
                 MatchPattern::Variable(name)
             } else {
@@ -1341,17 +1410,17 @@ impl AstBuilder {
             self.consume_value(">", "Expected '=>' after match pattern");
 
             // Parse arm body (single expression or block)
-            let body: Option<Box<dyn Statement>> = if self.match_value("{") {
+            let body: Option<StmtId> = if self.match_value("{") {
                 self.advance();
                 self.consume_end_of_line();
                 let b = self.parse_block();
                 self.consume_value("}", "Expected '}' after match arm block");
-                b.map(|b| b as Box<dyn Statement>)
+                b.map(|b| self.ast.add_stmt(b))
             } else {
                 let expr = self.parse_expression()?;
                 let mut block = Block::new();
-                block.add_statement(Box::new(ExpressionStatement::new(Some(expr))));
-                Some(Box::new(block))
+                block.add_statement(self.ast.add_stmt(ExpressionStatement::new_tail(Some(expr))));
+                Some(self.ast.add_stmt(block))
             };
 
             arms.push(MatchArm { pattern, body });
@@ -1366,10 +1435,10 @@ impl AstBuilder {
 
         self.consume_value("}", "Expected '}' after match body");
 
-        Some(Box::new(MatchExpression::new(Some(scrutinee), arms)))
+        Some(self.ast.add_expr(MatchExpression::new(Some(scrutinee), arms)))
     }
 
-    fn parse_new_expression(&mut self) -> Option<Box<dyn Expression>> {
+    fn parse_new_expression(&mut self) -> Option<ExprId> {
         self.advance(); // consume 'new'
 
         // Parse the type to allocate
@@ -1389,15 +1458,15 @@ impl AstBuilder {
                 self.advance();
             }
             // Return as a function-call-like expression (will expand later)
-            return Some(Box::new(Identifier::new("__new_array")));
+            return Some(self.ast.add_expr(Identifier::new("__new_array")));
         }
 
         // Struct instantiation with no args: new Type
         // Return as identifier (will expand later)
-        Some(Box::new(Identifier::new("__new_struct")))
+        Some(self.ast.add_expr(Identifier::new("__new_struct")))
     }
 
-    fn parse_if_statement(&mut self) -> Option<Box<dyn Statement>> {
+    fn parse_if_statement(&mut self) -> Option<StmtId> {
         self.consume_value("if", "An If Statement's begin token must be token 'if'");
         let condition = self.parse_expression()?;
 
@@ -1409,7 +1478,7 @@ impl AstBuilder {
         self.consume_value("}", "Expect '}' at end of branch body");
         self.consume_end_of_line();
 
-        let then_branch = then_branch?;
+        let then_branch = self.ast.add_stmt(then_branch?);
 
         let else_branch = if self.match_value("else") {
             self.advance();
@@ -1426,53 +1495,63 @@ impl AstBuilder {
                 self.consume_value("}", "Expect '}' at end of branch body");
                 self.consume_end_of_line();
 
-                else_block.map(|b| b as Box<dyn Statement>)
+                else_block.map(|b| self.ast.add_stmt(b))
             }
         } else {
             None
         };
 
-        Some(Box::new(IfStatement::new(
+        Some(self.ast.add_stmt(IfStatement::new(
             Some(condition),
             Some(then_branch),
             else_branch,
         )))
     }
 
-    fn parse_while_statement(&mut self) -> Option<Box<dyn Statement>> {
+    fn parse_while_statement(&mut self) -> Option<StmtId> {
         self.consume_value("while", "while statement must start with 'while' keyword");
         let condition = self.parse_expression()?;
 
-        let body: Option<Box<dyn Statement>> = if self.match_value("{") {
+        let body: Option<StmtId> = if self.match_value("{") {
             self.advance(); // consume '{'
             self.consume_end_of_line();
             let block = self.parse_block();
             self.consume_value("}", "Expected '}' at end of while body");
             self.consume_end_of_line();
-            block.map(|b| b as Box<dyn Statement>)
+            block.map(|b| self.ast.add_stmt(b))
         } else {
             self.parse_statement()
         };
 
         let body = body?;
-        Some(Box::new(WhileStatement::new(Some(condition), Some(body))))
+        Some(self.ast.add_stmt(WhileStatement::new(Some(condition), Some(body))))
+    }
+
+    fn parse_region_statement(&mut self) -> Option<StmtId> {
+        self.consume_value("region", "region statement must start with 'region' keyword");
+        self.consume_value("{", "Expected '{' after 'region'");
+        self.consume_end_of_line();
+        let body = self.parse_block()?;
+        self.consume_value("}", "Expected '}' at end of region body");
+        self.consume_end_of_line();
+        Some(self.ast.add_stmt(RegionStatement::new(body)))
     }
 
-    fn parse_break_statement(&mut self) -> Option<Box<dyn Statement>> {
+    fn parse_break_statement(&mut self) -> Option<StmtId> {
         self.consume_value("break", "break statement must start with 'break' keyword");
         self.consume_end_of_line();
-        Some(Box::new(BreakStatement::new()))
+        Some(self.ast.add_stmt(BreakStatement::new()))
     }
 
-    fn parse_continue_statement(&mut self) -> Option<Box<dyn Statement>> {
+    fn parse_continue_statement(&mut self) -> Option<StmtId> {
         self.consume_value("continue", "continue statement must start with 'continue' keyword");
         self.consume_end_of_line();
-        Some(Box::new(ContinueStatement::new()))
+        Some(self.ast.add_stmt(ContinueStatement::new()))
     }
 }
 
 // Helpers out of the AST builder
 
-fn as_number(expr: &Box<dyn Expression>) -> Option<f64> {
-    expr.as_any().downcast_ref::<NumberLiteral>().map(|n| n.get_value())
+fn as_number(ast: &Ast, expr: ExprId) -> Option<f64> {
+    ast[expr].as_number().map(|n| n.get_value())
 }
@@ -13,48 +13,33 @@ impl AstPrinter {
         print!("{}", " ".repeat((self.indent_level * 2) as usize));
     }
 
-    pub fn visit(&mut self, node: &dyn AstNode) {
-        node.accept(self);
+    pub fn visit(&mut self, program: &Program) {
+        program.accept(self);
     }
 }
 
 impl AstVisitor for AstPrinter {
-    fn visit_ast_node(&mut self, _node: &dyn AstNode) {
-        self.print_indent();
-        println!("ASTNode");
-    }
-
-    fn visit_program(&mut self, node: &Program) {
+    fn visit_program(&mut self, ast: &Ast, node: &Program) {
         self.print_indent();
         println!("Program");
         self.indent_level += 1;
         for stmt in node.get_statements() {
-            stmt.accept(self);
+            self.visit_stmt(ast, *stmt);
         }
         self.indent_level -= 1;
     }
 
-    fn visit_statement(&mut self, _node: &dyn Statement) {
-        self.print_indent();
-        println!("Statement");
-    }
-
-    fn visit_expression(&mut self, _node: &dyn Expression) {
-        self.print_indent();
-        println!("Expression");
-    }
-
-    fn visit_block(&mut self, node: &Block) {
+    fn visit_block(&mut self, ast: &Ast, node: &Block) {
         self.print_indent();
         println!("Block");
         self.indent_level += 1;
         for stmt in node.get_statements() {
-            stmt.accept(self);
+            self.visit_stmt(ast, *stmt);
         }
         self.indent_level -= 1;
     }
 
-    fn visit_function(&mut self, node: &Function) {
+    fn visit_function(&mut self, ast: &Ast, node: &Function) {
         self.print_indent();
         println!("Function");
         self.indent_level += 1;
@@ -67,7 +52,7 @@ impl AstVisitor for AstPrinter {
         self.indent_level += 1;
         if let Some(params) = node.get_parameters() {
             for param in params {
-                param.accept(self);
+                self.visit_parameter(ast, param);
             }
         }
         self.indent_level -= 1;
@@ -75,7 +60,7 @@ impl AstVisitor for AstPrinter {
         self.print_indent();
         print!("return-type: ");
         if let Some(rt) = node.get_return_type() {
-            rt.accept(self);
+            self.visit_type(ast, rt);
         }
         println!();
 
@@ -83,39 +68,39 @@ impl AstVisitor for AstPrinter {
         println!("body:");
         self.indent_level += 1;
         if let Some(body) = node.get_body() {
-            body.accept(self);
+            self.visit_block(ast, body);
         }
         self.indent_level -= 1;
 
         self.indent_level -= 1;
     }
 
-    fn visit_parameter(&mut self, node: &Parameter) {
+    fn visit_parameter(&mut self, ast: &Ast, node: &Parameter) {
         self.print_indent();
         print!("{}: ", node.get_name());
         if let Some(t) = node.get_type() {
-            t.accept(self);
+            self.visit_type(ast, t);
         }
         println!();
     }
 
-    fn visit_basic_type(&mut self, node: &BasicType) {
-        print!("{}", node.get_name());
+    fn visit_basic_type(&mut self, _ast: &Ast, node: &BasicType) {
+        print!("{}", node.name);
     }
 
-    fn visit_type(&mut self, node: &dyn Type) {
-        if let Some(arr) = node.as_type_any().downcast_ref::<ArrayType>() {
-            arr.accept(self);
+    fn visit_type(&mut self, ast: &Ast, node: &Type) {
+        if let Some(arr) = node.as_array() {
+            self.visit_array_type(ast, arr);
         } else {
             print!("{}", node.get_name());
         }
     }
 
-    fn visit_array_type(&mut self, node: &ArrayType) {
+    fn visit_array_type(&mut self, ast: &Ast, node: &ArrayType) {
         if node.is_multi_dimensional() {
             let element = node.get_element_type();
-            if let Some(arr) = element.as_type_any().downcast_ref::<ArrayType>() {
-                arr.accept(self);
+            if let Some(arr) = element.as_array() {
+                self.visit_array_type(ast, arr);
             } else {
                 print!("{}", element.get_name());
             }
@@ -125,14 +110,14 @@ impl AstVisitor for AstPrinter {
 
         print!("[");
         if let Some(size) = node.get_size() {
-            size.accept(self);
+            self.visit_expr(ast, size);
         } else {
             print!("?");
         }
         print!("]");
     }
 
-    fn visit_if_statement(&mut self, node: &IfStatement) {
+    fn visit_if_statement(&mut self, ast: &Ast, node: &IfStatement) {
         self.print_indent();
         println!("IfStatement");
         self.indent_level += 1;
@@ -140,7 +125,7 @@ impl AstVisitor for AstPrinter {
         self.print_indent();
         print!("condition:");
         if let Some(cond) = node.get_condition() {
-            cond.accept(self);
+            self.visit_expr(ast, cond);
         }
         println!();
 
@@ -148,7 +133,7 @@ impl AstVisitor for AstPrinter {
         println!("then:");
         self.indent_level += 1;
         if let Some(then_branch) = node.get_then_branch() {
-            then_branch.accept(self);
+            self.visit_stmt(ast, then_branch);
         }
         self.indent_level -= 1;
 
@@ -156,14 +141,14 @@ impl AstVisitor for AstPrinter {
             self.print_indent();
             println!("else:");
             self.indent_level += 1;
-            else_branch.accept(self);
+            self.visit_stmt(ast, else_branch);
             self.indent_level -= 1;
         }
 
         self.indent_level -= 1;
     }
 
-    fn visit_while_statement(&mut self, node: &WhileStatement) {
+    fn visit_while_statement(&mut self, ast: &Ast, node: &WhileStatement) {
         self.print_indent();
         println!("WhileStatement");
         self.indent_level += 1;
@@ -172,32 +157,45 @@ impl AstVisitor for AstPrinter {
         println!("condition:");
         self.indent_level += 1;
         if let Some(cond) = node.get_condition() {
-            cond.accept(self);
+            self.visit_expr(ast, cond);
         }
         self.indent_level -= 1;
 
         self.print_indent();
         println!("body:");
         if let Some(body) = node.get_body() {
-            body.accept(self);
+            self.visit_stmt(ast, body);
         }
 
         self.indent_level -= 1;
     }
 
-    fn visit_for_statement(&mut self, node: &ForStatement) {
+    fn visit_region_statement(&mut self, ast: &Ast, node: &RegionStatement) {
         self.print_indent();
-        println!("ForStatement");
+        println!("RegionStatement");
+        self.indent_level += 1;
+        self.visit_block(ast, node.get_body());
+        self.indent_level -= 1;
+    }
+
+    fn visit_for_statement(&mut self, ast: &Ast, node: &ForStatement) {
+        self.print_indent();
+        println!("{}", if node.is_parallel() { "ParallelForStatement" } else { "ForStatement" });
         self.indent_level += 1;
 
         self.print_indent();
         println!("variable: {}", node.get_loop_variable());
 
+        for (op, var) in node.get_reductions() {
+            self.print_indent();
+            println!("reduce: {}({})", op, var);
+        }
+
         self.print_indent();
         print!("iterable: ");
         self.indent_level += 1;
         if let Some(iter) = node.get_iterable() {
-            iter.accept(self);
+            self.visit_expr(ast, iter);
         }
         println!();
         self.indent_level -= 1;
@@ -206,56 +204,56 @@ impl AstVisitor for AstPrinter {
         println!("body:");
         self.indent_level += 1;
         if let Some(body) = node.get_body() {
-            body.accept(self);
+            self.visit_block(ast, body);
         }
 
         self.indent_level -= 1;
         self.indent_level -= 1;
     }
 
-    fn visit_return_statement(&mut self, node: &ReturnStatement) {
+    fn visit_return_statement(&mut self, ast: &Ast, node: &ReturnStatement) {
         self.print_indent();
         print!("ReturnStatement");
         if let Some(val) = node.get_value() {
             print!(" ");
-            val.accept(self);
+            self.visit_expr(ast, val);
         }
         println!();
     }
 
-    fn visit_break_statement(&mut self, _node: &BreakStatement) {
+    fn visit_break_statement(&mut self, _ast: &Ast, _node: &BreakStatement) {
         self.print_indent();
         println!("BreakStatement");
     }
 
-    fn visit_continue_statement(&mut self, _node: &ContinueStatement) {
+    fn visit_continue_statement(&mut self, _ast: &Ast, _node: &ContinueStatement) {
         self.print_indent();
         println!("ContinueStatement");
     }
 
-    fn visit_declaration(&mut self, node: &Declaration) {
+    fn visit_declaration(&mut self, ast: &Ast, node: &Declaration) {
         self.print_indent();
         print!("{} {}", node.get_keyword(), node.get_name());
         if let Some(t) = node.get_type() {
             print!(": ");
-            t.accept(self);
+            self.visit_type(ast, t);
         }
         if let Some(init) = node.get_initializer() {
             print!(" = ");
-            init.accept(self);
+            self.visit_expr(ast, init);
         }
         println!();
     }
 
-    fn visit_expression_statement(&mut self, node: &ExpressionStatement) {
+    fn visit_expression_statement(&mut self, ast: &Ast, node: &ExpressionStatement) {
         self.print_indent();
         if let Some(expr) = node.get_expression() {
-            expr.accept(self);
+            self.visit_expr(ast, expr);
         }
         println!(";");
     }
 
-    fn visit_import_statement(&mut self, node: &ImportStatement) {
+    fn visit_import_statement(&mut self, _ast: &Ast, node: &ImportStatement) {
         self.print_indent();
         print!("Import(path = {})", node.get_module_name());
         if let Some(alias) = node.get_alias() {
@@ -264,20 +262,20 @@ impl AstVisitor for AstPrinter {
         println!();
     }
 
-    fn visit_struct_definition(&mut self, node: &StructDefinition) {
+    fn visit_struct_definition(&mut self, ast: &Ast, node: &StructDefinition) {
         self.print_indent();
         print!("Struct {}(", node.get_name());
         for (i, field) in node.get_fields().iter().enumerate() {
             if i > 0 { print!(", "); }
             print!("{}: ", field.name);
             if let Some(t) = &field.field_type {
-                t.accept(self);
+                self.visit_type(ast, t);
             }
         }
         println!(")");
     }
 
-    fn visit_impl_block(&mut self, node: &ImplBlock) {
+    fn visit_impl_block(&mut self, ast: &Ast, node: &ImplBlock) {
         self.print_indent();
         println!("Impl {} {{", node.get_struct_name());
         self.indent_level += 1;
@@ -288,7 +286,7 @@ impl AstVisitor for AstPrinter {
                     println!("Constructor: {}", func.get_name());
                 }
                 ImplItem::Method(func) => {
-                    func.accept(self);
+                    self.visit_function(ast, func);
                 }
                 ImplItem::Convert(func) => {
                     self.print_indent();
@@ -301,7 +299,7 @@ impl AstVisitor for AstPrinter {
         println!("}}");
     }
 
-    fn visit_export_statement(&mut self, node: &ExportStatement) {
+    fn visit_export_statement(&mut self, _ast: &Ast, node: &ExportStatement) {
         self.print_indent();
         print!("Export(");
         for (i, name) in node.get_names().iter().enumerate() {
@@ -313,36 +311,36 @@ impl AstVisitor for AstPrinter {
         println!(")");
     }
 
-    fn visit_binary_expression(&mut self, node: &BinaryExpression) {
+    fn visit_binary_expression(&mut self, ast: &Ast, node: &BinaryExpression) {
         print!("(");
         if let Some(left) = node.get_left() {
-            left.accept(self);
+            self.visit_expr(ast, left);
         }
         print!(" {} ", node.get_operator());
         if let Some(right) = node.get_right() {
-            right.accept(self);
+            self.visit_expr(ast, right);
         }
         print!(")");
     }
 
-    fn visit_cast_expression(&mut self, node: &CastExpression) {
+    fn visit_cast_expression(&mut self, ast: &Ast, node: &CastExpression) {
         if let Some(expr) = node.get_expression() {
-            expr.accept(self);
+            self.visit_expr(ast, expr);
         }
         print!(" as ");
-        node.get_target_type().accept(self);
+        self.visit_type(ast, node.get_target_type());
     }
 
-    fn visit_unary_expression(&mut self, node: &UnaryExpression) {
+    fn visit_unary_expression(&mut self, ast: &Ast, node: &UnaryExpression) {
         print!("{}", node.get_operator());
         if let Some(operand) = node.get_operand() {
-            operand.accept(self);
+            self.visit_expr(ast, operand);
         }
     }
 
-    fn visit_function_call(&mut self, node: &FunctionCall) {
+    fn visit_function_call(&mut self, ast: &Ast, node: &FunctionCall) {
         if let Some(callee) = node.get_callee() {
-            callee.accept(self);
+            self.visit_expr(ast, callee);
         }
         print!("(");
         if let Some(args) = node.get_arguments() {
@@ -350,47 +348,47 @@ impl AstVisitor for AstPrinter {
                 if i > 0 {
                     print!(", ");
                 }
-                arg.accept(self);
+                self.visit_expr(ast, *arg);
             }
         }
         print!(")");
     }
 
-    fn visit_member_access(&mut self, node: &MemberAccess) {
+    fn visit_member_access(&mut self, ast: &Ast, node: &MemberAccess) {
         if let Some(obj) = node.get_object() {
-            obj.accept(self);
+            self.visit_expr(ast, obj);
         }
         print!(".{}", node.get_member());
     }
 
-    fn visit_array_index(&mut self, node: &ArrayIndex) {
+    fn visit_array_index(&mut self, ast: &Ast, node: &ArrayIndex) {
         if let Some(arr) = node.get_array() {
-            arr.accept(self);
+            self.visit_expr(ast, arr);
         }
         print!("[");
         if let Some(idx) = node.get_index() {
-            idx.accept(self);
+            self.visit_expr(ast, idx);
         }
         print!("]");
     }
 
-    fn visit_grouped_expression(&mut self, node: &GroupedExpression) {
+    fn visit_grouped_expression(&mut self, ast: &Ast, node: &GroupedExpression) {
         print!("(");
         if let Some(expr) = node.get_expression() {
-            expr.accept(self);
+            self.visit_expr(ast, expr);
         }
         print!(")");
     }
 
-    fn visit_identifier(&mut self, node: &Identifier) {
+    fn visit_identifier(&mut self, _ast: &Ast, node: &Identifier) {
         print!("{}", node.get_name());
     }
 
-    fn visit_number_literal(&mut self, node: &NumberLiteral) {
+    fn visit_number_literal(&mut self, _ast: &Ast, node: &NumberLiteral) {
         print!("{}", node.get_value());
     }
 
-    fn visit_string_literal(&mut self, node: &StringLiteral) {
+    fn visit_string_literal(&mut self, _ast: &Ast, node: &StringLiteral) {
         print!("\"");
         for c in node.get_value().chars() {
             match c {
@@ -404,15 +402,15 @@ impl AstVisitor for AstPrinter {
         print!("\"");
     }
 
-    fn visit_null_literal(&mut self, _node: &NullLiteral) {
+    fn visit_null_literal(&mut self, _ast: &Ast, _node: &NullLiteral) {
         print!("null");
     }
 
-    fn visit_boolean_literal(&mut self, node: &BooleanLiteral) {
+    fn visit_boolean_literal(&mut self, _ast: &Ast, node: &BooleanLiteral) {
         print!("{}", if node.get_value() { "true" } else { "false" });
     }
 
-    fn visit_format_string(&mut self, node: &FormatString) {
+    fn visit_format_string(&mut self, ast: &Ast, node: &FormatString) {
         print!("@\"");
         for c in node.get_value().chars() {
             match c {
@@ -432,8 +430,8 @@ impl AstVisitor for AstPrinter {
                 if i > 0 {
                     print!(", ");
                 }
-                if let Some(ref val) = var.value {
-                    val.accept(self);
+                if let Some(val) = var.value {
+                    self.visit_expr(ast, val);
                     print!(":{}", var.pos_in_value);
                 } else {
                     print!("?@{}", var.pos_in_value);
@@ -443,29 +441,29 @@ impl AstVisitor for AstPrinter {
         }
     }
 
-    fn visit_range_expression(&mut self, node: &RangeExpression) {
+    fn visit_range_expression(&mut self, ast: &Ast, node: &RangeExpression) {
         print!("range(");
         for (i, arg) in node.get_arguments().iter().enumerate() {
             if i > 0 {
                 print!(", ");
             }
-            arg.accept(self);
+            self.visit_expr(ast, *arg);
         }
         print!(")");
     }
 
-    fn visit_array_literal(&mut self, node: &ArrayLiteral) {
+    fn visit_array_literal(&mut self, ast: &Ast, node: &ArrayLiteral) {
         print!("[");
         for (i, elem) in node.get_elements().iter().enumerate() {
             if i > 0 {
                 print!(", ");
             }
-            elem.accept(self);
+            self.visit_expr(ast, *elem);
         }
         print!("]");
     }
 
-    fn visit_struct_literal(&mut self, node: &StructLiteral) {
+    fn visit_struct_literal(&mut self, ast: &Ast, node: &StructLiteral) {
         print!("{}", node.get_type_name());
         print!("{{");
         for (i, field) in node.get_fields().iter().enumerate() {
@@ -475,10 +473,10 @@ impl AstVisitor for AstPrinter {
             match field {
                 StructFieldInit::Named { name, value } => {
                     print!("{}: ", name);
-                    value.accept(self);
+                    self.visit_expr(ast, *value);
                 }
                 StructFieldInit::Positional(value) => {
-                    value.accept(self);
+                    self.visit_expr(ast, *value);
                 }
             }
         }
@@ -4,8 +4,11 @@ use std::fs;
 use std::path::{Path, PathBuf};
 use std::io::{self, Write};
 use std::process;
+use std::sync::Mutex;
+use std::thread;
 use colored::*;
-use git2::{Repository, ResetType};
+use gobol::driver::{self, CompileOptions};
+use git2::{Oid, Repository, ResetType};
 
 // ============ 错误处理 ============
 
@@ -115,7 +118,7 @@ fn run_command(args: &[String]) -> Result<()> {
         "update" => cmd_update(&args[2..]),
         "list" => cmd_list(),
         "run" => cmd_run(&args[2..]),
-        "clean" => cmd_clean(),
+        "clean" => cmd_clean(&args[2..]),
         "build" => cmd_build(&args[2..]),
         "help" | "--help" => {
             print_help();
@@ -141,7 +144,8 @@ fn print_help() {
     println!("  grape list               List all dependencies");
     println!("  grape run [--verbose]    Build and run the Gobol program");
     println!("  grape build [-o <file>]  Compile to a native binary");
-    println!("  grape clean              Clean cached packages");
+    println!("  grape build --release    Optimized build (also --debug, --size, --native, --pgo)");
+    println!("  grape clean [--store]    Clean cached packages (--store: also the shared package store)");
     println!("  grape version            Show the version");
     println!("  grape help               Show this help message");
     println!();
@@ -239,6 +243,7 @@ fn cmd_add(deps: &[String]) -> Result<()> {
         ));
     }
 
+    let mut added: Vec<(String, DependencySpec)> = Vec::new();
     for dep in deps {
         println!("📦 Adding dependency: {}", dep);
 
@@ -268,17 +273,15 @@ fn cmd_add(deps: &[String]) -> Result<()> {
             optional: if is_optional { Some(true) } else { None },
         };
 
-        let local_path = dep_spec.local_path();
-
-        // 下载依赖
         println!("  Downloading from {}", dep_spec.git_url());
-        download_package(&dep_spec)?;
-        println!("  ✓ Downloaded to {}", local_path.display());
-
+        added.push((var_name.clone(), dep_spec.clone()));
         config.dependencies.insert(var_name.clone(), dep_spec);
         println!("  ✓ Added dependency: {}", var_name);
     }
 
+    // 并行下载依赖
+    install_packages(&added, &read_lock_file()?, false)?;
+
     save_grape_toml(&config)?;
     update_lock_file(&config)?;
     
@@ -333,18 +336,11 @@ fn cmd_update(args: &[String]) -> Result<()> {
         config.dependencies.clone().into_iter().collect()
     };
     
-    for (name, spec) in deps_to_update {
+    for (name, spec) in &deps_to_update {
         println!("  Updating {}@{}", name, spec.tag);
-        
-        // 重新下载
-        let local_path = spec.local_path();
-        if local_path.exists() {
-            fs::remove_dir_all(&local_path).map_err(GrapeError::Io)?;
-        }
-        
-        download_package(&spec)?;
-        println!("  ✓ Updated {}", name);
     }
+    // 重新解析 tag，忽略锁文件中的 commit
+    install_packages(&deps_to_update, &read_lock_file()?, true)?;
     
     save_grape_toml(&config)?;
     update_lock_file(&config)?;
@@ -398,10 +394,8 @@ fn cmd_run(args: &[String]) -> Result<()> {
         .and_then(|i| args.get(i + 1).cloned())
         .unwrap_or_else(|| config.project.name.clone());
 
-    if !no_check && !Path::new("grape.lock").exists() {
-        println!("grape.lock not found, generating...");
-        update_lock_file(&config)?;
-    } else if !no_check {
+    let has_lock = Path::new("grape.lock").exists();
+    if !no_check && has_lock {
         verify_lock_file(&config)?;
     }
 
@@ -411,6 +405,10 @@ fn cmd_run(args: &[String]) -> Result<()> {
     }
 
     ensure_dependencies_downloaded(&config)?;
+    if !no_check && !has_lock {
+        println!("grape.lock not found, generating...");
+        update_lock_file(&config)?;
+    }
     let lib_paths = build_lib_paths(&config);
 
     if is_verbose {
@@ -420,20 +418,28 @@ fn cmd_run(args: &[String]) -> Result<()> {
         println!("Lib paths: {:?}", lib_paths);
     }
 
-    let mut cmd = process::Command::new("gobol");
-    cmd.arg("-o").arg(&out_name);
-    for path in &lib_paths { cmd.arg("--lib-path").arg(path); }
-    if is_verbose { cmd.arg("--verbose"); }
-    // Pass through extra flags from caller (e.g. --no-run from grape build)
-    for a in args {
-        if a == "-c" {
-            cmd.arg(a);
+    // Compile in-process; the build profile flags pass through
+    let mut options = CompileOptions::from_args(args);
+    options.input = entry_file.clone();
+    options.output = Some(out_name.clone());
+    options.lib_paths = lib_paths;
+    options.verbose = is_verbose;
+    let artifact = match driver::compile(&options) {
+        Ok(artifact) => artifact,
+        Err(failure) => {
+            for msg in &failure.messages {
+                eprintln!("{}", msg);
+            }
+            process::exit(failure.exit_code);
         }
-    }
-    cmd.arg(entry_file);
+    };
 
-    let status = cmd.status().map_err(|_| {
-        GrapeError::CommandFailed("Failed to run gobol. Make sure gobol is installed.".to_string())
+    // grape build passes -c: compile only
+    if args.iter().any(|a| a == "-c") {
+        return Ok(());
+    }
+    let status = driver::binary_command(&artifact.binary).status().map_err(|e| {
+        GrapeError::CommandFailed(format!("Failed to run '{}': {}", artifact.binary, e))
     })?;
 
     if !status.success() {
@@ -450,7 +456,7 @@ fn cmd_build(args: &[String]) -> Result<()> {
 }
 
 
-fn cmd_clean() -> Result<()> {
+fn cmd_clean(args: &[String]) -> Result<()> {
     println!("Cleaning cached packages...");
     
     let packages_dir = Path::new(".grape/packages");
@@ -470,6 +476,15 @@ fn cmd_clean() -> Result<()> {
         fs::remove_file("grape.lock").map_err(GrapeError::Io)?;
         println!("  Removed: grape.lock");
     }
+
+    // 共享存储被所有项目使用，只在明确要求时删除
+    if args.iter().any(|a| a == "--store") {
+        let store = store_dir();
+        if store.exists() {
+            fs::remove_dir_all(&store).map_err(GrapeError::Io)?;
+            println!("  Removed: {}", store.display());
+        }
+    }
     
     println!("✓ Clean completed");
     Ok(())
@@ -511,11 +526,18 @@ fn save_lock_file(lock: &GrapeLock) -> Result<()> {
 fn update_lock_file(config: &GrapeToml) -> Result<()> {
     let mut lock = read_lock_file()?;
     
+    // 已删除的依赖不再锁定
+    lock.packages.retain(|name, _| config.dependencies.contains_key(name));
     for (name, spec) in &config.dependencies {
         // 获取当前 commit hash
         let local_path = spec.local_path();
         if local_path.exists() {
-            if let Ok(commit) = get_current_commit(&local_path) {
+            // 存储中的包记录了 commit；旧版直接克隆的包还有 .git
+            let commit = match installed_commit(&local_path) {
+                Some(commit) => Ok(commit),
+                None => get_current_commit(&local_path),
+            };
+            if let Ok(commit) = commit {
                 lock.packages.insert(name.clone(), LockedPackage {
                     repo: spec.repo.clone(),
                     tag: spec.tag.clone(),
@@ -546,50 +568,233 @@ fn verify_lock_file(config: &GrapeToml) -> Result<()> {
 }
 
 fn ensure_dependencies_downloaded(config: &GrapeToml) -> Result<()> {
-    for (name, spec) in &config.dependencies {
-        let local_path = spec.local_path();
-        if !local_path.exists() {
-            println!("📦 Downloading missing dependency: {}", name);
-            download_package(spec)?;
+    let deps: Vec<(String, DependencySpec)> = config.dependencies.clone().into_iter().collect();
+    install_packages(&deps, &read_lock_file()?, false)
+}
+
+// ============ 包存储 ============
+//
+// 每个依赖先解析到一个 commit（优先使用 grape.lock 中锁定的 commit），
+// 检出到全局存储 ~/.grape/store/<commit>，再链接到项目的
+// .grape/packages/<name>。存储按 commit 寻址，多个项目和重复安装
+// 共用同一份检出；锁定的包已经链接到位时什么都不做。
+
+/// 同时进行的 git 下载数上限
+const FETCH_JOBS: usize = 8;
+
+/// 每个存储条目中记录其 commit 的文件
+const COMMIT_MARKER: &str = ".grape-commit";
+
+/// $GRAPE_HOME，默认 ~/.grape
+fn grape_home() -> PathBuf {
+    if let Ok(dir) = std::env::var("GRAPE_HOME") {
+        return PathBuf::from(dir);
+    }
+    let home = std::env::var("HOME")
+        .or_else(|_| std::env::var("USERPROFILE"))
+        .unwrap_or_else(|_| ".".to_string());
+    Path::new(&home).join(".grape")
+}
+
+fn store_dir() -> PathBuf {
+    grape_home().join("store")
+}
+
+/// 目录中（存储条目或其链接）检出的 commit
+fn installed_commit(dir: &Path) -> Option<String> {
+    fs::read_to_string(dir.join(COMMIT_MARKER)).ok().map(|s| s.trim().to_string())
+}
+
+fn short(commit: &str) -> &str {
+    &commit[..commit.len().min(10)]
+}
+
+/// 并行安装依赖。`refresh` 时忽略锁文件，重新解析 tag。
+fn install_packages(deps: &[(String, DependencySpec)], lock: &GrapeLock, refresh: bool) -> Result<()> {
+    let queue = Mutex::new(deps.iter());
+    let errors: Mutex<Vec<String>> = Mutex::new(Vec::new());
+    thread::scope(|s| {
+        for _ in 0..deps.len().min(FETCH_JOBS) {
+            s.spawn(|| loop {
+                let next = queue.lock().unwrap().next();
+                let (name, spec) = match next {
+                    Some(dep) => dep,
+                    None => break,
+                };
+                let pinned = lock.packages.get(name)
+                    .filter(|p| !refresh && p.repo == spec.repo && p.tag == spec.tag)
+                    .map(|p| p.commit.clone());
+                if let Err(e) = install_package(name, spec, pinned) {
+                    errors.lock().unwrap().push(format!("{}: {}", name, e));
+                }
+            });
         }
+    });
+    let errors = errors.into_inner().unwrap();
+    if errors.is_empty() {
+        Ok(())
+    } else {
+        Err(GrapeError::CommandFailed(errors.join("; ")))
+    }
+}
+
+fn install_package(name: &str, spec: &DependencySpec, pinned: Option<String>) -> Result<()> {
+    let target = spec.local_path();
+    // 锁定的包已经链接到位：重复安装什么都不做
+    if pinned.is_some() && installed_commit(&target) == pinned {
+        return Ok(());
     }
+
+    let store = store_dir();
+    fs::create_dir_all(&store).map_err(GrapeError::Io)?;
+    let commit = match pinned.or_else(|| resolve_commit(spec)) {
+        Some(commit) => {
+            let entry = store.join(&commit);
+            if installed_commit(&entry).as_deref() != Some(commit.as_str()) {
+                println!("  Fetching {}@{} ({})", name, spec.tag, short(&commit));
+                fetch_into_store(spec, Some(&commit), &store)?;
+            }
+            commit
+        }
+        // 无法远程解析 tag 时先下载，再按检出的 commit 入库
+        None => {
+            println!("  Fetching {}@{}", name, spec.tag);
+            fetch_into_store(spec, None, &store)?
+        }
+    };
+
+    link_package(&store.join(&commit), &target)?;
+    println!("  ✓ {}@{} ({})", name, spec.tag, short(&commit));
     Ok(())
 }
 
-fn download_package(spec: &DependencySpec) -> Result<()> {
+/// 用 `git ls-remote` 解析 tag 或分支，不必克隆；tag 本身是完整 commit 时直接使用
+fn resolve_commit(spec: &DependencySpec) -> Option<String> {
+    if spec.tag.len() == 40 && spec.tag.chars().all(|c| c.is_ascii_hexdigit()) {
+        return Some(spec.tag.to_lowercase());
+    }
+    let tag_ref = format!("refs/tags/{}", spec.tag);
+    let peeled_ref = format!("{}^{{}}", tag_ref);
+    let branch_ref = format!("refs/heads/{}", spec.tag);
+    let output = process::Command::new("git")
+        .args(["ls-remote", &spec.git_url(), &tag_ref, &peeled_ref, &branch_ref])
+        .output()
+        .ok()
+        .filter(|o| o.status.success())?;
+    let refs: HashMap<String, String> = String::from_utf8_lossy(&output.stdout)
+        .lines()
+        .filter_map(|line| line.split_once('\t'))
+        .map(|(id, name)| (name.to_string(), id.to_string()))
+        .collect();
+    // 附注 tag 取其指向的 commit
+    refs.get(&peeled_ref).or_else(|| refs.get(&tag_ref)).or_else(|| refs.get(&branch_ref)).cloned()
+}
+
+/// 下载 `spec`（`commit` 给定时为该 commit）到存储中，返回检出的 commit
+fn fetch_into_store(spec: &DependencySpec, commit: Option<&str>, store: &Path) -> Result<String> {
     let git_url = spec.git_url();
-    let tag = &spec.tag;
-    let target_dir = spec.local_path();
-    
-    if target_dir.exists() {
-        return Ok(());
+    let tmp = store.join(format!(".tmp-{}-{}", process::id(), spec.local_name()));
+    let _ = fs::remove_dir_all(&tmp);
+
+    // 尝试浅克隆
+    let shallow = match commit {
+        Some(commit) => fetch_commit_shallow(&git_url, commit, &tmp),
+        None => clone_tag_shallow(&git_url, &spec.tag, &tmp),
+    };
+    if let Err(e) = shallow {
+        println!("  ⚠ Shallow clone failed: {}, retrying with full clone...", e);
+        let _ = fs::remove_dir_all(&tmp);
+        clone_tag_full(&git_url, &spec.tag, commit, &tmp)?;
     }
 
-    if let Some(parent) = target_dir.parent() {
+    let checked_out = get_current_commit(&tmp)?;
+    if let Some(commit) = commit {
+        if !checked_out.eq_ignore_ascii_case(commit) {
+            let _ = fs::remove_dir_all(&tmp);
+            return Err(GrapeError::NotFound(format!("commit {} not found in {}", commit, git_url)));
+        }
+    }
+
+    // 存储条目只保留源码
+    let _ = fs::remove_dir_all(tmp.join(".git"));
+    fs::write(tmp.join(COMMIT_MARKER), format!("{}\n", checked_out)).map_err(GrapeError::Io)?;
+    let entry = store.join(&checked_out);
+    if fs::rename(&tmp, &entry).is_err() {
+        // 另一个进程已经放入了同一个 commit
+        let _ = fs::remove_dir_all(&tmp);
+        if installed_commit(&entry).as_deref() != Some(checked_out.as_str()) {
+            return Err(GrapeError::CommandFailed(format!("cannot add {} to the store", entry.display())));
+        }
+    }
+    Ok(checked_out)
+}
+
+/// 把存储条目链接到项目中：优先符号链接，否则逐个文件硬链接（跨文件系统时复制）
+fn link_package(entry: &Path, target: &Path) -> Result<()> {
+    if let Some(parent) = target.parent() {
         fs::create_dir_all(parent).map_err(GrapeError::Io)?;
     }
+    if let Ok(meta) = fs::symlink_metadata(target) {
+        let removed = if meta.file_type().is_symlink() {
+            fs::remove_file(target).or_else(|_| fs::remove_dir(target))
+        } else {
+            fs::remove_dir_all(target)
+        };
+        removed.map_err(GrapeError::Io)?;
+    }
 
-    println!("  Cloning {} (tag: {})", git_url, tag);
+    #[cfg(unix)]
+    let linked = std::os::unix::fs::symlink(entry, target).is_ok();
+    #[cfg(windows)]
+    let linked = std::os::windows::fs::symlink_dir(entry, target).is_ok();
+    #[cfg(not(any(unix, windows)))]
+    let linked = false;
 
-    // 尝试浅克隆
-    match clone_tag_shallow(&git_url, tag, &target_dir) {
-        Ok(_) => {
-            println!("  ✓ Successfully cloned");
-            Ok(())
+    if linked {
+        Ok(())
+    } else {
+        link_tree(entry, target).map_err(GrapeError::Io)
+    }
+}
+
+fn link_tree(from: &Path, to: &Path) -> io::Result<()> {
+    fs::create_dir_all(to)?;
+    for entry in fs::read_dir(from)? {
+        let entry = entry?;
+        let dest = to.join(entry.file_name());
+        if entry.file_type()?.is_dir() {
+            link_tree(&entry.path(), &dest)?;
+        } else if fs::hard_link(entry.path(), &dest).is_err() {
+            fs::copy(entry.path(), &dest)?;
         }
-        Err(e) => {
-            println!("  ⚠ Shallow clone failed: {}, retrying with full clone...", e);
-            clone_tag_full(&git_url, tag, &target_dir)?;
-            println!("  ✓ Successfully cloned with full clone");
-            Ok(())
+    }
+    Ok(())
+}
+
+/// 只下载一个 commit（深度 1），GitHub 等服务端允许按 commit 获取
+fn fetch_commit_shallow(git_url: &str, commit: &str, target_dir: &Path) -> Result<()> {
+    let dir = target_dir.to_str().unwrap();
+    let steps: [&[&str]; 3] = [
+        &["init", "-q", dir],
+        &["-C", dir, "fetch", "-q", "--depth", "1", git_url, commit],
+        &["-C", dir, "checkout", "-q", "FETCH_HEAD"],
+    ];
+    for args in steps {
+        let status = process::Command::new("git")
+            .args(args)
+            .status()
+            .map_err(|_| GrapeError::CommandFailed("git not found".to_string()))?;
+        if !status.success() {
+            return Err(GrapeError::CommandFailed(format!("Failed to fetch commit {}", commit)));
         }
     }
+    Ok(())
 }
 
 fn clone_tag_shallow(git_url: &str, tag: &str, target_dir: &Path) -> Result<()> {
     // 使用命令行进行浅克隆（git2 对浅克隆支持有限）
     let status = std::process::Command::new("git")
-        .args(&["clone", "--depth", "1", "--branch", tag, git_url, target_dir.to_str().unwrap()])
+        .args(&["clone", "-q", "--depth", "1", "--branch", tag, git_url, target_dir.to_str().unwrap()])
         .status()
         .map_err(|_| GrapeError::CommandFailed("git not found".to_string()))?;
     
@@ -600,7 +805,8 @@ fn clone_tag_shallow(git_url: &str, tag: &str, target_dir: &Path) -> Result<()>
     }
 }
 
-fn clone_tag_full(git_url: &str, tag: &str, target_dir: &Path) -> Result<()> {
+/// 完整克隆后检出 `commit`，未给定时检出 tag 或分支
+fn clone_tag_full(git_url: &str, tag: &str, commit: Option<&str>, target_dir: &Path) -> Result<()> {
     let repo = Repository::clone(git_url, target_dir).map_err(GrapeError::Git)?;
     
     // 查找 tag
@@ -608,7 +814,10 @@ fn clone_tag_full(git_url: &str, tag: &str, target_dir: &Path) -> Result<()> {
     let branch_ref_name = format!("refs/heads/{}", tag);
     
     let commit_id = {
-        if let Ok(reference) = repo.find_reference(&tag_ref_name) {
+        if let Some(commit) = commit {
+            Oid::from_str(commit).map_err(GrapeError::Git)?
+        }
+        else if let Ok(reference) = repo.find_reference(&tag_ref_name) {
             let annotated = repo.reference_to_annotated_commit(&reference)
                 .map_err(GrapeError::Git)?;
             annotated.id()
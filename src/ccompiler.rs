@@ -6,12 +6,37 @@
 // Usage:
 //   let cc = CCompiler::detect();
 //   cc.compile(&["src.c", "lib.c"], "output")?;
+//
+// With `with_cache(dir)` each source is compiled to an object file stored
+// under a content hash, and later builds link the cached objects instead
+// of recompiling unchanged sources.  `build_runtime` archives the C
+// companions (std/c/*.c) into a static library once per target and flag
+// set; `with_library` links it in place of the companion sources.
+//
+// `with_jobs(n)` compiles up to n sources to objects at once and links
+// them in a separate step, so a program split into one translation unit
+// per module (see `CodeGenC::generate_units`) builds in parallel.
+//
+// `with_profile` picks the optimization level (`Profile::Release` is -O3
+// with LTO, `Debug` is -O0 -g, `Size` is -Os) and `with_native` tunes for
+// the build machine.  `$CFLAGS` is appended after these flags, so it can
+// add to or override them.  `with_pgo` builds one phase of a
+// profile-guided build: an instrumented binary whose runs write profile
+// data, then a rebuild that optimizes with it.
+//
+// `with_time_report` asks the compiler for its own per-pass timings and
+// keeps what it prints, for `gobol --time-report`.
 
 use std::env;
-use std::path::Path;
+use std::fs;
+use std::path::{Path, PathBuf};
 use std::process::{Command, ExitStatus};
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::Mutex;
+use std::thread;
 use colored::*;
 use crate::error::ErrorFormatter;
+use crate::time_report;
 
 /// Compilation error with formatted output
 #[derive(Debug)]
@@ -30,16 +55,79 @@ impl std::fmt::Display for CompileError {
 
 impl std::error::Error for CompileError {}
 
+/// Optimization profile of a build.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub enum Profile {
+    /// `-O2` (`/O2`)
+    #[default]
+    Default,
+    /// `-O3` with LTO (`/O2 /GL`)
+    Release,
+    /// `-O0 -g` (`/Od /Zi`)
+    Debug,
+    /// `-Os` (`/O1`)
+    Size,
+}
+
+impl Profile {
+    fn gcc_flags(self) -> &'static [&'static str] {
+        match self {
+            Profile::Default => &["-O2"],
+            Profile::Release => &["-O3"],
+            Profile::Debug => &["-O0", "-g"],
+            Profile::Size => &["-Os"],
+        }
+    }
+
+    fn msvc_flags(self) -> &'static [&'static str] {
+        match self {
+            Profile::Default | Profile::Release => &["/O2"],
+            Profile::Debug => &["/Od", "/Zi"],
+            Profile::Size => &["/O1"],
+        }
+    }
+}
+
+/// Phase of a profile-guided build.  Both phases name the same directory.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum Pgo {
+    /// Instrument the binary; each run adds its profile data to the directory
+    Generate(PathBuf),
+    /// Optimize with the profile data an instrumented build collected
+    Use(PathBuf),
+}
+
 /// Represents a detected C compiler.
 pub struct CCompiler {
     /// The compiler executable (e.g. "cc", "gcc", "cl.exe")
     program: String,
     /// Whether this is MSVC (affects flag style)
     is_msvc: bool,
-    /// Whether this is MinGW (GCC on Windows)
+    /// Whether this is MinGW (a GNU-style compiler targeting Windows)
     is_mingw: bool,
     /// Error formatter for displaying errors
     error_formatter: Option<ErrorFormatter>,
+    /// Object cache directory; `None` compiles every source each time
+    cache_dir: Option<PathBuf>,
+    /// Prebuilt static libraries linked after the sources
+    libraries: Vec<PathBuf>,
+    /// Emit LTO bitcode so runtime helpers can inline across objects
+    lto: bool,
+    /// Probed when LTO is enabled: Clang and GCC differ in LTO flags
+    is_clang: bool,
+    /// Compiler processes run at once when building objects
+    jobs: usize,
+    /// Optimization level and debug info
+    profile: Profile,
+    /// Tune for the build machine (`-march=native`)
+    native: bool,
+    /// Profile-guided build phase, if any
+    pgo: Option<Pgo>,
+    /// Pass `-ftime-report` (`/Bt+`) and collect the compiler's output
+    time_report: bool,
+    reports: Mutex<String>,
+    /// Peak resident set size of the largest compiler process, in KiB
+    peak_rss_kb: Mutex<Option<u64>>,
 }
 
 impl CCompiler {
@@ -48,17 +136,28 @@ impl CCompiler {
     /// Respects `$CC`; falls back to `cc` on Unix or `cl.exe` on Windows.
     pub fn detect() -> Self {
         let program = env::var("CC").unwrap_or_else(|_| default_compiler());
-        
-        // More robust detection
-        let program_lower = program.to_lowercase();
-        let is_msvc = program_lower.contains("cl") || program_lower.contains("msvc");
-        let is_mingw = program_lower.contains("gcc") || program_lower.contains("mingw");
-        
+
+        // MSVC is known by its driver's name; any other compiler on a
+        // Windows host, or one that targets it, is MinGW
+        let is_msvc = is_msvc_driver(&program);
+        let is_mingw = !is_msvc && (cfg!(target_os = "windows") || targets_mingw(&program));
+
         CCompiler {
             program,
             is_msvc,
             is_mingw,
             error_formatter: None,
+            cache_dir: None,
+            libraries: Vec::new(),
+            lto: false,
+            is_clang: false,
+            jobs: 1,
+            profile: Profile::Default,
+            native: false,
+            pgo: None,
+            time_report: false,
+            reports: Mutex::new(String::new()),
+            peak_rss_kb: Mutex::new(None),
         }
     }
 
@@ -68,15 +167,189 @@ impl CCompiler {
         self
     }
 
+    /// Cache compiled objects under `dir` (created on first use).
+    pub fn with_cache(mut self, dir: impl Into<PathBuf>) -> Self {
+        self.cache_dir = Some(dir.into());
+        self
+    }
+
+    /// Link `lib` (e.g. the prebuilt runtime) into every executable.
+    pub fn with_library(mut self, lib: impl Into<PathBuf>) -> Self {
+        self.libraries.push(lib.into());
+        self
+    }
+
+    /// Compile and link with link-time optimization.
+    pub fn with_lto(mut self, lto: bool) -> Self {
+        self.lto = lto;
+        if lto {
+            self.probe_clang();
+        }
+        self
+    }
+
+    /// Select the optimization profile.  `Profile::Release` also turns on
+    /// LTO.
+    pub fn with_profile(mut self, profile: Profile) -> Self {
+        self.profile = profile;
+        let lto = self.lto || profile == Profile::Release;
+        self.with_lto(lto)
+    }
+
+    /// Tune for the build machine's CPU.  MSVC has no equivalent of
+    /// `-march=native`, so it ignores this.
+    pub fn with_native(mut self, native: bool) -> Self {
+        self.native = native;
+        self
+    }
+
+    /// Build one phase of a profile-guided build.  Profile data is matched
+    /// to the objects by name, so both phases compile every source in one
+    /// command, without the object cache.
+    pub fn with_pgo(mut self, pgo: Option<Pgo>) -> Self {
+        self.pgo = pgo;
+        if self.pgo.is_some() {
+            self.probe_clang();
+        }
+        self
+    }
+
+    /// Have the compiler report the time of its own passes; the output of
+    /// every successful compile is kept for `time_report`.
+    pub fn with_time_report(mut self, time_report: bool) -> Self {
+        self.time_report = time_report;
+        self
+    }
+
+    /// What the compiler printed for its time reports so far.
+    pub fn time_report(&self) -> String {
+        self.reports.lock().map(|r| r.clone()).unwrap_or_default()
+    }
+
+    /// Peak memory of the largest compiler process run with the time
+    /// report on, in KiB (Unix only).
+    pub fn peak_rss_kb(&self) -> Option<u64> {
+        self.peak_rss_kb.lock().ok().and_then(|p| *p)
+    }
+
+    /// Clang and GCC differ in LTO and profile flags
+    fn probe_clang(&mut self) {
+        if !self.is_msvc {
+            self.is_clang = Command::new(&self.program)
+                .arg("--version")
+                .output()
+                .map(|o| String::from_utf8_lossy(&o.stdout).contains("clang"))
+                .unwrap_or(false);
+        }
+    }
+
+    /// Compile up to `jobs` sources at once (at least one).
+    pub fn with_jobs(mut self, jobs: usize) -> Self {
+        self.jobs = jobs.max(1);
+        self
+    }
+
+    /// Build the runtime companions into `dir/libgobolrt-<target>-<key>.a`
+    /// (`.lib` with MSVC), reusing an existing archive with the same key.
+    pub fn build_runtime(&self, sources: &[impl AsRef<Path>], dir: &Path) -> Result<PathBuf, CompileError> {
+        fs::create_dir_all(dir).map_err(|e| io_error(format!("Cannot create runtime directory '{}'", dir.display()), e))?;
+
+        let flags = self.compiler_flags();
+        // Hash in name order so directory listing order doesn't change the key
+        let mut ordered: Vec<&Path> = sources.iter().map(|s| s.as_ref()).collect();
+        ordered.sort_by_key(|p| p.file_name().map(|n| n.to_os_string()));
+        let mut contents: Vec<u8> = Vec::new();
+        for src in ordered {
+            let bytes = fs::read(src).map_err(|e| io_error(format!("Cannot read '{}'", src.display()), e))?;
+            contents.extend_from_slice(src.file_name().map_or(&[][..], |n| n.as_encoded_bytes()));
+            contents.push(0);
+            contents.extend_from_slice(&bytes);
+        }
+        let target = format!("{}-{}", env::consts::ARCH, env::consts::OS);
+        let key = self.object_key(&flags, &contents);
+        let lib = if self.is_msvc {
+            dir.join(format!("gobolrt-{}-{}.lib", target, key))
+        } else {
+            dir.join(format!("libgobolrt-{}-{}.a", target, key))
+        };
+        if lib.exists() {
+            return Ok(lib);
+        }
+
+        let work = dir.join(format!("build-{}-{}", key, std::process::id()));
+        fs::create_dir_all(&work).map_err(|e| io_error(format!("Cannot create '{}'", work.display()), e))?;
+        let result = self.archive_runtime(sources, &flags, &work, &lib);
+        let _ = fs::remove_dir_all(&work);
+        result.map(|_| lib)
+    }
+
+    fn archive_runtime(&self, sources: &[impl AsRef<Path>], flags: &[String], work: &Path, lib: &Path) -> Result<(), CompileError> {
+        let tasks = self.object_tasks(sources, work);
+        self.build_objects(flags, &tasks)?;
+        let objects: Vec<PathBuf> = tasks.into_iter().map(|(_, obj)| obj).collect();
+
+        // Archive under a private name and rename, like the object cache
+        let tmp = work.join(lib.file_name().unwrap());
+        let mut cmd = if self.is_msvc {
+            let mut c = Command::new("lib.exe");
+            c.arg("/nologo").arg(format!("/OUT:{}", tmp.display()));
+            c
+        } else {
+            let mut c = Command::new(self.archiver());
+            c.arg("rcs").arg(&tmp);
+            c
+        };
+        cmd.args(&objects);
+        self.run(cmd)?;
+        fs::rename(&tmp, lib).map_err(|e| io_error(format!("Cannot store '{}'", lib.display()), e))
+    }
+
+    /// `$AR`, else `gcc-ar` for GCC LTO objects (plain `ar` can't index
+    /// them without the plugin), else `ar`.
+    fn archiver(&self) -> String {
+        if let Ok(ar) = env::var("AR") {
+            return ar;
+        }
+        if self.lto && !self.is_clang {
+            let gcc_ar = Command::new("gcc-ar").arg("--version").output();
+            if matches!(gcc_ar, Ok(o) if o.status.success()) {
+                return "gcc-ar".to_string();
+            }
+        }
+        "ar".to_string()
+    }
+
+    fn add_object_output(&self, cmd: &mut Command, src: &Path, obj: &Path) {
+        if self.is_msvc {
+            cmd.arg("/c").arg(src).arg(format!("/Fo:{}", obj.display()));
+        } else {
+            cmd.arg("-c").arg(src).arg("-o").arg(obj);
+        }
+    }
+
     /// Compile one or more C source files into a native executable.
     ///
     /// `sources` — paths to `.c` files (companion files first, then generated).
     /// `output`  — name of the resulting executable.
     pub fn compile(&self, sources: &[impl AsRef<Path>], output: &str) -> Result<ExitStatus, CompileError> {
+        if let Some(Pgo::Use(dir)) = &self.pgo {
+            self.merge_profile(dir)?;
+        } else if let Some(Pgo::Generate(dir)) = &self.pgo {
+            fs::create_dir_all(dir).map_err(|e| io_error(format!("Cannot create profile directory '{}'", dir.display()), e))?;
+        }
+        if self.pgo.is_none() {
+            if let Some(dir) = &self.cache_dir {
+                return self.compile_cached(dir, sources, output);
+            }
+            if self.jobs > 1 && sources.len() > 1 {
+                return self.compile_parallel(sources, output);
+            }
+        }
+
         let mut cmd = Command::new(&self.program);
 
         // Add compiler flags
-        self.add_compiler_flags(&mut cmd);
+        cmd.args(self.compiler_flags());
         
         // Output file
         if self.is_msvc {
@@ -89,17 +362,194 @@ impl CCompiler {
         for src in sources {
             cmd.arg(src.as_ref());
         }
+        cmd.args(&self.libraries);
 
         // Platform-specific libraries
         self.add_platform_libraries(&mut cmd);
+        let link_flags = self.msvc_link_flags();
+        if !link_flags.is_empty() {
+            cmd.arg("/link").args(link_flags);
+        }
+
+        self.run(cmd)
+    }
+
+    /// Clang writes one raw profile per run; merge them into the indexed
+    /// profile `-fprofile-use` reads.  GCC and MSVC read their run data
+    /// directly.
+    fn merge_profile(&self, dir: &Path) -> Result<(), CompileError> {
+        if !self.is_clang {
+            return Ok(());
+        }
+        let raw: Vec<PathBuf> = fs::read_dir(dir)
+            .map_err(|e| io_error(format!("Cannot read profile directory '{}'", dir.display()), e))?
+            .flatten()
+            .map(|e| e.path())
+            .filter(|p| p.extension().map_or(false, |e| e == "profraw"))
+            .collect();
+        let mut cmd = Command::new(env::var("LLVM_PROFDATA").unwrap_or_else(|_| "llvm-profdata".to_string()));
+        cmd.arg("merge").arg("-o").arg(dir.join("default.profdata")).args(raw);
+        self.run(cmd).map(|_| ())
+    }
+
+    /// Compile the sources to objects in a scratch directory, in parallel,
+    /// then link them.
+    fn compile_parallel(&self, sources: &[impl AsRef<Path>], output: &str) -> Result<ExitStatus, CompileError> {
+        let work = env::temp_dir().join(format!("gobol-build-{}", std::process::id()));
+        fs::create_dir_all(&work).map_err(|e| io_error(format!("Cannot create '{}'", work.display()), e))?;
+        let tasks = self.object_tasks(sources, &work);
+        let result = self.build_objects(&self.compiler_flags(), &tasks).and_then(|_| {
+            let objects: Vec<PathBuf> = tasks.into_iter().map(|(_, obj)| obj).collect();
+            self.link(&objects, output)
+        });
+        let _ = fs::remove_dir_all(&work);
+        result
+    }
+
+    /// Compile each source to a cached object (keyed by its content, the
+    /// local headers it includes, the compiler and the flags), then link
+    /// the objects.
+    fn compile_cached(&self, dir: &Path, sources: &[impl AsRef<Path>], output: &str) -> Result<ExitStatus, CompileError> {
+        fs::create_dir_all(dir).map_err(|e| io_error(format!("Cannot create cache directory '{}'", dir.display()), e))?;
+
+        let flags = self.compiler_flags();
+        let obj_ext = if self.is_msvc { "obj" } else { "o" };
+        let mut objects: Vec<PathBuf> = Vec::with_capacity(sources.len());
+        let mut missing: Vec<(PathBuf, PathBuf)> = Vec::new();
+        for src in sources {
+            let src = src.as_ref();
+            let mut contents = fs::read(src).map_err(|e| io_error(format!("Cannot read '{}'", src.display()), e))?;
+            contents.extend(local_includes(src, &contents));
+            let obj = dir.join(format!("{}.{}", self.object_key(&flags, &contents), obj_ext));
+            if !obj.exists() && !missing.iter().any(|(_, o)| *o == obj) {
+                missing.push((src.to_path_buf(), obj.clone()));
+            }
+            objects.push(obj);
+        }
+        self.build_objects(&flags, &missing)?;
+        self.link(&objects, output)
+    }
+
+    /// (source, object) pairs for building `sources` into `dir`.
+    fn object_tasks(&self, sources: &[impl AsRef<Path>], dir: &Path) -> Vec<(PathBuf, PathBuf)> {
+        let obj_ext = if self.is_msvc { "obj" } else { "o" };
+        sources.iter().enumerate()
+            .map(|(i, src)| (src.as_ref().to_path_buf(), dir.join(format!("{}.{}", i, obj_ext))))
+            .collect()
+    }
+
+    /// Compile every (source, object) pair, up to `jobs` at a time.  The
+    /// first failure stops workers from starting new compiles.
+    fn build_objects(&self, flags: &[String], tasks: &[(PathBuf, PathBuf)]) -> Result<(), CompileError> {
+        let workers = self.jobs.min(tasks.len());
+        if workers <= 1 {
+            for (src, obj) in tasks {
+                self.build_object(flags, src, obj)?;
+            }
+            return Ok(());
+        }
+        let next = AtomicUsize::new(0);
+        let failed = AtomicBool::new(false);
+        thread::scope(|s| {
+            let handles: Vec<_> = (0..workers)
+                .map(|_| s.spawn(|| {
+                    while !failed.load(Ordering::Relaxed) {
+                        let i = next.fetch_add(1, Ordering::Relaxed);
+                        let Some((src, obj)) = tasks.get(i) else { break };
+                        if let Err(e) = self.build_object(flags, src, obj) {
+                            failed.store(true, Ordering::Relaxed);
+                            return Err(e);
+                        }
+                    }
+                    Ok(())
+                }))
+                .collect();
+            handles.into_iter()
+                .map(|h| h.join().expect("compiler worker panicked"))
+                .collect::<Result<Vec<()>, CompileError>>()
+                .map(|_| ())
+        })
+    }
+
+    fn build_object(&self, flags: &[String], src: &Path, obj: &Path) -> Result<(), CompileError> {
+        // Build under a private name and rename, so concurrent builds
+        // never link a half-written object.
+        let tmp = obj.with_extension(format!("{}.tmp", std::process::id()));
+        let mut cmd = Command::new(&self.program);
+        cmd.args(flags);
+        self.add_object_output(&mut cmd, src, &tmp);
+        if let Err(e) = self.run(cmd) {
+            let _ = fs::remove_file(&tmp);
+            return Err(e);
+        }
+        fs::rename(&tmp, obj).map_err(|e| io_error(format!("Cannot store '{}'", obj.display()), e))
+    }
+
+    /// Link objects and libraries into `output`.
+    fn link(&self, objects: &[PathBuf], output: &str) -> Result<ExitStatus, CompileError> {
+        let mut cmd = Command::new(&self.program);
+        if self.is_msvc {
+            cmd.arg("/nologo").arg(&format!("/Fe:{}", output));
+        } else {
+            cmd.arg("-o").arg(output);
+            if self.is_mingw {
+                cmd.arg("-static");
+            }
+            // LTO objects are optimized again at link time
+            if self.lto {
+                cmd.arg("-flto").args(self.profile.gcc_flags());
+                if self.native {
+                    cmd.arg("-march=native");
+                }
+            }
+        }
+        cmd.args(objects);
+        cmd.args(&self.libraries);
+        self.add_platform_libraries(&mut cmd);
+        let link_flags = self.msvc_link_flags();
+        if !link_flags.is_empty() {
+            cmd.arg("/link").args(link_flags);
+        }
+        self.run(cmd)
+    }
 
+    /// Cache key: FNV-1a over the Gobol version, compiler, flags and source.
+    fn object_key(&self, flags: &[String], contents: &[u8]) -> String {
+        let mut h: u64 = 0xcbf29ce484222325;
+        let mut feed = |bytes: &[u8]| {
+            for b in bytes.iter().chain(std::iter::once(&0u8)) {
+                h ^= *b as u64;
+                h = h.wrapping_mul(0x100000001b3);
+            }
+        };
+        feed(env!("CARGO_PKG_VERSION").as_bytes());
+        feed(self.program.as_bytes());
+        for f in flags {
+            feed(f.as_bytes());
+        }
+        feed(contents);
+        format!("{:016x}-{:x}", h, contents.len())
+    }
+
+    fn run(&self, mut cmd: Command) -> Result<ExitStatus, CompileError> {
         // Debug: print command for diagnostics
         if env::var("GOBOL_DEBUG").is_ok() {
             eprintln!("{}", format!("Compiling: {:?}", cmd).red());
         }
 
-        // Execute and capture output
-        let output = cmd.output().map_err(|e| CompileError {
+        // Execute and capture output; the time report also wants the
+        // process's peak memory
+        let output = if self.time_report {
+            time_report::output_with_peak(&mut cmd).map(|(output, peak)| {
+                if let (Some(kb), Ok(mut max)) = (peak, self.peak_rss_kb.lock()) {
+                    *max = Some(max.map_or(kb, |m| m.max(kb)));
+                }
+                output
+            })
+        } else {
+            cmd.output()
+        };
+        let output = output.map_err(|e| CompileError {
             message: format!("Failed to execute compiler '{}': {}", self.program, e),
             status: ExitStatus::default(),
             stderr: String::new(),
@@ -121,6 +571,14 @@ impl CCompiler {
             });
         }
 
+        if self.time_report {
+            // GCC and Clang report on stderr, MSVC on stdout
+            let text = if self.is_msvc { &output.stdout } else { &output.stderr };
+            if let Ok(mut reports) = self.reports.lock() {
+                reports.push_str(&String::from_utf8_lossy(text));
+            }
+        }
+
         Ok(output.status)
     }
 
@@ -244,47 +702,108 @@ impl CCompiler {
         None
     }
 
-    fn add_compiler_flags(&self, cmd: &mut Command) {
-        // Use environment CFLAGS if available
-        if let Ok(cflags) = env::var("CFLAGS") {
-            for flag in cflags.split_whitespace() {
-                cmd.arg(flag);
-            }
-            return;
-        }
+    fn compiler_flags(&self) -> Vec<String> {
+        let mut flags: Vec<&str> = Vec::new();
 
         // Default flags
         if self.is_msvc {
             // MSVC flags
-            cmd.arg("/O2")      // Optimize for speed
-                .arg("/W3")     // Warning level 3
-                .arg("/MD")     // Dynamic CRT
-                .arg("/EHsc")   // C++ exception handling (also works for C)
-                .arg("/nologo") // No copyright banner
-                .arg("/FC");    // Full path in diagnostics
+            flags.extend_from_slice(self.profile.msvc_flags());
+            flags.extend([
+                "/W3",      // Warning level 3
+                "/MD",      // Dynamic CRT
+                "/EHsc",    // C++ exception handling (also works for C)
+                "/nologo",  // No copyright banner
+                "/FC",      // Full path in diagnostics
+            ]);
+            // Whole-program optimization, which PGO also requires
+            if self.lto || self.pgo.is_some() {
+                flags.push("/GL");
+            }
         } else {
             // GCC/Clang flags
-            cmd.arg("-O2")
-                .arg("-Wall")
-                .arg("-Wextra")
-                .arg("-Wpedantic")
-                .arg("-std=c11");
+            flags.extend_from_slice(self.profile.gcc_flags());
+            flags.extend(["-Wall", "-Wextra", "-Wpedantic", "-std=c11"]);
+            if self.native {
+                flags.push("-march=native");
+            }
             
             // Position-independent code for Linux
             if cfg!(target_os = "linux") {
-                cmd.arg("-fPIC");
+                flags.push("-fPIC");
             }
             
             // macOS version
             if cfg!(target_os = "macos") {
-                cmd.arg("-mmacosx-version-min=10.15");
+                flags.push("-mmacosx-version-min=10.15");
             }
             
             // MinGW static linking
             if self.is_mingw {
-                cmd.arg("-static");
+                flags.push("-static");
+            }
+
+            // Keep machine code next to the bitcode so non-LTO links of the
+            // runtime archive still work (GCC only; Clang archives bitcode)
+            if self.lto {
+                flags.push("-flto");
+                if !self.is_clang {
+                    flags.push("-ffat-lto-objects");
+                }
+            }
+        }
+
+        let mut flags: Vec<String> = flags.into_iter().map(|f| f.to_string()).collect();
+        if !self.is_msvc {
+            match &self.pgo {
+                Some(Pgo::Generate(dir)) => flags.push(format!("-fprofile-generate={}", dir.display())),
+                // Sources without profile data (e.g. code the training run
+                // never reached) are still optimized, just without a profile
+                Some(Pgo::Use(dir)) if self.is_clang => {
+                    flags.push(format!("-fprofile-use={}", dir.join("default.profdata").display()));
+                    flags.push("-Wno-profile-instr-unprofiled".to_string());
+                }
+                Some(Pgo::Use(dir)) => {
+                    flags.push(format!("-fprofile-use={}", dir.display()));
+                    flags.push("-fprofile-correction".to_string());
+                    flags.push("-Wno-missing-profile".to_string());
+                }
+                None => {}
             }
         }
+
+        if self.time_report {
+            flags.push(if self.is_msvc { "/Bt+" } else { "-ftime-report" }.to_string());
+        }
+
+        // Environment CFLAGS come last, so they can override the defaults
+        if let Ok(cflags) = env::var("CFLAGS") {
+            flags.extend(cflags.split_whitespace().map(|f| f.to_string()));
+        }
+        flags
+    }
+
+    /// Options MSVC passes to the linker (after `/link`).
+    fn msvc_link_flags(&self) -> Vec<String> {
+        let mut flags = Vec::new();
+        if !self.is_msvc {
+            return flags;
+        }
+        if self.profile == Profile::Debug {
+            flags.push("/DEBUG".to_string());
+        }
+        match &self.pgo {
+            Some(Pgo::Generate(dir)) => {
+                flags.push("/LTCG".to_string());
+                flags.push(format!("/GENPROFILE:PGD={}", dir.join("gobol.pgd").display()));
+            }
+            Some(Pgo::Use(dir)) => {
+                flags.push("/LTCG".to_string());
+                flags.push(format!("/USEPROFILE:PGD={}", dir.join("gobol.pgd").display()));
+            }
+            None => {}
+        }
+        flags
     }
 
     fn add_platform_libraries(&self, cmd: &mut Command) {
@@ -293,23 +812,22 @@ impl CCompiler {
             return;
         }
 
-        // GCC/Clang/MinGW
-        let target_os = env::var("CARGO_CFG_TARGET_OS").unwrap_or_default();
-        
-        // Always link math library on Unix
-        if target_os != "windows" {
-            cmd.arg("-lm");
+        // GCC/Clang/MinGW: the math library, and pthreads for the runtime's
+        // `parallel for` pool on Unix targets (Windows uses its own threads)
+        cmd.arg("-lm");
+        if !self.is_mingw && !cfg!(target_os = "windows") {
+            cmd.arg("-pthread");
         }
-        
+
         // Additional libraries for specific platforms
-        if target_os == "linux" {
+        if cfg!(target_os = "linux") {
             // For dynamic linking with glibc
             if !self.is_mingw {
                 // No extra flags needed for glibc
             }
         }
-        
-        if target_os == "macos" {
+
+        if cfg!(target_os = "macos") {
             // macOS framework
             // cmd.arg("-framework").arg("CoreFoundation");
         }
@@ -374,6 +892,70 @@ fn default_compiler() -> String {
     }
 }
 
+/// Contents of the headers a source pulls in with `#include "..."`
+/// (looked up next to the source), so editing a shared header
+/// invalidates the objects built from it.
+fn local_includes(src: &Path, contents: &[u8]) -> Vec<u8> {
+    let dir = src.parent().unwrap_or(Path::new("."));
+    let mut out = Vec::new();
+    for line in String::from_utf8_lossy(contents).lines() {
+        let Some(rest) = line.trim_start().strip_prefix("#include \"") else { continue };
+        if let Some(name) = rest.split('"').next() {
+            if let Ok(bytes) = fs::read(dir.join(name)) {
+                out.extend_from_slice(name.as_bytes());
+                out.push(0);
+                out.extend(bytes);
+            }
+        }
+    }
+    out
+}
+
+fn io_error(what: String, e: std::io::Error) -> CompileError {
+    CompileError {
+        message: format!("{}: {}", what, e),
+        status: ExitStatus::default(),
+        stderr: String::new(),
+        stdout: String::new(),
+    }
+}
+
+/// Where the prebuilt runtime lives: `$GOBOL_RUNTIME_DIR`, else the user
+/// cache directory, so every project on the machine shares one build.
+pub fn default_runtime_dir() -> PathBuf {
+    if let Ok(dir) = env::var("GOBOL_RUNTIME_DIR") {
+        return PathBuf::from(dir);
+    }
+    let base = if cfg!(target_os = "windows") {
+        env::var("LOCALAPPDATA").ok().map(PathBuf::from)
+    } else {
+        env::var("XDG_CACHE_HOME").ok().map(PathBuf::from)
+            .or_else(|| env::var("HOME").ok().map(|h| Path::new(&h).join(".cache")))
+    };
+    match base {
+        Some(b) => b.join("gobol").join("runtime"),
+        None => PathBuf::from(".gobol-cache").join("runtime"),
+    }
+}
+
+/// `cl` and `clang-cl` take MSVC-style flags; `clang`, `gcc` and the rest
+/// take GNU-style ones.
+fn is_msvc_driver(program: &str) -> bool {
+    let name = program.rsplit(['/', '\\']).next().unwrap_or(program).to_lowercase();
+    let name = name.strip_suffix(".exe").unwrap_or(&name);
+    name == "cl" || name == "clang-cl"
+}
+
+/// Whether a GNU-style compiler targets MinGW, from its `-dumpmachine`
+/// triple (e.g. `x86_64-w64-mingw32`).
+fn targets_mingw(program: &str) -> bool {
+    Command::new(program)
+        .arg("-dumpmachine")
+        .output()
+        .map(|o| String::from_utf8_lossy(&o.stdout).contains("mingw"))
+        .unwrap_or(false)
+}
+
 fn is_msvc_available() -> bool {
     Command::new("cl.exe")
         .arg("/?")
@@ -432,6 +1014,37 @@ mod tests {
         assert!(cc.is_available(), "Compiler should be available");
     }
 
+    #[test]
+    fn test_driver_detection() {
+        for msvc in ["cl", "cl.exe", "CL.EXE", "C:\\VS\\bin\\cl.exe", "clang-cl"] {
+            assert!(is_msvc_driver(msvc), "{} takes MSVC flags", msvc);
+        }
+        for gnu in ["cc", "clang", "/usr/bin/clang-17", "gcc", "x86_64-w64-mingw32-gcc", "tcc"] {
+            assert!(!is_msvc_driver(gnu), "{} takes GNU flags", gnu);
+        }
+    }
+
+    #[test]
+    fn test_profile_flags() {
+        let cc = CCompiler::detect();
+        if cc.is_msvc {
+            let flags = cc.with_profile(Profile::Size).compiler_flags();
+            assert!(flags.iter().any(|f| f == "/O1"));
+            return;
+        }
+        let release = CCompiler::detect().with_profile(Profile::Release).with_native(true);
+        assert!(release.lto);
+        let flags = release.compiler_flags();
+        assert!(flags.iter().any(|f| f == "-O3") && flags.iter().any(|f| f == "-march=native"));
+        assert!(!flags.iter().any(|f| f == "-O2"));
+
+        let flags = CCompiler::detect().with_profile(Profile::Debug).compiler_flags();
+        assert!(flags.iter().any(|f| f == "-O0") && flags.iter().any(|f| f == "-g"));
+
+        let pgo = CCompiler::detect().with_pgo(Some(Pgo::Generate(PathBuf::from("prof"))));
+        assert!(pgo.compiler_flags().iter().any(|f| f.starts_with("-fprofile-generate=")));
+    }
+
     #[test]
     fn test_compile_simple() {
         use std::fs;
@@ -1,15 +1,102 @@
 // codegen_c.rs — C code generator. Walks the IR and emits C source.
 use crate::environment::DataType;
 use crate::ir::*;
-use std::collections::HashMap;
+use std::collections::{BTreeSet, HashMap, HashSet};
+
+/// One C translation unit of a program split by `generate_units`.
+pub struct CUnit {
+    /// Gobol module the unit holds; empty for the main program
+    pub module: String,
+    pub source: String,
+}
+
+pub struct CUnits {
+    pub header: String,
+    pub units: Vec<CUnit>,
+}
 
 #[allow(dead_code)]
+/// How a function receives one parameter.  Only arrays and user structs
+/// are ever passed by pointer.
+#[derive(Debug, Clone, Copy, PartialEq)]
+enum Pass {
+    Value,
+    /// `T*`: a method's `self` or an array that the function modifies
+    Ref,
+    /// `const T*`: `self`, an array or a large struct the body only reads
+    ConstRef,
+}
+
+/// A C block whose exit has to release something: the local arrays
+/// declared in it, and for a `region` block the region itself.
+struct Cleanup {
+    arrays: Vec<String>,
+    region: Option<String>,
+    /// A loop body, the block `break` and `continue` leave
+    loop_body: bool,
+}
+
 pub struct CodeGenC {
     output: String,
     indent: usize,
     generated_functions: Vec<String>,
     vars: HashMap<String, DataType>,
     structs: Vec<String>,
+    struct_fields: HashMap<String, Vec<(String, DataType)>>,
+    func_returns: HashMap<String, DataType>,
+    /// `gobol_array_<T>` prefixes whose definitions have been emitted
+    array_types: Vec<String>,
+    /// Array definitions requested after the struct section, spliced in at
+    /// `array_defs_at` once generation finishes
+    array_defs: String,
+    array_defs_at: Option<usize>,
+    /// Declarations and assignments per name in the function being emitted
+    writes: HashMap<String, usize>,
+    /// `n` → `arr` for `var n = arr.len()` where neither is ever rewritten
+    len_aliases: HashMap<String, String>,
+    /// Loop variables proven in bounds: (var, array, lowest value, k) where
+    /// the variable stays below `arr.len() - k`
+    safe_indices: Vec<(String, String, i64, i64)>,
+    /// Body of the function being emitted, for escape checks
+    current_body: Option<IRBlock>,
+    /// Parameter passing per C function name, aligned with its params
+    param_passing: HashMap<String, Vec<Pass>>,
+    /// Static methods returning their own struct; each is emitted as
+    /// `<name>_init(T* self, ...)` plus a by-value wrapper
+    ctors: HashSet<String>,
+    /// Parameters of the function being emitted that are pointers
+    ref_params: HashSet<String>,
+    /// Whether the function being emitted is a constructor's `_init`
+    in_ctor: bool,
+    /// Forward declaration per C function name, for helpers that call a
+    /// user function (`sort_by`, `partition`)
+    forward_decls: HashMap<String, String>,
+    /// Small functions that call nothing, defined `static inline` in the
+    /// shared header so calls from every translation unit can be inlined
+    inline_leaves: HashSet<String>,
+    /// Bytes of C emitted per function body, in emission order
+    function_sizes: Vec<(String, usize)>,
+    /// Wrap every function body in the runtime's profiling hooks
+    instrument: bool,
+    /// Blocks being emitted, innermost last, for scope-exit cleanup
+    cleanups: Vec<Cleanup>,
+    /// `region` blocks emitted so far, to name their `gobol_region_t`
+    regions: usize,
+    /// C return type of the function being emitted
+    return_c: String,
+    /// `parallel for` loops outlined so far, to name their body functions
+    parallels: usize,
+    /// Body functions of the `parallel for` loops in the function being
+    /// emitted, placed ahead of it once it is done
+    outlined: String,
+    /// `gobol_opt_<T>` prefixes whose definitions have been emitted
+    opt_types: Vec<String>,
+    /// Parameter types per C function name, for arguments to `T?` params
+    func_params: HashMap<String, Vec<DataType>>,
+    /// Return type of the function being emitted
+    return_ty: DataType,
+    /// The next expression is emitted as its `T?` itself, not its value
+    raw_opt: bool,
 }
 
 impl CodeGenC {
@@ -19,13 +106,139 @@ impl CodeGenC {
             generated_functions: Vec::new(),
             vars: HashMap::new(),
             structs: Vec::new(),
+            struct_fields: HashMap::new(),
+            func_returns: HashMap::new(),
+            array_types: Vec::new(),
+            array_defs: String::new(),
+            array_defs_at: None,
+            writes: HashMap::new(),
+            len_aliases: HashMap::new(),
+            safe_indices: Vec::new(),
+            current_body: None,
+            param_passing: HashMap::new(),
+            ctors: HashSet::new(),
+            ref_params: HashSet::new(),
+            in_ctor: false,
+            forward_decls: HashMap::new(),
+            inline_leaves: HashSet::new(),
+            function_sizes: Vec::new(),
+            instrument: false,
+            cleanups: Vec::new(),
+            regions: 0,
+            return_c: String::new(),
+            parallels: 0,
+            outlined: String::new(),
+            opt_types: Vec::new(),
+            func_params: HashMap::new(),
+            return_ty: DataType::None_,
+            raw_opt: false,
         }
     }
 
+    /// Bracket every function body with `GOBOL_PROF_BEGIN` / `GOBOL_PROF_END`
+    /// (`gobol --instrument`): the runtime counts calls and time per call
+    /// stack and reports them, under gobol names and lines, at exit.
+    pub fn set_instrument(&mut self, instrument: bool) {
+        self.instrument = instrument;
+    }
+
+    /// Bytes of C emitted for each function by the last `generate` or
+    /// `generate_units` (for `--time-report`).
+    pub fn function_sizes(&self) -> &[(String, usize)] {
+        &self.function_sizes
+    }
+
     pub fn generate(&mut self, ir: &GobolIR) -> String {
+        self.emit_prologue(ir);
+        // bodies
+        for f in &ir.functions {
+            if f.name != "main" { self.emit_function(f); }
+        }
+        for imp in &ir.impls {
+            for m in &imp.methods { self.emit_function(m); }
+        }
+        self.emit_entry_point(ir);
+        let mut out = std::mem::take(&mut self.output);
+        if let Some(at) = self.array_defs_at.take() {
+            out.insert_str(at, &std::mem::take(&mut self.array_defs));
+        }
+        out
+    }
+
+    /// Split the program into one translation unit per Gobol module plus a
+    /// shared header (`header_name`) of runtime declarations, struct and
+    /// array typedefs and forward declarations.  Functions go to the unit
+    /// of their module prefix (`math.add` → `math`); the main program,
+    /// methods and `main` go to the unit with an empty module name, which
+    /// always comes first.
+    pub fn generate_units(&mut self, ir: &GobolIR, header_name: &str) -> CUnits {
+        self.emit_prologue(ir);
+        let mut header = std::mem::take(&mut self.output);
+
+        let mut units: Vec<CUnit> = vec![CUnit { module: String::new(), source: String::new() }];
+        for f in &ir.functions {
+            if f.name == "main" { continue; }
+            let module = Self::module_of(&f.name);
+            let at = match units.iter().position(|u| u.module == module) {
+                Some(at) => at,
+                None => {
+                    units.push(CUnit { module: module.to_string(), source: String::new() });
+                    units.len() - 1
+                }
+            };
+            self.output = std::mem::take(&mut units[at].source);
+            self.emit_function(f);
+            units[at].source = std::mem::take(&mut self.output);
+        }
+        self.output = std::mem::take(&mut units[0].source);
+        for imp in &ir.impls {
+            for m in &imp.methods { self.emit_function(m); }
+        }
+        self.emit_entry_point(ir);
+        units[0].source = std::mem::take(&mut self.output);
+
+        // Array types first seen in a body still belong in the header
+        if let Some(at) = self.array_defs_at.take() {
+            header.insert_str(at, &std::mem::take(&mut self.array_defs));
+        }
+        let guard: String = header_name.chars()
+            .map(|c| if c.is_ascii_alphanumeric() { c.to_ascii_uppercase() } else { '_' })
+            .collect();
+        let header = format!("#ifndef GOBOL_{g}\n#define GOBOL_{g}\n\n{}#endif\n", header, g = guard);
+
+        // Modules whose functions are all provided by C companions emit nothing
+        units.retain(|u| u.module.is_empty() || !u.source.is_empty());
+        for u in &mut units {
+            u.source = format!("#include \"{}\"\n\n{}", header_name, u.source);
+        }
+        CUnits { header, units }
+    }
+
+    /// Headers, struct and array definitions and forward declarations
+    /// shared by `generate` and `generate_units`.
+    fn emit_prologue(&mut self, ir: &GobolIR) {
         self.emit_headers();
-        self.emit_builtins();
-        for s in &ir.structs { self.structs.push(s.name.clone()); self.emit_struct(s); }
+        for s in &ir.structs {
+            self.structs.push(s.name.clone());
+            self.struct_fields.insert(s.name.clone(), s.fields.iter().map(|f| (f.name.clone(), f.ty.clone())).collect());
+            self.emit_struct(s);
+        }
+        // Every struct is defined from here on, so any array type can be.
+        self.array_defs_at = Some(self.output.len());
+        for f in ir.functions.iter().chain(ir.impls.iter().flat_map(|imp| imp.methods.iter())) {
+            if !matches!(f.return_type, DataType::None_ | DataType::Unknown) {
+                self.func_returns.insert(Self::c_func_name(&f.name), f.return_type.clone());
+            }
+            for p in &f.params {
+                self.use_array_type(&p.ty);
+                self.use_opt_type(&p.ty);
+            }
+            self.use_array_type(&f.return_type);
+            self.use_opt_type(&f.return_type);
+            self.func_params.insert(Self::c_func_name(&f.name), f.params.iter().map(|p| p.ty.clone()).collect());
+        }
+        self.plan_struct_params(ir);
+        self.plan_inline_leaves(ir);
         // forward-declare all user functions (including methods)
         for f in &ir.functions {
             if f.name != "main" { self.emit_forward_decl(f); }
@@ -34,27 +247,114 @@ impl CodeGenC {
             for m in &imp.methods { self.emit_forward_decl(m); }
         }
         self.emit_line("");
-        // bodies
-        for f in &ir.functions {
-            if f.name != "main" { self.emit_function(f); }
+        // Leaves are defined here, once for every unit, and skipped later
+        for f in ir.functions.iter().chain(ir.impls.iter().flat_map(|imp| imp.methods.iter())) {
+            if self.inline_leaves.contains(&Self::c_func_name(&f.name)) { self.emit_function(f); }
         }
-        for imp in &ir.impls {
-            for m in &imp.methods { self.emit_function(m); }
+    }
+
+    /// Pick the functions `emit_prologue` defines `static inline`: at most
+    /// four statements, no loops or regions and no calls, so inlining them
+    /// never grows a caller by much.  Instrumented builds keep every
+    /// function out of line for its profiling site.
+    fn plan_inline_leaves(&mut self, ir: &GobolIR) {
+        fn size(b: &IRBlock) -> Option<usize> {
+            let mut n = 0;
+            for stmt in &b.statements {
+                let exprs: Vec<&IRExpr> = match stmt {
+                    IRStmt::Declaration { init, .. } => init.iter().collect(),
+                    IRStmt::Expression(e) | IRStmt::Return(Some(e)) => vec![e],
+                    IRStmt::Assignment { target, value } => vec![target, value],
+                    IRStmt::If { cond, then_block, else_block } => {
+                        n += size(then_block)? + else_block.as_ref().map_or(Some(0), size)?;
+                        vec![cond]
+                    }
+                    IRStmt::Return(None) | IRStmt::Break | IRStmt::Continue => vec![],
+                    IRStmt::Call { .. } | IRStmt::MethodCall { .. } | IRStmt::While { .. }
+                    | IRStmt::For { .. } | IRStmt::Region { .. } => return None,
+                };
+                let mut calls = false;
+                for e in exprs {
+                    visit_expr(e, &mut |x| calls |= matches!(x, IRExpr::Call { .. } | IRExpr::MethodCall { .. }));
+                }
+                if calls { return None; }
+                n += 1;
+            }
+            Some(n)
+        }
+        if self.instrument { return; }
+        for f in ir.functions.iter().chain(ir.impls.iter().flat_map(|imp| imp.methods.iter())) {
+            let c_name = Self::c_func_name(&f.name);
+            if f.is_main || self.ctors.contains(&c_name) { continue; }
+            if f.body.as_ref().and_then(size).map_or(false, |n| n <= 4) {
+                self.inline_leaves.insert(c_name);
+            }
+        }
+    }
+
+    /// Declarations behind `--instrument`.  GCC and Clang close the frame
+    /// with a cleanup variable, MSVC with `__finally`, so every `return`
+    /// leaves it.
+    fn emit_prof_hooks(&mut self) {
+        self.emit_line("typedef struct gobol_prof_site { const char* name; const char* file; int line; uint64_t calls, self, total; int active, seen; } gobol_prof_site_t;");
+        self.emit_line("int gobol_prof_enter(gobol_prof_site_t* site);");
+        self.emit_line("void gobol_prof_leave(int* frame);");
+        self.emit_line("#if defined(_MSC_VER)");
+        self.emit_line("#define GOBOL_PROF_BEGIN(site) gobol_prof_enter(site); __try {");
+        self.emit_line("#define GOBOL_PROF_END } __finally { gobol_prof_leave(NULL); }");
+        self.emit_line("#else");
+        self.emit_line("#define GOBOL_PROF_BEGIN(site) __attribute__((cleanup(gobol_prof_leave))) int gobol_prof_frame_ = gobol_prof_enter(site); {");
+        self.emit_line("#define GOBOL_PROF_END }");
+        self.emit_line("#endif");
+        self.emit_line("");
+    }
+
+    /// The static site of `f`, emitted just before its definition.
+    fn emit_prof_site(&mut self, f: &IRFunction, c_name: &str) {
+        if !self.instrument { return; }
+        let quote = |s: &str| s.replace('\\', "\\\\").replace('"', "\\\"");
+        self.emit_line(&format!(
+            "static gobol_prof_site_t gobol_prof_site_{} = {{ .name = \"{}\", .file = \"{}\", .line = {} }};",
+            c_name, quote(&f.name), quote(&f.file), f.line
+        ));
+    }
+
+    fn emit_prof_begin(&mut self, c_name: &str) {
+        if self.instrument {
+            self.emit_line(&format!("GOBOL_PROF_BEGIN(&gobol_prof_site_{});", c_name));
         }
+    }
+
+    fn emit_prof_end(&mut self) {
+        if self.instrument {
+            self.emit_line("GOBOL_PROF_END");
+        }
+    }
+
+    fn emit_entry_point(&mut self, ir: &GobolIR) {
         let has_main = ir.functions.iter().any(|f| f.is_main);
         if has_main {
             for f in &ir.functions {
-                if f.is_main { self.emit_main_function(f); }
+                if f.is_main {
+                    let start = self.output.len();
+                    self.emit_main_function(f);
+                    self.place_outlined(start);
+                    self.function_sizes.push((f.name.clone(), self.output.len() - start));
+                }
             }
         } else {
             // Stub main when no main function (e.g. library modules)
             self.emit_line("int main(void) { return 0; }");
             self.emit_line("");
         }
-        std::mem::take(&mut self.output)
     }
 
-    // ── headers / builtins ──
+    /// Module part of a qualified function name: `lib.math.add` → `lib.math`.
+    fn module_of(name: &str) -> &str {
+        name.rsplit_once('.').map_or("", |(m, _)| m)
+    }
+
+    // ── headers ──
 
     fn emit_headers(&mut self) {
         self.emit_line("#include <stdio.h>");
@@ -67,42 +367,1155 @@ impl CodeGenC {
         self.emit_line("void println(const char* v);");
         self.emit_line("void print(const char* v);");
         self.emit_line("char* read(void);");
+        self.emit_line("void flush(void);");
         self.emit_line("char* gobol_str_int(int64_t n);");
         self.emit_line("char* gobol_str_float(double f);");
         self.emit_line("char* gobol_str_cat(const char* a, const char* b);");
-        self.emit_line("// array runtime");
-        self.emit_line("typedef struct { int64_t* data; int64_t len; int64_t cap; } gobol_array_t;");
-        self.emit_line("void gobol_array_add(gobol_array_t* arr, int64_t val);");
-        self.emit_line("int64_t gobol_array_len(gobol_array_t* arr);");
-        self.emit_line("int64_t gobol_array_get(gobol_array_t* arr, int64_t i);");
-        self.emit_line("void gobol_array_set(gobol_array_t* arr, int64_t i, int64_t val);");
-        self.emit_line("int64_t gobol_array_get_flat(gobol_array_t* arr, int64_t i, int64_t j);");
-        self.emit_line("void gobol_array_set_flat(gobol_array_t* arr, int64_t i, int64_t j, int64_t val);");
+        self.emit_line("int64_t gobol_str_len(const char* s);");
+        self.emit_line("char* gobol_str_alloc(int64_t len);");
+        self.emit_line("typedef struct gobol_arena_chunk gobol_arena_chunk_t;");
+        self.emit_line("typedef struct { gobol_arena_chunk_t* chunk; size_t used; } gobol_arena_mark_t;");
+        self.emit_line("gobol_arena_mark_t gobol_arena_mark(void);");
+        self.emit_line("void gobol_arena_release(gobol_arena_mark_t m);");
+        self.emit_line("typedef struct { int kind; int64_t len; union { const char* s; int64_t i; double f; } v; } gobol_fmt_piece_t;");
+        self.emit_line("#define GOBOL_FMT_LIT(x, n) { 0, (n), { .s = (x) } }");
+        self.emit_line("#define GOBOL_FMT_S(x) { 0, -1, { .s = (x) } }");
+        self.emit_line("#define GOBOL_FMT_I(x) { 1, 0, { .i = (x) } }");
+        self.emit_line("#define GOBOL_FMT_F(x) { 2, 0, { .f = (x) } }");
+        self.emit_line("char* gobol_str_format(int64_t n, gobol_fmt_piece_t* pieces);");
+        self.emit_line("void gobol_array_reserve(void** data, int64_t* cap, int64_t need, size_t elem_size);");
+        self.emit_line("void* gobol_array_zeroed(int64_t n, size_t elem_size);");
+        self.emit_line("void gobol_array_free(void* data, int64_t cap);");
+        self.emit_line("typedef struct { gobol_arena_mark_t strings; gobol_arena_mark_t arrays; gobol_arena_mark_t outer; } gobol_region_t;");
+        self.emit_line("gobol_region_t gobol_region_enter(void);");
+        self.emit_line("void gobol_region_leave(gobol_region_t r);");
+        self.emit_line("typedef void (*gobol_par_body_t)(void* env, int64_t lo, int64_t hi);");
+        self.emit_line("void gobol_parallel_for(int64_t n, gobol_par_body_t body, void* env);");
+        self.emit_line("void gobol_parallel_lock(void);");
+        self.emit_line("void gobol_parallel_unlock(void);");
+        self.emit_line("#if defined(_MSC_VER) && !defined(__clang__)");
+        self.emit_line("#define GOBOL_TLS __declspec(thread)");
+        self.emit_line("#elif defined(__GNUC__)");
+        self.emit_line("#define GOBOL_TLS _Thread_local __attribute__((tls_model(\"initial-exec\")))");
+        self.emit_line("#else");
+        self.emit_line("#define GOBOL_TLS _Thread_local");
+        self.emit_line("#endif");
+        self.emit_line("// Empty storage of an array, tagged with the region depth it was created at");
+        self.emit_line("extern GOBOL_TLS int gobol_region_depth;");
+        self.emit_line("extern char gobol_array_seeds[];");
+        self.emit_line("static inline void* gobol_array_seed(void) { return gobol_region_depth ? gobol_array_seeds + (gobol_region_depth < 64 ? gobol_region_depth : 64) : NULL; }");
+        self.emit_line("_Noreturn void gobol_index_error(int64_t i, int64_t len);");
+        self.emit_line("_Noreturn void gobol_size_error(int64_t n);");
+        self.emit_line("_Noreturn void gobol_length_error(int64_t a, int64_t b);");
+        self.emit_line("// Build with -DGOBOL_NO_BOUNDS_CHECK to compile the index checks out.");
+        self.emit_line("#ifndef GOBOL_NO_BOUNDS_CHECK");
+        self.emit_line("#define GOBOL_BOUNDS_CHECK(i, n) do { if ((uint64_t)(i) >= (uint64_t)(n)) gobol_index_error((i), (n)); } while (0)");
+        self.emit_line("#else");
+        self.emit_line("#define GOBOL_BOUNDS_CHECK(i, n) ((void)0)");
+        self.emit_line("#endif");
         self.emit_line("");
+        if self.instrument {
+            self.emit_prof_hooks();
+        }
+        self.emit_range_type();
     }
 
-    fn emit_builtins(&mut self) {
-        self.emit_line("void gobol_print(const char* s) { printf(\"%s\", s); }");
+    // ── ranges ──
+
+    /// `range` values are plain (start, end, step) triples; `for` over one
+    /// is a counted loop, and nothing is ever materialized into an array.
+    fn emit_range_type(&mut self) {
+        self.emit_line("typedef struct { int64_t start; int64_t end; int64_t step; } gobol_range_t;");
+        self.emit_line("static inline gobol_range_t gobol_range(int64_t start, int64_t end, int64_t step) { gobol_range_t r = { start, end, step }; return r; }");
+        self.emit_line("static inline int64_t gobol_range_start(gobol_range_t r) { return r.start; }");
+        self.emit_line("static inline int64_t gobol_range_end(gobol_range_t r) { return r.end; }");
+        self.emit_line("static inline int64_t gobol_range_step(gobol_range_t r) { return r.step; }");
+        self.emit_line("static inline int64_t gobol_range_len(gobol_range_t r) {");
+        self.emit_line("    if (r.step > 0) return r.end > r.start ? (r.end - r.start + r.step - 1) / r.step : 0;");
+        self.emit_line("    if (r.step < 0) return r.start > r.end ? (r.start - r.end - r.step - 1) / -r.step : 0;");
+        self.emit_line("    return 0;");
+        self.emit_line("}");
+        self.emit_line("static inline bool gobol_range_contains(gobol_range_t r, int64_t v) {");
+        self.emit_line("    if (r.step > 0) return v >= r.start && v < r.end && (v - r.start) % r.step == 0;");
+        self.emit_line("    if (r.step < 0) return v <= r.start && v > r.end && (v - r.start) % r.step == 0;");
+        self.emit_line("    return false;");
+        self.emit_line("}");
         self.emit_line("");
-        self.emit_line("char* gobol_read(void) {");
+    }
+
+    /// Whether `dt` is the built-in range (a user struct may shadow the name).
+    fn is_range_type(&self, dt: &DataType) -> bool {
+        matches!(dt, DataType::Struct(n) if n == "range" && !self.structs.contains(n))
+    }
+
+    /// Arguments of a direct `range(...)` / `a..b` call.
+    fn range_call_args<'e>(&self, e: &'e IRExpr) -> Option<&'e [IRExpr]> {
+        match e {
+            IRExpr::Call { func, args, .. } if func == "range" && !self.func_returns.contains_key("range") => Some(args),
+            _ => None,
+        }
+    }
+
+    fn int_literal(e: &IRExpr) -> Option<i64> {
+        match e {
+            IRExpr::Literal(LitValue::Int(n)) => Some(*n),
+            IRExpr::Unary { op, operand } if op == "-" => Self::int_literal(operand).and_then(|n| n.checked_neg()),
+            _ => None,
+        }
+    }
+
+    /// `(start, end, step)` of a range call; `range(n)` counts from 0.
+    fn range_parts(args: &[IRExpr]) -> (IRExpr, IRExpr, IRExpr) {
+        let one = IRExpr::Literal(LitValue::Int(1));
+        match args {
+            [end] => (IRExpr::Literal(LitValue::Int(0)), end.clone(), one),
+            [start, end] => (start.clone(), end.clone(), one),
+            [start, end, step, ..] => (start.clone(), end.clone(), step.clone()),
+            [] => (IRExpr::Literal(LitValue::Int(0)), IRExpr::Literal(LitValue::Int(0)), one),
+        }
+    }
+
+    /// `for v in <range>` (or `for i, v in <range>`, `i` counting from 0).
+    /// A direct call with a literal step becomes `for (v = a; v < b; v += k)`
+    /// (`>` for a negative step); the bound is evaluated once up front
+    /// unless it's a literal or a variable the body never writes.  Any
+    /// other range value is copied and walked by its own step.
+    fn emit_range_for(&mut self, loop_var: &str, idx_var: Option<&str>, iterable: &IRExpr, body: &IRBlock) {
+        let idx_init = idx_var.map_or(String::new(), |iv| format!(", {} = 0", iv));
+        let idx_step = idx_var.map_or(String::new(), |iv| format!(", {}++", iv));
+        let direct = self.range_call_args(iterable).map(Self::range_parts);
+        let step = direct.as_ref().and_then(|(_, _, step)| Self::int_literal(step)).filter(|k| *k != 0);
+        let mut scoped = true;
+        let mut fact = None;
+        match (direct, step) {
+            (Some((start, end, _)), Some(k)) => {
+                let mut body_writes = HashMap::new();
+                self.count_writes(body, &mut body_writes);
+                let stable = match &end {
+                    IRExpr::Literal(_) => true,
+                    IRExpr::Variable(n) => !body_writes.contains_key(n),
+                    _ => false,
+                };
+                scoped = !stable;
+                if scoped {
+                    self.emit_line("{");
+                    self.indent += 1;
+                    self.emit("int64_t _end = ");
+                    self.emit_expression(&end);
+                    self.emit_line(";");
+                }
+                self.emit(&format!("for (int64_t {} = ", loop_var));
+                self.emit_expression(&start);
+                self.emit(&idx_init);
+                self.emit(&format!("; {} {} ", loop_var, if k > 0 { "<" } else { ">" }));
+                if scoped { self.emit("_end"); } else { self.emit_expression(&end); }
+                let advance = match k {
+                    1 => format!("{}++", loop_var),
+                    -1 => format!("{}--", loop_var),
+                    k if k > 0 => format!("{} += {}", loop_var, k),
+                    k => format!("{} -= {}", loop_var, k.unsigned_abs()),
+                };
+                self.emit(&format!("; {}{})", advance, idx_step));
+                self.emit_line(" {");
+                // An ascending loop stays below its bound whatever the step
+                if k > 0 {
+                    if let Some(args) = self.range_call_args(iterable) {
+                        fact = self.range_fact(loop_var, args, body);
+                    }
+                }
+            }
+            (direct, _) => {
+                self.emit_line("{");
+                self.indent += 1;
+                self.emit("gobol_range_t _r = ");
+                match direct {
+                    Some((start, end, step)) => {
+                        self.emit("gobol_range(");
+                        self.emit_expression(&start);
+                        self.emit(", ");
+                        self.emit_expression(&end);
+                        self.emit(", ");
+                        self.emit_expression(&step);
+                        self.emit(")");
+                    }
+                    None => self.emit_expression(iterable),
+                }
+                self.emit_line(";");
+                self.emit_line(&format!(
+                    "for (int64_t {v} = _r.start{}; _r.step > 0 ? {v} < _r.end : (_r.step < 0 && {v} > _r.end); {v} += _r.step{}) {{",
+                    idx_init, idx_step, v = loop_var
+                ));
+            }
+        }
+        self.indent += 1;
+        self.vars.insert(loop_var.to_string(), DataType::Int);
+        if let Some(iv) = idx_var { self.vars.insert(iv.to_string(), DataType::Int); }
+        let proven = fact.is_some();
+        if let Some(f) = fact { self.safe_indices.push(f); }
+        self.emit_loop_body(body);
+        if proven { self.safe_indices.pop(); }
+        self.indent -= 1;
+        self.emit_line("}");
+        if scoped {
+            self.indent -= 1;
+            self.emit_line("}");
+        }
+    }
+
+    // ── parallel for ──
+
+    /// `parallel for`: the body becomes `gobol_par<N>_body(env, lo, hi)`,
+    /// which runs iterations `lo..hi`, and the runtime's pool hands out
+    /// chunks of the iteration space to its threads.  Variables the body
+    /// reads from outside are copied into a `gobol_par<N>_env_t`; the
+    /// analyzer has made sure no iteration writes them.  A reduction is
+    /// accumulated per chunk in a copy of its own (from 0 for `sum`, from
+    /// the variable's value for `min` / `max`) and merged back under the
+    /// pool's lock.
+    fn emit_parallel_for(&mut self, vars: &[String], iterable: &IRExpr, body: &IRBlock, reductions: &[Reduction]) {
+        let n = self.parallels;
+        self.parallels += 1;
+        let env_t = format!("gobol_par{}_env_t", n);
+        let body_fn = format!("gobol_par{}_body", n);
+        let loop_var = if vars.len() >= 2 { vars[1].clone() } else { vars[0].clone() };
+        let idx_var = if vars.len() >= 2 { Some(vars[0].clone()) } else { None };
+        let is_range = self.range_call_args(iterable).is_some() || {
+            let ty = self.infer_type(iterable);
+            self.is_range_type(&ty)
+        };
+        let arr_ty = self.infer_type(iterable);
+        let prefix = if is_range { String::new() } else {
+            self.use_array_type(&arr_ty).unwrap_or_else(|| "gobol_array_int".to_string())
+        };
+
+        // What the body reads from the enclosing function, in a fixed order
+        let mut used = BTreeSet::new();
+        rewrite_block(&mut body.clone(), &mut |e| {
+            if let IRExpr::Variable(v) = e { used.insert(v.clone()); }
+        });
+        let mut declared = HashSet::new();
+        Self::declared_names(body, &mut declared);
+        let captures: Vec<(String, DataType)> = used.into_iter()
+            .filter(|v| !declared.contains(v) && !vars.contains(v) && !reductions.iter().any(|r| &r.var == v))
+            .filter_map(|v| self.vars.get(&v).map(|t| (v.clone(), t.clone())))
+            .collect();
+        let reduced: Vec<(Reduction, String)> = reductions.iter()
+            .map(|r| (r.clone(), self.c_type_name(self.vars.get(&r.var).unwrap_or(&DataType::Int))))
+            .collect();
+
+        // The outlined body, written to its own buffer
+        let saved_output = std::mem::take(&mut self.output);
+        let saved_indent = std::mem::replace(&mut self.indent, 0);
+        let saved_cleanups = std::mem::take(&mut self.cleanups);
+        let saved_refs = self.ref_params.clone();
+        self.emit_line("typedef struct {");
+        self.indent += 1;
+        if is_range {
+            self.emit_line("int64_t _start;");
+            self.emit_line("int64_t _step;");
+        } else {
+            self.emit_line(&format!("{}_t _it;", prefix));
+        }
+        for (v, ty) in &captures {
+            self.emit_line(&format!("{} {};", self.c_type_name(ty), v));
+            self.ref_params.remove(v);
+        }
+        for (r, t) in &reduced {
+            self.emit_line(&format!("{} {};", t, r.var));
+            self.emit_line(&format!("{}* _to_{};", t, r.var));
+            self.ref_params.remove(&r.var);
+        }
+        self.indent -= 1;
+        self.emit_line(&format!("}} {};", env_t));
+        self.emit_line(&format!("static void {}(void* _env, int64_t _lo, int64_t _hi) {{", body_fn));
         self.indent += 1;
-        self.emit_line("static char buf[4096];");
-        self.emit_line("if (fgets(buf, sizeof(buf), stdin)) {");
+        self.emit_line(&format!("{}* _e = _env;", env_t));
+        for (v, ty) in &captures {
+            self.emit_line(&format!("{} {} = _e->{};", self.c_type_name(ty), v, v));
+        }
+        for (r, t) in &reduced {
+            let init = if r.op == "sum" { "0".to_string() } else { format!("_e->{}", r.var) };
+            self.emit_line(&format!("{} {} = {};", t, r.var, init));
+        }
+        self.emit_line("for (int64_t _k = _lo; _k < _hi; _k++) {");
         self.indent += 1;
-        self.emit_line("size_t len = strlen(buf);");
-        self.emit_line("if (len > 0 && buf[len-1] == '\\n') buf[len-1] = '\\0';");
-        self.emit_line("return buf;");
+        if let Some(iv) = &idx_var {
+            self.emit_line(&format!("int64_t {} = _k;", iv));
+            self.vars.insert(iv.clone(), DataType::Int);
+        }
+        let mut fact = None;
+        if is_range {
+            self.emit_line(&format!("int64_t {} = _e->_start + _k * _e->_step;", loop_var));
+            self.vars.insert(loop_var.clone(), DataType::Int);
+            // An ascending range keeps its value below the bound
+            if let Some(args) = self.range_call_args(iterable) {
+                let (_, _, step) = Self::range_parts(args);
+                if Self::int_literal(&step).map_or(false, |k| k > 0) {
+                    fact = self.range_fact(&loop_var, args, body);
+                }
+            }
+        } else {
+            let nd = Self::array_rank(&arr_ty) > 1;
+            let et = match &arr_ty {
+                DataType::Array(inner) => inner.as_ref().clone(),
+                _ => DataType::Int,
+            };
+            if nd { self.use_array_type(&et); }
+            let read = if nd { "row" } else { "get_unchecked" };
+            self.emit_line(&format!("{} {} = {}_{}(&_e->_it, _k);", self.c_type_name(&et), loop_var, prefix, read));
+            self.vars.insert(loop_var.clone(), et);
+            if let (Some(iv), IRExpr::Variable(arr)) = (&idx_var, iterable) {
+                let mut body_writes = HashMap::new();
+                self.count_writes(body, &mut body_writes);
+                if self.written_once(arr) && !body_writes.contains_key(iv) {
+                    fact = Some((iv.clone(), arr.clone(), 0, 0));
+                }
+            }
+        }
+        let proven = fact.is_some();
+        if let Some(f) = fact { self.safe_indices.push(f); }
+        self.emit_loop_body(body);
+        if proven { self.safe_indices.pop(); }
         self.indent -= 1;
         self.emit_line("}");
-        self.emit_line("return \"\";");
+        if !reduced.is_empty() {
+            self.emit_line("gobol_parallel_lock();");
+            for (r, _) in &reduced {
+                match r.op.as_str() {
+                    "sum" => self.emit_line(&format!("*_e->_to_{v} += {v};", v = r.var)),
+                    op => self.emit_line(&format!(
+                        "if ({v} {} *_e->_to_{v}) *_e->_to_{v} = {v};",
+                        if op == "min" { "<" } else { ">" }, v = r.var
+                    )),
+                }
+            }
+            self.emit_line("gobol_parallel_unlock();");
+        }
         self.indent -= 1;
         self.emit_line("}");
         self.emit_line("");
+        let code = std::mem::replace(&mut self.output, saved_output);
+        self.outlined.push_str(&code);
+        self.indent = saved_indent;
+        self.cleanups = saved_cleanups;
+        self.ref_params = saved_refs;
+
+        // The call: fill in the environment and run the loop
+        self.emit_line("{");
+        self.indent += 1;
+        self.emit_line(&format!("{} _pe;", env_t));
+        if is_range {
+            self.emit("gobol_range_t _r = ");
+            self.emit_expression(iterable);
+            self.emit_line(";");
+            self.emit_line("_pe._start = _r.start;");
+            self.emit_line("_pe._step = _r.step;");
+        } else {
+            self.emit("_pe._it = ");
+            self.emit_expression(iterable);
+            self.emit_line(";");
+        }
+        for (v, _) in &captures {
+            self.emit(&format!("_pe.{} = ", v));
+            self.emit_expression(&IRExpr::Variable(v.clone()));
+            self.emit_line(";");
+        }
+        for (r, _) in &reduced {
+            let var = IRExpr::Variable(r.var.clone());
+            self.emit(&format!("_pe.{} = ", r.var));
+            self.emit_expression(&var);
+            self.emit_line(";");
+            self.emit(&format!("_pe._to_{} = &", r.var));
+            self.emit_expression(&var);
+            self.emit_line(";");
+        }
+        let count = if is_range { "gobol_range_len(_r)".to_string() } else { format!("{}_len(&_pe._it)", prefix) };
+        self.emit_line(&format!("gobol_parallel_for({}, {}, &_pe);", count, body_fn));
+        self.indent -= 1;
+        self.emit_line("}");
+    }
+
+    /// Every name declared in `b`, nested blocks and loop variables included.
+    fn declared_names(b: &IRBlock, out: &mut HashSet<String>) {
+        for s in &b.statements {
+            match s {
+                IRStmt::Declaration { name, .. } => { out.insert(name.clone()); }
+                IRStmt::If { then_block, else_block, .. } => {
+                    Self::declared_names(then_block, out);
+                    if let Some(eb) = else_block { Self::declared_names(eb, out); }
+                }
+                IRStmt::While { body, .. } | IRStmt::Region { body } => Self::declared_names(body, out),
+                IRStmt::For { vars, body, .. } => {
+                    out.extend(vars.iter().cloned());
+                    Self::declared_names(body, out);
+                }
+                _ => {}
+            }
+        }
+    }
+
+    // ── nullable ──
+
+    /// `gobol_opt_<T>` for a nullable scalar or struct, which is held inline
+    /// as `{ bool has; T val; }`: no allocation, and `null` is `has == false`
+    /// rather than a value of `T`.  A `str?` stays a pointer that may be NULL.
+    fn opt_prefix(&self, dt: &DataType) -> Option<String> {
+        let DataType::Nullable(inner) = dt else { return None };
+        match inner.as_ref() {
+            DataType::Int | DataType::Float | DataType::Bool => Some(format!("gobol_opt_{}", self.array_suffix(inner))),
+            DataType::Struct(name) if self.structs.contains(name) => Some(format!("gobol_opt_{}", name)),
+            _ => None,
+        }
+    }
+
+    /// Makes sure the C type of an inline nullable exists (see `use_array_type`).
+    fn use_opt_type(&mut self, dt: &DataType) {
+        let Some(prefix) = self.opt_prefix(dt) else { return };
+        if self.opt_types.contains(&prefix) { return; }
+        let DataType::Nullable(inner) = dt else { return };
+        let def = format!("typedef struct {{ bool has; {} val; }} {}_t;\n", self.c_type_name(inner), prefix);
+        self.opt_types.push(prefix);
+        if self.array_defs_at.is_some() { self.array_defs.push_str(&def); }
+        else { self.output.push_str(&def); }
+    }
+
+    /// The inline nullable type of `e`, for the expressions that can have one.
+    fn opt_of(&self, e: &IRExpr) -> Option<String> {
+        if self.opt_types.is_empty() { return None; }
+        match e {
+            IRExpr::Variable(_) | IRExpr::MemberAccess { .. } | IRExpr::Call { .. } | IRExpr::MethodCall { .. } => {
+                self.opt_prefix(&self.infer_type(e))
+            }
+            _ => None,
+        }
+    }
+
+    /// `e` as a value of type `ty`: a `T?` is built from `null` or a `T`,
+    /// and copied as is from another `T?`.
+    fn emit_as(&mut self, ty: &DataType, e: &IRExpr) {
+        let Some(prefix) = self.opt_prefix(ty) else { return self.emit_expression(e) };
+        match e {
+            IRExpr::Literal(LitValue::None) => self.emit(&format!("({}_t){{0}}", prefix)),
+            _ if self.opt_of(e).as_ref() == Some(&prefix) => {
+                self.raw_opt = true;
+                self.emit_expression(e);
+            }
+            _ => {
+                self.emit(&format!("({}_t){{ true, ", prefix));
+                self.emit_expression(e);
+                self.emit(" }");
+            }
+        }
+    }
+
+    /// The side of `a == null` / `a != null` that is an inline nullable.
+    fn null_test<'e>(&self, left: &'e IRExpr, right: &'e IRExpr) -> Option<&'e IRExpr> {
+        match (left, right) {
+            (IRExpr::Literal(LitValue::None), e) | (e, IRExpr::Literal(LitValue::None)) if self.opt_of(e).is_some() => Some(e),
+            _ => None,
+        }
+    }
+
+    // ── arrays ──
+
+    /// Innermost element type of an (N-dimensional) array type.
+    fn array_scalar(dt: &DataType) -> &DataType {
+        match dt {
+            DataType::Array(elem) => Self::array_scalar(elem),
+            _ => dt,
+        }
+    }
+
+    /// Number of dimensions: `int[]` is 1, `int[3][4]` is 2.
+    fn array_rank(dt: &DataType) -> usize {
+        match dt {
+            DataType::Array(elem) => 1 + Self::array_rank(elem),
+            DataType::Nullable(inner) => Self::array_rank(inner),
+            _ => 0,
+        }
+    }
+
+    fn array_suffix(&self, elem: &DataType) -> String {
+        match elem {
+            DataType::Float => "float".to_string(),
+            DataType::Bool => "bool".to_string(),
+            DataType::Str => "str".to_string(),
+            DataType::Struct(name) if self.structs.contains(name) => name.clone(),
+            DataType::Struct(_) => "ptr".to_string(),
+            DataType::Nullable(inner) => self.array_suffix(inner),
+            _ => "int".to_string(),
+        }
+    }
+
+    /// `gobol_array_<T>` for growable 1-D arrays, `gobol_array<N>_<T>` for
+    /// N-dimensional ones.
+    fn array_prefix(&self, dt: &DataType) -> String {
+        let sfx = self.array_suffix(Self::array_scalar(dt));
+        match Self::array_rank(dt) {
+            1 => format!("gobol_array_{}", sfx),
+            rank => format!("gobol_array{}_{}", rank, sfx),
+        }
+    }
+
+    /// Makes sure the C type and inline accessors exist for an array type
+    /// and returns its prefix.  Definitions are written in place while
+    /// structs are still being emitted (for array fields) and collected for
+    /// the post-struct splice afterwards.
+    fn use_array_type(&mut self, dt: &DataType) -> Option<String> {
+        match dt {
+            DataType::Nullable(inner) => self.use_array_type(inner),
+            DataType::Array(inner) => {
+                let prefix = self.array_prefix(dt);
+                if !self.array_types.contains(&prefix) {
+                    let rank = Self::array_rank(dt);
+                    // rows of an N-D array are (N-1)-D arrays
+                    let row = if rank > 1 { self.use_array_type(inner) } else { None };
+                    self.array_types.push(prefix.clone());
+                    let t = self.c_type_name(Self::array_scalar(dt));
+                    let def = match row {
+                        Some(row) => Self::nd_array_definition(&prefix, &t, rank, &row),
+                        None => Self::array_definition(&prefix, &t) + &Self::array_bulk_definition(&prefix, &t, Self::array_scalar(dt)),
+                    };
+                    if self.array_defs_at.is_some() { self.array_defs.push_str(&def); }
+                    else { self.output.push_str(&def); }
+                }
+                Some(prefix)
+            }
+            _ => None,
+        }
+    }
+
+    /// 1-D array: a growable buffer.  `cap < 0` marks storage the array
+    /// doesn't own (a stack buffer or a row of an N-D array), which can be
+    /// indexed but not grown.
+    fn array_definition(p: &str, t: &str) -> String {
+        let mut d = String::new();
+        d.push_str(&format!("typedef struct {{ {t}* data; int64_t len; int64_t cap; }} {p}_t;\n"));
+        d.push_str(&format!("static inline {p}_t {p}_from(int64_t n, {t} const* src) {{\n"));
+        d.push_str(&format!("    {p}_t a = {{ gobol_array_seed(), 0, 0 }};\n"));
+        d.push_str(&format!("    gobol_array_reserve((void**)&a.data, &a.cap, n, sizeof({t}));\n"));
+        d.push_str(&format!("    memcpy(a.data, src, (size_t)n * sizeof({t}));\n"));
+        d.push_str("    a.len = n;\n");
+        d.push_str("    return a;\n");
+        d.push_str("}\n");
+        d.push_str(&format!("static inline {p}_t {p}_wrap({t}* data, int64_t n) {{ {p}_t a = {{ data, n, -1 }}; return a; }}\n"));
+        d.push_str(&format!("static inline {p}_t {p}_new(int64_t n) {{ {p}_t a = {{ gobol_array_zeroed(n, sizeof({t})), n, n }}; return a; }}\n"));
+        d.push_str(&format!("static inline void {p}_add({p}_t* a, {t} v) {{\n"));
+        d.push_str(&format!("    if (a->len >= a->cap) gobol_array_reserve((void**)&a->data, &a->cap, a->len + 1, sizeof({t}));\n"));
+        d.push_str("    a->data[a->len++] = v;\n");
+        d.push_str("}\n");
+        d.push_str(&format!("static inline int64_t {p}_len(const {p}_t* a) {{ return a->len; }}\n"));
+        d.push_str(&format!("static inline {t} {p}_get(const {p}_t* a, int64_t i) {{ GOBOL_BOUNDS_CHECK(i, a->len); return a->data[i]; }}\n"));
+        d.push_str(&format!("static inline void {p}_set({p}_t* a, int64_t i, {t} v) {{ GOBOL_BOUNDS_CHECK(i, a->len); a->data[i] = v; }}\n"));
+        d.push_str(&format!("static inline {t} {p}_get_unchecked(const {p}_t* a, int64_t i) {{ return a->data[i]; }}\n"));
+        d.push_str(&format!("static inline void {p}_set_unchecked({p}_t* a, int64_t i, {t} v) {{ a->data[i] = v; }}\n"));
+        d.push('\n');
+        d
+    }
+
+    /// Bulk operations of a 1-D array.  Int and float arrays hand their
+    /// storage to the runtime kernels; the rest loop inline.  `copy_from`
+    /// overwrites the first `b.len()` elements, growing `a` if it's shorter.
+    fn array_bulk_definition(p: &str, t: &str, elem: &DataType) -> String {
+        let kernel = match t { "int64_t" => Some("i64"), "double" => Some("f64"), _ => None };
+        let mut d = String::new();
+        if let Some(k) = kernel {
+            d.push_str(&format!("{t} gobol_kernel_sum_{k}(const {t}* a, int64_t n);\n"));
+            d.push_str(&format!("{t} gobol_kernel_dot_{k}(const {t}* a, const {t}* b, int64_t n);\n"));
+            d.push_str(&format!("{t} gobol_kernel_min_{k}(const {t}* a, int64_t n);\n"));
+            d.push_str(&format!("{t} gobol_kernel_max_{k}(const {t}* a, int64_t n);\n"));
+            d.push_str(&format!("void gobol_kernel_add_scalar_{k}({t}* a, int64_t n, {t} k);\n"));
+            d.push_str(&format!("void gobol_kernel_fill_{k}({t}* a, int64_t n, {t} v);\n"));
+            d.push_str(&format!("int64_t gobol_kernel_find_{k}(const {t}* a, int64_t n, {t} v);\n"));
+            d.push_str(&format!("static inline {t} {p}_sum(const {p}_t* a) {{ return gobol_kernel_sum_{k}(a->data, a->len); }}\n"));
+            d.push_str(&format!("static inline {t} {p}_dot(const {p}_t* a, const {p}_t* b) {{\n"));
+            d.push_str("    if (a->len != b->len) gobol_length_error(a->len, b->len);\n");
+            d.push_str(&format!("    return gobol_kernel_dot_{k}(a->data, b->data, a->len);\n"));
+            d.push_str("}\n");
+            for op in ["min", "max"] {
+                d.push_str(&format!("static inline {t} {p}_{op}(const {p}_t* a) {{ if (a->len == 0) gobol_index_error(0, 0); return gobol_kernel_{op}_{k}(a->data, a->len); }}\n"));
+            }
+            d.push_str(&format!("static inline void {p}_map_add_scalar({p}_t* a, {t} k) {{ gobol_kernel_add_scalar_{k}(a->data, a->len, k); }}\n"));
+            d.push_str(&format!("static inline void {p}_fill({p}_t* a, {t} v) {{ gobol_kernel_fill_{k}(a->data, a->len, v); }}\n"));
+            d.push_str(&format!("static inline int64_t {p}_find(const {p}_t* a, {t} v) {{ return gobol_kernel_find_{k}(a->data, a->len, v); }}\n"));
+        } else {
+            d.push_str(&format!("static inline void {p}_fill({p}_t* a, {t} v) {{ for (int64_t i = 0; i < a->len; i++) a->data[i] = v; }}\n"));
+            let eq = match elem {
+                DataType::Str => Some("strcmp(a->data[i], v) == 0"),
+                DataType::Struct(_) => None,
+                _ => Some("a->data[i] == v"),
+            };
+            if let Some(eq) = eq {
+                d.push_str(&format!("static inline int64_t {p}_find(const {p}_t* a, {t} v) {{\n"));
+                d.push_str(&format!("    for (int64_t i = 0; i < a->len; i++) {{ if ({eq}) return i; }}\n"));
+                d.push_str("    return -1;\n");
+                d.push_str("}\n");
+            }
+        }
+        d.push_str(&format!("static inline void {p}_copy_from({p}_t* a, const {p}_t* b) {{\n"));
+        d.push_str("    int64_t n = b->len;\n");
+        d.push_str(&format!("    if (n > a->len && n > a->cap) gobol_array_reserve((void**)&a->data, &a->cap, n, sizeof({t}));\n"));
+        d.push_str(&format!("    if (n > 0) memmove(a->data, b->data, (size_t)n * sizeof({t}));\n"));
+        d.push_str("    if (n > a->len) a->len = n;\n");
+        d.push_str("}\n");
+        d.push('\n');
+        d
+    }
+
+    // ── sorting ──
+
+    /// Defines the helper behind `a.sort()`, `a.sort_by(less)`,
+    /// `a.binary_search(v)` or `a.partition(keep)` on array type `p` (once
+    /// per array type and callback) and returns its C name.  Int and float
+    /// arrays sort in the runtime's radix sort, bool arrays by counting, and
+    /// everything else in an introsort specialized to its comparison, so a
+    /// `sort_by` callback is a direct call the C compiler can inline.
+    fn use_array_order(&mut self, p: &str, elem: &DataType, method: &str, callback: Option<&str>) -> String {
+        let name = match callback {
+            Some(c) => format!("{}_{}_{}", p, method, c),
+            None => format!("{}_{}", p, method),
+        };
+        if self.array_types.contains(&name) { return name; }
+        self.array_types.push(name.clone());
+        let t = self.c_type_name(elem);
+        let natural = match elem {
+            DataType::Str => "strcmp(*x, *y) < 0",
+            _ => "*x < *y",
+        };
+        // `callback(x, y)` / `callback(x)` on `const T*` arguments
+        let call = |this: &Self, c: &str, args: &[&str]| -> String {
+            let by_ref = this.passes_by_ref(c, 0);
+            let args: Vec<String> = args.iter().map(|a| if by_ref { a.to_string() } else { format!("*{}", a) }).collect();
+            format!("{}({})", c, args.join(", "))
+        };
+        let mut d = String::new();
+        if let Some(decl) = callback.and_then(|c| self.forward_decls.get(c)) {
+            d.push_str(decl);
+            d.push('\n');
+        }
+        match (method, callback) {
+            ("sort", _) if t == "int64_t" || t == "double" => {
+                let k = if t == "double" { "f64" } else { "i64" };
+                d.push_str(&format!("void gobol_sort_{k}({t}* a, int64_t n);\n"));
+                d.push_str(&format!("static inline void {name}({p}_t* a) {{ gobol_sort_{k}(a->data, a->len); }}\n"));
+            }
+            ("sort", _) if t == "bool" => {
+                d.push_str(&format!("static inline void {name}({p}_t* a) {{\n"));
+                d.push_str("    int64_t falses = 0;\n");
+                d.push_str("    for (int64_t i = 0; i < a->len; i++) falses += !a->data[i];\n");
+                d.push_str("    for (int64_t i = 0; i < a->len; i++) a->data[i] = i >= falses;\n");
+                d.push_str("}\n");
+            }
+            ("sort", _) => d.push_str(&Self::introsort_definition(&name, p, &t, natural)),
+            ("sort_by", Some(c)) => d.push_str(&Self::introsort_definition(&name, p, &t, &call(self, c, &["x", "y"]))),
+            ("partition", Some(c)) => {
+                d.push_str(&format!("static inline bool {name}_keep(const {t}* x) {{ return {}; }}\n", call(self, c, &["x"])));
+                d.push_str(&format!("static inline int64_t {name}({p}_t* a) {{\n"));
+                d.push_str("    int64_t k = 0;\n");
+                d.push_str("    for (int64_t i = 0; i < a->len; i++) {\n");
+                d.push_str(&format!("        if ({name}_keep(&a->data[i])) {{ {t} v = a->data[k]; a->data[k++] = a->data[i]; a->data[i] = v; }}\n"));
+                d.push_str("    }\n");
+                d.push_str("    return k;\n");
+                d.push_str("}\n");
+            }
+            _ => {
+                // binary_search: the first index holding `v` in a sorted array, or -1
+                d.push_str(&format!("static inline bool {name}_less(const {t}* x, const {t}* y) {{ return {natural}; }}\n"));
+                d.push_str(&format!("static inline int64_t {name}(const {p}_t* a, {t} v) {{\n"));
+                d.push_str("    int64_t lo = 0, hi = a->len;\n");
+                d.push_str("    while (lo < hi) {\n");
+                d.push_str("        int64_t mid = lo + (hi - lo) / 2;\n");
+                d.push_str(&format!("        if ({name}_less(&a->data[mid], &v)) lo = mid + 1; else hi = mid;\n"));
+                d.push_str("    }\n");
+                d.push_str(&format!("    return lo < a->len && !{name}_less(&v, &a->data[lo]) ? lo : -1;\n"));
+                d.push_str("}\n");
+            }
+        }
+        d.push('\n');
+        if self.array_defs_at.is_some() { self.array_defs.push_str(&d); } else { self.output.push_str(&d); }
+        name
+    }
+
+    /// Introsort under `less` (a C expression over `const T* x, y`):
+    /// quicksort around a median of three, heapsort once the depth limit
+    /// is reached, insertion sort below 16 elements.  The partition scans
+    /// stay in bounds even when `less` isn't a strict order.
+    fn introsort_definition(n: &str, p: &str, t: &str, less: &str) -> String {
+        let mut d = String::new();
+        d.push_str(&format!("static inline bool {n}_less(const {t}* x, const {t}* y) {{ return {less}; }}\n"));
+        d.push_str(&format!("static inline void {n}_swap({t}* a, int64_t i, int64_t j) {{ {t} v = a[i]; a[i] = a[j]; a[j] = v; }}\n"));
+        d.push_str(&format!("static inline void {n}_sift({t}* a, int64_t i, int64_t n) {{\n"));
+        d.push_str("    for (;;) {\n");
+        d.push_str("        int64_t c = 2 * i + 1;\n");
+        d.push_str("        if (c >= n) return;\n");
+        d.push_str(&format!("        if (c + 1 < n && {n}_less(&a[c], &a[c + 1])) c++;\n"));
+        d.push_str(&format!("        if (!{n}_less(&a[i], &a[c])) return;\n"));
+        d.push_str(&format!("        {n}_swap(a, i, c);\n"));
+        d.push_str("        i = c;\n");
+        d.push_str("    }\n");
+        d.push_str("}\n");
+        d.push_str(&format!("static inline void {n}_run({t}* a, int64_t n, int depth) {{\n"));
+        d.push_str("    while (n > 16) {\n");
+        d.push_str("        if (depth-- == 0) {\n");
+        d.push_str(&format!("            for (int64_t i = n / 2 - 1; i >= 0; i--) {n}_sift(a, i, n);\n"));
+        d.push_str(&format!("            for (int64_t e = n - 1; e > 0; e--) {{ {n}_swap(a, 0, e); {n}_sift(a, 0, e); }}\n"));
+        d.push_str("            return;\n");
+        d.push_str("        }\n");
+        d.push_str("        int64_t m = (n - 1) / 2;\n");
+        d.push_str(&format!("        if ({n}_less(&a[m], &a[0])) {n}_swap(a, 0, m);\n"));
+        d.push_str(&format!("        if ({n}_less(&a[n - 1], &a[0])) {n}_swap(a, 0, n - 1);\n"));
+        d.push_str(&format!("        if ({n}_less(&a[n - 1], &a[m])) {n}_swap(a, m, n - 1);\n"));
+        d.push_str(&format!("        {t} pivot = a[m];\n"));
+        d.push_str("        int64_t i = -1, j = n;\n");
+        d.push_str("        for (;;) {\n");
+        d.push_str(&format!("            do i++; while (i < n - 1 && {n}_less(&a[i], &pivot));\n"));
+        d.push_str(&format!("            do j--; while (j > 0 && {n}_less(&pivot, &a[j]));\n"));
+        d.push_str("            if (i >= j) break;\n");
+        d.push_str(&format!("            {n}_swap(a, i, j);\n"));
+        d.push_str("        }\n");
+        d.push_str("        // recurse into the smaller side, loop on the larger\n");
+        d.push_str("        int64_t k = j + 1;\n");
+        d.push_str(&format!("        if (k < n - k) {{ {n}_run(a, k, depth); a += k; n -= k; }}\n"));
+        d.push_str(&format!("        else {{ {n}_run(a + k, n - k, depth); n = k; }}\n"));
+        d.push_str("    }\n");
+        d.push_str("    for (int64_t i = 1; i < n; i++) {\n");
+        d.push_str(&format!("        {t} v = a[i];\n"));
+        d.push_str("        int64_t j = i;\n");
+        d.push_str(&format!("        for (; j > 0 && {n}_less(&v, &a[j - 1]); j--) a[j] = a[j - 1];\n"));
+        d.push_str("        a[j] = v;\n");
+        d.push_str("    }\n");
+        d.push_str("}\n");
+        d.push_str(&format!("static inline void {n}({p}_t* a) {{\n"));
+        d.push_str("    int depth = 0;\n");
+        d.push_str("    for (int64_t k = a->len; k > 1; k >>= 1) depth += 2;\n");
+        d.push_str(&format!("    {n}_run(a->data, a->len, depth);\n"));
+        d.push_str("}\n");
+        d
+    }
+
+    /// N-D array: one contiguous row-major block with its shape and strides
+    /// in the header.  `a[i][j]` is `data[i * strides[0] + j]`, and `a[i]`
+    /// is a view of row `i` as an (N-1)-D array of type `row`.
+    fn nd_array_definition(p: &str, t: &str, rank: usize, row: &str) -> String {
+        let dims: Vec<String> = (0..rank).map(|k| format!("int64_t d{}", k)).collect();
+        let dim_args: Vec<String> = (0..rank).map(|k| format!("d{}", k)).collect();
+        let idx: Vec<String> = (0..rank).map(|k| format!("int64_t i{}", k)).collect();
+        let idx_args: Vec<String> = (0..rank).map(|k| format!("i{}", k)).collect();
+        let mut d = String::new();
+        d.push_str(&format!("typedef struct {{ {t}* data; int64_t len; int64_t shape[{rank}]; int64_t strides[{rank}]; }} {p}_t;\n"));
+        d.push_str(&format!("static inline {p}_t {p}_wrap({t}* data, {}) {{\n", dims.join(", ")));
+        d.push_str(&format!("    {p}_t a;\n"));
+        for k in 0..rank {
+            d.push_str(&format!("    a.shape[{k}] = d{k};\n"));
+        }
+        d.push_str("    a.len = 1;\n");
+        d.push_str(&format!("    for (int k = {} - 1; k >= 0; k--) {{\n", rank));
+        d.push_str("        if (a.shape[k] < 0) gobol_size_error(a.shape[k]);\n");
+        d.push_str("        a.strides[k] = a.len;\n");
+        d.push_str("        a.len *= a.shape[k];\n");
+        d.push_str("    }\n");
+        d.push_str("    a.data = data;\n");
+        d.push_str("    return a;\n");
+        d.push_str("}\n");
+        d.push_str(&format!("static inline {p}_t {p}_new({}) {{\n", dims.join(", ")));
+        d.push_str(&format!("    {p}_t a = {p}_wrap(NULL, {});\n", dim_args.join(", ")));
+        d.push_str(&format!("    a.data = gobol_array_zeroed(a.len, sizeof({t}));\n"));
+        d.push_str("    return a;\n");
+        d.push_str("}\n");
+        d.push_str(&format!("static inline int64_t {p}_len(const {p}_t* a) {{ return a->shape[0]; }}\n"));
+        d.push_str(&format!("static inline int64_t {p}_index(const {p}_t* a, {}) {{\n", idx.join(", ")));
+        for k in 0..rank {
+            d.push_str(&format!("    GOBOL_BOUNDS_CHECK(i{k}, a->shape[{k}]);\n"));
+        }
+        let terms: Vec<String> = (0..rank - 1).map(|k| format!("i{k} * a->strides[{k}]")).collect();
+        d.push_str(&format!("    return {} + i{};\n", terms.join(" + "), rank - 1));
+        d.push_str("}\n");
+        d.push_str(&format!("static inline {t} {p}_get(const {p}_t* a, {}) {{ return a->data[{p}_index(a, {})]; }}\n", idx.join(", "), idx_args.join(", ")));
+        d.push_str(&format!("static inline void {p}_set({p}_t* a, {}, {t} v) {{ a->data[{p}_index(a, {})] = v; }}\n", idx.join(", "), idx_args.join(", ")));
+        d.push_str(&format!("static inline {row}_t {p}_row(const {p}_t* a, int64_t i) {{\n"));
+        d.push_str("    GOBOL_BOUNDS_CHECK(i, a->shape[0]);\n");
+        if rank == 2 {
+            d.push_str(&format!("    return {row}_wrap(a->data + i * a->strides[0], a->shape[1]);\n"));
+        } else {
+            d.push_str(&format!("    {row}_t r;\n"));
+            d.push_str("    r.data = a->data + i * a->strides[0];\n");
+            d.push_str("    r.len = a->strides[0];\n");
+            d.push_str(&format!("    for (int k = 1; k < {}; k++) {{ r.shape[k - 1] = a->shape[k]; r.strides[k - 1] = a->strides[k]; }}\n", rank));
+            d.push_str("    return r;\n");
+        }
+        d.push_str("}\n");
+        d.push('\n');
+        d
+    }
+
+    /// Array prefix when `e` has an array type.
+    fn array_prefix_of(&mut self, e: &IRExpr) -> Option<String> {
+        let ty = self.infer_type(e);
+        self.use_array_type(&ty)
+    }
+
+    /// Address of an array for the accessors.  Values without an address
+    /// (a row view, a call result) go through a compound literal; they
+    /// still share the underlying storage.
+    fn emit_array_ref(&mut self, e: &IRExpr) {
+        match e {
+            IRExpr::Variable(name) if self.ref_params.contains(name) => self.emit(name),
+            IRExpr::Variable(name) => self.emit(&format!("&{}", name)),
+            IRExpr::MemberAccess { object, .. } if matches!(object.as_ref(), IRExpr::Variable(_)) => {
+                self.emit("&("); self.emit_expression(e); self.emit(")");
+            }
+            _ => {
+                let ct = self.c_type_name(&self.infer_type(e));
+                self.emit(&format!("&({}){{ ", ct)); self.emit_expression(e); self.emit(" }");
+            }
+        }
+    }
+
+    /// `a[i][j]...` → (`a`, [i, j, ...]).
+    fn index_chain(e: &IRExpr) -> (&IRExpr, Vec<&IRExpr>) {
+        match e {
+            IRExpr::ArrayIndex { array, index } => {
+                let (root, mut idxs) = Self::index_chain(array);
+                idxs.push(index);
+                (root, idxs)
+            }
+            _ => (e, Vec::new()),
+        }
+    }
+
+    /// Prefix and root of `e` when it indexes every dimension of an N-D
+    /// array at once, so it can use the flat `_get`/`_set`.
+    fn full_nd_index<'e>(&mut self, e: &'e IRExpr) -> Option<(String, &'e IRExpr, Vec<&'e IRExpr>)> {
+        let (root, idxs) = Self::index_chain(e);
+        let ty = self.infer_type(root);
+        let rank = Self::array_rank(&ty);
+        if rank < 2 || idxs.len() != rank { return None; }
+        Some((self.use_array_type(&ty)?, root, idxs))
+    }
+
+    fn emit_nd_access(&mut self, call: &str, root: &IRExpr, idxs: &[&IRExpr]) {
+        self.emit(&format!("{}(", call));
+        self.emit_array_ref(root);
+        for i in idxs { self.emit(", "); self.emit_expression(i); }
+    }
+
+    /// `arr.add(x)` / `arr.len()` / `arr.get(i)` → the typed inline accessor.
+    fn emit_array_method(&mut self, prefix: &str, object: &IRExpr, method: &str, args: &[IRExpr]) {
+        if matches!(method, "sort" | "sort_by" | "binary_search" | "partition") {
+            let elem = match self.infer_type(object) {
+                DataType::Array(elem) => *elem,
+                _ => DataType::Int,
+            };
+            let callback = match method {
+                "sort_by" | "partition" => args.first().and_then(dotted_path).map(|f| Self::c_func_name(&f)),
+                _ => None,
+            };
+            let name = self.use_array_order(prefix, &elem, method, callback.as_deref());
+            self.emit(&format!("{}(", name));
+            self.emit_array_ref(object);
+            if callback.is_none() {
+                for a in args { self.emit(", "); self.emit_expression(a); }
+            }
+            self.emit(")");
+            return;
+        }
+        self.emit(&format!("{}_{}(", prefix, method));
+        self.emit_array_ref(object);
+        for a in args {
+            self.emit(", ");
+            // array arguments: a.copy_from(b), a.dot(b)
+            if matches!(method, "copy_from" | "dot") { self.emit_array_ref(a); } else { self.emit_expression(a); }
+        }
+        self.emit(")");
+    }
+
+    /// Methods of a 1-D array value (N-D arrays only have `len`).
+    fn is_array_method(method: &str) -> bool {
+        matches!(method, "add" | "len" | "get" | "fill" | "copy_from" | "sum" | "min" | "max" | "dot" | "map_add_scalar" | "find"
+            | "sort" | "sort_by" | "binary_search" | "partition")
+    }
+
+    /// Array literal as a value of array type `dt`, copied out of a C
+    /// compound literal with a single allocation.
+    fn emit_array_literal(&mut self, elems: &[IRExpr], dt: &DataType) {
+        let prefix = self.use_array_type(dt).unwrap_or_else(|| "gobol_array_int".to_string());
+        if elems.is_empty() {
+            self.emit(&format!("({}_t){{ gobol_array_seed(), 0, 0 }}", prefix));
+            return;
+        }
+        let et = self.c_type_name(Self::array_scalar(dt));
+        self.emit(&format!("{}_from({}, ({}[]){{", prefix, elems.len(), et));
+        for (i, el) in elems.iter().enumerate() {
+            if i > 0 { self.emit(", "); }
+            self.emit_expression(el);
+        }
+        self.emit("})");
+    }
+
+    /// Largest fixed-size array (in bytes) given a stack buffer.
+    const STACK_ARRAY_LIMIT: i64 = 64 * 1024;
+
+    /// `var m: T[d0][d1]...;` → zeroed storage with the declared shape.
+    /// When every dimension is a literal, the array is small and `m` is only
+    /// ever indexed, the storage is a stack buffer instead of the heap.
+    fn emit_array_new(&mut self, name: &str, dt: &DataType, dims: &[IRExpr]) {
+        let prefix = match self.use_array_type(dt) { Some(p) => p, None => return };
+        let et = self.c_type_name(Self::array_scalar(dt));
+        let consts: Option<Vec<i64>> = dims.iter()
+            .map(|d| match d { IRExpr::Literal(LitValue::Int(n)) if *n > 0 => Some(*n), _ => None })
+            .collect();
+        let stack_len = consts.map(|c| c.iter().product::<i64>())
+            .filter(|n| n.saturating_mul(Self::c_size_hint(Self::array_scalar(dt))) <= Self::STACK_ARRAY_LIMIT);
+        let on_stack = stack_len.is_some()
+            && dims.len() == Self::array_rank(dt)
+            && self.current_body.as_ref().map_or(false, |b| Self::only_indexed(name, dims.len(), b));
+        if on_stack {
+            self.emit_line(&format!("{} {}_buf[{}] = {{0}};", et, name, stack_len.unwrap_or(1)));
+            self.emit(&format!("{}_t {} = {}_wrap({}_buf, ", prefix, name, prefix, name));
+        } else {
+            self.emit(&format!("{}_t {} = {}_new(", prefix, name, prefix));
+        }
+        for (i, d) in dims.iter().enumerate() {
+            if i > 0 { self.emit(", "); }
+            self.emit_expression(d);
+        }
+        self.emit_line(");");
+    }
+
+    /// Rough element size, only used to cap stack buffers.
+    fn c_size_hint(dt: &DataType) -> i64 {
+        match dt {
+            DataType::Bool => 1,
+            DataType::Struct(_) => 64,
+            _ => 8,
+        }
+    }
+
+    /// Whether every use of array `name` in `b` indexes all of its `rank`
+    /// dimensions or asks for its length.  Nothing can then keep a
+    /// reference to its storage past the end of the function.
+    fn only_indexed(name: &str, rank: usize, b: &IRBlock) -> bool {
+        let ok = |e: &IRExpr| Self::only_indexed_expr(name, rank, e);
+        b.statements.iter().all(|s| match s {
+            IRStmt::Declaration { init, .. } => init.as_ref().map_or(true, ok),
+            IRStmt::Expression(e) | IRStmt::Return(Some(e)) => ok(e),
+            IRStmt::Assignment { target, value } => ok(target) && ok(value),
+            IRStmt::If { cond, then_block, else_block } => {
+                ok(cond) && Self::only_indexed(name, rank, then_block)
+                    && else_block.as_ref().map_or(true, |eb| Self::only_indexed(name, rank, eb))
+            }
+            IRStmt::While { cond, body } => ok(cond) && Self::only_indexed(name, rank, body),
+            IRStmt::For { iterable, body, .. } => ok(iterable) && Self::only_indexed(name, rank, body),
+            IRStmt::Region { body } => Self::only_indexed(name, rank, body),
+            IRStmt::Call { args, .. } => args.iter().all(ok),
+            IRStmt::MethodCall { object, method, args, .. } => {
+                ok(&IRExpr::MethodCall { object: object.clone(), method: method.clone(), args: args.clone(), generic_args: Vec::new() })
+            }
+            IRStmt::Return(None) | IRStmt::Break | IRStmt::Continue => true,
+        })
+    }
+
+    fn only_indexed_expr(name: &str, rank: usize, e: &IRExpr) -> bool {
+        let ok = |e: &IRExpr| Self::only_indexed_expr(name, rank, e);
+        match e {
+            IRExpr::Variable(n) => n != name,
+            IRExpr::ArrayIndex { .. } => {
+                let (root, idxs) = Self::index_chain(e);
+                let rooted_here = matches!(root, IRExpr::Variable(n) if n == name);
+                (!rooted_here || idxs.len() == rank) && (rooted_here || ok(root)) && idxs.into_iter().all(ok)
+            }
+            IRExpr::MethodCall { object, method, args, .. } => {
+                let is_len = method == "len" && args.is_empty() && matches!(object.as_ref(), IRExpr::Variable(n) if n == name);
+                (is_len || ok(object)) && args.iter().all(ok)
+            }
+            IRExpr::Binary { left, right, .. } => ok(left) && ok(right),
+            IRExpr::Unary { operand: x, .. } | IRExpr::Cast { expr: x, .. } | IRExpr::MemberAccess { object: x, .. } => ok(x),
+            IRExpr::Assignment { target, value } => ok(target) && ok(value),
+            IRExpr::Call { args, .. } | IRExpr::ArrayLiteral(args) | IRExpr::ArrayNew { dims: args } => args.iter().all(ok),
+            IRExpr::StructLiteral { fields, .. } => fields.iter().all(|(_, f)| ok(f)),
+            IRExpr::Format(parts) => parts.iter().all(|p| match p { FormatPart::Expr(x) => ok(x), FormatPart::Lit(_) => true }),
+            IRExpr::Literal(_) | IRExpr::None => true,
+        }
+    }
+
+    // ── bounds-check elision ──
+
+    /// Counts how often each name is declared or assigned in `b`.  Loop
+    /// variables count as declarations, so a name written once is bound to
+    /// a single value for its whole scope.
+    /// An array passed to a parameter the callee modifies counts as
+    /// written too.
+    fn count_writes(&self, b: &IRBlock, counts: &mut HashMap<String, usize>) {
+        for s in &b.statements {
+            match s {
+                IRStmt::Declaration { name, init, .. } => {
+                    *counts.entry(name.clone()).or_insert(0) += 1;
+                    if let Some(e) = init { self.count_writes_expr(e, counts); }
+                }
+                IRStmt::Assignment { target, value } => {
+                    if let IRExpr::Variable(n) = target { *counts.entry(n.clone()).or_insert(0) += 1; }
+                    self.count_writes_expr(target, counts);
+                    self.count_writes_expr(value, counts);
+                }
+                IRStmt::Expression(e) | IRStmt::Return(Some(e)) => self.count_writes_expr(e, counts),
+                IRStmt::If { cond, then_block, else_block } => {
+                    self.count_writes_expr(cond, counts);
+                    self.count_writes(then_block, counts);
+                    if let Some(eb) = else_block { self.count_writes(eb, counts); }
+                }
+                IRStmt::While { cond, body } => {
+                    self.count_writes_expr(cond, counts);
+                    self.count_writes(body, counts);
+                }
+                IRStmt::For { vars, iterable, body, .. } => {
+                    for v in vars { *counts.entry(v.clone()).or_insert(0) += 1; }
+                    self.count_writes_expr(iterable, counts);
+                    self.count_writes(body, counts);
+                }
+                IRStmt::Region { body } => self.count_writes(body, counts),
+                IRStmt::Call { func, args, .. } => {
+                    self.count_ref_args(None, func, args, counts);
+                    for a in args { self.count_writes_expr(a, counts); }
+                }
+                IRStmt::MethodCall { object, method, args, .. } => {
+                    self.count_ref_args(Some(object), method, args, counts);
+                    self.count_writes_expr(object, counts);
+                    for a in args { self.count_writes_expr(a, counts); }
+                }
+                IRStmt::Return(None) | IRStmt::Break | IRStmt::Continue => {}
+            }
+        }
+    }
+
+    fn count_ref_args(&self, object: Option<&IRExpr>, callee: &str, args: &[IRExpr], counts: &mut HashMap<String, usize>) {
+        for (i, a) in args.iter().enumerate() {
+            if let IRExpr::Variable(n) = a {
+                if self.arg_is_ref(object, callee, i) { *counts.entry(n.clone()).or_insert(0) += 1; }
+            }
+        }
+    }
+
+    fn count_writes_expr(&self, e: &IRExpr, counts: &mut HashMap<String, usize>) {
+        match e {
+            IRExpr::Assignment { target, value } => {
+                if let IRExpr::Variable(n) = target.as_ref() { *counts.entry(n.clone()).or_insert(0) += 1; }
+                self.count_writes_expr(target, counts);
+                self.count_writes_expr(value, counts);
+            }
+            IRExpr::Binary { left, right, .. } => {
+                self.count_writes_expr(left, counts);
+                self.count_writes_expr(right, counts);
+            }
+            IRExpr::Unary { operand: x, .. } | IRExpr::Cast { expr: x, .. } | IRExpr::MemberAccess { object: x, .. } => {
+                self.count_writes_expr(x, counts);
+            }
+            IRExpr::ArrayIndex { array, index } => {
+                self.count_writes_expr(array, counts);
+                self.count_writes_expr(index, counts);
+            }
+            IRExpr::Call { func, args, .. } => {
+                self.count_ref_args(None, func, args, counts);
+                for a in args { self.count_writes_expr(a, counts); }
+            }
+            IRExpr::ArrayLiteral(args) | IRExpr::ArrayNew { dims: args } => {
+                for a in args { self.count_writes_expr(a, counts); }
+            }
+            IRExpr::MethodCall { object, method, args, .. } => {
+                self.count_ref_args(Some(object), method, args, counts);
+                self.count_writes_expr(object, counts);
+                for a in args { self.count_writes_expr(a, counts); }
+            }
+            IRExpr::StructLiteral { fields, .. } => {
+                for (_, f) in fields { self.count_writes_expr(f, counts); }
+            }
+            IRExpr::Format(parts) => {
+                for p in parts {
+                    if let FormatPart::Expr(x) = p { self.count_writes_expr(x, counts); }
+                }
+            }
+            IRExpr::Literal(_) | IRExpr::Variable(_) | IRExpr::None => {}
+        }
+    }
+
+    /// Resets the range facts for a function about to be emitted.
+    fn begin_function_analysis(&mut self, f: &IRFunction) {
+        self.writes.clear();
+        self.len_aliases.clear();
+        self.safe_indices.clear();
+        for p in &f.params { *self.writes.entry(p.name.clone()).or_insert(0) += 1; }
+        let mut writes = std::mem::take(&mut self.writes);
+        if let Some(b) = &f.body { self.count_writes(b, &mut writes); }
+        self.writes = writes;
+        self.current_body = f.body.clone();
+    }
+
+    fn written_once(&self, name: &str) -> bool {
+        self.writes.get(name).copied() == Some(1)
+    }
+
+    /// The array whose length `e` is, if that length can't change under us:
+    /// `arr.len()` itself or an alias `n` bound by `var n = arr.len()`.
+    fn len_source(&self, e: &IRExpr) -> Option<String> {
+        match e {
+            IRExpr::Variable(n) => self.len_aliases.get(n).cloned(),
+            IRExpr::MethodCall { object, method, args, .. } if method == "len" && args.is_empty() => {
+                match object.as_ref() {
+                    IRExpr::Variable(a) if matches!(self.vars.get(a), Some(DataType::Array(_))) && self.written_once(a) => Some(a.clone()),
+                    _ => None,
+                }
+            }
+            _ => None,
+        }
+    }
+
+    /// Range fact for `for v in lo..(len - k)`: `v` runs over
+    /// `[lo, arr.len() - k)` when `lo` and `k` are non-negative literals,
+    /// the bound is a length that can't change, and the body never
+    /// rebinds `v`.
+    fn range_fact(&self, var: &str, args: &[IRExpr], body: &IRBlock) -> Option<(String, String, i64, i64)> {
+        let lo = match args.first() {
+            Some(IRExpr::Literal(LitValue::Int(n))) if *n >= 0 => *n,
+            _ => return None,
+        };
+        let (bound, k) = match args.get(1)? {
+            IRExpr::Binary { op, left, right } if op == "-" => match right.as_ref() {
+                IRExpr::Literal(LitValue::Int(k)) if *k >= 0 => (left.as_ref(), *k),
+                _ => return None,
+            },
+            e => (e, 0),
+        };
+        let arr = self.len_source(bound)?;
+        let mut body_writes = HashMap::new();
+        self.count_writes(body, &mut body_writes);
+        if body_writes.contains_key(var) { return None; }
+        Some((var.to_string(), arr, lo, k))
+    }
+
+    /// Whether `array[index]` is proven in bounds by an enclosing loop.
+    fn index_is_safe(&self, array: &IRExpr, index: &IRExpr) -> bool {
+        let arr = match array { IRExpr::Variable(a) => a, _ => return false };
+        let (var, off) = match index {
+            IRExpr::Variable(v) => (v, 0),
+            IRExpr::Binary { op, left, right } => match (op.as_str(), left.as_ref(), right.as_ref()) {
+                ("+", IRExpr::Variable(v), IRExpr::Literal(LitValue::Int(c)))
+                | ("+", IRExpr::Literal(LitValue::Int(c)), IRExpr::Variable(v)) => (v, *c),
+                ("-", IRExpr::Variable(v), IRExpr::Literal(LitValue::Int(c))) => (v, -*c),
+                _ => return false,
+            },
+            _ => return false,
+        };
+        self.safe_indices.iter().rev()
+            .find(|(v, ..)| v == var)
+            .map_or(false, |(_, a, lo, k)| a == arr && lo + off >= 0 && off <= *k)
     }
 
     // ── struct ──
 
     fn emit_struct(&mut self, s: &IRStruct) {
+        for f in &s.fields {
+            self.use_array_type(&f.ty);
+            self.use_opt_type(&f.ty);
+        }
         self.emit(&format!("typedef struct {} {{ ", s.name));
         for f in &s.fields {
             self.emit(&format!("{} {}; ", self.c_type_name(&f.ty), f.name));
@@ -111,40 +1524,294 @@ impl CodeGenC {
         self.emit_line("");
     }
 
-    // ── forward decl ──
-
-    fn c_func_name(name: &str) -> String { name.replace('.', "_") }
+    // ── struct parameters ──
+
+    /// Rough C size of a value, for deciding what is worth a pointer.
+    fn c_size_of(&self, dt: &DataType) -> i64 {
+        match dt {
+            DataType::Struct(s) => self.struct_fields.get(s)
+                .map_or(8, |fields| fields.iter().map(|(_, t)| self.c_size_of(t)).sum()),
+            // data, len, cap
+            DataType::Array(_) => 24,
+            _ => 8,
+        }
+    }
+
+    fn is_constructor(&self, f: &IRFunction) -> bool {
+        f.is_method && f.body.is_some() && !f.params.iter().any(|p| p.name == "self")
+            && matches!((&f.struct_name, &f.return_type), (Some(s), DataType::Struct(r)) if s == r && self.structs.contains(s))
+    }
+
+    /// Decides how every function with a body takes its struct and array
+    /// parameters.  `self` is always a pointer, `const` unless the method
+    /// (or a method it calls on `self`) modifies it; other structs bigger
+    /// than two registers are `const T*` when the body never writes them,
+    /// or stay copies.  Arrays are always pointers, so an `add` in the
+    /// callee grows the caller's array; `const` unless the body (or a
+    /// callee it passes the array to) modifies it.  Mutability depends on
+    /// the callees', so this iterates to a fixed point; it only ever moves
+    /// towards `Ref` for `self` and arrays and `Value` for the rest, so it
+    /// terminates.
+    fn plan_struct_params(&mut self, ir: &GobolIR) {
+        let funcs: Vec<&IRFunction> = ir.functions.iter()
+            .chain(ir.impls.iter().flat_map(|imp| imp.methods.iter()))
+            .filter(|f| f.body.is_some())
+            .collect();
+        for f in &funcs {
+            if self.is_constructor(f) { self.ctors.insert(Self::c_func_name(&f.name)); }
+        }
+        loop {
+            let mut changed = false;
+            for f in &funcs {
+                let plan: Vec<Pass> = f.params.iter().map(|p| self.plan_param(f, p)).collect();
+                let name = Self::c_func_name(&f.name);
+                if self.param_passing.get(&name) != Some(&plan) {
+                    self.param_passing.insert(name, plan);
+                    changed = true;
+                }
+            }
+            if !changed { break; }
+        }
+    }
+
+    fn plan_param(&self, f: &IRFunction, p: &IRParam) -> Pass {
+        let writes = || f.body.as_ref().map_or(false, |b| self.writes_param(&p.name, &p.ty, b));
+        match &p.ty {
+            DataType::Array(_) => return if writes() { Pass::Ref } else { Pass::ConstRef },
+            DataType::Struct(s) if self.structs.contains(s) => {}
+            _ => return Pass::Value,
+        }
+        // Written through (its own fields, or a field's array grown by a
+        // callee): by pointer, so the caller sees the change
+        if writes() { return Pass::Ref; }
+        let is_self = f.is_method && p.name == "self";
+        if !is_self && self.c_size_of(&p.ty) <= 16 { Pass::Value } else { Pass::ConstRef }
+    }
+
+    fn passes_by_ref(&self, c_name: &str, i: usize) -> bool {
+        self.param_passing.get(c_name).and_then(|plan| plan.get(i)).map_or(false, |p| *p != Pass::Value)
+    }
+
+    /// `x.a.b` and `x` name storage that can have its address taken.
+    fn is_lvalue(e: &IRExpr) -> bool {
+        match e {
+            IRExpr::Variable(_) => true,
+            IRExpr::MemberAccess { object, .. } => Self::is_lvalue(object),
+            _ => false,
+        }
+    }
+
+    fn root_var(e: &IRExpr) -> Option<&str> {
+        match e {
+            IRExpr::Variable(n) => Some(n),
+            IRExpr::MemberAccess { object, .. } | IRExpr::ArrayIndex { array: object, .. } => Self::root_var(object),
+            _ => None,
+        }
+    }
+
+    /// Whether `b` can modify the parameter `name` (a struct or an array
+    /// of type `ty`): by assigning through it, rebinding it, calling a
+    /// mutating method on it, calling anything but a read on one of its
+    /// fields, or passing it (or a field) on to a parameter the callee
+    /// modifies.
+    fn writes_param(&self, name: &str, ty: &DataType, b: &IRBlock) -> bool {
+        let expr = |e: &IRExpr| self.writes_param_expr(name, ty, e);
+        b.statements.iter().any(|s| match s {
+            IRStmt::Declaration { name: n, init, .. } => n == name || init.as_ref().map_or(false, expr),
+            IRStmt::Assignment { target, value } => Self::root_var(target) == Some(name) || expr(target) || expr(value),
+            IRStmt::Expression(e) | IRStmt::Return(Some(e)) => expr(e),
+            IRStmt::If { cond, then_block, else_block } => {
+                expr(cond) || self.writes_param(name, ty, then_block)
+                    || else_block.as_ref().map_or(false, |eb| self.writes_param(name, ty, eb))
+            }
+            IRStmt::While { cond, body } => expr(cond) || self.writes_param(name, ty, body),
+            IRStmt::For { vars, iterable, body, .. } => {
+                vars.iter().any(|v| v == name) || expr(iterable) || self.writes_param(name, ty, body)
+            }
+            IRStmt::Region { body } => self.writes_param(name, ty, body),
+            IRStmt::Call { func, args, .. } => self.passes_to_ref(name, None, func, args) || args.iter().any(expr),
+            IRStmt::MethodCall { object, method, args, .. } => {
+                self.method_writes(name, ty, object, method) || self.passes_to_ref(name, Some(object), method, args)
+                    || expr(object) || args.iter().any(expr)
+            }
+            IRStmt::Return(None) | IRStmt::Break | IRStmt::Continue => false,
+        })
+    }
+
+    fn writes_param_expr(&self, name: &str, ty: &DataType, e: &IRExpr) -> bool {
+        let expr = |e: &IRExpr| self.writes_param_expr(name, ty, e);
+        match e {
+            IRExpr::Assignment { target, value } => Self::root_var(target) == Some(name) || expr(target) || expr(value),
+            IRExpr::MethodCall { object, method, args, .. } => {
+                self.method_writes(name, ty, object, method) || self.passes_to_ref(name, Some(object), method, args)
+                    || expr(object) || args.iter().any(expr)
+            }
+            IRExpr::Call { func, args, .. } => self.passes_to_ref(name, None, func, args) || args.iter().any(expr),
+            IRExpr::Binary { left, right, .. } => expr(left) || expr(right),
+            IRExpr::Unary { operand: x, .. } | IRExpr::Cast { expr: x, .. } | IRExpr::MemberAccess { object: x, .. } => expr(x),
+            IRExpr::ArrayIndex { array, index } => expr(array) || expr(index),
+            IRExpr::ArrayLiteral(args) | IRExpr::ArrayNew { dims: args } => args.iter().any(expr),
+            IRExpr::StructLiteral { fields, .. } => fields.iter().any(|(_, f)| expr(f)),
+            IRExpr::Format(parts) => parts.iter().any(|p| matches!(p, FormatPart::Expr(x) if expr(x))),
+            IRExpr::Literal(_) | IRExpr::Variable(_) | IRExpr::None => false,
+        }
+    }
+
+    fn method_writes(&self, name: &str, ty: &DataType, object: &IRExpr, method: &str) -> bool {
+        match (object, ty) {
+            (IRExpr::Variable(n), DataType::Struct(s)) if n == name => self.param_passing.get(&format!("{}_{}", s, method))
+                .and_then(|plan| plan.first()) == Some(&Pass::Ref),
+            _ => Self::root_var(object) == Some(name) && !matches!(method, "len" | "get" | "sum" | "min" | "max" | "dot" | "find" | "binary_search"),
+        }
+    }
+
+    /// Whether a call passes `name`, or storage inside it, to a parameter
+    /// the callee modifies.
+    fn passes_to_ref(&self, name: &str, object: Option<&IRExpr>, callee: &str, args: &[IRExpr]) -> bool {
+        args.iter().enumerate().any(|(i, a)| Self::is_lvalue(a) && Self::root_var(a) == Some(name) && self.arg_is_ref(object, callee, i))
+    }
+
+    /// Whether argument `i` of a call goes to a parameter the callee
+    /// modifies through a pointer.  `object` is a method call's receiver;
+    /// an instance call is checked against every struct's method of that
+    /// name, since this also runs before local types are known.
+    fn arg_is_ref(&self, object: Option<&IRExpr>, callee: &str, i: usize) -> bool {
+        let is_ref = |c: &str, i: usize| self.param_passing.get(c).and_then(|plan| plan.get(i)) == Some(&Pass::Ref);
+        let Some(object) = object else { return is_ref(&Self::c_func_name(callee), i) };
+        if let Some(path) = dotted_path(object) {
+            let c_name = format!("{}_{}", Self::c_func_name(&path), callee);
+            if self.param_passing.contains_key(&c_name) { return is_ref(&c_name, i); }
+        }
+        self.structs.iter().any(|s| is_ref(&format!("{}_{}", s, callee), i + 1))
+    }
+
+    /// An argument for a pointer parameter: a pointer parameter as is, an
+    /// lvalue by address, anything else through a one-element compound
+    /// literal (which lives until the end of the enclosing block).
+    fn emit_ref_arg(&mut self, arg: &IRExpr) {
+        match arg {
+            IRExpr::Variable(n) if self.ref_params.contains(n) => self.emit(n),
+            _ if Self::is_lvalue(arg) => { self.emit("&"); self.emit_expression(arg); }
+            _ => {
+                let ct = self.c_type_name(&self.infer_type(arg));
+                self.emit(&format!("({}[1]){{", ct));
+                self.emit_expression(arg);
+                self.emit("}");
+            }
+        }
+    }
+
+    /// Arguments of a call to `c_name`, the first being its parameter `from`.
+    fn emit_call_args(&mut self, c_name: &str, from: usize, args: &[IRExpr], wrap: bool) {
+        for (i, a) in args.iter().enumerate() {
+            if i > 0 { self.emit(", "); }
+            let opt_param = if self.opt_types.is_empty() { None } else {
+                self.func_params.get(c_name).and_then(|ps| ps.get(from + i)).filter(|t| self.opt_prefix(t).is_some()).cloned()
+            };
+            if self.passes_by_ref(c_name, from + i) { self.emit_ref_arg(a); }
+            else if let Some(ty) = opt_param { self.emit_as(&ty, a); }
+            else { self.emit_arg(a, wrap); }
+        }
+    }
+
+    /// `obj.method(args)` / `Type.method(args)` on a user struct.
+    fn emit_struct_method_call(&mut self, struct_name: &str, object: &IRExpr, method: &str, args: &[IRExpr]) {
+        let is_type_call = matches!(object, IRExpr::Variable(n) if self.structs.contains(n));
+        let c_name = format!("{}_{}", struct_name, method);
+        self.emit(&format!("{}(", c_name));
+        let wrap = method == "print" || method == "println";
+        if is_type_call {
+            self.emit_call_args(&c_name, 0, args, wrap);
+        } else {
+            if self.passes_by_ref(&c_name, 0) { self.emit_ref_arg(object); } else { self.emit_expression(object); }
+            if !args.is_empty() { self.emit(", "); }
+            self.emit_call_args(&c_name, 1, args, wrap);
+        }
+        self.emit(")");
+    }
+
+    // ── forward decl ──
+
+    fn c_func_name(name: &str) -> String { name.replace('.', "_") }
+
+    fn param_decls(&self, f: &IRFunction) -> Vec<String> {
+        let c_name = Self::c_func_name(&f.name);
+        let plan = self.param_passing.get(&c_name);
+        f.params.iter().enumerate().map(|(i, p)| {
+            let ct = self.c_type_name(&p.ty);
+            match plan.and_then(|plan| plan.get(i)).copied().unwrap_or(Pass::Value) {
+                Pass::Value => format!("{} {}", ct, p.name),
+                Pass::Ref => format!("{}* {}", ct, p.name),
+                Pass::ConstRef => format!("const {}* {}", ct, p.name),
+            }
+        }).collect()
+    }
+
+    /// `void T_m_init(T* self, ...)` of constructor `T_m`.
+    fn ctor_init_signature(&self, f: &IRFunction) -> String {
+        let c_name = Self::c_func_name(&f.name);
+        let mut params = vec![format!("{}* self", self.c_type_name(&f.return_type))];
+        params.extend(self.param_decls(f));
+        format!("void {}_init({})", c_name, params.join(", "))
+    }
 
     fn emit_forward_decl(&mut self, f: &IRFunction) {
         let ret = self.c_type_name(&f.return_type);
-        let params: Vec<String> = f.params.iter()
-            .map(|p| {
-                let ct = if p.ty == DataType::Unknown { "gobol_array_t".to_string() }
-                    else { self.c_type_name(&p.ty).to_string() };
-                format!("{} {}", ct, p.name)
-            })
-            .collect();
-        self.emit_line(&format!("{} {}({});", ret, Self::c_func_name(&f.name), params.join(", ")));
+        let c_name = Self::c_func_name(&f.name);
+        if self.ctors.contains(&c_name) {
+            let init = self.ctor_init_signature(f);
+            self.emit_line(&format!("{};", init));
+        }
+        let storage = if self.inline_leaves.contains(&c_name) { "static inline " } else { "" };
+        let decl = format!("{}{} {}({});", storage, ret, c_name, self.param_decls(f).join(", "));
+        self.emit_line(&decl);
+        self.forward_decls.insert(c_name, decl);
     }
 
     // ── function ──
 
     fn emit_function(&mut self, f: &IRFunction) {
+        let start = self.output.len();
+        self.emit_function_code(f);
+        self.place_outlined(start);
+        if self.output.len() > start {
+            self.function_sizes.push((f.name.clone(), self.output.len() - start));
+        }
+    }
+
+    /// Moves the loop bodies outlined from the function just emitted, which
+    /// started at `start`, in front of it.
+    fn place_outlined(&mut self, start: usize) {
+        if !self.outlined.is_empty() {
+            let code = std::mem::take(&mut self.outlined);
+            self.output.insert_str(start, &code);
+        }
+    }
+
+    fn emit_function_code(&mut self, f: &IRFunction) {
         if self.generated_functions.contains(&f.name) { return; }
         self.generated_functions.push(f.name.clone());
         // If no body, C companion provides implementation (skip body generation)
         if f.body.is_none() { return; }
         let ret = self.c_type_name(&f.return_type);
-        let params: Vec<String> = f.params.iter()
-            .map(|p| {
-                let ct = if p.ty == DataType::Unknown { "gobol_array_t".to_string() }
-                    else { self.c_type_name(&p.ty).to_string() };
-                format!("{} {}", ct, p.name)
-            })
-            .collect();
+        let params = self.param_decls(f);
         let c_name = Self::c_func_name(&f.name);
-        self.emit_line(&format!("{} {}({}) {{", ret, c_name, params.join(", ")));
+        self.ref_params = f.params.iter().enumerate()
+            .filter(|(i, _)| self.passes_by_ref(&c_name, *i))
+            .map(|(_, p)| p.name.clone())
+            .collect();
+        self.return_c = ret.clone();
+        self.return_ty = f.return_type.clone();
+        if self.ctors.contains(&c_name) {
+            self.emit_ctor(f, &c_name, &ret);
+            return;
+        }
+        self.begin_function_analysis(f);
+        self.emit_prof_site(f, &c_name);
+        let storage = if self.inline_leaves.contains(&c_name) { "static inline " } else { "" };
+        self.emit_line(&format!("{}{} {}({}) {{", storage, ret, c_name, params.join(", ")));
         self.indent += 1;
+        self.emit_prof_begin(&c_name);
         for p in &f.params {
             self.vars.insert(p.name.clone(), p.ty.clone());
         }
@@ -158,19 +1825,89 @@ impl CodeGenC {
         }
         if let Some(b) = &f.body { self.emit_block(b); }
         if f.return_type != DataType::None_ && f.return_type != DataType::Unknown {
-            let is_struct = matches!(&f.return_type, DataType::Struct(_));
-            if is_struct { self.emit_line("return self;"); }
-            else { self.emit_line("return 0;"); }
+            match &f.return_type {
+                DataType::Struct(_) if self.is_range_type(&f.return_type) => self.emit_line(&format!("return ({}){{0}};", ret)),
+                DataType::Struct(s) if f.struct_name.as_ref() == Some(s) && self.ref_params.contains("self") => self.emit_line("return *self;"),
+                DataType::Struct(s) if f.struct_name.as_ref() == Some(s) => self.emit_line("return self;"),
+                DataType::Struct(_) | DataType::Array(_) => self.emit_line(&format!("return ({}){{0}};", ret)),
+                DataType::Nullable(_) if self.opt_prefix(&f.return_type).is_some() => self.emit_line(&format!("return ({}){{0}};", ret)),
+                _ => self.emit_line("return 0;"),
+            }
+        }
+        self.emit_prof_end();
+        self.indent -= 1;
+        self.emit_line("}");
+        self.emit_line("");
+    }
+
+    /// A constructor initializes a slot its caller provides, so
+    /// `var p = T.new(...)` builds `p` in place; returning anything but
+    /// `self` stores that value into the slot.  The by-value `T_new` stays
+    /// for every other use.
+    fn emit_ctor(&mut self, f: &IRFunction, c_name: &str, ret: &str) {
+        self.begin_function_analysis(f);
+        let init = self.ctor_init_signature(f);
+        self.emit_prof_site(f, c_name);
+        self.emit_line(&format!("{} {{", init));
+        self.indent += 1;
+        self.emit_prof_begin(c_name);
+        for p in &f.params {
+            self.vars.insert(p.name.clone(), p.ty.clone());
+        }
+        self.vars.insert("self".to_string(), f.return_type.clone());
+        self.ref_params.insert("self".to_string());
+        self.emit_line(&format!("*self = ({}){{0}};", ret));
+        self.in_ctor = true;
+        if let Some(b) = &f.body {
+            let n = b.statements.len();
+            let tail_self = matches!(b.statements.last(), Some(IRStmt::Return(Some(IRExpr::Variable(v)))) if v == "self");
+            for s in &b.statements[..if tail_self { n - 1 } else { n }] { self.emit_statement(s); }
         }
+        self.in_ctor = false;
+        self.emit_prof_end();
+        self.indent -= 1;
+        self.emit_line("}");
+        self.emit_line("");
+
+        let params = self.param_decls(f);
+        let names: Vec<&str> = f.params.iter().map(|p| p.name.as_str()).collect();
+        self.emit_line(&format!("{} {}({}) {{", ret, c_name, params.join(", ")));
+        self.indent += 1;
+        self.emit_line(&format!("{} self;", ret));
+        let mut args = vec!["&self"];
+        args.extend(names);
+        self.emit_line(&format!("{}_init({});", c_name, args.join(", ")));
+        self.emit_line("return self;");
         self.indent -= 1;
         self.emit_line("}");
         self.emit_line("");
     }
 
+    /// `var name = T.new(args)` for a constructor `T_new` → `T name;
+    /// T_new_init(&name, args);`.  Returns false for any other initializer.
+    fn emit_ctor_declaration(&mut self, name: &str, init: &IRExpr) -> bool {
+        let IRExpr::MethodCall { object, method, args, .. } = init else { return false };
+        let IRExpr::Variable(ty) = object.as_ref() else { return false };
+        let c_name = format!("{}_{}", ty, method);
+        if !self.structs.contains(ty) || !self.ctors.contains(&c_name) { return false; }
+        self.emit_line(&format!("{} {};", ty, name));
+        self.emit(&format!("{}_init(&{}", c_name, name));
+        if !args.is_empty() { self.emit(", "); }
+        self.emit_call_args(&c_name, 0, args, false);
+        self.emit_line(");");
+        true
+    }
+
     fn emit_main_function(&mut self, f: &IRFunction) {
         self.vars.clear();
+        self.ref_params.clear();
+        self.begin_function_analysis(f);
+        self.emit_prof_site(f, "main");
+        self.return_c = "int".to_string();
+        self.return_ty = DataType::Int;
         self.emit_line("int main(void) {");
         self.indent += 1;
+        self.emit_prof_begin("main");
         if let Some(b) = &f.body {
             for s in &b.statements {
                 match s {
@@ -184,6 +1921,7 @@ impl CodeGenC {
             }
         }
         self.emit_line("return 0;");
+        self.emit_prof_end();
         self.indent -= 1;
         self.emit_line("}");
         self.emit_line("");
@@ -191,41 +1929,300 @@ impl CodeGenC {
 
     // ── block / stmt ──
 
+    /// Type of a variable declared without type or value (the result of a
+    /// `match`): that of the first value assigned to it whose type is known
+    /// here, `int` if there is none.
+    fn assigned_type(&self, name: &str) -> DataType {
+        fn values<'b>(name: &str, b: &'b IRBlock, out: &mut Vec<&'b IRExpr>) {
+            for s in &b.statements {
+                match s {
+                    IRStmt::Assignment { target: IRExpr::Variable(t), value } if t == name => out.push(value),
+                    IRStmt::If { then_block, else_block, .. } => {
+                        values(name, then_block, out);
+                        if let Some(eb) = else_block { values(name, eb, out); }
+                    }
+                    IRStmt::While { body, .. } | IRStmt::For { body, .. } | IRStmt::Region { body } => values(name, body, out),
+                    _ => {}
+                }
+            }
+        }
+        let mut found = Vec::new();
+        if let Some(body) = &self.current_body { values(name, body, &mut found); }
+        found.into_iter()
+            .find(|v| !matches!(v, IRExpr::Variable(n) if !self.vars.contains_key(n)) && !matches!(v, IRExpr::None))
+            .map_or(DataType::Int, |v| self.infer_type(v))
+    }
+
+    /// One arm of an if-chain testing a variable against int constants:
+    /// (variable, constant, then-block, else-block).
+    fn switch_case(s: &IRStmt) -> Option<(&str, i64, &IRBlock, Option<&IRBlock>)> {
+        let IRStmt::If { cond: IRExpr::Binary { op, left, right }, then_block, else_block } = s else { return None };
+        if op != "==" { return None; }
+        let ((IRExpr::Variable(v), k) | (k, IRExpr::Variable(v))) = (left.as_ref(), right.as_ref()) else { return None };
+        Some((v, Self::int_literal(k)?, then_block, else_block.as_ref()))
+    }
+
+    /// `if x == 1 {..} else if x == 2 {..} ...` (how `match` on int
+    /// patterns lowers), as the subject, its cases in order and the final
+    /// else.  Only chains of three or more cases on an int, none of whose
+    /// bodies breaks out of an enclosing loop, make a C `switch`.
+    fn switch_cases<'s>(&self, s: &'s IRStmt) -> Option<(&'s str, Vec<(i64, &'s IRBlock)>, Option<&'s IRBlock>)> {
+        let (subject, k, then_block, mut rest) = Self::switch_case(s)?;
+        if self.vars.get(subject) != Some(&DataType::Int) { return None; }
+        let mut cases = vec![(k, then_block)];
+        while let Some(b) = rest {
+            match b.statements.as_slice() {
+                [next] => match Self::switch_case(next) {
+                    Some((v, k, then_block, else_block)) if v == subject => {
+                        cases.push((k, then_block));
+                        rest = else_block;
+                    }
+                    _ => break,
+                },
+                _ => break,
+            }
+        }
+        if cases.len() < 3 { return None; }
+        if cases.iter().map(|(_, b)| *b).chain(rest).any(Self::breaks_loop) { return None; }
+        Some((subject, cases, rest))
+    }
+
+    /// Whether `b` has a `break` for the loop around it (not one of its own).
+    fn breaks_loop(b: &IRBlock) -> bool {
+        b.statements.iter().any(|s| match s {
+            IRStmt::Break => true,
+            IRStmt::If { then_block, else_block, .. } => Self::breaks_loop(then_block) || else_block.as_ref().map_or(false, Self::breaks_loop),
+            IRStmt::Region { body } => Self::breaks_loop(body),
+            _ => false,
+        })
+    }
+
+    /// A `switch` for an if-chain `switch_cases` accepts; a constant tested
+    /// again further down the chain keeps its first arm.
+    fn emit_switch(&mut self, s: &IRStmt) {
+        let Some((subject, cases, default)) = self.switch_cases(s) else { return };
+        self.emit("switch (");
+        self.emit_expression(&IRExpr::Variable(subject.to_string()));
+        self.emit_line(") {");
+        let mut seen = HashSet::new();
+        let arms = cases.into_iter()
+            .filter(|(k, _)| seen.insert(*k))
+            .map(|(k, b)| (format!("case {}:", k), b))
+            .chain(default.map(|b| ("default:".to_string(), b)));
+        for (label, b) in arms {
+            self.emit_line(&format!("{} {{", label));
+            self.indent += 1;
+            self.emit_block(b);
+            if !matches!(b.statements.last(), Some(IRStmt::Return(_) | IRStmt::Continue)) {
+                self.emit_line("break;");
+            }
+            self.indent -= 1;
+            self.emit_line("}");
+        }
+        self.emit_line("}");
+    }
+
     fn emit_block(&mut self, b: &IRBlock) {
+        self.emit_scoped_block(b, false, None);
+    }
+
+    fn emit_loop_body(&mut self, b: &IRBlock) {
+        self.emit_scoped_block(b, true, None);
+    }
+
+    /// Emits `b`, then releases what it allocated unless control can't
+    /// reach its end.
+    fn emit_scoped_block(&mut self, b: &IRBlock, loop_body: bool, region: Option<String>) {
+        self.cleanups.push(Cleanup { arrays: Vec::new(), region, loop_body });
         for s in &b.statements { self.emit_statement(s); }
+        let scope = self.cleanups.pop().unwrap_or(Cleanup { arrays: Vec::new(), region: None, loop_body });
+        if !matches!(b.statements.last(), Some(IRStmt::Return(_) | IRStmt::Break | IRStmt::Continue)) {
+            self.emit_cleanup(&scope);
+        }
+    }
+
+    fn emit_cleanup(&mut self, scope: &Cleanup) {
+        for a in scope.arrays.iter().rev() {
+            self.emit_line(&format!("gobol_array_free({}.data, {}.cap);", a, a));
+        }
+        if let Some(r) = &scope.region {
+            self.emit_line(&format!("gobol_region_leave({});", r));
+        }
+    }
+
+    /// Whether leaving the enclosing blocks (up to the innermost loop body
+    /// for `break`/`continue`) releases anything.
+    fn unwinds(&self, to_loop: bool) -> bool {
+        for scope in self.cleanups.iter().rev() {
+            if !scope.arrays.is_empty() || scope.region.is_some() { return true; }
+            if to_loop && scope.loop_body { break; }
+        }
+        false
+    }
+
+    /// Cleanup of every block an early exit leaves, innermost first.
+    fn emit_unwind(&mut self, to_loop: bool) {
+        let mut lines = Vec::new();
+        for scope in self.cleanups.iter().rev() {
+            for a in scope.arrays.iter().rev() {
+                lines.push(format!("gobol_array_free({}.data, {}.cap);", a, a));
+            }
+            if let Some(r) = &scope.region {
+                lines.push(format!("gobol_region_leave({});", r));
+            }
+            if to_loop && scope.loop_body { break; }
+        }
+        for line in lines { self.emit_line(&line); }
+    }
+
+    /// Registers a 1-D local array for release at the end of its block when
+    /// its storage is its own and can't be reached from anywhere else.
+    fn track_local_array(&mut self, name: &str, ty: &DataType, init: Option<&IRExpr>) {
+        if Self::array_rank(ty) != 1 || self.cleanups.is_empty() || !self.written_once(name) {
+            return;
+        }
+        if !matches!(init, None | Some(IRExpr::ArrayLiteral(_) | IRExpr::ArrayNew { .. })) {
+            return;
+        }
+        if !self.current_body.as_ref().map_or(false, |b| Self::only_local_uses(name, b)) {
+            return;
+        }
+        if let Some(scope) = self.cleanups.last_mut() {
+            scope.arrays.push(name.to_string());
+        }
+    }
+
+    /// Whether every use of array `name` in `b` is as the receiver of an
+    /// array method, the base of an index or the iterable of a `for`: no
+    /// copy of it (and so of its storage pointer) is ever made.
+    fn only_local_uses(name: &str, b: &IRBlock) -> bool {
+        let ok = |e: &IRExpr| Self::only_local_uses_expr(name, e);
+        let is_it = |e: &IRExpr| matches!(e, IRExpr::Variable(n) if n == name);
+        b.statements.iter().all(|s| match s {
+            IRStmt::Declaration { init, .. } => init.as_ref().map_or(true, ok),
+            IRStmt::Expression(e) | IRStmt::Return(Some(e)) => ok(e),
+            IRStmt::Assignment { target, value } => !is_it(target) && ok(target) && ok(value),
+            IRStmt::If { cond, then_block, else_block } => {
+                ok(cond) && Self::only_local_uses(name, then_block)
+                    && else_block.as_ref().map_or(true, |eb| Self::only_local_uses(name, eb))
+            }
+            IRStmt::While { cond, body } => ok(cond) && Self::only_local_uses(name, body),
+            IRStmt::For { iterable, body, .. } => (is_it(iterable) || ok(iterable)) && Self::only_local_uses(name, body),
+            IRStmt::Region { body } => Self::only_local_uses(name, body),
+            IRStmt::Call { args, .. } => args.iter().all(ok),
+            IRStmt::MethodCall { object, method, args, .. } => {
+                ok(&IRExpr::MethodCall { object: object.clone(), method: method.clone(), args: args.clone(), generic_args: Vec::new() })
+            }
+            IRStmt::Return(None) | IRStmt::Break | IRStmt::Continue => true,
+        })
+    }
+
+    fn only_local_uses_expr(name: &str, e: &IRExpr) -> bool {
+        let ok = |e: &IRExpr| Self::only_local_uses_expr(name, e);
+        match e {
+            IRExpr::Variable(n) => n != name,
+            IRExpr::ArrayIndex { array, index } => {
+                (matches!(array.as_ref(), IRExpr::Variable(n) if n == name) || ok(array)) && ok(index)
+            }
+            IRExpr::MethodCall { object, method, args, .. } => {
+                let receiver = Self::is_array_method(method) && matches!(object.as_ref(), IRExpr::Variable(n) if n == name);
+                (receiver || ok(object)) && args.iter().all(ok)
+            }
+            IRExpr::Binary { left, right, .. } => ok(left) && ok(right),
+            IRExpr::Unary { operand: x, .. } | IRExpr::Cast { expr: x, .. } | IRExpr::MemberAccess { object: x, .. } => ok(x),
+            IRExpr::Assignment { target, value } => {
+                !matches!(target.as_ref(), IRExpr::Variable(n) if n == name) && ok(target) && ok(value)
+            }
+            IRExpr::Call { args, .. } | IRExpr::ArrayLiteral(args) | IRExpr::ArrayNew { dims: args } => args.iter().all(ok),
+            IRExpr::StructLiteral { fields, .. } => fields.iter().all(|(_, f)| ok(f)),
+            IRExpr::Format(parts) => parts.iter().all(|p| match p { FormatPart::Expr(x) => ok(x), FormatPart::Lit(_) => true }),
+            IRExpr::Literal(_) | IRExpr::None => true,
+        }
     }
 
     fn emit_statement(&mut self, s: &IRStmt) {
+        // Statements whose string temporaries can't outlive them get their own
+        // arena scope, so a print in a hot loop doesn't grow the arena.
+        if self.is_arena_scoped(s) {
+            self.emit_line("{");
+            self.indent += 1;
+            self.emit_line("gobol_arena_mark_t _m = gobol_arena_mark();");
+            self.emit_plain_statement(s);
+            self.emit_line("gobol_arena_release(_m);");
+            self.indent -= 1;
+            self.emit_line("}");
+        } else {
+            self.emit_plain_statement(s);
+        }
+    }
+
+    fn emit_plain_statement(&mut self, s: &IRStmt) {
         match s {
             IRStmt::Declaration { name, ty, init } => {
-                let is_array_init = init.as_ref().map_or(false, |e| matches!(e, IRExpr::ArrayLiteral(_)));
-                let is_array_type = *ty == DataType::Unknown; // array type like int[] or int[10]
-                let is_array = is_array_init || is_array_type;
-                let resolved = if *ty == DataType::None_ || *ty == DataType::Unknown {
-                    init.as_ref().map(|e| self.infer_type(e)).unwrap_or(DataType::Int)
-                } else { ty.clone() };
-                self.vars.insert(name.clone(), if is_array { DataType::Unknown } else { resolved.clone() });
-                if is_array {
-                    self.emit(&format!("gobol_array_t {} = {{0}};", name));
-                    // For empty array literal, just declare
-                    if let Some(IRExpr::ArrayLiteral(elems)) = init {
-                        for el in elems {
-                            self.emit(&format!("gobol_array_add(&{}, ", name));
-                            self.emit_expression(el);
-                            self.emit("); ");
-                        }
+                let resolved = match (ty, init) {
+                    (DataType::None_ | DataType::Unknown, Some(e)) => self.infer_type(e),
+                    (DataType::None_ | DataType::Unknown, None) => self.assigned_type(name),
+                    _ => ty.clone(),
+                };
+                self.vars.insert(name.clone(), resolved.clone());
+                self.use_opt_type(&resolved);
+                if matches!(resolved, DataType::Array(_)) {
+                    self.use_array_type(&resolved);
+                    let ct = self.c_type_name(&resolved);
+                    if !matches!(init, Some(IRExpr::ArrayNew { .. })) { self.emit(&format!("{} {} = ", ct, name)); }
+                    match init {
+                        Some(IRExpr::ArrayNew { dims }) => self.emit_array_new(name, &resolved, dims),
+                        Some(IRExpr::ArrayLiteral(elems)) => self.emit_array_literal(elems, &resolved),
+                        Some(e) => self.emit_expression(e),
+                        None if Self::array_rank(&resolved) == 1 => self.emit("{ gobol_array_seed(), 0, 0 }"),
+                        None => self.emit("{0}"),
                     }
-                    self.emit_line("");
-                } else {
+                    if !matches!(init, Some(IRExpr::ArrayNew { .. })) { self.emit_line(";"); }
+                    self.track_local_array(name, &resolved, init.as_ref());
+                } else if !init.as_ref().map_or(false, |e| self.emit_ctor_declaration(name, e)) {
                     let ct = self.c_type_name(&resolved);
                     self.emit(&format!("{} {} = ", ct, name));
-                    if let Some(e) = init { self.emit_expression(e); } else { self.emit("0"); }
+                    match init {
+                        Some(e) => self.emit_as(&resolved, e),
+                        None if matches!(resolved, DataType::Struct(_) | DataType::Nullable(_)) && ct != "const char*" => self.emit("{0}"),
+                        None => self.emit("0"),
+                    }
                     self.emit_line(";");
+                    if let Some(arr) = init.as_ref().and_then(|e| self.len_source(e)) {
+                        if self.written_once(name) { self.len_aliases.insert(name.clone(), arr); }
+                    }
                 }
             }
             IRStmt::Expression(e) => { self.emit_expression(e); self.emit_line(";"); }
-            IRStmt::Return(Some(e)) => { self.emit("return "); self.emit_expression(e); self.emit_line(";"); }
-            IRStmt::Return(None) => { self.emit_line("return;"); }
+            IRStmt::Return(Some(IRExpr::Variable(v))) if self.in_ctor && v == "self" => {
+                self.emit_unwind(false);
+                self.emit_line("return;");
+            }
+            IRStmt::Return(Some(e)) if self.in_ctor => {
+                self.emit("*self = "); self.emit_expression(e); self.emit_line(";");
+                self.emit_unwind(false);
+                self.emit_line("return;");
+            }
+            // The value is computed before the arrays and regions it may
+            // read are released
+            IRStmt::Return(Some(e)) if self.unwinds(false) => {
+                self.emit_line("{");
+                self.indent += 1;
+                self.emit(&format!("{} _ret = ", self.return_c));
+                let ty = self.return_ty.clone();
+                self.emit_as(&ty, e);
+                self.emit_line(";");
+                self.emit_unwind(false);
+                self.emit_line("return _ret;");
+                self.indent -= 1;
+                self.emit_line("}");
+            }
+            IRStmt::Return(Some(e)) => {
+                let ty = self.return_ty.clone();
+                self.emit("return "); self.emit_as(&ty, e); self.emit_line(";");
+            }
+            IRStmt::Return(None) => { self.emit_unwind(false); self.emit_line("return;"); }
+            IRStmt::If { .. } if self.switch_cases(s).is_some() => self.emit_switch(s),
             IRStmt::If { cond, then_block, else_block } => {
                 self.emit("if ("); self.emit_expression(cond); self.emit_line(") {");
                 self.indent += 1; self.emit_block(then_block); self.indent -= 1;
@@ -236,28 +2233,22 @@ impl CodeGenC {
             }
             IRStmt::While { cond, body } => {
                 self.emit("while ("); self.emit_expression(cond); self.emit_line(") {");
-                self.indent += 1; self.emit_block(body); self.indent -= 1;
+                self.indent += 1; self.emit_loop_body(body); self.indent -= 1;
                 self.emit_line("}");
             }
-            IRStmt::For { vars, iterable, body } => {
+            IRStmt::For { vars, iterable, body, parallel: Some(reductions) } => {
+                self.emit_parallel_for(vars, iterable, body, reductions);
+            }
+            IRStmt::For { vars, iterable, body, .. } => {
                 let loop_var = if vars.len() >= 2 { vars[1].clone() } else { vars[0].clone() };
                 let idx_var = if vars.len() >= 2 { Some(vars[0].clone()) } else { None };
-                let is_range = matches!(iterable, IRExpr::Call { func, .. } if func == "range");
+                let is_range = self.range_call_args(iterable).is_some() || {
+                    let ty = self.infer_type(iterable);
+                    self.is_range_type(&ty)
+                };
                 let is_str_lit = matches!(iterable, IRExpr::Literal(LitValue::Str(_)));
                 if is_range {
-                    if let IRExpr::Call { args, .. } = &iterable {
-                        self.emit(&format!("for (int64_t {} = ", loop_var));
-                        if let Some(a) = args.first() { self.emit_expression(a); } else { self.emit("0"); }
-                        self.emit(&format!("; {} < ", loop_var));
-                        if args.len() >= 2 { self.emit_expression(&args[1]); } else { self.emit("0"); }
-                        self.emit(&format!("; {}++)", loop_var));
-                        self.emit_line(" {");
-                        self.indent += 1;
-                        self.vars.insert(loop_var, DataType::Int);
-                        self.emit_block(body);
-                        self.indent -= 1;
-                        self.emit_line("}");
-                    }
+                    self.emit_range_for(&loop_var, idx_var.as_deref(), iterable, body);
                 } else if is_str_lit {
                     self.emit("for (const char* _p = ");
                     self.emit_expression(iterable);
@@ -265,63 +2256,93 @@ impl CodeGenC {
                     self.indent += 1;
                     self.emit_line(&format!("char {} = *_p;", loop_var));
                     self.vars.insert(loop_var, DataType::Int);
-                    self.emit_block(body);
+                    self.emit_loop_body(body);
                     self.indent -= 1;
                     self.emit_line("}");
                 } else {
-                    let arr_name = self.expr_var_name(iterable).to_string();
-                    self.emit_line(&format!("for (int64_t _i = 0; _i < gobol_array_len(&{}); _i++) {{", arr_name));
+                    let arr_ty = self.infer_type(iterable);
+                    // N-D arrays iterate over their rows
+                    let nd = Self::array_rank(&arr_ty) > 1;
+                    let et = match &arr_ty {
+                        DataType::Array(inner) => inner.as_ref().clone(),
+                        _ => DataType::Int,
+                    };
+                    let prefix = self.use_array_type(&arr_ty).unwrap_or_else(|| "gobol_array_int".to_string());
+                    // Iterate a named array in place; anything else is evaluated once.
+                    let arr_name = match iterable {
+                        IRExpr::Variable(n) => n.clone(),
+                        _ => {
+                            self.emit_line("{");
+                            self.indent += 1;
+                            self.emit(&format!("{}_t _it = ", prefix));
+                            self.emit_expression(iterable);
+                            self.emit_line(";");
+                            "_it".to_string()
+                        }
+                    };
+                    let arr_ref = if self.ref_params.contains(&arr_name) { arr_name.clone() } else { format!("&{}", arr_name) };
+                    self.emit_line(&format!("for (int64_t _i = 0; _i < {}_len({}); _i++) {{", prefix, arr_ref));
                     self.indent += 1;
-                    let et = self.infer_type(iterable);
+                    // The loop condition just checked `_i`; the index
+                    // variable stays in range as long as nothing rebinds it.
+                    let mut fact = None;
                     if let Some(iv) = &idx_var {
                         self.emit_line(&format!("int64_t {} = _i;", iv));
                         self.vars.insert(iv.clone(), DataType::Int);
+                        let mut body_writes = HashMap::new();
+                        self.count_writes(body, &mut body_writes);
+                        if arr_name != "_it" && self.written_once(&arr_name) && !body_writes.contains_key(iv) {
+                            fact = Some((iv.clone(), arr_name.clone(), 0, 0));
+                        }
                     }
-                    self.emit_line(&format!("{} {} = gobol_array_get(&{}, _i);", self.c_type_name(&et), loop_var, arr_name));
+                    let read = if nd { "row" } else { "get_unchecked" };
+                    if nd { self.use_array_type(&et); }
+                    self.emit_line(&format!("{} {} = {}_{}({}, _i);", self.c_type_name(&et), loop_var, prefix, read, arr_ref));
                     self.vars.insert(loop_var, et);
-                    self.emit_block(body);
+                    let proven = fact.is_some();
+                    if let Some(f) = fact { self.safe_indices.push(f); }
+                    self.emit_loop_body(body);
+                    if proven { self.safe_indices.pop(); }
                     self.indent -= 1;
                     self.emit_line("}");
+                    if arr_name == "_it" {
+                        self.indent -= 1;
+                        self.emit_line("}");
+                    }
                 }
             }
-            IRStmt::Break => self.emit_line("break;"),
-            IRStmt::Continue => self.emit_line("continue;"),
+            IRStmt::Break => { self.emit_unwind(true); self.emit_line("break;"); }
+            IRStmt::Continue => { self.emit_unwind(true); self.emit_line("continue;"); }
+            IRStmt::Region { body } => {
+                let r = format!("_region{}", self.regions);
+                self.regions += 1;
+                self.emit_line("{");
+                self.indent += 1;
+                self.emit_line(&format!("gobol_region_t {} = gobol_region_enter();", r));
+                self.emit_scoped_block(body, false, Some(r));
+                self.indent -= 1;
+                self.emit_line("}");
+            }
             IRStmt::Assignment { target, value } => {
-                self.emit_expression(target); self.emit(" = "); self.emit_expression(value); self.emit_line(";");
+                let ty = if self.opt_types.is_empty() { DataType::Unknown } else { self.infer_type(target) };
+                self.raw_opt = self.opt_of(target).is_some();
+                self.emit_expression(target); self.emit(" = "); self.emit_as(&ty, value); self.emit_line(";");
             }
             IRStmt::Call { func, args, .. } => {
                 let c_name = Self::c_func_name(func);
                 self.emit(&format!("{}(", c_name));
                 let wrap = func == "print" || func == "println";
-                for (i, a) in args.iter().enumerate() {
-                    if i > 0 { self.emit(", "); }
-                    self.emit_arg(a, wrap);
-                }
+                self.emit_call_args(&c_name, 0, args, wrap);
                 self.emit_line(");");
             }
             IRStmt::MethodCall { object, method, args, .. } => {
-                // Handle array methods: arr.add(x) → gobol_array_add(&arr, x)
-                let is_array_method = method == "add" || method == "len" || method == "get";
-                let obj_name = self.expr_var_name(object).to_string();
-                let is_arr_var = matches!(self.vars.get(&obj_name), Some(DataType::Unknown))
-                    || obj_name.contains("arr");
-                if is_array_method && is_arr_var && !obj_name.is_empty() && obj_name != "unknown" {
-                    match method.as_str() {
-                        "add" => {
-                            self.emit(&format!("gobol_array_add(&{}, ", obj_name));
-                            for (i, a) in args.iter().enumerate() {
-                                if i > 0 { self.emit(", "); }
-                                self.emit_expression(a);
-                            }
-                            self.emit_line(");");
-                        }
-                        "len" => {
-                            self.emit(&format!("gobol_array_len(&{})", obj_name));
-                            self.emit_line(";");
-                        }
-                        _ => {}
+                // Handle array methods: arr.add(x) → gobol_array_int_add(&arr, x)
+                if Self::is_array_method(method) {
+                    if let Some(prefix) = self.array_prefix_of(object) {
+                        self.emit_array_method(&prefix, object, method, args);
+                        self.emit_line(";");
+                        return;
                     }
-                    return;
                 }
                 let obj_ty = self.infer_type(object);
                 let struct_name = match &obj_ty {
@@ -334,20 +2355,11 @@ impl CodeGenC {
                     }
                 };
                 if !struct_name.is_empty() {
-                    let is_type_call = matches!(object.as_ref(), IRExpr::Variable(n) if self.structs.contains(n));
-                    self.emit(&format!("{}_{}(", struct_name, method));
-                    let mut first = true;
-                    if !is_type_call { self.emit_expression(object); first = false; }
-                    let wrap = method == "print" || method == "println";
-                    for a in args {
-                        if !first { self.emit(", "); }
-                        self.emit_arg(a, wrap);
-                        first = false;
-                    }
-                    self.emit_line(");");
+                    self.emit_struct_method_call(&struct_name, object, method, args);
+                    self.emit_line(";");
                 } else {
                     let func_name = if let IRExpr::Variable(obj) = object.as_ref() {
-                        let is_builtin = matches!(method.as_str(), "print" | "println" | "read");
+                        let is_builtin = matches!(method.as_str(), "print" | "println" | "read" | "flush");
                         if is_builtin { method.clone() }
                         else { format!("{}_{}", obj, method) }
                     } else { method.clone() };
@@ -366,15 +2378,32 @@ impl CodeGenC {
     // ── expression ──
 
     fn emit_expression(&mut self, e: &IRExpr) {
+        // A `T?` read as a value is its payload
+        let raw = std::mem::take(&mut self.raw_opt);
+        if !raw && self.opt_of(e).is_some() {
+            self.raw_opt = true;
+            self.emit_expression(e);
+            self.emit(".val");
+            return;
+        }
         match e {
             IRExpr::Literal(l) => match l {
                 LitValue::Int(n) => self.emit(&format!("{}", n)),
-                LitValue::Float(f) => self.emit(&format!("{}", f)),
+                // `{:?}` keeps the `.0` on integral values, so 2.0 stays a double
+                LitValue::Float(f) => self.emit(&format!("{:?}", f)),
                 LitValue::Bool(b) => self.emit(if *b { "true" } else { "false" }),
-                LitValue::Str(s) => self.emit(&format!("\"{}\"", s.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n"))),
+                LitValue::Str(s) => self.emit(&Self::c_string_literal(s)),
                 LitValue::None => self.emit("0"),
             },
+            IRExpr::Variable(name) if self.ref_params.contains(name) => self.emit(&format!("(*{})", name)),
             IRExpr::Variable(name) => self.emit(name),
+            IRExpr::Binary { op, left, right } if (op == "==" || op == "!=") && self.null_test(left, right).is_some() => {
+                let subject = self.null_test(left, right).unwrap_or(left);
+                self.emit(if op == "==" { "(!" } else { "(" });
+                self.raw_opt = true;
+                self.emit_expression(subject);
+                self.emit(".has)");
+            }
             IRExpr::Binary { op, left, right } => {
                 if op == "+" && (self.contains_str(left) || self.contains_str(right)) {
                     self.emit("gobol_str_cat(");
@@ -389,48 +2418,46 @@ impl CodeGenC {
             IRExpr::Unary { op, operand } => {
                 self.emit(op); self.emit_expression(operand);
             }
+            IRExpr::Call { args, .. } if self.range_call_args(e).is_some() => {
+                let (start, end, step) = Self::range_parts(args);
+                self.emit("gobol_range(");
+                self.emit_expression(&start);
+                self.emit(", ");
+                self.emit_expression(&end);
+                self.emit(", ");
+                self.emit_expression(&step);
+                self.emit(")");
+            }
             IRExpr::Call { func, args, .. } => {
                 match func.as_str() {
-                    "_print" => self.emit("gobol_print("),
-                    "_read" => self.emit("gobol_read("),
+                    "_print" => self.emit("print("),
+                    "_read" => self.emit("read("),
+                    "_flush" => self.emit("flush("),
                     _ => self.emit(&format!("{}(", Self::c_func_name(func))),
                 }
                 let wrap = func == "print" || func == "println";
-                for (i, a) in args.iter().enumerate() {
-                    if i > 0 { self.emit(", "); }
-                    self.emit_arg(a, wrap);
-                }
+                self.emit_call_args(&Self::c_func_name(func), 0, args, wrap);
                 self.emit(")");
             }
             IRExpr::MethodCall { object, method, args, .. } => {
                 // Handle array methods
-                let is_array_method = method == "add" || method == "len" || method == "get";
-                let obj_name = self.expr_var_name(object).to_string();
-                let is_arr_var = matches!(self.vars.get(&obj_name), Some(DataType::Unknown))
-                    || obj_name.contains("arr");
-                if is_array_method && is_arr_var && !obj_name.is_empty() && obj_name != "unknown" {
-                    match method.as_str() {
-                        "add" => {
-                            self.emit(&format!("gobol_array_add(&{}, ", obj_name));
-                            for (i, a) in args.iter().enumerate() {
-                                if i > 0 { self.emit(", "); }
-                                self.emit_expression(a);
-                            }
-                            self.emit(")");
-                        }
-                        "len" => {
-                            self.emit(&format!("gobol_array_len(&{})", obj_name));
-                        }
-                        "get" => {
-                            self.emit(&format!("gobol_array_get(&{}", obj_name));
-                            for a in args { self.emit(", "); self.emit_expression(a); }
-                            self.emit(")");
-                        }
-                        _ => {}
+                if Self::is_array_method(method) {
+                    if let Some(prefix) = self.array_prefix_of(object) {
+                        self.emit_array_method(&prefix, object, method, args);
+                        return;
                     }
-                    return;
                 }
                 let obj_ty = self.infer_type(object);
+                if self.is_range_type(&obj_ty) && matches!(method.as_str(), "start" | "end" | "step" | "len" | "contains") {
+                    self.emit(&format!("gobol_range_{}(", method));
+                    self.emit_expression(object);
+                    for a in args {
+                        self.emit(", ");
+                        self.emit_expression(a);
+                    }
+                    self.emit(")");
+                    return;
+                }
                 let struct_name = match &obj_ty {
                     DataType::Struct(n) => n.clone(),
                     _ => {
@@ -441,21 +2468,11 @@ impl CodeGenC {
                     }
                 };
                 if !struct_name.is_empty() {
-                    let is_type_call = matches!(object.as_ref(), IRExpr::Variable(n) if self.structs.contains(n));
-                    self.emit(&format!("{}_{}(", struct_name, method));
-                    let mut first = true;
-                    if !is_type_call { self.emit_expression(object); first = false; }
-                    let wrap = method == "print" || method == "println";
-                    for a in args {
-                        if !first { self.emit(", "); }
-                        self.emit_arg(a, wrap);
-                        first = false;
-                    }
-                    self.emit(")");
+                    self.emit_struct_method_call(&struct_name, object, method, args);
                 } else {
                     // Module call: emit object_method(args) for non-builtin modules
                     let func_name = if let IRExpr::Variable(obj) = object.as_ref() {
-                        let is_builtin = matches!(method.as_str(), "print" | "println" | "read");
+                        let is_builtin = matches!(method.as_str(), "print" | "println" | "read" | "flush");
                         if is_builtin { method.clone() }
                         else { format!("{}_{}", obj, method) }
                     } else { method.clone() };
@@ -469,23 +2486,28 @@ impl CodeGenC {
                 }
             }
             IRExpr::MemberAccess { object, member } => {
+                if let IRExpr::Variable(n) = object.as_ref() {
+                    if self.ref_params.contains(n) {
+                        self.emit(&format!("{}->{}", n, member));
+                        return;
+                    }
+                }
                 self.emit_expression(object); self.emit("."); self.emit(member);
             }
             IRExpr::ArrayIndex { array, index } => {
-                let arr_name = self.expr_var_name(array);
-                // Handle nested indexing: arr[i][j] → gobol_array_get_flat(&arr, i, j)
-                if let IRExpr::ArrayIndex { array: inner, index: inner_idx } = array.as_ref() {
-                    let root_name = self.expr_var_name(inner);
-                    if root_name != "unknown" {
-                        self.emit(&format!("gobol_array_get_flat(&{}, ", root_name));
-                        self.emit_expression(inner_idx); self.emit(", ");
-                        self.emit_expression(index);
-                        self.emit(")");
-                        return;
-                    }
+                // Every dimension at once: m[i][j] → gobol_array2_int_get(&m, i, j)
+                if let Some((prefix, root, idxs)) = self.full_nd_index(e) {
+                    self.emit_nd_access(&format!("{}_get", prefix), root, &idxs);
+                    self.emit(")");
+                    return;
                 }
-                if arr_name != "unknown" {
-                    self.emit(&format!("gobol_array_get(&{}, ", arr_name));
+                if let Some(prefix) = self.array_prefix_of(array) {
+                    // m[i] on an N-D array is a view of row i
+                    let get = if Self::array_rank(&self.infer_type(array)) > 1 { "row" }
+                        else if self.index_is_safe(array, index) { "get_unchecked" }
+                        else { "get" };
+                    self.emit(&format!("{}_{}(", prefix, get));
+                    self.emit_array_ref(array); self.emit(", ");
                     self.emit_expression(index);
                     self.emit(")");
                 } else {
@@ -493,26 +2515,18 @@ impl CodeGenC {
                 }
             }
             IRExpr::ArrayLiteral(elems) => {
-                if elems.is_empty() {
-                    self.emit("(int64_t[]){0}");
-                } else if let Some(first) = elems.first() {
-                    let et = self.infer_type(first);
-                    self.emit(&format!("({}[]){{", self.c_type_name(&et)));
-                    for (i, el) in elems.iter().enumerate() {
-                        if i > 0 { self.emit(", "); }
-                        self.emit_expression(el);
-                    }
-                    self.emit("}");
-                } else {
-                    self.emit("(int64_t[]){0}");
-                }
+                let dt = self.infer_type(e);
+                self.emit_array_literal(elems, &dt);
             }
             IRExpr::StructLiteral { name, fields } => {
                 self.emit(&format!("({}){{", name));
                 for (i, (fn_, fe)) in fields.iter().enumerate() {
                     if i > 0 { self.emit(", "); }
                     self.emit(&format!(".{} = ", fn_));
-                    self.emit_expression(fe);
+                    let ty = self.struct_fields.get(name)
+                        .and_then(|fs| fs.iter().find(|(n, _)| n == fn_))
+                        .map_or(DataType::Unknown, |(_, t)| t.clone());
+                    self.emit_as(&ty, fe);
                 }
                 self.emit("}");
             }
@@ -521,8 +2535,9 @@ impl CodeGenC {
                 let src_ty = self.infer_type(expr);
                 if matches!(target, DataType::Str) {
                     if let DataType::Struct(name) = &src_ty {
-                        self.emit(&format!("{}_convert_str(", name));
-                        self.emit_expression(expr);
+                        let c_name = format!("{}_convert_str", name);
+                        self.emit(&format!("{}(", c_name));
+                        if self.passes_by_ref(&c_name, 0) { self.emit_ref_arg(expr); } else { self.emit_expression(expr); }
                         self.emit(")");
                         return;
                     }
@@ -532,25 +2547,20 @@ impl CodeGenC {
                 self.emit(")");
             }
             IRExpr::Assignment { target, value } => {
-                // Nested array assignment: arr[i][j] = v
-                if let IRExpr::ArrayIndex { array: outer_arr, index: outer_idx } = target.as_ref() {
-                    if let IRExpr::ArrayIndex { array: inner_arr, index: inner_idx } = outer_arr.as_ref() {
-                        let root_name = self.expr_var_name(inner_arr);
-                        if root_name != "unknown" {
-                            self.emit(&format!("gobol_array_set_flat(&{}, ", root_name));
-                            self.emit_expression(inner_idx); self.emit(", ");
-                            self.emit_expression(outer_idx); self.emit(", ");
-                            self.emit_expression(value);
-                            self.emit(")");
-                            return;
-                        }
-                    }
+                // N-D array assignment: m[i][j] = v → gobol_array2_int_set(&m, i, j, v)
+                if let Some((prefix, root, idxs)) = self.full_nd_index(target) {
+                    self.emit_nd_access(&format!("{}_set", prefix), root, &idxs);
+                    self.emit(", ");
+                    self.emit_expression(value);
+                    self.emit(")");
+                    return;
                 }
                 // Single array index assignment: arr[i] = v
                 if let IRExpr::ArrayIndex { array, index } = target.as_ref() {
-                    let arr_name = self.expr_var_name(array);
-                    if arr_name != "unknown" {
-                        self.emit(&format!("gobol_array_set(&{}, ", arr_name));
+                    if let Some(prefix) = self.array_prefix_of(array) {
+                        let set = if self.index_is_safe(array, index) { "set_unchecked" } else { "set" };
+                        self.emit(&format!("{}_{}(", prefix, set));
+                        self.emit_array_ref(array); self.emit(", ");
                         self.emit_expression(index);
                         self.emit(", ");
                         self.emit_expression(value);
@@ -558,34 +2568,110 @@ impl CodeGenC {
                         return;
                     }
                 }
-                self.emit_expression(target); self.emit(" = "); self.emit_expression(value);
+                let ty = if self.opt_types.is_empty() { DataType::Unknown } else { self.infer_type(target) };
+                self.raw_opt = self.opt_of(target).is_some();
+                self.emit_expression(target); self.emit(" = "); self.emit_as(&ty, value);
+            }
+            IRExpr::Format(parts) => self.emit_format(parts),
+            IRExpr::ArrayNew { dims } => {
+                let dt = self.infer_type(e);
+                let prefix = self.use_array_type(&dt).unwrap_or_else(|| "gobol_array_int".to_string());
+                self.emit(&format!("{}_new(", prefix));
+                for (i, d) in dims.iter().enumerate() {
+                    if i > 0 { self.emit(", "); }
+                    self.emit_expression(d);
+                }
+                self.emit(")");
             }
             IRExpr::None => self.emit("0"),
         }
     }
 
+    /// `@"..."` → one gobol_str_format call. The runtime sizes the result up
+    /// front and formats every piece in place, so k pieces cost one
+    /// allocation and O(total length) instead of k nested concatenations.
+    fn emit_format(&mut self, parts: &[FormatPart]) {
+        let parts: Vec<&FormatPart> = parts.iter()
+            .filter(|p| !matches!(p, FormatPart::Lit(l) if l.is_empty()))
+            .collect();
+        if parts.iter().all(|p| matches!(p, FormatPart::Lit(_))) {
+            let text: String = parts.iter()
+                .map(|p| if let FormatPart::Lit(l) = p { l.as_str() } else { "" })
+                .collect();
+            self.emit(&Self::c_string_literal(&text));
+            return;
+        }
+        self.emit(&format!("gobol_str_format({}, (gobol_fmt_piece_t[]){{", parts.len()));
+        for (i, p) in parts.iter().enumerate() {
+            if i > 0 { self.emit(", "); }
+            match p {
+                FormatPart::Lit(l) => {
+                    self.emit(&format!("GOBOL_FMT_LIT({}, {})", Self::c_string_literal(l), l.len()));
+                }
+                FormatPart::Expr(e) => {
+                    if self.contains_str(e) {
+                        self.emit("GOBOL_FMT_S("); self.emit_expression(e); self.emit(")");
+                    } else {
+                        let ty = match self.infer_type(e) {
+                            DataType::Nullable(inner) if self.opt_of(e).is_some() => *inner,
+                            ty => ty,
+                        };
+                        match ty {
+                            DataType::Float => { self.emit("GOBOL_FMT_F("); self.emit_expression(e); self.emit(")"); }
+                            DataType::Bool => {
+                                self.emit("GOBOL_FMT_S(("); self.emit_expression(e); self.emit(") ? \"true\" : \"false\")");
+                            }
+                            _ => { self.emit("GOBOL_FMT_I("); self.emit_expression(e); self.emit(")"); }
+                        }
+                    }
+                }
+            }
+        }
+        self.emit("})");
+    }
+
     // ── helpers ──
 
-    fn emit(&mut self, s: &str) { self.output.push_str(s); }
+    fn emit(&mut self, s: &str) {
+        self.emit_indent();
+        self.output.push_str(s);
+    }
 
     fn emit_line(&mut self, s: &str) {
-        for _ in 0..self.indent { self.output.push_str("    "); }
+        self.emit_indent();
         self.output.push_str(s);
         self.output.push('\n');
     }
 
-    fn c_type_name<'a>(&self, dt: &'a DataType) -> &'a str {
+    /// Indent only at the start of a line, so `emit` + `emit_line` pieces of
+    /// one statement land on a single, properly indented line.
+    fn emit_indent(&mut self) {
+        if self.output.is_empty() || self.output.ends_with('\n') {
+            for _ in 0..self.indent { self.output.push_str("    "); }
+        }
+    }
+
+    fn c_string_literal(s: &str) -> String {
+        format!("\"{}\"", s.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n"))
+    }
+
+    fn c_type_name(&self, dt: &DataType) -> String {
         match dt {
-            DataType::Int => "int64_t",
-            DataType::Float => "double",
-            DataType::Bool => "bool",
-            DataType::Str => "const char*",
-            DataType::None_ => "void",
+            DataType::Int => "int64_t".to_string(),
+            DataType::Float => "double".to_string(),
+            DataType::Bool => "bool".to_string(),
+            DataType::Str => "const char*".to_string(),
+            DataType::None_ => "void".to_string(),
             #[allow(unused)]
-            DataType::Unknown => "int64_t",
-            DataType::Struct(name) if self.structs.contains(name) => name.as_str(),
-            DataType::Struct(_) => "void*",
-            DataType::Nullable(inner) => self.c_type_name(inner),
+            DataType::Unknown => "int64_t".to_string(),
+            DataType::Struct(name) if self.structs.contains(name) => name.clone(),
+            DataType::Struct(name) if name == "range" => "gobol_range_t".to_string(),
+            DataType::Struct(_) => "void*".to_string(),
+            DataType::Nullable(inner) => match self.opt_prefix(dt) {
+                Some(prefix) => format!("{}_t", prefix),
+                None => self.c_type_name(inner),
+            },
+            DataType::Array(_) => format!("{}_t", self.array_prefix(dt)),
         }
     }
 
@@ -594,16 +2680,15 @@ impl CodeGenC {
         // If the expression already produces a string, don't wrap
         if self.contains_str(arg) { self.emit_expression(arg); return; }
         match arg {
-            IRExpr::Literal(LitValue::Int(n)) => self.emit(&format!("gobol_str_int({})", n)),
+            IRExpr::Literal(LitValue::Int(n)) => self.emit(&format!("\"{}\"", n)),
             IRExpr::Literal(LitValue::Float(f)) => self.emit(&format!("gobol_str_float({})", f)),
             IRExpr::Literal(LitValue::Bool(b)) => self.emit(if *b { "\"true\"" } else { "\"false\"" }),
             IRExpr::Literal(LitValue::Str(_)) => self.emit_expression(arg),
-            IRExpr::Variable(name) => {
-                let is_str = matches!(self.vars.get(name), Some(DataType::Str));
-                if is_str { self.emit_expression(arg); }
-                else { self.emit("gobol_str_int("); self.emit_expression(arg); self.emit(")"); }
-            }
-            _ => { self.emit("gobol_str_int("); self.emit_expression(arg); self.emit(")"); }
+            _ => match self.infer_type(arg) {
+                DataType::Float => { self.emit("gobol_str_float("); self.emit_expression(arg); self.emit(")"); }
+                DataType::Bool => { self.emit("(("); self.emit_expression(arg); self.emit(") ? \"true\" : \"false\")"); }
+                _ => { self.emit("gobol_str_int("); self.emit_expression(arg); self.emit(")"); }
+            },
         }
     }
 
@@ -626,13 +2711,115 @@ impl CodeGenC {
             IRExpr::Literal(LitValue::Str(_)) => true,
             IRExpr::Variable(name) => matches!(self.vars.get(name), Some(DataType::Str)),
             IRExpr::Cast { target, .. } => matches!(target, DataType::Str),
-            IRExpr::MethodCall { method, .. } => method.contains("str") || method == "convert_str",
+            IRExpr::MethodCall { method, .. } => {
+                method.contains("str") || method == "convert_str" || matches!(self.infer_type(e), DataType::Str)
+            }
             IRExpr::Call { func, .. } => {
                 func == "gobol_str_cat" || func == "gobol_str_int" || func == "gobol_str_float"
                     || func.contains("str") || func.contains("convert")
+                    || matches!(self.func_returns.get(&Self::c_func_name(func)), Some(DataType::Str))
             }
             IRExpr::Binary { left, right, .. } => self.contains_str(left) || self.contains_str(right),
+            IRExpr::Format(_) => true,
+            IRExpr::ArrayIndex { .. } | IRExpr::MemberAccess { .. } => matches!(self.infer_type(e), DataType::Str),
+            _ => false,
+        }
+    }
+
+    /// True when a statement allocates string temporaries and nothing it
+    /// allocates can be retained past its end: it assigns nothing, and every
+    /// user call it makes only receives values the callee can't store into.
+    fn is_arena_scoped(&self, s: &IRStmt) -> bool {
+        match s {
+            IRStmt::Expression(e) => self.allocs_str(e) && !self.may_retain_str(e),
+            IRStmt::Call { func, args, .. } => {
+                self.call_allocs_str(None, func, args) && !self.call_may_retain_str(None, func, args)
+            }
+            IRStmt::MethodCall { object, method, args, .. } => {
+                self.call_allocs_str(Some(object), method, args) && !self.call_may_retain_str(Some(object), method, args)
+            }
+            _ => false,
+        }
+    }
+
+    /// Whether evaluating `e` builds strings in the arena.
+    fn allocs_str(&self, e: &IRExpr) -> bool {
+        match e {
+            IRExpr::Binary { op, left, right } => {
+                (op == "+" && self.contains_str(e)) || self.allocs_str(left) || self.allocs_str(right)
+            }
+            IRExpr::Unary { operand, .. } => self.allocs_str(operand),
+            IRExpr::Cast { expr, target } => matches!(target, DataType::Str) || self.allocs_str(expr),
+            IRExpr::Call { func, args, .. } => self.call_allocs_str(None, func, args),
+            IRExpr::MethodCall { object, method, args, .. } => self.call_allocs_str(Some(object), method, args),
+            IRExpr::MemberAccess { object, .. } => self.allocs_str(object),
+            IRExpr::ArrayIndex { array, index } => self.allocs_str(array) || self.allocs_str(index),
+            IRExpr::Format(parts) => parts.iter().any(|p| matches!(p, FormatPart::Expr(_))),
+            _ => false,
+        }
+    }
+
+    fn call_allocs_str(&self, object: Option<&IRExpr>, func: &str, args: &[IRExpr]) -> bool {
+        // Mirrors `emit_arg`: a print argument that isn't already a string is
+        // converted through the arena.
+        let wraps = func == "print" || func == "println";
+        object.map_or(false, |o| self.allocs_str(o))
+            || args.iter().any(|a| {
+                self.allocs_str(a)
+                    || (wraps && !self.contains_str(a) && !matches!(a, IRExpr::Literal(LitValue::Bool(_) | LitValue::Int(_))))
+            })
+    }
+
+    /// Whether a string built while evaluating `e` could end up stored
+    /// somewhere that outlives the statement.
+    fn may_retain_str(&self, e: &IRExpr) -> bool {
+        match e {
+            IRExpr::Assignment { .. } => true,
+            IRExpr::Binary { left, right, .. } => self.may_retain_str(left) || self.may_retain_str(right),
+            IRExpr::Unary { operand, .. } => self.may_retain_str(operand),
+            IRExpr::Cast { expr, .. } => self.may_retain_str(expr),
+            IRExpr::MemberAccess { object, .. } => self.may_retain_str(object),
+            IRExpr::ArrayIndex { array, index } => self.may_retain_str(array) || self.may_retain_str(index),
+            IRExpr::Call { func, args, .. } => self.call_may_retain_str(None, func, args),
+            IRExpr::MethodCall { object, method, args, .. } => self.call_may_retain_str(Some(object), method, args),
+            IRExpr::Format(parts) => parts.iter().any(|p| matches!(p, FormatPart::Expr(e) if self.may_retain_str(e))),
+            _ => false,
+        }
+    }
+
+    /// A callee that writes through a pointer parameter (a `self` or struct
+    /// it modifies) can store any string it is given there, so such a call
+    /// retains everything, whatever the types of its arguments.
+    fn call_may_retain_str(&self, object: Option<&IRExpr>, callee: &str, args: &[IRExpr]) -> bool {
+        if self.call_passes_ref(object, callee, args) { return true; }
+        let passes = |e: &IRExpr| self.may_retain_str(e) || !self.is_plain_value(&self.infer_type(e));
+        // `io.print(...)`-style module calls don't pass the module along
+        let object_passed = object.map_or(false, |o| {
+            !matches!(o, IRExpr::Variable(n) if !self.vars.contains_key(n)) && passes(o)
+        });
+        object_passed || args.iter().any(|a| passes(a))
+    }
+
+    /// Whether the receiver or any argument of a call goes to a `Pass::Ref`
+    /// parameter.
+    fn call_passes_ref(&self, object: Option<&IRExpr>, callee: &str, args: &[IRExpr]) -> bool {
+        let receiver_ref = object.map_or(false, |o| match self.infer_type(o) {
+            DataType::Struct(s) => self.param_passing.get(&format!("{}_{}", s, callee))
+                .map_or(false, |plan| plan.first() == Some(&Pass::Ref)),
             _ => false,
+        });
+        receiver_ref || (0..args.len()).any(|i| self.arg_is_ref(object, callee, i))
+    }
+
+    /// Values passed by copy that hold no references into caller memory.
+    fn is_plain_value(&self, dt: &DataType) -> bool {
+        match dt {
+            DataType::Int | DataType::Float | DataType::Bool | DataType::Str | DataType::None_ => true,
+            DataType::Nullable(inner) => self.is_plain_value(inner),
+            DataType::Struct(name) => self.struct_fields.get(name)
+                .map_or(false, |fields| fields.iter().all(|(_, f)| self.is_plain_value(f))),
+            // arrays share their buffer with the caller
+            DataType::Unknown | DataType::Array(_) => false,
         }
     }
 
@@ -645,17 +2832,50 @@ impl CodeGenC {
             IRExpr::Variable(name) => self.vars.get(name).cloned().unwrap_or(DataType::Int),
             IRExpr::StructLiteral { name, .. } => DataType::Struct(name.clone()),
             IRExpr::ArrayLiteral(elems) => {
-                elems.first().map(|e| self.infer_type(e)).unwrap_or(DataType::Int)
+                DataType::Array(Box::new(elems.first().map(|e| self.infer_type(e)).unwrap_or(DataType::Int)))
+            }
+            IRExpr::ArrayNew { dims } => {
+                dims.iter().fold(DataType::Int, |t, _| DataType::Array(Box::new(t)))
             }
+            IRExpr::ArrayIndex { array, .. } => match self.infer_type(array) {
+                DataType::Array(elem) => *elem,
+                _ => DataType::Int,
+            },
+            IRExpr::MemberAccess { object, member } => match self.infer_type(object) {
+                DataType::Struct(s) => self.struct_fields.get(&s)
+                    .and_then(|fields| fields.iter().find(|(n, _)| n == member))
+                    .map(|(_, t)| t.clone())
+                    .unwrap_or(DataType::Int),
+                _ => DataType::Int,
+            },
             IRExpr::MethodCall { object, method, .. } => {
                 if method == "new" {
                     if let IRExpr::Variable(name) = object.as_ref() {
                         return DataType::Struct(name.clone());
                     }
                 }
-                DataType::Int
+                let obj_ty = self.infer_type(object);
+                if self.is_range_type(&obj_ty) {
+                    return if method == "contains" { DataType::Bool } else { DataType::Int };
+                }
+                if let DataType::Array(elem) = &obj_ty {
+                    if matches!(method.as_str(), "sum" | "min" | "max" | "dot" | "get") {
+                        return elem.as_ref().clone();
+                    }
+                }
+                let owner = match obj_ty {
+                    DataType::Struct(n) => n,
+                    _ => self.expr_var_name(object).to_string(),
+                };
+                self.func_returns.get(&format!("{}_{}", owner, method)).cloned().unwrap_or(DataType::Int)
+            }
+            IRExpr::Call { func, .. } if self.func_returns.contains_key(&Self::c_func_name(func)) => {
+                self.func_returns[&Self::c_func_name(func)].clone()
             }
             IRExpr::Call { func, .. } if func == "gobol_str_cat" => DataType::Str,
+            IRExpr::Call { func, .. } if func == "range" => DataType::Struct("range".to_string()),
+            IRExpr::Format(_) => DataType::Str,
+            IRExpr::Cast { target, .. } => target.clone(),
             IRExpr::Binary { left, .. } => {
                 if self.contains_str(e) { DataType::Str }
                 else { self.infer_type(left) }
@@ -0,0 +1,857 @@
+// driver.rs — the compiler pipeline behind `gobol`, callable in-process.
+//
+// Source → AstBuilder → SemanticAnalyzer → IRBuilder (+ imported modules)
+// → Monomorphizer → PassManager → CodeGenC → CCompiler.  A `Session`
+// keeps what doesn't change from one compile to the next: every parsed
+// and lowered module, re-read only when its file changes, and the
+// analyzer state after the std prelude.  Build tools, editors and the
+// `gobol --server` loop compile through one session instead of paying
+// for the standard library's front end on every build.
+//
+// Usage:
+//   let mut options = CompileOptions::new("main.gbl");
+//   options.profile = Profile::Release;
+//   match gobol::driver::compile(&options) {
+//       Ok(artifact) => { binary_command(&artifact.binary).status(); }
+//       Err(failure) => eprintln!("{}", failure),
+//   }
+
+use crate::ast::Program;
+use crate::ast_builder::AstBuilder;
+use crate::ast_printer::AstPrinter;
+use crate::ccompiler::{default_runtime_dir, CCompiler, Pgo, Profile};
+use crate::codegen_c::CodeGenC;
+use crate::error::ErrorFormatter;
+use crate::ir::{check_regions, GobolIR, IRBuilder, IRExpr, IRFunction, IRStmt, Monomorphizer};
+use crate::lexer::Lexer;
+use crate::module_graph::{resolve_module_path, stamp, ModuleCache, ModuleGraph, Stamp};
+use crate::optimizer::PassManager;
+use crate::semantic_analyzer::SemanticAnalyzer;
+use crate::time_report::TimeReport;
+use crate::token::TokenType;
+use colored::*;
+use std::cell::RefCell;
+use std::env;
+use std::fmt;
+use std::fs;
+use std::path::{Path, PathBuf};
+use std::process;
+use std::rc::Rc;
+use std::time::Instant;
+
+/// How a build uses profile-guided optimization.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub enum PgoMode {
+    #[default]
+    Off,
+    /// Instrumented build; its runs record a profile
+    Generate,
+    /// Rebuild with the profile recorded by `Generate` runs
+    Use,
+    /// Instrument, run once to train, rebuild
+    Train,
+}
+
+/// Everything one compile needs; `from_args` reads the `gobol` command line.
+#[derive(Debug, Clone)]
+pub struct CompileOptions {
+    pub input: String,
+    /// Source to compile instead of reading `input`, which still names the
+    /// file in diagnostics and anchors relative imports
+    pub source: Option<String>,
+    /// Binary to write; `<stem>.out` (`.exe` on Windows) by default
+    pub output: Option<String>,
+    /// `--lib-path` entries, searched before the standard library
+    pub lib_paths: Vec<String>,
+    pub profile: Profile,
+    pub native: bool,
+    pub lto: bool,
+    pub pgo: PgoMode,
+    pub jobs: usize,
+    /// Reuse compiled objects from `cache_dir` and link the prebuilt runtime
+    pub object_cache: bool,
+    pub cache_dir: String,
+    pub instrument: bool,
+    pub save_c: bool,
+    pub verbose: bool,
+    pub time_report: bool,
+}
+
+impl CompileOptions {
+    pub fn new(input: &str) -> Self {
+        CompileOptions {
+            input: input.to_string(),
+            source: None,
+            output: None,
+            lib_paths: Vec::new(),
+            profile: Profile::Default,
+            native: false,
+            lto: env::var("GOBOL_LTO").is_ok(),
+            pgo: PgoMode::Off,
+            jobs: std::thread::available_parallelism().map_or(1, |n| n.get()),
+            object_cache: true,
+            cache_dir: env::var("GOBOL_CACHE_DIR").unwrap_or_else(|_| ".gobol-cache".to_string()),
+            instrument: false,
+            save_c: false,
+            verbose: false,
+            time_report: false,
+        }
+    }
+
+    /// Options from `gobol` arguments (without the program name).  Flags
+    /// that don't affect compiling (`-c`, `--help`, ...) are ignored; with
+    /// no file name `input` is left empty.
+    pub fn from_args(args: &[String]) -> Self {
+        let mut options = CompileOptions::new("");
+        let mut i = 0;
+        while i < args.len() {
+            let arg = args[i].as_str();
+            match arg {
+                "--lib-path" if i + 1 < args.len() => {
+                    options.lib_paths.extend(args[i + 1].split(',').filter(|p| !p.is_empty()).map(|p| p.to_string()));
+                    i += 1;
+                }
+                "-o" | "--output" => {
+                    if let Some(out) = args.get(i + 1) {
+                        options.output = Some(out.clone());
+                        i += 1;
+                    }
+                }
+                "--socket" => i += 1,
+                "-j" | "--jobs" => {
+                    if let Some(n) = args.get(i + 1).and_then(|n| n.parse::<usize>().ok()) {
+                        options.jobs = n;
+                        i += 1;
+                    }
+                }
+                "--verbose" | "-v" => options.verbose = true,
+                "--save-c" | "-s" => options.save_c = true,
+                "--no-cache" => options.object_cache = false,
+                "--lto" => options.lto = true,
+                "--native" => options.native = true,
+                "--instrument" => options.instrument = true,
+                "--time-report" | "--time-report=json" => options.time_report = true,
+                "--pgo" => options.pgo = PgoMode::Train,
+                "--pgo-generate" => options.pgo = PgoMode::Generate,
+                "--pgo-use" => options.pgo = PgoMode::Use,
+                _ if arg.starts_with('-') => {}
+                _ => {
+                    if options.input.is_empty() {
+                        options.input = arg.to_string();
+                    }
+                }
+            }
+            i += 1;
+        }
+        let has_flag = |flag: &str| args.iter().any(|s| s == flag);
+        options.profile = if has_flag("--release") {
+            Profile::Release
+        } else if has_flag("--debug") {
+            Profile::Debug
+        } else if has_flag("--size") {
+            Profile::Size
+        } else {
+            Profile::Default
+        };
+        options
+    }
+
+    /// The binary this compile writes.
+    pub fn output_name(&self) -> String {
+        self.output.clone().unwrap_or_else(|| {
+            // Default output name derived from input filename: tmp.gbl → tmp.out
+            let stem = Path::new(&self.input).file_stem()
+                .and_then(|s| s.to_str())
+                .unwrap_or("a");
+            let ext = if cfg!(target_os = "windows") { "exe" } else { "out" };
+            format!("{}.{}", stem, ext)
+        })
+    }
+
+    /// A C compiler set up for these options.
+    pub fn c_compiler(&self) -> CCompiler {
+        CCompiler::detect()
+            .with_lto(self.lto)
+            .with_profile(self.profile)
+            .with_native(self.native)
+            .with_jobs(self.jobs)
+    }
+}
+
+/// A successful compile.
+pub struct Artifact {
+    pub binary: String,
+    /// The generated C sources, when `save_c` kept them
+    pub c_files: Vec<String>,
+    pub report: Option<TimeReport>,
+}
+
+/// A failed compile: the diagnostics, one per line, and the exit status
+/// `gobol` reports for it.
+pub struct CompileFailure {
+    pub messages: Vec<String>,
+    pub exit_code: i32,
+    pub report: Option<TimeReport>,
+}
+
+impl CompileFailure {
+    fn new(messages: Vec<String>) -> Self {
+        CompileFailure { messages, exit_code: 1, report: None }
+    }
+}
+
+impl fmt::Display for CompileFailure {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "{}", self.messages.join("\n"))
+    }
+}
+
+impl fmt::Debug for CompileFailure {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "CompileFailure(exit {}): {}", self.exit_code, self)
+    }
+}
+
+/// The analyzer after the std prelude, and what it was built from.
+struct Prelude {
+    setup: Option<String>,
+    lib_paths: Vec<String>,
+    cwd: PathBuf,
+    files: Vec<(String, Stamp)>,
+    analyzer: SemanticAnalyzer,
+}
+
+impl Prelude {
+    fn is_fresh(&self, setup: &Option<String>, lib_paths: &[String], cwd: &Path) -> bool {
+        self.setup == *setup
+            && self.lib_paths == lib_paths
+            && self.cwd == cwd
+            && self.files.iter().all(|(path, s)| stamp(path) == Some(*s))
+    }
+}
+
+/// State kept warm between compiles.
+#[derive(Default)]
+pub struct Session {
+    modules: ModuleCache,
+    prelude: Option<Prelude>,
+}
+
+thread_local! {
+    static SESSION: RefCell<Session> = RefCell::new(Session::new());
+}
+
+/// Compile through this thread's session.
+pub fn compile(options: &CompileOptions) -> Result<Artifact, CompileFailure> {
+    SESSION.with(|s| s.borrow_mut().compile(options))
+}
+
+impl Session {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Modules held in the parse cache.
+    pub fn cached_modules(&self) -> usize {
+        self.modules.len()
+    }
+
+    /// An analyzer with the prelude loaded: a copy of the kept one while
+    /// `__setup__` resolves to the same file and no prelude module changed.
+    fn analyzer(&mut self, lib_paths: &[String], main_file: &str, main_dir: &Option<String>) -> SemanticAnalyzer {
+        let setup = resolve_module_path(lib_paths, &["__setup__".to_string()], main_dir.as_deref());
+        let cwd = env::current_dir().unwrap_or_default();
+        if let Some(prelude) = &self.prelude {
+            if prelude.is_fresh(&setup, lib_paths, &cwd) {
+                return prelude.analyzer.clone();
+            }
+        }
+        let graph = ModuleGraph::load_cached(&[("__setup__".to_string(), main_dir.clone())], lib_paths, &mut self.modules);
+        let mut analyzer = SemanticAnalyzer::new();
+        analyzer.set_main_file(main_file);
+        analyzer.set_lib_paths(lib_paths.to_vec());
+        analyzer.set_preparsed(graph.programs());
+        analyzer.load_prelude();
+        let files = graph.paths().iter().filter_map(|p| Some((p.clone(), stamp(p)?))).collect();
+        self.prelude = Some(Prelude { setup, lib_paths: lib_paths.to_vec(), cwd, files, analyzer: analyzer.clone() });
+        analyzer
+    }
+
+    pub fn compile(&mut self, options: &CompileOptions) -> Result<Artifact, CompileFailure> {
+        let mut report = options.time_report.then(TimeReport::new);
+        match self.run(options, &mut report) {
+            Ok((binary, generated)) => {
+                let c_files = if options.save_c { generated } else { Vec::new() };
+                Ok(Artifact { binary, c_files, report })
+            }
+            Err(mut failure) => {
+                failure.report = report;
+                Err(failure)
+            }
+        }
+    }
+
+    /// The pipeline; the binary and the C files it wrote.
+    fn run(&mut self, options: &CompileOptions, report: &mut Option<TimeReport>) -> Result<(String, Vec<String>), CompileFailure> {
+        let filename = options.input.as_str();
+        let is_verbose = options.verbose;
+        // Times the phase since the last mark, when a report was asked for
+        let mut phase_start = Instant::now();
+        let mut mark = |report: &mut Option<TimeReport>, name: &str| {
+            if let Some(r) = report.as_mut() {
+                r.record(name, phase_start);
+            }
+            phase_start = Instant::now();
+        };
+
+        if filename.is_empty() {
+            return Err(CompileFailure::new(vec!["Error: No filename provided".red().to_string()]));
+        }
+        let out_name = options.output_name();
+
+        let source = match &options.source {
+            Some(s) => s.clone(),
+            None => fs::read_to_string(filename).map_err(|e| {
+                CompileFailure::new(vec![format!("Error: Cannot open file '{}': {}", filename, e)])
+            })?,
+        };
+        mark(report, "read");
+
+        if is_verbose {
+            println!("===== Step 0: Reprint Source =====");
+            println!("{}", source);
+        }
+        let error_fmt = ErrorFormatter::new(filename.to_string(), source.clone());
+
+        let mut lexer = Lexer::new(source);
+        if is_verbose {
+            let mut tk = lexer.get_next_token();
+            println!("===== Step 1: Tokenize =====");
+            while tk.r#type != TokenType::EndOfFile {
+                println!(
+                    "Token(Type={}, Val='{}')",
+                    tk.r#type,
+                    if tk.r#type == TokenType::EndOfLine { "\\n" } else { tk.text(lexer.source()) }
+                );
+                tk = lexer.get_next_token();
+            }
+            println!();
+            println!();
+            println!("======= Step 2: AST =======");
+            lexer.reset_position();
+        }
+
+        let mut builder = AstBuilder::new(lexer);
+        builder.set_error_formatter(error_fmt.clone());
+        let prog = builder.build();
+        if builder.has_error() {
+            return Err(CompileFailure::new(builder.get_error_message().iter().map(|m| m.red().to_string()).collect()));
+        }
+        let prog = prog.ok_or_else(|| CompileFailure::new(vec!["Failed to build AST".red().to_string()]))?;
+        mark(report, "parse");
+
+        if is_verbose {
+            let mut printer = AstPrinter::new();
+            printer.visit(prog.as_ref());
+            println!();
+            println!();
+            println!("======= Step 3: Semantic Analysis =======");
+        }
+
+        let lib_paths = script_lib_paths(filename, &options.lib_paths);
+        if is_verbose {
+            println!("Library paths: {:?}", lib_paths);
+        }
+
+        // Lex, parse and build IR for every imported module up front, in
+        // parallel; analysis and the merge below consume the results in order.
+        let main_dir = Path::new(filename).parent().and_then(|p| p.to_str()).map(|s| s.to_string());
+        let mut roots = vec![("__setup__".to_string(), main_dir.clone())];
+        for stmt in prog.statement_nodes() {
+            if let Some(import_stmt) = stmt.as_import() {
+                roots.push((import_stmt.get_module_name(), main_dir.clone()));
+            }
+        }
+        let modules = ModuleGraph::load_cached(&roots, &lib_paths, &mut self.modules);
+        mark(report, "modules");
+        if let Some(r) = report.as_mut() {
+            r.modules = modules.timings();
+        }
+        if is_verbose {
+            println!("Modules loaded: {}", modules.len());
+        }
+
+        let mut semantic_analyzer = self.analyzer(&lib_paths, filename, &main_dir);
+        semantic_analyzer.set_main_file(filename);
+        semantic_analyzer.set_preparsed(modules.programs());
+        semantic_analyzer.set_error_formatter(error_fmt.clone());
+        if !semantic_analyzer.analyze(&prog) {
+            let errors = semantic_analyzer.get_errors();
+            let mut messages = vec![format!("Semantic analysis failed with {} error(s):", errors.len())];
+            messages.extend(errors.iter().cloned());
+            return Err(CompileFailure::new(messages));
+        }
+        mark(report, "semantic");
+
+        if is_verbose {
+            println!();
+            println!("======= Step 4: C Codegen =======");
+        }
+
+        // Build IR from AST
+        let mut ir = IRBuilder::new().build(&prog).map_err(|errors| {
+            let mut messages = vec!["IR build failed:".red().to_string()];
+            messages.extend(errors.iter().map(|m| m.red().to_string()));
+            CompileFailure::new(messages)
+        })?;
+
+        // Source file of every function, for --instrument reports
+        for f in ir.functions.iter_mut().chain(ir.impls.iter_mut().flat_map(|imp| imp.methods.iter_mut())) {
+            f.file = filename.to_string();
+        }
+        mark(report, "ir");
+
+        merge_imports(&mut ir, &prog, &modules, &lib_paths, filename, &error_fmt);
+        mark(report, "imports");
+
+        // Monomorphize (expand generics)
+        let mut monomorphizer = Monomorphizer::new();
+        let mut concrete_ir = monomorphizer.monomorphize(&ir);
+        mark(report, "monomorphize");
+        if !monomorphizer.errors().is_empty() {
+            let errors = monomorphizer.errors();
+            let mut messages = vec![format!("Generic instantiation failed with {} error(s):", errors.len()).red().to_string()];
+            messages.extend(errors.iter().map(|m| m.red().to_string()));
+            return Err(CompileFailure::new(messages));
+        }
+
+        // Nothing built inside a `region` may outlive it
+        let region_errors = check_regions(&concrete_ir);
+        if !region_errors.is_empty() {
+            let mut messages = vec![format!("Region check failed with {} error(s):", region_errors.len()).red().to_string()];
+            messages.extend(region_errors.iter().map(|m| m.red().to_string()));
+            return Err(CompileFailure::new(messages));
+        }
+
+        // Fold constants, inline small functions and drop dead branches
+        // before codegen.  Instrumented builds keep every call, so each
+        // function's counters see all of its callers.
+        let mut passes = PassManager::with_default_passes();
+        if options.instrument {
+            passes.remove("inline");
+        }
+        passes.run(&mut concrete_ir);
+        mark(report, "optimize");
+
+        // One translation unit per module (<out>.c for the main program,
+        // <out>.<module>.c for imports) sharing the declarations in <out>.h
+        let h_file = format!("{}.h", out_name);
+        let h_name = Path::new(&h_file).file_name().and_then(|n| n.to_str()).unwrap_or(&h_file).to_string();
+        let mut codegen = CodeGenC::new();
+        codegen.set_instrument(options.instrument);
+        let c_units = codegen.generate_units(&concrete_ir, &h_name);
+        mark(report, "codegen");
+        if let Some(r) = report.as_mut() {
+            r.functions = codegen.function_sizes().to_vec();
+        }
+
+        if is_verbose {
+            println!("{}", c_units.header);
+            for unit in &c_units.units {
+                println!("{}", unit.source);
+            }
+        }
+
+        // Collect C companion files from lib paths (std/c/*.c)
+        let c_files = companion_c_files(&lib_paths);
+
+        // Write generated C sources
+        let unit_files: Vec<String> = c_units.units.iter().map(|u| unit_file(&out_name, &u.module)).collect();
+        let mut generated = vec![h_file.clone()];
+        generated.extend(unit_files.iter().cloned());
+        let writes = std::iter::once((&h_file, &c_units.header))
+            .chain(unit_files.iter().zip(c_units.units.iter().map(|u| &u.source)));
+        for (path, text) in writes {
+            if let Err(e) = fs::write(path, text) {
+                return Err(CompileFailure::new(vec![format!("Failed to write C file '{}': {}", path, e).red().to_string()]));
+            }
+        }
+        mark(report, "write");
+
+        // Compiled objects are cached by content hash under `cache_dir`.  The
+        // companions are linked from the prebuilt runtime library, except in
+        // profile-guided builds, which compile everything in one go, and
+        // with --time-report, so the C compiler's report covers every source.
+        let use_cache = options.object_cache && report.is_none();
+        let mut cc_report = String::new();
+        let mut cc_peak: Option<u64> = None;
+        let mut build = |pgo: Option<Pgo>| -> Result<(), CompileFailure> {
+            let mut compiler = options.c_compiler()
+                .with_pgo(pgo.clone())
+                .with_time_report(options.time_report);
+            let mut sources: Vec<String> = Vec::new();
+            if !use_cache || pgo.is_some() {
+                sources.extend(c_files.iter().cloned());
+            } else {
+                compiler = compiler.with_cache(&options.cache_dir);
+                match compiler.build_runtime(&c_files, &default_runtime_dir()) {
+                    Ok(lib) => compiler = compiler.with_library(lib),
+                    Err(e) => return Err(CompileFailure::new(vec![format!("Runtime build failed: {}", e)])),
+                }
+            }
+            if is_verbose {
+                println!("Compiler: {}", compiler.name());
+            }
+            sources.extend(unit_files.iter().cloned());
+            let status = compiler.compile(&sources, &out_name);
+            cc_report.push_str(&compiler.time_report());
+            cc_peak = cc_peak.max(compiler.peak_rss_kb());
+            match status {
+                Ok(s) if s.success() => Ok(()),
+                Ok(s) => Err(CompileFailure { messages: Vec::new(), exit_code: s.code().unwrap_or(1), report: None }),
+                Err(e) => Err(CompileFailure::new(vec![format!("Compilation failed: {}", e)])),
+            }
+        };
+
+        // Profile data lives under the cache, one directory per output.  An
+        // instrumented build starts from an empty profile: data recorded for
+        // older sources no longer matches them.
+        let out_stem = Path::new(&out_name).file_name().and_then(|n| n.to_str()).unwrap_or("a");
+        let pgo_dir = env::current_dir().unwrap_or_default().join(&options.cache_dir).join("pgo").join(out_stem);
+        let fresh_profile = |dir: &PathBuf| {
+            let _ = fs::remove_dir_all(dir);
+            Some(Pgo::Generate(dir.clone()))
+        };
+        let built = match options.pgo {
+            PgoMode::Train => build(fresh_profile(&pgo_dir)).and_then(|_| {
+                if is_verbose {
+                    println!("Training run: {}", out_name);
+                }
+                match binary_command(&out_name).status() {
+                    Ok(s) if !s.success() => eprintln!("{}", format!("Training run exited with {}", s).yellow()),
+                    Ok(_) => {}
+                    Err(e) => return Err(CompileFailure::new(vec![format!("Failed to run '{}': {}", out_name, e)])),
+                }
+                build(Some(Pgo::Use(pgo_dir.clone())))
+            }),
+            PgoMode::Generate => build(fresh_profile(&pgo_dir)),
+            PgoMode::Use => build(Some(Pgo::Use(pgo_dir.clone()))),
+            PgoMode::Off => build(None),
+        };
+
+        // The compiler processes did this phase's work, not this one
+        if let Some(r) = report.as_mut() {
+            r.record_children("cc", phase_start, cc_peak);
+            r.cc_report = cc_report;
+        }
+
+        if !options.save_c {
+            for path in &generated {
+                let _ = fs::remove_file(path);
+            }
+        }
+        built.map(|_| (out_name, generated))
+    }
+}
+
+/// `<out>.c` for the main program, `<out>.<module>.c` for an import.
+fn unit_file(out_name: &str, module: &str) -> String {
+    if module.is_empty() {
+        format!("{}.c", out_name)
+    } else {
+        format!("{}.{}.c", out_name, module.replace('.', "_"))
+    }
+}
+
+/// Merge the functions, impls and constants of every module `prog`
+/// imports into `ir`, under the module's full name and its alias.
+fn merge_imports(ir: &mut GobolIR, prog: &Program, modules: &ModuleGraph, lib_paths: &[String], filename: &str, error_fmt: &ErrorFormatter) {
+    for stmt in prog.statement_nodes() {
+        let import_stmt = match stmt.as_import() {
+            Some(i) => i,
+            None => continue,
+        };
+        let module_name = import_stmt.get_module_name();
+        let path_parts: Vec<String> = module_name.split('.').map(|s| s.to_string()).collect();
+        let module_path = match resolve_module_file(&path_parts, lib_paths, filename) {
+            Some(p) => p,
+            None => continue,
+        };
+        let parsed = match modules.ir(&module_path) {
+            Some(mod_ir) => Some(mod_ir),
+            None if modules.contains(&module_path) => None,
+            None => parse_module_ir(&module_path, error_fmt).map(Rc::new),
+        };
+        let mod_ir = match parsed {
+            Some(ir) => ir,
+            None => continue,
+        };
+        // Merge functions — register under both full name and alias
+        let alias = import_stmt.get_alias().map(|a| a.to_string());
+        // Builtin modules (with C companions) → strip bodies
+        let is_builtin = module_name == "io";
+        for f in &mod_ir.functions {
+            if !f.is_main && !f.is_method {
+                let mut f = f.clone();
+                f.file = module_path.clone();
+                if is_builtin || is_c_companion(&f) { f.body = None; }
+                // Register under alias if present (e.g. m.add)
+                if let Some(ref a) = alias {
+                    let mut fa = f.clone();
+                    fa.name = format!("{}.{}", a, f.name);
+                    ir.functions.push(fa);
+                }
+                // Also register under full module name
+                f.name = format!("{}.{}", module_name, f.name);
+                ir.functions.push(f);
+            }
+        }
+        // Structs the module defines, for its functions and its importers
+        for s in &mod_ir.structs {
+            if !ir.structs.iter().any(|t| t.name == s.name) {
+                ir.structs.push(s.clone());
+            }
+        }
+        for imp in &mod_ir.impls {
+            let mut imp = imp.clone();
+            for m in &mut imp.methods {
+                m.file = module_path.clone();
+            }
+            ir.impls.push(imp);
+        }
+        // Module constants (math.PI), also under the alias
+        for c in &mod_ir.constants {
+            if let Some(ref a) = alias {
+                let mut ca = c.clone();
+                ca.name = format!("{}.{}", a, c.name);
+                ir.constants.push(ca);
+            }
+            let mut c = c.clone();
+            c.name = format!("{}.{}", module_name, c.name);
+            ir.constants.push(c);
+        }
+    }
+}
+
+/// A module function whose whole body is one `__builtins__._x(...)` call
+/// is implemented in std/c/__builtins__.c (e.g. `fs._map` → `fs__map`).
+fn is_c_companion(f: &IRFunction) -> bool {
+    let Some(body) = &f.body else { return false };
+    let builtins = |object: &IRExpr| matches!(object, IRExpr::Variable(m) if m == "__builtins__");
+    match body.statements.as_slice() {
+        [IRStmt::Expression(IRExpr::MethodCall { object, .. }) | IRStmt::Return(Some(IRExpr::MethodCall { object, .. }))]
+        | [IRStmt::MethodCall { object, .. }] => builtins(object),
+        _ => false,
+    }
+}
+
+fn resolve_module_file(path_parts: &[String], lib_paths: &[String], main_file: &str) -> Option<String> {
+    let relative = format!("{}.gbl", path_parts.join("/"));
+    // Check relative to main file's directory
+    if let Some(parent) = Path::new(main_file).parent() {
+        let p = parent.join(&relative);
+        if p.exists() { return p.to_str().map(|s| s.to_string()); }
+    }
+    // Check lib paths
+    for lp in lib_paths {
+        let p = Path::new(lp).join(&relative);
+        if p.exists() { return p.to_str().map(|s| s.to_string()); }
+    }
+    // Direct path
+    if Path::new(&relative).exists() { return Some(relative); }
+    None
+}
+
+/// Lex, parse and lower a module the graph didn't reach (e.g. one whose
+/// path the analyzer resolved differently).
+fn parse_module_ir(module_path: &str, error_fmt: &ErrorFormatter) -> Option<GobolIR> {
+    let source = fs::read_to_string(module_path).ok()?;
+    let mut mod_builder = AstBuilder::new(Lexer::new(source));
+    mod_builder.set_error_formatter(error_fmt.clone());
+    let mod_prog = mod_builder.build()?;
+    if mod_builder.has_error() {
+        return None;
+    }
+    IRBuilder::new().build(&mod_prog).ok()
+}
+
+/// Library search paths for a script: its local `lib/` directories first,
+/// then `std_lib_paths`.
+fn script_lib_paths(filename: &str, cli_paths: &[String]) -> Vec<String> {
+    let mut lib_paths = Vec::new();
+
+    if let Some(parent) = Path::new(filename).parent() {
+        // 1. <script_dir>/lib (highest priority — local overrides)
+        if let Some(p) = parent.join("lib").to_str() {
+            lib_paths.push(p.to_string());
+        }
+        // 2. <script_dir>/../lib
+        if let Some(grandparent) = parent.parent() {
+            if let Some(p) = grandparent.join("lib").to_str() {
+                lib_paths.push(p.to_string());
+            }
+        }
+    }
+
+    // 3-6. CLI paths, then the development and installed stdlib
+    lib_paths.extend(std_lib_paths(cli_paths));
+    lib_paths
+}
+
+/// Library search paths that don't depend on the script location:
+/// `--lib-path` entries, ./std, std/ next to the binary, $GOBOL_INSTALL_DIR/std.
+pub fn std_lib_paths(cli_paths: &[String]) -> Vec<String> {
+    let mut lib_paths = Vec::new();
+
+    // 3. CLI lib paths (--lib-path arguments)
+    for path in cli_paths {
+        lib_paths.push(path.clone());
+    }
+
+    // 4. ./std (development stdlib, relative to CWD)
+    lib_paths.push("std".to_string());
+
+    // 5. <gobol_binary_dir>/../std (installed alongside binary)
+    if let Ok(exe_path) = env::current_exe() {
+        if let Some(exe_dir) = exe_path.parent() {
+            if let Some(p) = exe_dir.parent().map(|d| d.join("std")).and_then(|d| d.to_str().map(|s| s.to_string())) {
+                lib_paths.push(p);
+            }
+            if let Some(p) = exe_dir.join("std").to_str().map(|s| s.to_string()) {
+                lib_paths.push(p);
+            }
+        }
+    }
+
+    // 6. $GOBOL_INSTALL_DIR/std (installed stdlib, lowest priority)
+    if let Ok(install_dir) = env::var("GOBOL_INSTALL_DIR") {
+        let std_path = Path::new(&install_dir).join("std");
+        if let Some(p) = std_path.to_str() {
+            lib_paths.push(p.to_string());
+        }
+    }
+
+    lib_paths
+}
+
+/// C companion files from the lib paths (std/c/*.c) and a `c/` directory
+/// next to the binary; the first file of each name wins.
+pub fn companion_c_files(lib_paths: &[String]) -> Vec<String> {
+    let mut c_files: Vec<String> = Vec::new();
+    let mut seen_names = std::collections::HashSet::new();
+    let mut add_c_file = |path: String| {
+        let basename = Path::new(&path)
+            .file_name()
+            .and_then(|n| n.to_str())
+            .unwrap_or(&path)
+            .to_string();
+        if seen_names.insert(basename) {
+            c_files.push(path);
+        }
+    };
+
+    for lib_path in lib_paths {
+        let c_dir = Path::new(lib_path).join("c");
+        if c_dir.is_dir() {
+            if let Ok(entries) = fs::read_dir(&c_dir) {
+                for entry in entries.flatten() {
+                    let p = entry.path();
+                    if p.extension().map_or(false, |e| e == "c") {
+                        if let Some(s) = p.to_str() {
+                            add_c_file(s.to_string());
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Also check for a c/ directory alongside the binary
+    if let Ok(exe_path) = env::current_exe() {
+        if let Some(exe_dir) = exe_path.parent() {
+            let c_dir = exe_dir.join("c");
+            if c_dir.is_dir() {
+                if let Ok(entries) = fs::read_dir(&c_dir) {
+                    for entry in entries.flatten() {
+                        let p = entry.path();
+                        if p.extension().map_or(false, |e| e == "c") {
+                            if let Some(s) = p.to_str() {
+                                add_c_file(s.to_string());
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    c_files
+}
+
+/// Command that runs a freshly built binary: a bare name is looked up in
+/// the working directory rather than on `$PATH`.
+pub fn binary_command(out_name: &str) -> process::Command {
+    if Path::new(out_name).components().count() > 1 {
+        process::Command::new(out_name)
+    } else {
+        process::Command::new(format!("./{}", out_name))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_from_args() {
+        let args: Vec<String> = ["main.gbl", "-o", "app", "--release", "--lib-path", "a,b", "-j", "3", "-c", "--pgo-use"]
+            .iter().map(|s| s.to_string()).collect();
+        let options = CompileOptions::from_args(&args);
+        assert_eq!(options.input, "main.gbl");
+        assert_eq!(options.output_name(), "app");
+        assert_eq!(options.profile, Profile::Release);
+        assert_eq!(options.lib_paths, vec!["a", "b"]);
+        assert_eq!(options.jobs, 3);
+        assert_eq!(options.pgo, PgoMode::Use);
+        assert_eq!(CompileOptions::new("dir/tmp.gbl").output_name(),
+            if cfg!(target_os = "windows") { "tmp.exe" } else { "tmp.out" });
+    }
+
+    #[test]
+    fn test_session_reuses_parsed_modules() {
+        let root = env!("CARGO_MANIFEST_DIR");
+        let dir = env::temp_dir().join(format!("gobol-session-{}", process::id()));
+        fs::create_dir_all(&dir).unwrap();
+        let main = dir.join("main.gbl");
+        fs::write(&main, "import io\n\nfunc main() {\n    io.println(\"hi\");\n}\n").unwrap();
+
+        let mut options = CompileOptions::new(main.to_str().unwrap());
+        options.output = Some(dir.join("main.out").to_string_lossy().into_owned());
+        options.lib_paths = vec![format!("{}/std", root)];
+        options.source = Some("func main() {\n    val x = ;\n}\n".to_string());
+
+        let mut session = Session::new();
+        // Parse errors in the source come back as diagnostics
+        let failure = session.compile(&options).err().expect("syntax error is reported");
+        assert_eq!(failure.exit_code, 1);
+        assert!(!failure.messages.is_empty());
+
+        // Analysis loads std once; a second compile reuses it
+        options.source = None;
+        options.object_cache = false;
+        options.time_report = true;
+        let first = session.compile(&options);
+        let cached = session.cached_modules();
+        assert!(cached > 0);
+        if let Ok(artifact) = first {
+            assert!(Path::new(&artifact.binary).exists());
+        }
+        let second = session.compile(&options);
+        assert_eq!(session.cached_modules(), cached);
+        if let Ok(artifact) = second {
+            let report = artifact.report.expect("time report requested");
+            assert!(report.modules.iter().all(|m| m.wall.is_zero() && m.alloc_kb.unwrap_or(0) == 0));
+        }
+        let _ = fs::remove_dir_all(&dir);
+    }
+}
@@ -1,6 +1,6 @@
 #![allow(dead_code)]
 
-use crate::ast::Expression;
+use crate::ast::ExprId;
 use std::collections::HashMap;
 use std::fmt;
 
@@ -14,6 +14,7 @@ pub enum DataType {
     Unknown,
     Struct(String),
     Nullable(Box<DataType>),
+    Array(Box<DataType>),
 }
 
 impl fmt::Display for DataType {
@@ -27,6 +28,7 @@ impl fmt::Display for DataType {
             DataType::Unknown => "unknown",
             DataType::Struct(name) => return write!(f, "{}", name),
             DataType::Nullable(inner) => return write!(f, "{}?", inner),
+            DataType::Array(elem) => return write!(f, "{}[]", elem),
         };
         write!(f, "{}", s)
     }
@@ -39,10 +41,11 @@ pub enum SymbolType {
     Module,
 }
 
+#[derive(Debug, Clone)]
 pub struct ArrayDimension {
     pub is_constant: bool,
     pub constant_size: i32,
-    pub size_expr: Option<Box<dyn Expression>>,
+    pub size_expr: Option<ExprId>,
 }
 
 impl ArrayDimension {
@@ -54,7 +57,7 @@ impl ArrayDimension {
         }
     }
 
-    pub fn new_expr(expr: Box<dyn Expression>) -> Self {
+    pub fn new_expr(expr: ExprId) -> Self {
         ArrayDimension {
             is_constant: false,
             constant_size: 0,
@@ -63,26 +66,6 @@ impl ArrayDimension {
     }
 }
 
-impl Clone for ArrayDimension {
-    fn clone(&self) -> Self {
-        ArrayDimension {
-            is_constant: self.is_constant,
-            constant_size: self.constant_size,
-            size_expr: None, // Can't clone dyn Expression
-        }
-    }
-}
-
-impl std::fmt::Debug for ArrayDimension {
-    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
-        f.debug_struct("ArrayDimension")
-            .field("is_constant", &self.is_constant)
-            .field("constant_size", &self.constant_size)
-            .field("size_expr", &self.size_expr.as_ref().map(|_| "<expr>"))
-            .finish()
-    }
-}
-
 pub struct Symbol {
     pub name: String,
     pub symbol_type: SymbolType,
@@ -175,7 +158,7 @@ impl Symbol {
         name: &str,
         dt: &DataType,
         scope: i32,
-        size_exprs: Vec<Box<dyn Expression>>,
+        size_exprs: Vec<ExprId>,
         is_mut: bool,
     ) -> Self {
         let dimensions: Vec<ArrayDimension> = size_exprs.into_iter().map(ArrayDimension::new_expr).collect();
@@ -207,11 +190,11 @@ impl Symbol {
         }
     }
 
-    pub fn get_size_expr(&self, dim: i32) -> Option<&dyn Expression> {
+    pub fn get_size_expr(&self, dim: i32) -> Option<ExprId> {
         if dim < 0 || dim as usize >= self.dimensions.len() {
             return None;
         }
-        self.dimensions[dim as usize].size_expr.as_deref().map(|e| e.as_expression())
+        self.dimensions[dim as usize].size_expr
     }
 
     pub fn is_dimension_constant(&self, dim: i32) -> bool {
@@ -226,81 +209,160 @@ pub fn data_type_to_string(dt: DataType) -> String {
     dt.to_string()
 }
 
+/// Interned identifier: an index into the environment's name table.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct SymbolId(u32);
+
+/// Maps each distinct name to a `SymbolId`, so scope lookups index
+/// vectors instead of hashing the name once per scope level.
+#[derive(Default, Clone)]
+pub struct Interner {
+    ids: HashMap<String, SymbolId>,
+    names: Vec<String>,
+}
+
+impl Interner {
+    pub fn intern(&mut self, name: &str) -> SymbolId {
+        if let Some(&id) = self.ids.get(name) {
+            return id;
+        }
+        let id = SymbolId(self.names.len() as u32);
+        self.names.push(name.to_string());
+        self.ids.insert(name.to_string(), id);
+        id
+    }
+
+    /// Id of a name seen before; a name that was never interned can't be bound.
+    pub fn get(&self, name: &str) -> Option<SymbolId> {
+        self.ids.get(name).copied()
+    }
+
+    pub fn resolve(&self, id: SymbolId) -> &str {
+        &self.names[id.0 as usize]
+    }
+
+    pub fn len(&self) -> usize {
+        self.names.len()
+    }
+}
+
+/// A local binding on the scope stack, and the binding of the same name it shadows.
+#[derive(Clone)]
+struct Binding {
+    id: SymbolId,
+    symbol: Symbol,
+    shadowed: Option<usize>,
+}
+
+/// Global symbols live in a table indexed by `SymbolId`; locals live on
+/// one flat binding stack, cut into scopes by the marks in `scope_starts`.
+/// `innermost[id]` is the stack slot currently visible for a name, so a
+/// lookup is one intern-table probe plus two index operations, entering a
+/// scope pushes a mark and leaving one pops just the bindings it made.
+#[derive(Clone)]
 pub struct Environment {
-    scopes: Vec<HashMap<String, Symbol>>,
+    interner: Interner,
+    globals: Vec<Option<Symbol>>,
+    locals: Vec<Binding>,
+    innermost: Vec<Option<usize>>,
+    scope_starts: Vec<usize>,
 }
 
 impl Environment {
     pub fn new() -> Self {
-        let mut env = Environment { scopes: Vec::new() };
-        env.scopes.push(HashMap::new()); // global scope
-        env
+        Environment {
+            interner: Interner::default(),
+            globals: Vec::new(),
+            locals: Vec::new(),
+            innermost: Vec::new(),
+            scope_starts: Vec::new(),
+        }
     }
 
     pub fn enter_scope(&mut self) {
-        self.scopes.push(HashMap::new());
+        self.scope_starts.push(self.locals.len());
     }
 
     pub fn exit_scope(&mut self) {
-        if !self.scopes.is_empty() {
-            self.scopes.pop();
+        let Some(start) = self.scope_starts.pop() else { return };
+        while self.locals.len() > start {
+            let b = self.locals.pop().unwrap();
+            self.innermost[b.id.0 as usize] = b.shadowed;
         }
     }
 
     pub fn get_current_scope(&self) -> i32 {
-        self.scopes.len() as i32 - 1
+        self.scope_starts.len() as i32
     }
 
     pub fn get_scope_count(&self) -> usize {
-        self.scopes.len()
+        self.scope_starts.len() + 1
     }
 
-    pub fn declare_variable(&mut self, name: &str, dt: &DataType, is_mut: bool) -> bool {
-        if self.scopes.is_empty() {
-            self.scopes.push(HashMap::new());
+    pub fn intern(&mut self, name: &str) -> SymbolId {
+        let id = self.interner.intern(name);
+        if self.globals.len() < self.interner.len() {
+            self.globals.resize_with(self.interner.len(), || None);
+            self.innermost.resize(self.interner.len(), None);
         }
+        id
+    }
 
-        let scope_level = self.get_current_scope();
-        let scope = self.scopes.last_mut().unwrap();
-        if scope.contains_key(name) {
+    pub fn name_of(&self, id: SymbolId) -> &str {
+        self.interner.resolve(id)
+    }
+
+    /// Bind `sym` in the current scope unless the name is already bound there.
+    fn bind(&mut self, name: &str, sym: Symbol) -> bool {
+        let id = self.intern(name);
+        if self.scope_starts.is_empty() {
+            let slot = &mut self.globals[id.0 as usize];
+            if slot.is_some() {
+                return false;
+            }
+            *slot = Some(sym);
+            return true;
+        }
+        if self.is_bound_in_current_scope(id) {
             return false;
         }
-
-        let mut sym = Symbol::new_variable(name, dt, scope_level);
-        sym.is_mut = is_mut;
-        scope.insert(name.to_string(), sym);
+        let shadowed = self.innermost[id.0 as usize];
+        self.innermost[id.0 as usize] = Some(self.locals.len());
+        self.locals.push(Binding { id, symbol: sym, shadowed });
         true
     }
 
-    pub fn declare_function(&mut self, name: &str, return_type: &DataType, module_name: &str) -> bool {
-        if self.scopes.is_empty() {
-            self.scopes.push(HashMap::new());
+    fn is_bound_in_current_scope(&self, id: SymbolId) -> bool {
+        match self.scope_starts.last() {
+            None => self.globals[id.0 as usize].is_some(),
+            Some(&start) => self.innermost[id.0 as usize].map_or(false, |slot| slot >= start),
         }
+    }
 
+    pub fn declare_variable(&mut self, name: &str, dt: &DataType, is_mut: bool) -> bool {
+        let mut sym = Symbol::new_variable(name, dt, self.get_current_scope());
+        sym.is_mut = is_mut;
+        self.bind(name, sym)
+    }
+
+    pub fn declare_function(&mut self, name: &str, return_type: &DataType, module_name: &str) -> bool {
         let full_name = format!("{}.{}", module_name, name);
-        let global_scope = &mut self.scopes[0];
+        let id = self.intern(&full_name);
 
         // Allow duplicate declarations (e.g., from load_module + direct analysis)
-        global_scope.insert(full_name, Symbol::new_function(name, module_name, return_type, 0));
+        self.globals[id.0 as usize] = Some(Symbol::new_function(name, module_name, return_type, 0));
         true
     }
 
     pub fn declare_module(&mut self, name: &str) -> bool {
-        if self.scopes.is_empty() {
-            self.scopes.push(HashMap::new());
-        }
-
-        let global_scope = &mut self.scopes[0];
-        if let Some(existing) = global_scope.get(name) {
-            if existing.symbol_type != SymbolType::Module {
-                return false;
-            }
-            return true;
+        let id = self.intern(name);
+        if let Some(existing) = &self.globals[id.0 as usize] {
+            return existing.symbol_type == SymbolType::Module;
         }
 
         let mut sym = Symbol::new_variable(name, &DataType::None_, 0);
         sym.symbol_type = SymbolType::Module;
-        global_scope.insert(name.to_string(), sym);
+        self.globals[id.0 as usize] = Some(sym);
         true
     }
 
@@ -311,63 +373,38 @@ impl Environment {
         sizes: &[i32],
         is_mut: bool,
     ) -> bool {
-        if self.scopes.is_empty() {
-            self.scopes.push(HashMap::new());
-        }
-
-        let scope_level = self.get_current_scope();
-        let scope = self.scopes.last_mut().unwrap();
-        if scope.contains_key(name) {
-            return false;
-        }
-
-        scope.insert(
-            name.to_string(),
-            Symbol::new_array_constant(name, element_type, scope_level, sizes, is_mut),
-        );
-        true
+        let sym = Symbol::new_array_constant(name, element_type, self.get_current_scope(), sizes, is_mut);
+        self.bind(name, sym)
     }
 
     pub fn declare_array_expr(
         &mut self,
         name: &str,
         element_type: &DataType,
-        size_exprs: Vec<Box<dyn Expression>>,
+        size_exprs: Vec<ExprId>,
         is_mut: bool,
     ) -> bool {
-        if self.scopes.is_empty() {
-            self.scopes.push(HashMap::new());
-        }
-
-        let scope_level = self.get_current_scope();
-        let scope = self.scopes.last_mut().unwrap();
-        if scope.contains_key(name) {
-            return false;
-        }
-
-        scope.insert(
-            name.to_string(),
-            Symbol::new_array_expr(name, element_type, scope_level, size_exprs, is_mut),
-        );
-        true
+        let sym = Symbol::new_array_expr(name, element_type, self.get_current_scope(), size_exprs, is_mut);
+        self.bind(name, sym)
     }
 
     pub fn lookup_symbol(&self, name: &str) -> Option<&Symbol> {
-        for scope in self.scopes.iter().rev() {
-            if let Some(sym) = scope.get(name) {
-                return Some(sym);
-            }
+        self.interner.get(name).and_then(|id| self.lookup_id(id))
+    }
+
+    pub fn lookup_id(&self, id: SymbolId) -> Option<&Symbol> {
+        match self.innermost[id.0 as usize] {
+            Some(slot) => Some(&self.locals[slot].symbol),
+            None => self.globals[id.0 as usize].as_ref(),
         }
-        None
     }
 
     pub fn lookup_symbol_mut(&mut self, name: &str) -> Option<&mut Symbol> {
-        for scope in self.scopes.iter_mut().rev() {
-            if let Some(sym) = scope.get_mut(name) {
-                return Some(sym);
-            }
+        let id = self.interner.get(name)?;
+        match self.innermost[id.0 as usize] {
+            Some(slot) => Some(&mut self.locals[slot].symbol),
+            None => self.globals[id.0 as usize].as_mut(),
         }
-        None
     }
 
     pub fn is_declared(&self, name: &str) -> bool {
@@ -375,10 +412,7 @@ impl Environment {
     }
 
     pub fn is_declared_in_current_scope(&self, name: &str) -> bool {
-        if self.scopes.is_empty() {
-            return false;
-        }
-        self.scopes.last().unwrap().contains_key(name)
+        self.interner.get(name).map_or(false, |id| self.is_bound_in_current_scope(id))
     }
 
     pub fn get_symbol_type(&self, name: &str) -> DataType {
@@ -407,90 +441,73 @@ impl Environment {
     }
 
     pub fn reset(&mut self) {
-        self.scopes.clear();
-        self.scopes.push(HashMap::new());
+        *self = Environment::new();
     }
 
-    #[cfg(debug_assertions)]
-    pub fn print_scope(&self) {
-        if self.scopes.is_empty() {
-            println!("No scopes available");
-            return;
+    /// Symbols of scope `level` (0 is the global scope).  Locals come in
+    /// declaration order; globals in the order their names were first
+    /// interned, which a use before the declaration can change.
+    fn scope_symbols(&self, level: usize) -> Vec<(&str, &Symbol)> {
+        if level == 0 {
+            return self.globals.iter().enumerate()
+                .filter_map(|(i, s)| s.as_ref().map(|s| (self.interner.resolve(SymbolId(i as u32)), s)))
+                .collect();
         }
+        let start = self.scope_starts[level - 1];
+        let end = self.scope_starts.get(level).copied().unwrap_or(self.locals.len());
+        self.locals[start..end].iter()
+            .map(|b| (self.interner.resolve(b.id), &b.symbol))
+            .collect()
+    }
 
-        let current = self.scopes.len() - 1;
-        println!("=== Current Scope (level {}) ===", current);
-
-        let scope = self.scopes.last().unwrap();
-        if scope.is_empty() {
+    #[cfg(debug_assertions)]
+    fn print_symbols(symbols: &[(&str, &Symbol)]) {
+        if symbols.is_empty() {
             println!("  (empty)");
-        } else {
-            for (name, sym) in scope {
-                print!("  {} : ", name);
-                match sym.symbol_type {
-                    SymbolType::Variable => print!("variable"),
-                    SymbolType::Function => print!("function"),
-                    SymbolType::Module => print!("module"),
-                }
-                print!(" ({})", sym.data_type);
-                if !sym.module_name.is_empty() {
-                    print!(" [module={}]", sym.module_name);
-                }
-                if sym.is_array {
-                    print!(" array[");
-                    for (j, dim) in sym.dimensions.iter().enumerate() {
-                        if j > 0 {
-                            print!(",");
-                        }
-                        if dim.is_constant {
-                            print!("{}", dim.constant_size);
-                        } else {
-                            print!("expr");
-                        }
+            return;
+        }
+        for (name, sym) in symbols {
+            print!("  {} : ", name);
+            match sym.symbol_type {
+                SymbolType::Variable => print!("variable"),
+                SymbolType::Function => print!("function"),
+                SymbolType::Module => print!("module"),
+            }
+            print!(" ({})", sym.data_type);
+            if !sym.module_name.is_empty() {
+                print!(" [module={}]", sym.module_name);
+            }
+            if sym.is_array {
+                print!(" array[");
+                for (j, dim) in sym.dimensions.iter().enumerate() {
+                    if j > 0 {
+                        print!(",");
+                    }
+                    if dim.is_constant {
+                        print!("{}", dim.constant_size);
+                    } else {
+                        print!("expr");
                     }
-                    print!("]");
                 }
-                println!(" ({})", if sym.is_mut { "var" } else { "val" });
+                print!("]");
             }
+            println!(" ({})", if sym.is_mut { "var" } else { "val" });
         }
     }
 
+    #[cfg(debug_assertions)]
+    pub fn print_scope(&self) {
+        let current = self.scope_starts.len();
+        println!("=== Current Scope (level {}) ===", current);
+        Self::print_symbols(&self.scope_symbols(current));
+    }
+
     #[cfg(debug_assertions)]
     pub fn print_all_scopes(&self) {
-        println!("=== All Scopes ({} levels) ===", self.scopes.len());
-        for (i, scope) in self.scopes.iter().enumerate() {
+        println!("=== All Scopes ({} levels) ===", self.get_scope_count());
+        for i in 0..self.get_scope_count() {
             println!("Scope {}:", i);
-            if scope.is_empty() {
-                println!("  (empty)");
-            } else {
-                for (name, sym) in scope {
-                    print!("  {} : ", name);
-                    match sym.symbol_type {
-                        SymbolType::Variable => print!("variable"),
-                        SymbolType::Function => print!("function"),
-                        SymbolType::Module => print!("module"),
-                    }
-                    print!(" ({})", sym.data_type);
-                    if !sym.module_name.is_empty() {
-                        print!(" [module={}]", sym.module_name);
-                    }
-                    if sym.is_array {
-                        print!(" array[");
-                        for (j, dim) in sym.dimensions.iter().enumerate() {
-                            if j > 0 {
-                                print!(",");
-                            }
-                            if dim.is_constant {
-                                print!("{}", dim.constant_size);
-                            } else {
-                                print!("expr");
-                            }
-                        }
-                        print!("]");
-                    }
-                    println!(" ({})", if sym.is_mut { "var" } else { "val" });
-                }
-            }
+            Self::print_symbols(&self.scope_symbols(i));
         }
     }
 }
@@ -1,7 +1,7 @@
 // ir.rs
 use crate::ast::*;
 use crate::environment::DataType;
-use std::collections::HashMap;
+use std::collections::{HashMap, HashSet, VecDeque};
 
 // ==================== IR 数据结构 ====================
 
@@ -10,6 +10,7 @@ pub struct GobolIR {
     pub functions: Vec<IRFunction>,
     pub structs: Vec<IRStruct>,
     pub impls: Vec<IRImpl>,
+    pub constants: Vec<IRConstant>,
     pub main_function: Option<String>,
 }
 
@@ -23,6 +24,10 @@ pub struct IRFunction {
     pub is_main: bool,
     pub is_method: bool,
     pub struct_name: Option<String>,
+    /// 声明所在的源码行（从 1 开始，未知为 0）
+    pub line: usize,
+    /// 所在源文件，由驱动合并模块时填写（未知为空）
+    pub file: String,
 }
 
 #[derive(Debug, Clone)]
@@ -51,11 +56,26 @@ pub struct IRImpl {
     pub methods: Vec<IRFunction>,
 }
 
+/// 顶层 `val` 常量，如 `math.PI`；导入后以 `module.NAME` 命名
+#[derive(Debug, Clone)]
+pub struct IRConstant {
+    pub name: String,
+    pub ty: DataType,
+    pub value: IRExpr,
+}
+
 #[derive(Debug, Clone)]
 pub struct IRBlock {
     pub statements: Vec<IRStmt>,
 }
 
+/// `parallel for` 的 `reduce(op: var)`：每个线程先在私有副本上累积，结束时按 `op` 合并回 `var`
+#[derive(Debug, Clone)]
+pub struct Reduction {
+    pub op: String,
+    pub var: String,
+}
+
 #[derive(Debug, Clone)]
 pub enum IRStmt {
     Declaration { name: String, ty: DataType, init: Option<IRExpr> },
@@ -68,7 +88,10 @@ pub enum IRStmt {
     Assignment { target: IRExpr, value: IRExpr },
     Call { func: String, args: Vec<IRExpr>, generic_args: Vec<DataType> },
     MethodCall { object: Box<IRExpr>, method: String, args: Vec<IRExpr>, generic_args: Vec<DataType> },
-    For { vars: Vec<String>, iterable: IRExpr, body: IRBlock },
+    /// `parallel` 为 `Some` 时是 `parallel for`：各次迭代互不依赖，可分到多个线程上执行
+    For { vars: Vec<String>, iterable: IRExpr, body: IRBlock, parallel: Option<Vec<Reduction>> },
+    /// `region { ... }`：块内分配的字符串与数组在块结束时一并释放
+    Region { body: IRBlock },
 }
 
 #[derive(Debug, Clone)]
@@ -85,9 +108,19 @@ pub enum IRExpr {
     StructLiteral { name: String, fields: Vec<(String, IRExpr)> },
     Cast { expr: Box<IRExpr>, target: DataType },
     Assignment { target: Box<IRExpr>, value: Box<IRExpr> },  // ← 添加这个
+    Format(Vec<FormatPart>),
+    /// 定长数组 `T[d0][d1]...` 的零初始化存储，各维按书写顺序排列
+    ArrayNew { dims: Vec<IRExpr> },
     None,
 }
 
+/// 格式字符串 `@"..."` 的一个片段：字面量或插值表达式
+#[derive(Debug, Clone)]
+pub enum FormatPart {
+    Lit(String),
+    Expr(IRExpr),
+}
+
 #[derive(Debug, Clone)]
 pub enum LitValue {
     Int(i64),
@@ -97,6 +130,130 @@ pub enum LitValue {
     None,
 }
 
+// ==================== IR 遍历 ====================
+
+/// 后序改写块内每个表达式：子表达式先于父表达式交给 `f`
+pub fn rewrite_block(block: &mut IRBlock, f: &mut dyn FnMut(&mut IRExpr)) {
+    for stmt in block.statements.iter_mut() {
+        rewrite_stmt(stmt, f);
+    }
+}
+
+pub fn rewrite_stmt(stmt: &mut IRStmt, f: &mut dyn FnMut(&mut IRExpr)) {
+    match stmt {
+        IRStmt::Declaration { init, .. } => {
+            if let Some(e) = init { rewrite_expr(e, f); }
+        }
+        IRStmt::Expression(e) => rewrite_expr(e, f),
+        IRStmt::Return(e) => {
+            if let Some(e) = e { rewrite_expr(e, f); }
+        }
+        IRStmt::If { cond, then_block, else_block } => {
+            rewrite_expr(cond, f);
+            rewrite_block(then_block, f);
+            if let Some(b) = else_block { rewrite_block(b, f); }
+        }
+        IRStmt::While { cond, body } => {
+            rewrite_expr(cond, f);
+            rewrite_block(body, f);
+        }
+        IRStmt::Assignment { target, value } => {
+            rewrite_expr(target, f);
+            rewrite_expr(value, f);
+        }
+        IRStmt::Call { args, .. } => {
+            for a in args.iter_mut() { rewrite_expr(a, f); }
+        }
+        IRStmt::MethodCall { object, args, .. } => {
+            rewrite_expr(object, f);
+            for a in args.iter_mut() { rewrite_expr(a, f); }
+        }
+        IRStmt::For { iterable, body, .. } => {
+            rewrite_expr(iterable, f);
+            rewrite_block(body, f);
+        }
+        IRStmt::Region { body } => rewrite_block(body, f),
+        IRStmt::Break | IRStmt::Continue => {}
+    }
+}
+
+pub fn rewrite_expr(expr: &mut IRExpr, f: &mut dyn FnMut(&mut IRExpr)) {
+    match expr {
+        IRExpr::Binary { left, right, .. } => {
+            rewrite_expr(left, f);
+            rewrite_expr(right, f);
+        }
+        IRExpr::Unary { operand: x, .. } | IRExpr::Cast { expr: x, .. } | IRExpr::MemberAccess { object: x, .. } => {
+            rewrite_expr(x, f);
+        }
+        IRExpr::Call { args, .. } | IRExpr::ArrayLiteral(args) | IRExpr::ArrayNew { dims: args } => {
+            for a in args.iter_mut() { rewrite_expr(a, f); }
+        }
+        IRExpr::MethodCall { object, args, .. } => {
+            rewrite_expr(object, f);
+            for a in args.iter_mut() { rewrite_expr(a, f); }
+        }
+        IRExpr::ArrayIndex { array, index } => {
+            rewrite_expr(array, f);
+            rewrite_expr(index, f);
+        }
+        IRExpr::StructLiteral { fields, .. } => {
+            for (_, v) in fields.iter_mut() { rewrite_expr(v, f); }
+        }
+        IRExpr::Assignment { target, value } => {
+            rewrite_expr(target, f);
+            rewrite_expr(value, f);
+        }
+        IRExpr::Format(parts) => {
+            for p in parts.iter_mut() {
+                if let FormatPart::Expr(x) = p { rewrite_expr(x, f); }
+            }
+        }
+        IRExpr::Literal(_) | IRExpr::Variable(_) | IRExpr::None => {}
+    }
+    f(expr);
+}
+
+/// 先序只读遍历表达式：父表达式先于子表达式交给 `f`
+pub fn visit_expr(expr: &IRExpr, f: &mut dyn FnMut(&IRExpr)) {
+    f(expr);
+    match expr {
+        IRExpr::Binary { left, right, .. } | IRExpr::ArrayIndex { array: left, index: right }
+        | IRExpr::Assignment { target: left, value: right } => {
+            visit_expr(left, f);
+            visit_expr(right, f);
+        }
+        IRExpr::Unary { operand: x, .. } | IRExpr::Cast { expr: x, .. } | IRExpr::MemberAccess { object: x, .. } => {
+            visit_expr(x, f);
+        }
+        IRExpr::Call { args, .. } | IRExpr::ArrayLiteral(args) | IRExpr::ArrayNew { dims: args } => {
+            for a in args { visit_expr(a, f); }
+        }
+        IRExpr::MethodCall { object, args, .. } => {
+            visit_expr(object, f);
+            for a in args { visit_expr(a, f); }
+        }
+        IRExpr::StructLiteral { fields, .. } => {
+            for (_, v) in fields { visit_expr(v, f); }
+        }
+        IRExpr::Format(parts) => {
+            for p in parts {
+                if let FormatPart::Expr(x) = p { visit_expr(x, f); }
+            }
+        }
+        IRExpr::Literal(_) | IRExpr::Variable(_) | IRExpr::None => {}
+    }
+}
+
+/// `math.PI` / `lib.math.PI` 形式的成员访问链还原为点分路径
+pub fn dotted_path(e: &IRExpr) -> Option<String> {
+    match e {
+        IRExpr::Variable(n) => Some(n.clone()),
+        IRExpr::MemberAccess { object, member } => dotted_path(object).map(|p| format!("{}.{}", p, member)),
+        _ => None,
+    }
+}
+
 // ==================== IR 构建器 ====================
 
 pub struct IRBuilder {
@@ -120,6 +277,14 @@ pub struct IRBuilder {
     structs: HashMap<String, IRStruct>,
     methods: HashMap<String, Vec<IRFunction>>,
     
+    // match 降低
+    /// 已降低的 match 个数，用于命名其临时变量
+    matches: usize,
+    /// 下一个 match 处于语句位置，不需要结果
+    discard_match: bool,
+    /// 正在降低的 match 分支是否需要值；不在分支内时为 `None`
+    arm_value: Option<bool>,
+
     // 错误收集
     errors: Vec<String>,
 }
@@ -131,6 +296,7 @@ impl IRBuilder {
                 functions: Vec::new(),
                 structs: Vec::new(),
                 impls: Vec::new(),
+                constants: Vec::new(),
                 main_function: None,
             },
             current_function: None,
@@ -144,29 +310,47 @@ impl IRBuilder {
             generic_stack: Vec::new(),
             structs: HashMap::new(),
             methods: HashMap::new(),
+            matches: 0,
+            discard_match: false,
+            arm_value: None,
             errors: Vec::new(),
         }
     }
 
     pub fn build(mut self, program: &Program) -> Result<GobolIR, Vec<String>> {
+        let ast = program.get_ast();
+
         // 第一遍：收集结构体定义
         for stmt in program.get_statements() {
-            if stmt.as_any().downcast_ref::<StructDefinition>().is_some() {
-                stmt.accept(&mut self);
+            if ast[*stmt].as_struct_definition().is_some() {
+                self.visit_stmt(ast, *stmt);
             }
         }
 
         // 第二遍：收集 impl 块
         for stmt in program.get_statements() {
-            if stmt.as_any().downcast_ref::<ImplBlock>().is_some() {
-                stmt.accept(&mut self);
+            if ast[*stmt].as_impl_block().is_some() {
+                self.visit_stmt(ast, *stmt);
             }
         }
 
         // 第三遍：收集函数
         for stmt in program.get_statements() {
-            if stmt.as_any().downcast_ref::<Function>().is_some() {
-                stmt.accept(&mut self);
+            if ast[*stmt].as_function().is_some() {
+                self.visit_stmt(ast, *stmt);
+            }
+        }
+
+        // 第四遍：收集顶层 val 常量
+        for stmt in program.get_statements() {
+            if let Some(decl) = ast[*stmt].as_declaration() {
+                if decl.get_keyword() != "val" {
+                    continue;
+                }
+                self.visit_declaration(ast, decl);
+                if let Some(IRStmt::Declaration { name, ty, init: Some(value) }) = self.current_block.pop() {
+                    self.ir.constants.push(IRConstant { name, ty, value });
+                }
             }
         }
 
@@ -179,6 +363,26 @@ impl IRBuilder {
 
     // ==================== 辅助方法 ====================
 
+    /// 在当前构建器上降低嵌套块：暂存外层语句与表达式栈，返回块内语句。
+    /// 结构体表与泛型上下文直接共享，不必为每个块复制一份
+    fn nested(&mut self, f: impl FnOnce(&mut Self)) -> Vec<IRStmt> {
+        let outer_block = std::mem::take(&mut self.current_block);
+        let outer_exprs = std::mem::take(&mut self.expr_stack);
+        f(self);
+        self.expr_stack = outer_exprs;
+        std::mem::replace(&mut self.current_block, outer_block)
+    }
+
+    /// 单独降低一个表达式（如格式串占位符、for 的迭代对象）
+    fn lower_expr(&mut self, ast: &Ast, id: ExprId) -> IRExpr {
+        let mut expr = IRExpr::None;
+        self.nested(|b| {
+            b.visit_expr(ast, id);
+            expr = b.pop_expr();
+        });
+        expr
+    }
+
     fn push_expr(&mut self, expr: IRExpr) {
         self.expr_stack.push(expr);
     }
@@ -208,7 +412,7 @@ impl IRBuilder {
         None
     }
 
-    fn ast_type_to_data_type(&mut self, ty: Option<&dyn Type>) -> DataType {
+    fn ast_type_to_data_type(&mut self, ty: Option<&Type>) -> DataType {
         let ty = match ty {
             Some(t) => t,
             None => return DataType::None_,
@@ -220,25 +424,26 @@ impl IRBuilder {
             return binding;
         }
 
-        // 检查数组类型 → return Unknown to mark as array
-        if ty.as_type_any().downcast_ref::<ArrayType>().is_some() {
-            return DataType::Unknown;
+        // 检查数组类型（多维数组为嵌套的 Array）
+        if let Some(arr) = ty.as_array() {
+            let elem = self.ast_type_to_data_type(Some(arr.get_element_type()));
+            return DataType::Array(Box::new(elem));
         }
 
         // 检查泛型类型（如 vec<int>）
-        if let Some(gt) = ty.as_type_any().downcast_ref::<GenericType>() {
+        if let Some(gt) = ty.as_generic() {
             let base_name = gt.get_base_name();
             // 如果是 vec，当作数组
             if base_name == "vec" && !gt.get_type_args().is_empty() {
-                let elem = self.ast_type_to_data_type(Some(&*gt.get_type_args()[0]));
-                return elem;
+                let elem = self.ast_type_to_data_type(Some(&gt.get_type_args()[0]));
+                return DataType::Array(Box::new(elem));
             }
             // 其他泛型类型当作结构体
             return DataType::Struct(base_name.to_string());
         }
 
         // 检查可空类型
-        if let Some(nullable) = ty.as_type_any().downcast_ref::<NullableType>() {
+        if let Some(nullable) = ty.as_nullable() {
             let inner = self.ast_type_to_data_type(Some(nullable.get_inner_type()));
             return DataType::Nullable(Box::new(inner));
         }
@@ -254,8 +459,30 @@ impl IRBuilder {
         }
     }
 
+    /// 定长数组类型的各维大小（按书写顺序）；任一维未给出大小（`int[]`）时返回 None
+    fn array_dims(&mut self, ast: &Ast, ty: Option<&Type>) -> Option<Vec<IRExpr>> {
+        let mut arr = ty?.as_array()?;
+        let mut dims = Vec::new();
+        loop {
+            let size = self.lower_expr(ast, arr.get_size()?);
+            // 解析器用 0 表示未指定大小
+            if matches!(size, IRExpr::Literal(LitValue::Int(0))) {
+                return None;
+            }
+            dims.push(size);
+            match arr.get_element_type().as_array() {
+                Some(inner) => arr = inner,
+                None => break,
+            }
+        }
+        // 外层 ArrayType 对应最后一个 `[...]`
+        dims.reverse();
+        Some(dims)
+    }
+
     fn extract_generic_params(&self, func: &Function) -> Vec<String> {
-        let mut params = Vec::new();
+        // 显式声明的 `<T>` 在前，其余从参数与返回类型中推断
+        let mut params = func.get_generic_params().clone();
         
         if let Some(param_list) = func.get_parameters() {
             for p in param_list {
@@ -267,11 +494,12 @@ impl IRBuilder {
             self.collect_generic_names(Some(ret), &mut params);
         }
         
-        params.dedup();
+        let mut seen = HashSet::new();
+        params.retain(|p| seen.insert(p.clone()));
         params
     }
 
-    fn collect_generic_names(&self, ty: Option<&dyn Type>, params: &mut Vec<String>) {
+    fn collect_generic_names(&self, ty: Option<&Type>, params: &mut Vec<String>) {
         let ty = match ty {
             Some(t) => t,
             None => return,
@@ -279,23 +507,23 @@ impl IRBuilder {
 
         let name = ty.get_name();
         // Only treat as generic param if lowercase AND not a built-in type
-        let is_builtin = matches!(name, "int" | "float" | "bool" | "str" | "none");
+        let is_builtin = matches!(name, "int" | "float" | "bool" | "str" | "none" | "range");
         if !is_builtin && name.chars().next().map_or(false, |c| c.is_lowercase()) {
             params.push(name.to_string());
         }
 
         // 检查嵌套类型
-        if let Some(gt) = ty.as_type_any().downcast_ref::<GenericType>() {
+        if let Some(gt) = ty.as_generic() {
             for arg in gt.get_type_args() {
-                self.collect_generic_names(Some(arg.as_type()), params);
+                self.collect_generic_names(Some(arg), params);
             }
         }
 
-        if let Some(arr) = ty.as_type_any().downcast_ref::<ArrayType>() {
+        if let Some(arr) = ty.as_array() {
             self.collect_generic_names(Some(arr.get_element_type()), params);
         }
 
-        if let Some(nullable) = ty.as_type_any().downcast_ref::<NullableType>() {
+        if let Some(nullable) = ty.as_nullable() {
             self.collect_generic_names(Some(nullable.get_inner_type()), params);
         }
     }
@@ -347,38 +575,52 @@ impl IRBuilder {
         }
     }
 
-    fn build_arm_body(&mut self, arm: &MatchArm) -> IRBlock {
+    /// 分支体：变量模式先绑定 scrutinee；`result` 为 `Some` 时分支的最后一个表达式写入该变量
+    fn build_arm_body(&mut self, ast: &Ast, arm: &MatchArm, subject: &IRExpr, result: Option<&str>) -> IRBlock {
         let mut block = IRBlock { statements: Vec::new() };
-        
-        // 如果是变量模式，在 body 中声明变量
+
         if let MatchPattern::Variable(name) = &arm.pattern {
-            // 这里需要从 scrutinee 推导类型，暂时用 Unknown
             block.statements.push(IRStmt::Declaration {
                 name: name.clone(),
                 ty: DataType::Unknown,
-                init: Some(self.pop_expr()), // 这里需要保留 scrutinee
+                init: Some(subject.clone()),
             });
-            // 实际上我们应该把 scrutinee 推回栈，因为上面已经 pop 了
-            // 更好的方式是在构建条件时不消耗 scrutinee
         }
 
-        // 处理 body
-        if let Some(body) = &arm.body {
-            // 使用子构建器处理 body
-            let mut sub_builder = IRBuilder::new();
-            sub_builder.generic_stack = self.generic_stack.clone();
-            
-            if let Some(block_node) = body.as_any().downcast_ref::<Block>() {
-                for stmt in block_node.get_statements() {
-                    stmt.accept(&mut sub_builder);
+        let mut tail_value = false;
+        if let Some(body) = arm.body {
+            let outer_arm = self.arm_value.replace(result.is_some());
+            let statements = self.nested(|b| {
+                if let Some(block_node) = ast[body].as_block() {
+                    for stmt in block_node.get_statements() {
+                        b.visit_stmt(ast, *stmt);
+                    }
+                } else {
+                    b.visit_stmt(ast, body);
                 }
-            } else {
-                body.accept(&mut sub_builder);
+            });
+            self.arm_value = outer_arm;
+            block.statements.extend(statements);
+            tail_value = ast[body].as_block()
+                .and_then(|b| b.get_statements().last())
+                .map_or(false, |&last| ast[last].as_expression_statement().is_some());
+        }
+
+        // 最后一个表达式是分支的值，不是函数的返回值
+        if tail_value {
+            if let Some(last) = block.statements.pop() {
+                let last = match (last, result) {
+                    (IRStmt::Expression(e) | IRStmt::Return(Some(e)), Some(r)) => IRStmt::Assignment {
+                        target: IRExpr::Variable(r.to_string()),
+                        value: e,
+                    },
+                    (IRStmt::Return(Some(e)), None) => IRStmt::Expression(e),
+                    (other, _) => other,
+                };
+                block.statements.push(last);
             }
-            
-            block.statements.extend(sub_builder.current_block);
         }
-        
+
         block
     }
 
@@ -391,11 +633,11 @@ impl IRBuilder {
 // ==================== AstVisitor 实现 ====================
 
 impl AstVisitor for IRBuilder {
-    fn visit_program(&mut self, _node: &Program) {
+    fn visit_program(&mut self, _ast: &Ast, _node: &Program) {
         // 在 build() 中处理
     }
 
-    fn visit_struct_definition(&mut self, node: &StructDefinition) {
+    fn visit_struct_definition(&mut self, _ast: &Ast, node: &StructDefinition) {
         let name = node.get_name().to_string();
         let generic_params = node.get_generic_params().clone();
 
@@ -406,7 +648,7 @@ impl AstVisitor for IRBuilder {
             .map(|f| {
                 IRField {
                     name: f.name.clone(),
-                    ty: self.ast_type_to_data_type(f.field_type.as_deref()),
+                    ty: self.ast_type_to_data_type(f.field_type.as_ref()),
                 }
             })
             .collect();
@@ -423,7 +665,7 @@ impl AstVisitor for IRBuilder {
         self.ir.structs.push(ir_struct);
     }
 
-    fn visit_impl_block(&mut self, node: &ImplBlock) {
+    fn visit_impl_block(&mut self, ast: &Ast, node: &ImplBlock) {
         let struct_name = node.get_struct_name().to_string();
         let generic_params = node.get_generic_params().clone();
 
@@ -445,7 +687,7 @@ impl AstVisitor for IRBuilder {
                     let prev_in_function = self.in_function;
                     
                     // 处理方法
-                    func.accept(self);
+                    self.visit_function(ast, func);
                     
                     // 提取方法
                     if let Some(mut ir_func) = self.current_ir_function.take() {
@@ -487,7 +729,7 @@ impl AstVisitor for IRBuilder {
         self.ir.impls.push(ir_impl);
     }
 
-    fn visit_function(&mut self, node: &Function) {
+    fn visit_function(&mut self, ast: &Ast, node: &Function) {
         let name = node.get_name().to_string();
         let is_main = name == "main";
         let is_method = self.current_struct.is_some();
@@ -550,6 +792,8 @@ impl AstVisitor for IRBuilder {
             is_main,
             is_method,
             struct_name: self.current_struct.clone(),
+            line: node.get_line().max(0) as usize,
+            file: String::new(),
         });
 
         // 处理函数体
@@ -558,7 +802,7 @@ impl AstVisitor for IRBuilder {
             if is_method && self.current_struct.is_some() {
                 // self 作为隐式参数
             }
-            body.accept(self);
+            self.visit_block(ast, body);
         }
 
         self.pop_generic_scope();
@@ -569,32 +813,43 @@ impl AstVisitor for IRBuilder {
         }
     }
 
-    fn visit_block(&mut self, node: &Block) {
+    fn visit_block(&mut self, ast: &Ast, node: &Block) {
         for stmt in node.get_statements() {
-            stmt.accept(self);
+            self.visit_stmt(ast, *stmt);
         }
     }
 
-    fn visit_declaration(&mut self, node: &Declaration) {
+    fn visit_declaration(&mut self, ast: &Ast, node: &Declaration) {
         let name = node.get_name().to_string();
         let ty = self.ast_type_to_data_type(node.get_type());
         
         let init = if let Some(init_expr) = node.get_initializer() {
-            init_expr.accept(self);
+            self.visit_expr(ast, init_expr);
             let expr = self.pop_expr();
             Some(expr)
         } else {
-            None
+            // `var m: int[3][4];` 直接分配 3×4 的存储
+            self.array_dims(ast, node.get_type()).map(|dims| IRExpr::ArrayNew { dims })
         };
 
         self.current_block.push(IRStmt::Declaration { name, ty, init });
     }
 
-    fn visit_expression_statement(&mut self, node: &ExpressionStatement) {
+    fn visit_expression_statement(&mut self, ast: &Ast, node: &ExpressionStatement) {
         if let Some(expr) = node.get_expression() {
-            expr.accept(self);
+            // 语句位置的 match（或无返回值函数末尾的 match）只做分支
+            let is_match = ast[expr].as_match().is_some();
+            let wants_value = self.arm_value.unwrap_or_else(|| {
+                self.current_function_return != DataType::None_ && self.current_function.as_deref() != Some("main")
+            });
+            let discard = is_match && !(node.tail && wants_value);
+            self.discard_match = discard;
+            self.visit_expr(ast, expr);
             let ir_expr = self.pop_expr();
             
+            if discard {
+                return;
+            }
             if node.tail {
                 self.current_block.push(IRStmt::Return(Some(ir_expr)));
             } else {
@@ -603,9 +858,9 @@ impl AstVisitor for IRBuilder {
         }
     }
 
-    fn visit_return_statement(&mut self, node: &ReturnStatement) {
+    fn visit_return_statement(&mut self, ast: &Ast, node: &ReturnStatement) {
         let value = if let Some(expr) = node.get_value() {
-            expr.accept(self);
+            self.visit_expr(ast, expr);
             Some(self.pop_expr())
         } else {
             None
@@ -613,10 +868,10 @@ impl AstVisitor for IRBuilder {
         self.current_block.push(IRStmt::Return(value));
     }
 
-    fn visit_if_statement(&mut self, node: &IfStatement) {
+    fn visit_if_statement(&mut self, ast: &Ast, node: &IfStatement) {
         // 条件
         let cond = if let Some(c) = node.get_condition() {
-            c.accept(self);
+            self.visit_expr(ast, c);
             self.pop_expr()
         } else {
             IRExpr::Literal(LitValue::Bool(false))
@@ -624,10 +879,8 @@ impl AstVisitor for IRBuilder {
 
         // then 分支
         let then_block = if let Some(then_branch) = node.get_then_branch() {
-            let mut builder = IRBuilder::new();
-            then_branch.accept(&mut builder);
             IRBlock {
-                statements: builder.current_block,
+                statements: self.nested(|b| b.visit_stmt(ast, then_branch)),
             }
         } else {
             IRBlock { statements: vec![] }
@@ -635,10 +888,8 @@ impl AstVisitor for IRBuilder {
 
         // else 分支
         let else_block = if let Some(else_branch) = node.get_else_branch() {
-            let mut builder = IRBuilder::new();
-            else_branch.accept(&mut builder);
             Some(IRBlock {
-                statements: builder.current_block,
+                statements: self.nested(|b| b.visit_stmt(ast, else_branch)),
             })
         } else {
             None
@@ -647,19 +898,17 @@ impl AstVisitor for IRBuilder {
         self.current_block.push(IRStmt::If { cond, then_block, else_block });
     }
 
-    fn visit_while_statement(&mut self, node: &WhileStatement) {
+    fn visit_while_statement(&mut self, ast: &Ast, node: &WhileStatement) {
         let cond = if let Some(c) = node.get_condition() {
-            c.accept(self);
+            self.visit_expr(ast, c);
             self.pop_expr()
         } else {
             IRExpr::Literal(LitValue::Bool(false))
         };
 
         let body = if let Some(b) = node.get_body() {
-            let mut builder = IRBuilder::new();
-            b.accept(&mut builder);
             IRBlock {
-                statements: builder.current_block,
+                statements: self.nested(|builder| builder.visit_stmt(ast, b)),
             }
         } else {
             IRBlock { statements: vec![] }
@@ -668,17 +917,24 @@ impl AstVisitor for IRBuilder {
         self.current_block.push(IRStmt::While { cond, body });
     }
 
-    fn visit_break_statement(&mut self, _node: &BreakStatement) {
+    fn visit_region_statement(&mut self, ast: &Ast, node: &RegionStatement) {
+        let body = IRBlock {
+            statements: self.nested(|builder| builder.visit_block(ast, node.get_body())),
+        };
+        self.current_block.push(IRStmt::Region { body });
+    }
+
+    fn visit_break_statement(&mut self, _ast: &Ast, _node: &BreakStatement) {
         self.current_block.push(IRStmt::Break);
     }
 
-    fn visit_continue_statement(&mut self, _node: &ContinueStatement) {
+    fn visit_continue_statement(&mut self, _ast: &Ast, _node: &ContinueStatement) {
         self.current_block.push(IRStmt::Continue);
     }
 
     // ==================== Expressions ====================
 
-    fn visit_identifier(&mut self, node: &Identifier) {
+    fn visit_identifier(&mut self, _ast: &Ast, node: &Identifier) {
         let name = node.get_name().to_string();
         
         // 检查是否是泛型参数
@@ -698,7 +954,7 @@ impl AstVisitor for IRBuilder {
         self.push_expr(IRExpr::Variable(name));
     }
 
-    fn visit_number_literal(&mut self, node: &NumberLiteral) {
+    fn visit_number_literal(&mut self, _ast: &Ast, node: &NumberLiteral) {
         let v = node.get_value();
         if v == (v as i64) as f64 {
             self.push_expr(IRExpr::Literal(LitValue::Int(v as i64)));
@@ -707,30 +963,30 @@ impl AstVisitor for IRBuilder {
         }
     }
 
-    fn visit_string_literal(&mut self, node: &StringLiteral) {
+    fn visit_string_literal(&mut self, _ast: &Ast, node: &StringLiteral) {
         self.push_expr(IRExpr::Literal(LitValue::Str(node.get_value().to_string())));
     }
 
-    fn visit_boolean_literal(&mut self, node: &BooleanLiteral) {
+    fn visit_boolean_literal(&mut self, _ast: &Ast, node: &BooleanLiteral) {
         self.push_expr(IRExpr::Literal(LitValue::Bool(node.get_value())));
     }
 
-    fn visit_null_literal(&mut self, _node: &NullLiteral) {
+    fn visit_null_literal(&mut self, _ast: &Ast, _node: &NullLiteral) {
         self.push_expr(IRExpr::Literal(LitValue::None));
     }
 
-    fn visit_binary_expression(&mut self, node: &BinaryExpression) {
+    fn visit_binary_expression(&mut self, ast: &Ast, node: &BinaryExpression) {
         let op = node.get_operator().to_string();
         
         // 处理赋值
         if op == "=" || op == "+=" || op == "-=" || op == "*=" || op == "/=" {
             let right = node.get_right().unwrap();
-            right.accept(self);
+            self.visit_expr(ast, right);
             let right_val = self.pop_expr();
 
             let left = node.get_left().unwrap();
             // Visit left once for the assignment target
-            left.accept(self);
+            self.visit_expr(ast, left);
             let target = self.pop_expr();
 
             // For compound ops: x += y → x = x + y
@@ -738,7 +994,7 @@ impl AstVisitor for IRBuilder {
                 right_val
             } else {
                 let real_op = &op[..1]; // "+=" → "+", "-=" → "-", etc.
-                left.accept(self);  // push left again as the value operand
+                self.visit_expr(ast, left);  // push left again as the value operand
                 let left_val = self.pop_expr();
                 IRExpr::Binary {
                     op: real_op.to_string(),
@@ -754,11 +1010,11 @@ impl AstVisitor for IRBuilder {
         // 处理 && 和 || (短路求值)
         if op == "&&" || op == "||" {
             let left = node.get_left().unwrap();
-            left.accept(self);
+            self.visit_expr(ast, left);
             let left_expr = self.pop_expr();
             
             let right = node.get_right().unwrap();
-            right.accept(self);
+            self.visit_expr(ast, right);
             let right_expr = self.pop_expr();
             
             self.push_expr(IRExpr::Binary {
@@ -771,11 +1027,11 @@ impl AstVisitor for IRBuilder {
         
         // 普通二元运算
         let left = node.get_left().unwrap();
-        left.accept(self);
+        self.visit_expr(ast, left);
         let left_expr = self.pop_expr();
         
         let right = node.get_right().unwrap();
-        right.accept(self);
+        self.visit_expr(ast, right);
         let right_expr = self.pop_expr();
         
         self.push_expr(IRExpr::Binary {
@@ -785,10 +1041,10 @@ impl AstVisitor for IRBuilder {
         });
     }
 
-    fn visit_unary_expression(&mut self, node: &UnaryExpression) {
+    fn visit_unary_expression(&mut self, ast: &Ast, node: &UnaryExpression) {
         let op = node.get_operator().to_string();
         let operand = node.get_operand().unwrap();
-        operand.accept(self);
+        self.visit_expr(ast, operand);
         let operand_expr = self.pop_expr();
         
         self.push_expr(IRExpr::Unary {
@@ -797,9 +1053,9 @@ impl AstVisitor for IRBuilder {
         });
     }
 
-    fn visit_cast_expression(&mut self, node: &CastExpression) {
+    fn visit_cast_expression(&mut self, ast: &Ast, node: &CastExpression) {
         let expr = node.get_expression().unwrap();
-        expr.accept(self);
+        self.visit_expr(ast, expr);
         let expr_expr = self.pop_expr();
         
         let target = self.ast_type_to_data_type(Some(node.get_target_type()));
@@ -810,23 +1066,23 @@ impl AstVisitor for IRBuilder {
         });
     }
 
-    fn visit_function_call(&mut self, node: &FunctionCall) {
+    fn visit_function_call(&mut self, ast: &Ast, node: &FunctionCall) {
         let callee = node.get_callee();
         let mut args = Vec::new();
         let generic_args = Vec::new();
 
         if let Some(arg_list) = node.get_arguments() {
             for arg in arg_list {
-                arg.accept(self);
+                self.visit_expr(ast, *arg);
                 args.push(self.pop_expr());
             }
         }
 
         if let Some(callee_expr) = callee {
             // 检查是否是方法调用 (obj.method)
-            if let Some(member) = callee_expr.as_any().downcast_ref::<MemberAccess>() {
+            if let Some(member) = ast[callee_expr].as_member() {
                 let obj = member.get_object().unwrap();
-                obj.accept(self);
+                self.visit_expr(ast, obj);
                 let object = self.pop_expr();
                 let method = member.get_member().to_string();
                 
@@ -840,7 +1096,7 @@ impl AstVisitor for IRBuilder {
             }
 
             // 普通函数调用
-            if let Some(id) = callee_expr.as_any().downcast_ref::<Identifier>() {
+            if let Some(id) = ast[callee_expr].as_identifier() {
                 let func_name = id.get_name().to_string();
                 
                 // 检查是否是结构体构造函数
@@ -877,9 +1133,9 @@ impl AstVisitor for IRBuilder {
         });
     }
 
-    fn visit_member_access(&mut self, node: &MemberAccess) {
+    fn visit_member_access(&mut self, ast: &Ast, node: &MemberAccess) {
         let obj = node.get_object().unwrap();
-        obj.accept(self);
+        self.visit_expr(ast, obj);
         let object = self.pop_expr();
         let member = node.get_member().to_string();
         
@@ -889,13 +1145,13 @@ impl AstVisitor for IRBuilder {
         });
     }
 
-    fn visit_array_index(&mut self, node: &ArrayIndex) {
+    fn visit_array_index(&mut self, ast: &Ast, node: &ArrayIndex) {
         let array = node.get_array().unwrap();
-        array.accept(self);
+        self.visit_expr(ast, array);
         let array_expr = self.pop_expr();
         
         let index = node.get_index().unwrap();
-        index.accept(self);
+        self.visit_expr(ast, index);
         let index_expr = self.pop_expr();
         
         self.push_expr(IRExpr::ArrayIndex {
@@ -904,27 +1160,27 @@ impl AstVisitor for IRBuilder {
         });
     }
 
-    fn visit_array_literal(&mut self, node: &ArrayLiteral) {
+    fn visit_array_literal(&mut self, ast: &Ast, node: &ArrayLiteral) {
         let mut elements = Vec::new();
         for elem in node.get_elements() {
-            elem.accept(self);
+            self.visit_expr(ast, *elem);
             elements.push(self.pop_expr());
         }
         self.push_expr(IRExpr::ArrayLiteral(elements));
     }
 
-    fn visit_struct_literal(&mut self, node: &StructLiteral) {
+    fn visit_struct_literal(&mut self, ast: &Ast, node: &StructLiteral) {
         let name = node.get_type_name().to_string();
         let mut fields = Vec::new();
         
         for field in node.get_fields() {
             match field {
                 StructFieldInit::Named { name: fname, value } => {
-                    value.accept(self);
+                    self.visit_expr(ast, *value);
                     fields.push((fname.clone(), self.pop_expr()));
                 }
                 StructFieldInit::Positional(value) => {
-                    value.accept(self);
+                    self.visit_expr(ast, *value);
                     fields.push((format!("_{}", fields.len()), self.pop_expr()));
                 }
             }
@@ -933,10 +1189,12 @@ impl AstVisitor for IRBuilder {
         self.push_expr(IRExpr::StructLiteral { name, fields });
     }
 
-    fn visit_match_expression(&mut self, node: &MatchExpression) {
+    fn visit_match_expression(&mut self, ast: &Ast, node: &MatchExpression) {
+        let discard = std::mem::take(&mut self.discard_match);
+
         // 1. 求值 scrutinee
         let scrutinee = if let Some(scrut) = node.get_scrutinee() {
-            scrut.accept(self);
+            self.visit_expr(ast, scrut);
             self.pop_expr()
         } else {
             IRExpr::None
@@ -948,47 +1206,58 @@ impl AstVisitor for IRBuilder {
             return;
         }
 
-        // 2. 构建 match 的 if-else 链
-        // 使用递归构建：从最后一个 arm 开始反向构建
-        let mut else_block = None;
-        
-        // 从后往前遍历 arms
+        // 2. scrutinee 只求值一次；需要值的 match 把各分支的值写入 `_match<N>`
+        let n = self.matches;
+        self.matches += 1;
+        let subject = match scrutinee {
+            IRExpr::Variable(_) | IRExpr::Literal(_) => scrutinee,
+            other => {
+                let name = format!("_subject{}", n);
+                self.current_block.push(IRStmt::Declaration { name: name.clone(), ty: DataType::Unknown, init: Some(other) });
+                IRExpr::Variable(name)
+            }
+        };
+        let result = (!discard).then(|| format!("_match{}", n));
+        if let Some(r) = &result {
+            self.current_block.push(IRStmt::Declaration { name: r.clone(), ty: DataType::Unknown, init: None });
+        }
+
+        // 3. 从最后一个 arm 开始反向构建 if-else 链；整数字面量的长链由代码生成器降为 switch
+        let mut else_block: Option<IRBlock> = None;
+        let mut catch_all = false;
         for arm in arms.iter().rev() {
-            // 构建条件表达式
-            let cond = self.build_match_condition(&scrutinee, &arm.pattern);
-            
-            // 构建 arm body
-            let then_block = self.build_arm_body(arm);
-            
-            // 创建 if 语句
-            let if_stmt = IRStmt::If {
-                cond,
-                then_block,
-                else_block: else_block.take(),
-            };
-            
-            // 将 if 语句包装成 Block
-            let mut block = IRBlock { statements: Vec::new() };
-            block.statements.push(if_stmt);
-            else_block = Some(block);
+            let cond = self.build_match_condition(&subject, &arm.pattern);
+            let then_block = self.build_arm_body(ast, arm, &subject, result.as_deref());
+            // 通配与变量模式总是匹配，其后的 arm 不可达
+            catch_all = matches!(cond, IRExpr::Literal(LitValue::Bool(true)));
+            else_block = Some(if catch_all {
+                then_block
+            } else {
+                IRBlock { statements: vec![IRStmt::If { cond, then_block, else_block: else_block.take() }] }
+            });
         }
 
-        // 3. 将生成的 if-else 链插入当前块
-        if let Some(final_block) = else_block {
-            self.current_block.extend(final_block.statements);
+        // 4. 插入当前块；第一个 arm 就总是匹配时仍保留一层块作用域
+        if let Some(block) = else_block {
+            if catch_all {
+                self.current_block.push(IRStmt::If {
+                    cond: IRExpr::Literal(LitValue::Bool(true)),
+                    then_block: block,
+                    else_block: None,
+                });
+            } else {
+                self.current_block.extend(block.statements);
+            }
         }
 
-        // 4. match 表达式的结果
-        // 在 IR 层面，match 表达式的值就是最后一个匹配的 arm 的值
-        // 但我们无法确定哪个 arm 会匹配，所以用 None 占位
-        // 后续代码生成器需要特殊处理 match 表达式
-        self.push_expr(IRExpr::None);
+        // 5. match 表达式的结果
+        self.push_expr(result.map_or(IRExpr::None, IRExpr::Variable));
     }
 
-    fn visit_range_expression(&mut self, node: &RangeExpression) {
+    fn visit_range_expression(&mut self, ast: &Ast, node: &RangeExpression) {
         let mut args = Vec::new();
         for arg in node.get_arguments() {
-            arg.accept(self);
+            self.visit_expr(ast, *arg);
             args.push(self.pop_expr());
         }
         // range 被转换为函数调用
@@ -999,17 +1268,17 @@ impl AstVisitor for IRBuilder {
         });
     }
 
-    fn visit_grouped_expression(&mut self, node: &GroupedExpression) {
+    fn visit_grouped_expression(&mut self, ast: &Ast, node: &GroupedExpression) {
         if let Some(expr) = node.get_expression() {
-            expr.accept(self);
+            self.visit_expr(ast, expr);
             // 分组表达式直接传递内部表达式
         } else {
             self.push_expr(IRExpr::None);
         }
     }
 
-    fn visit_format_string(&mut self, node: &FormatString) {
-        // 格式字符串转换为字符串拼接
+    fn visit_format_string(&mut self, ast: &Ast, node: &FormatString) {
+        // 格式字符串转换为一个 Format 节点，代码生成时一次性分配并写入
         let template = node.get_value();
         let vars = node.get_variables();
         
@@ -1018,197 +1287,511 @@ impl AstVisitor for IRBuilder {
             return;
         }
         
-        // 构建字符串拼接表达式
-        let mut expr = IRExpr::Literal(LitValue::Str(String::new()));
+        let mut parts = Vec::new();
         let mut last_pos = 0;
-        
+
         for var in vars {
             let pos = var.pos_in_value as usize;
             // 添加字面量部分
             if pos > last_pos {
-                let lit = &template[last_pos..pos];
-                expr = IRExpr::Binary {
-                    op: "+".to_string(),
-                    left: Box::new(expr),
-                    right: Box::new(IRExpr::Literal(LitValue::Str(lit.to_string()))),
-                };
+                parts.push(FormatPart::Lit(template[last_pos..pos].to_string()));
             }
             // 添加变量部分
-            if let Some(ref value) = var.value {
-                // 需要克隆或重新构建表达式
-                // 由于表达式是 trait 对象，我们只能重新访问
-                // 这里简化处理
-                let mut temp_builder = IRBuilder::new();
-                value.accept(&mut temp_builder);
-                let var_expr = temp_builder.pop_expr();
-                expr = IRExpr::Binary {
-                    op: "+".to_string(),
-                    left: Box::new(expr),
-                    right: Box::new(var_expr),
-                };
-            }
-            last_pos = pos + 1; // 跳过 {
-            // 找到 }
-            let mut depth = 0;
-            let chars: Vec<char> = template.chars().collect();
-            let mut i = pos;
-            while i < chars.len() {
-                if chars[i] == '{' { depth += 1; }
-                else if chars[i] == '}' { 
-                    depth -= 1;
-                    if depth == 0 {
-                        last_pos = i + 1;
-                        break;
-                    }
-                }
-                i += 1;
+            if let Some(value) = var.value {
+                parts.push(FormatPart::Expr(self.lower_expr(ast, value)));
             }
+            // 跳过 {...}
+            last_pos = var.end_in_value as usize;
         }
-        
+
         // 添加剩余字面量
         if last_pos < template.len() {
-            let lit = &template[last_pos..];
-            expr = IRExpr::Binary {
-                op: "+".to_string(),
-                left: Box::new(expr),
-                right: Box::new(IRExpr::Literal(LitValue::Str(lit.to_string()))),
-            };
+            parts.push(FormatPart::Lit(template[last_pos..].to_string()));
         }
         
-        self.push_expr(expr);
+        self.push_expr(IRExpr::Format(parts));
     }
 
     // ==================== Stub visitors ====================
 
-    fn visit_ast_node(&mut self, _node: &dyn AstNode) {}
-    fn visit_statement(&mut self, _node: &dyn Statement) {}
-    fn visit_expression(&mut self, _node: &dyn Expression) {}
-    fn visit_parameter(&mut self, _node: &Parameter) {}
-    fn visit_basic_type(&mut self, _node: &BasicType) {}
-    fn visit_type(&mut self, _node: &dyn Type) {}
-    fn visit_array_type(&mut self, _node: &ArrayType) {}
-    fn visit_for_statement(&mut self, node: &ForStatement) {
+    fn visit_parameter(&mut self, _ast: &Ast, _node: &Parameter) {}
+    fn visit_basic_type(&mut self, _ast: &Ast, _node: &BasicType) {}
+    fn visit_type(&mut self, _ast: &Ast, _node: &Type) {}
+    fn visit_array_type(&mut self, _ast: &Ast, _node: &ArrayType) {}
+    fn visit_for_statement(&mut self, ast: &Ast, node: &ForStatement) {
         let vars = node.get_loop_variables().clone();
         if !vars.is_empty() {
             if let Some(iterable) = node.get_iterable() {
-                let mut temp = IRBuilder::new();
-                iterable.accept(&mut temp);
-                let iter_expr = temp.pop_expr();
-                let mut body_builder = IRBuilder::new();
-                if let Some(b) = node.get_body() {
-                    b.accept(&mut body_builder);
-                }
+                let iter_expr = self.lower_expr(ast, iterable);
+                let body = self.nested(|builder| {
+                    if let Some(b) = node.get_body() {
+                        builder.visit_block(ast, b);
+                    }
+                });
+                let parallel = node.is_parallel().then(|| {
+                    node.get_reductions().iter()
+                        .map(|(op, var)| Reduction { op: op.clone(), var: var.clone() })
+                        .collect()
+                });
                 self.current_block.push(IRStmt::For {
                     vars,
                     iterable: iter_expr,
-                    body: IRBlock { statements: body_builder.current_block },
+                    body: IRBlock { statements: body },
+                    parallel,
                 });
             }
         }
     }
-    fn visit_import_statement(&mut self, _node: &ImportStatement) {}
-    fn visit_export_statement(&mut self, _node: &ExportStatement) {}
+    fn visit_import_statement(&mut self, _ast: &Ast, _node: &ImportStatement) {}
+    fn visit_export_statement(&mut self, _ast: &Ast, _node: &ExportStatement) {}
 }
 
 // ==================== 单态化器（Monomorphizer） ====================
 
-#[allow(dead_code)]
+/// 按需单态化：从 `main` 出发沿调用图做工作表遍历，
+/// 只为实际可达的 (函数, 类型实参) 生成实例，并把调用点改写为实例名
 pub struct Monomorphizer {
-    instance_counter: usize,
-    instances: HashMap<String, String>,
+    /// 函数名 → `GobolIR::functions` 中的下标
+    index: HashMap<String, usize>,
+    /// (函数, 类型实参) → 实例名，跨模块去重
+    instances: HashMap<(String, Vec<String>), String>,
+    /// 函数、方法与实例的返回类型，用于推断调用点的实参类型
+    returns: HashMap<String, DataType>,
+    fields: HashMap<String, Vec<IRField>>,
+    queued: HashSet<String>,
+    worklist: VecDeque<IRFunction>,
+    /// 可达代码调用过的方法名，决定泛型 impl 保留哪些方法
+    used_methods: HashSet<String>,
+    /// 推断不出类型实参等错误，每个调用点一条
+    errors: Vec<String>,
 }
 
 impl Monomorphizer {
     pub fn new() -> Self {
         Monomorphizer {
-            instance_counter: 0,
+            index: HashMap::new(),
             instances: HashMap::new(),
+            returns: HashMap::new(),
+            fields: HashMap::new(),
+            queued: HashSet::new(),
+            worklist: VecDeque::new(),
+            used_methods: HashSet::new(),
+            errors: Vec::new(),
         }
     }
 
-    /// 对 IR 进行单态化，展开所有泛型
+    /// `monomorphize` 发现的错误；非空时得到的 IR 不可用于代码生成
+    pub fn errors(&self) -> &[String] {
+        &self.errors
+    }
+
+    /// 对 IR 进行单态化，展开所有泛型并丢弃不可达的函数
     pub fn monomorphize(&mut self, ir: &GobolIR) -> GobolIR {
-        let mut result = ir.clone();
-        
-        // 收集需要实例化的泛型函数
-        let mut generic_functions: Vec<IRFunction> = Vec::new();
-        let mut concrete_functions: Vec<IRFunction> = Vec::new();
-        
-        for func in &ir.functions {
-            if !func.generic_params.is_empty() {
-                // 泛型函数：需要实例化
-                // 从调用点收集实际类型参数
-                let instances = self.collect_instances(ir, func);
-                for (_type_args, instance) in instances {
-                    generic_functions.push(instance);
+        for (i, f) in ir.functions.iter().enumerate() {
+            self.index.insert(f.name.clone(), i);
+            self.returns.insert(f.name.clone(), f.return_type.clone());
+        }
+        for imp in &ir.impls {
+            for m in &imp.methods {
+                self.returns.insert(m.name.clone(), m.return_type.clone());
+            }
+        }
+        for st in &ir.structs {
+            self.fields.insert(st.name.clone(), st.fields.clone());
+        }
+
+        // 根：main；没有 main 时（库）保留全部非泛型函数
+        match ir.functions.iter().find(|f| f.is_main) {
+            Some(main) => self.enqueue(ir, &main.name),
+            None => {
+                for f in ir.functions.iter().filter(|f| f.generic_params.is_empty()) {
+                    self.enqueue(ir, &f.name);
                 }
-            } else {
-                // 非泛型函数：直接保留
-                concrete_functions.push(func.clone());
             }
         }
-        
-        // 更新结果
-        result.functions = concrete_functions;
-        result.functions.extend(generic_functions);
-        
-        result
-    }
 
-    fn collect_instances(&mut self, _ir: &GobolIR, func: &IRFunction) -> Vec<(Vec<DataType>, IRFunction)> {
-        let mut instances = Vec::new();
-        
-        // 从函数体中收集类型参数
-        if let Some(body) = &func.body {
-            self.scan_for_type_args(body, &func.generic_params, &mut instances, func);
+        // 非泛型 impl 整体保留，其方法体里的调用同样是根
+        let mut impls: Vec<IRImpl> = Vec::with_capacity(ir.impls.len());
+        let mut pending: Vec<(usize, &IRFunction)> = Vec::new();
+        for imp in &ir.impls {
+            let mut out = IRImpl {
+                struct_name: imp.struct_name.clone(),
+                generic_params: imp.generic_params.clone(),
+                methods: Vec::new(),
+            };
+            for m in &imp.methods {
+                if imp.generic_params.is_empty() {
+                    let mut m = m.clone();
+                    self.resolve_function(ir, &mut m);
+                    out.methods.push(m);
+                } else {
+                    pending.push((impls.len(), m));
+                }
+            }
+            impls.push(out);
         }
-        
-        // 如果没有找到任何实例，使用默认类型
-        if instances.is_empty() {
-            // 默认使用 int, float, str
-            for ty in [DataType::Int, DataType::Float, DataType::Str] {
-                let type_args = vec![ty.clone()];
-                let instance = self.instantiate_function(func, &type_args);
-                instances.push((type_args, instance));
+
+        let mut done: HashMap<String, IRFunction> = HashMap::new();
+        let mut instance_order: Vec<String> = Vec::new();
+        loop {
+            while let Some(mut f) = self.worklist.pop_front() {
+                self.resolve_function(ir, &mut f);
+                if !self.index.contains_key(&f.name) {
+                    instance_order.push(f.name.clone());
+                }
+                done.insert(f.name.clone(), f);
+            }
+            // 泛型 impl 的方法按名字可达后再纳入
+            let (ready, rest): (Vec<_>, Vec<_>) = pending
+                .into_iter()
+                .partition(|(_, m)| self.used_methods.contains(Self::short_name(&m.name)));
+            pending = rest;
+            if ready.is_empty() {
+                break;
+            }
+            for (i, m) in ready {
+                let mut m = m.clone();
+                self.resolve_function(ir, &mut m);
+                impls[i].methods.push(m);
             }
         }
-        
-        instances
+        impls.retain(|imp| !imp.methods.is_empty());
+
+        // 保持源码顺序，实例按生成顺序排在后面
+        let mut functions: Vec<IRFunction> = ir.functions.iter()
+            .filter_map(|f| done.remove(&f.name))
+            .collect();
+        functions.extend(instance_order.iter().filter_map(|n| done.remove(n)));
+
+        GobolIR {
+            functions,
+            structs: ir.structs.clone(),
+            impls,
+            constants: ir.constants.clone(),
+            main_function: ir.main_function.clone(),
+        }
+    }
+
+    fn short_name(name: &str) -> &str {
+        name.rsplit('.').next().unwrap_or(name)
+    }
+
+    fn enqueue(&mut self, ir: &GobolIR, name: &str) {
+        if let Some(&i) = self.index.get(name) {
+            if self.queued.insert(name.to_string()) {
+                self.worklist.push_back(ir.functions[i].clone());
+            }
+        }
+    }
+
+    /// 返回 (函数, 类型实参) 的实例名，首次出现时生成实例并入队
+    fn instance(&mut self, ir: &GobolIR, name: &str, type_args: Vec<DataType>) -> String {
+        let key = (name.to_string(), type_args.iter().map(Self::mangle).collect());
+        if let Some(inst) = self.instances.get(&key) {
+            return inst.clone();
+        }
+        let func = &ir.functions[self.index[name]];
+        let instance = self.instantiate_function(func, &type_args);
+        let inst_name = instance.name.clone();
+        self.returns.insert(inst_name.clone(), instance.return_type.clone());
+        self.queued.insert(inst_name.clone());
+        self.worklist.push_back(instance);
+        self.instances.insert(key, inst_name.clone());
+        inst_name
+    }
+
+    // ── 调用点解析 ──
+
+    fn resolve_function(&mut self, ir: &GobolIR, f: &mut IRFunction) {
+        // 导入的 `math.trunc` 在模块内直接调用 `floor`
+        let module = if f.is_method { None } else { f.name.rsplit_once('.').map(|(m, _)| m.to_string()) };
+        let mut scopes: Vec<HashMap<String, DataType>> =
+            vec![f.params.iter().map(|p| (p.name.clone(), p.ty.clone())).collect()];
+        if let Some(body) = f.body.as_mut() {
+            self.resolve_block(ir, body, &mut scopes, module.as_deref());
+        }
     }
 
-    fn scan_for_type_args(
+    fn resolve_block(
         &mut self,
-        block: &IRBlock,
-        _generic_params: &[String],
-        instances: &mut Vec<(Vec<DataType>, IRFunction)>,
-        func: &IRFunction,
+        ir: &GobolIR,
+        block: &mut IRBlock,
+        scopes: &mut Vec<HashMap<String, DataType>>,
+        module: Option<&str>,
     ) {
-        for stmt in &block.statements {
+        scopes.push(HashMap::new());
+        for stmt in block.statements.iter_mut() {
             match stmt {
-                IRStmt::Call { func: call_name, args: _args, generic_args } => {
-                    if call_name == &func.name && !generic_args.is_empty() {
-                        // 找到了一个泛型调用
-                        let type_args = generic_args.clone();
-                        let instance = self.instantiate_function(func, &type_args);
-                        instances.push((type_args, instance));
+                IRStmt::Declaration { name, ty, init } => {
+                    let mut bound = ty.clone();
+                    if let Some(e) = init {
+                        self.resolve_expr(ir, e, scopes, module);
+                        if matches!(bound, DataType::None_ | DataType::Unknown) {
+                            bound = Self::expr_type(&self.returns, &self.fields, e, scopes);
+                        }
+                    }
+                    if let Some(scope) = scopes.last_mut() {
+                        scope.insert(name.clone(), bound);
                     }
                 }
-                IRStmt::MethodCall { args: _args, generic_args, .. } => {
-                    if !generic_args.is_empty() {
-                        let type_args = generic_args.clone();
-                        let instance = self.instantiate_function(func, &type_args);
-                        instances.push((type_args, instance));
+                IRStmt::If { cond, then_block, else_block } => {
+                    self.resolve_expr(ir, cond, scopes, module);
+                    self.resolve_block(ir, then_block, scopes, module);
+                    if let Some(b) = else_block { self.resolve_block(ir, b, scopes, module); }
+                }
+                IRStmt::While { cond, body } => {
+                    self.resolve_expr(ir, cond, scopes, module);
+                    self.resolve_block(ir, body, scopes, module);
+                }
+                IRStmt::Region { body } => self.resolve_block(ir, body, scopes, module),
+                IRStmt::For { vars, iterable, body, .. } => {
+                    self.resolve_expr(ir, iterable, scopes, module);
+                    // 下标为 int，数组的最后一个循环变量绑定元素类型
+                    let elem = match Self::expr_type(&self.returns, &self.fields, iterable, scopes) {
+                        DataType::Array(e) => *e,
+                        _ => DataType::Int,
+                    };
+                    let mut scope: HashMap<String, DataType> = vars.iter().map(|v| (v.clone(), DataType::Int)).collect();
+                    if let Some(last) = vars.last() {
+                        scope.insert(last.clone(), elem);
                     }
+                    scopes.push(scope);
+                    self.resolve_block(ir, body, scopes, module);
+                    scopes.pop();
+                }
+                IRStmt::Call { func, args, generic_args } => {
+                    for a in args.iter_mut() { self.resolve_expr(ir, a, scopes, module); }
+                    self.resolve_call(ir, func, args, generic_args, scopes, module);
+                }
+                IRStmt::MethodCall { object, method, args, generic_args } => {
+                    self.resolve_expr(ir, object, scopes, module);
+                    for a in args.iter_mut() { self.resolve_expr(ir, a, scopes, module); }
+                    self.resolve_callback(ir, method, args, scopes, module);
+                    self.resolve_method(ir, object, method, args, generic_args, scopes);
+                }
+                other => rewrite_stmt(other, &mut |e| self.resolve_node(ir, e, scopes, module)),
+            }
+        }
+        scopes.pop();
+    }
+
+    fn resolve_expr(&mut self, ir: &GobolIR, e: &mut IRExpr, scopes: &[HashMap<String, DataType>], module: Option<&str>) {
+        rewrite_expr(e, &mut |x| self.resolve_node(ir, x, scopes, module));
+    }
+
+    fn resolve_node(&mut self, ir: &GobolIR, e: &mut IRExpr, scopes: &[HashMap<String, DataType>], module: Option<&str>) {
+        match e {
+            IRExpr::Call { func, args, generic_args } => {
+                self.resolve_call(ir, func, args, generic_args, scopes, module);
+            }
+            IRExpr::MethodCall { object, method, args, generic_args } => {
+                self.resolve_callback(ir, method, args, scopes, module);
+                self.resolve_method(ir, object, method, args, generic_args, scopes);
+            }
+            _ => {}
+        }
+    }
+
+    /// `f(args)`：模块内优先解析为 `module.f`；泛型函数改写为实例名
+    fn resolve_call(
+        &mut self,
+        ir: &GobolIR,
+        func: &mut String,
+        args: &[IRExpr],
+        generic_args: &mut Vec<DataType>,
+        scopes: &[HashMap<String, DataType>],
+        module: Option<&str>,
+    ) {
+        let qualified = module.map(|m| format!("{}.{}", m, func));
+        let target = match qualified.filter(|q| self.index.contains_key(q)) {
+            Some(q) => q,
+            None if self.index.contains_key(func.as_str()) => func.clone(),
+            None => return,
+        };
+        *func = self.resolve_target(ir, &target, args, generic_args, scopes);
+    }
+
+    /// `a.sort_by(less)` / `a.partition(keep)` 的实参是函数名：
+    /// 按调用同样的规则解析、标记可达，并改写为完整名字
+    fn resolve_callback(
+        &mut self,
+        ir: &GobolIR,
+        method: &str,
+        args: &mut [IRExpr],
+        scopes: &[HashMap<String, DataType>],
+        module: Option<&str>,
+    ) {
+        if !matches!(method, "sort_by" | "partition") {
+            return;
+        }
+        let name = match args.first_mut() {
+            Some(IRExpr::Variable(n)) if !scopes.iter().any(|s| s.contains_key(n.as_str())) => n,
+            _ => return,
+        };
+        let qualified = module.map(|m| format!("{}.{}", m, name));
+        let target = match qualified.filter(|q| self.index.contains_key(q)) {
+            Some(q) => q,
+            None if self.index.contains_key(name.as_str()) => name.clone(),
+            None => return,
+        };
+        self.enqueue(ir, &target);
+        *name = target;
+    }
+
+    /// `module.f(args)` 走模块函数；其余方法调用只记录方法名
+    fn resolve_method(
+        &mut self,
+        ir: &GobolIR,
+        object: &IRExpr,
+        method: &mut String,
+        args: &[IRExpr],
+        generic_args: &mut Vec<DataType>,
+        scopes: &[HashMap<String, DataType>],
+    ) {
+        self.used_methods.insert(method.clone());
+        let path = match dotted_path(object) {
+            Some(p) => p,
+            None => return,
+        };
+        let root = path.split('.').next().unwrap_or("");
+        if scopes.iter().any(|s| s.contains_key(root)) {
+            return;
+        }
+        let target = format!("{}.{}", path, method);
+        if !self.index.contains_key(&target) {
+            return;
+        }
+        let resolved = self.resolve_target(ir, &target, args, generic_args, scopes);
+        *method = Self::short_name(&resolved).to_string();
+    }
+
+    /// 标记 `target` 可达并返回调用点应使用的名字
+    fn resolve_target(
+        &mut self,
+        ir: &GobolIR,
+        target: &str,
+        args: &[IRExpr],
+        generic_args: &mut Vec<DataType>,
+        scopes: &[HashMap<String, DataType>],
+    ) -> String {
+        let def = &ir.functions[self.index[target]];
+        // 没有函数体的由 C 运行时提供（如 io.print），不做实例化
+        if def.generic_params.is_empty() || def.body.is_none() {
+            self.enqueue(ir, target);
+            return target.to_string();
+        }
+        let mut bindings: HashMap<String, DataType> = HashMap::new();
+        for (p, a) in def.params.iter().zip(args) {
+            let arg_ty = Self::expr_type(&self.returns, &self.fields, a, scopes);
+            Self::unify(&p.ty, &arg_ty, &def.generic_params, &mut bindings);
+        }
+        // 推断不出的参数沿用调用点显式给出的实参；小写的结构体名（如 fs 的
+        // file_view）也会被当作隐式泛型参数，它就是那个结构体；都不是则报错
+        let mut type_args: Vec<DataType> = Vec::with_capacity(def.generic_params.len());
+        for (i, g) in def.generic_params.iter().enumerate() {
+            match bindings.remove(g).or_else(|| generic_args.get(i).cloned()) {
+                Some(ty) => type_args.push(ty),
+                None if self.fields.contains_key(g) => type_args.push(DataType::Struct(g.clone())),
+                None => {
+                    self.errors.push(format!("cannot infer type argument '{}' for '{}'", g, target));
+                    return target.to_string();
+                }
+            }
+        }
+        *generic_args = type_args.clone();
+        self.instance(ir, target, type_args)
+    }
+
+    fn unify(param: &DataType, arg: &DataType, generics: &[String], out: &mut HashMap<String, DataType>) {
+        match (param, arg) {
+            (_, DataType::Unknown) | (_, DataType::None_) => {}
+            (DataType::Struct(g), _) if generics.contains(g) => {
+                out.entry(g.clone()).or_insert_with(|| arg.clone());
+            }
+            (DataType::Array(p), DataType::Array(a)) => Self::unify(p, a, generics, out),
+            (DataType::Nullable(p), DataType::Nullable(a)) => Self::unify(p, a, generics, out),
+            (DataType::Nullable(p), a) => Self::unify(p, a, generics, out),
+            _ => {}
+        }
+    }
+
+    /// 调用点实参的静态类型；推断不出时为 Unknown
+    fn expr_type(
+        returns: &HashMap<String, DataType>,
+        fields: &HashMap<String, Vec<IRField>>,
+        e: &IRExpr,
+        scopes: &[HashMap<String, DataType>],
+    ) -> DataType {
+        let ty = |x: &IRExpr| Self::expr_type(returns, fields, x, scopes);
+        match e {
+            IRExpr::Literal(LitValue::Int(_)) => DataType::Int,
+            IRExpr::Literal(LitValue::Float(_)) => DataType::Float,
+            IRExpr::Literal(LitValue::Bool(_)) => DataType::Bool,
+            IRExpr::Literal(LitValue::Str(_)) | IRExpr::Format(_) => DataType::Str,
+            IRExpr::Variable(n) => scopes.iter().rev()
+                .find_map(|s| s.get(n).cloned())
+                .unwrap_or(DataType::Unknown),
+            IRExpr::Binary { op, left, right } => match op.as_str() {
+                "<" | ">" | "<=" | ">=" | "==" | "!=" | "&&" | "||" => DataType::Bool,
+                _ => match (ty(left), ty(right)) {
+                    (DataType::Str, _) | (_, DataType::Str) if op == "+" => DataType::Str,
+                    (DataType::Float, _) | (_, DataType::Float) => DataType::Float,
+                    (DataType::Unknown, r) => r,
+                    (l, _) => l,
+                },
+            },
+            IRExpr::Unary { op, operand } => if op == "!" { DataType::Bool } else { ty(operand) },
+            IRExpr::Cast { target, .. } => target.clone(),
+            IRExpr::Call { func, .. } => returns.get(func).cloned().unwrap_or(DataType::Unknown),
+            IRExpr::MethodCall { object, method, .. } => {
+                let by_path = dotted_path(object).and_then(|p| returns.get(&format!("{}.{}", p, method)));
+                match (by_path, ty(object)) {
+                    (Some(r), _) => r.clone(),
+                    (None, DataType::Struct(s)) => returns.get(&format!("{}.{}", s, method)).cloned().unwrap_or(DataType::Unknown),
+                    // 数组内建方法
+                    (None, DataType::Array(elem)) => match method.as_str() {
+                        "len" | "find" | "binary_search" | "partition" => DataType::Int,
+                        "get" | "sum" | "min" | "max" | "dot" => *elem,
+                        _ => DataType::Unknown,
+                    },
+                    _ => DataType::Unknown,
                 }
-                _ => {}
             }
+            IRExpr::MemberAccess { object, member } => match ty(object) {
+                DataType::Struct(s) => fields.get(&s)
+                    .and_then(|fs| fs.iter().find(|f| &f.name == member))
+                    .map(|f| f.ty.clone())
+                    .unwrap_or(DataType::Unknown),
+                _ => DataType::Unknown,
+            },
+            IRExpr::ArrayLiteral(items) => match items.first() {
+                Some(first) => DataType::Array(Box::new(ty(first))),
+                None => DataType::Unknown,
+            },
+            IRExpr::ArrayIndex { array, .. } => match ty(array) {
+                DataType::Array(elem) => *elem,
+                _ => DataType::Unknown,
+            },
+            IRExpr::StructLiteral { name, .. } => DataType::Struct(name.clone()),
+            IRExpr::Assignment { value, .. } => ty(value),
+            _ => DataType::Unknown,
+        }
+    }
+
+    /// 实例名中的类型片段：`first<int[]>` → `first_arr_int`
+    fn mangle(dt: &DataType) -> String {
+        match dt {
+            DataType::Struct(name) => name.clone(),
+            DataType::Nullable(inner) => format!("opt_{}", Self::mangle(inner)),
+            DataType::Array(elem) => format!("arr_{}", Self::mangle(elem)),
+            other => other.to_string(),
         }
     }
 
     fn instantiate_function(&mut self, func: &IRFunction, type_args: &[DataType]) -> IRFunction {
         // 生成实例化名称: func_T1_T2
         let type_suffix: String = type_args.iter()
-            .map(|t| format!("_{}", t))
+            .map(|t| format!("_{}", Self::mangle(t)))
             .collect();
         let instance_name = format!("{}{}", func.name, type_suffix);
         
@@ -1254,21 +1837,325 @@ impl Monomorphizer {
             DataType::Nullable(inner) => {
                 DataType::Nullable(Box::new(self.substitute_type(inner, type_map)))
             }
+            DataType::Array(elem) => {
+                DataType::Array(Box::new(self.substitute_type(elem, type_map)))
+            }
             _ => dt.clone(),
         }
     }
 
     fn substitute_in_block(&self, block: &mut IRBlock, type_map: &HashMap<String, DataType>) {
+        rewrite_block(block, &mut |e| {
+            if let IRExpr::Cast { target, .. } = e {
+                *target = self.substitute_type(target, type_map);
+            }
+        });
+        self.substitute_decls(block, type_map);
+    }
+
+    fn substitute_decls(&self, block: &mut IRBlock, type_map: &HashMap<String, DataType>) {
         for stmt in &mut block.statements {
             match stmt {
                 IRStmt::Declaration { ty, .. } => {
                     *ty = self.substitute_type(ty, type_map);
                 }
-                IRStmt::Call { generic_args: _generic_args, .. } => {
-                    // 替换泛型参数
+                IRStmt::If { then_block, else_block, .. } => {
+                    self.substitute_decls(then_block, type_map);
+                    if let Some(b) = else_block { self.substitute_decls(b, type_map); }
+                }
+                IRStmt::While { body, .. } | IRStmt::For { body, .. } | IRStmt::Region { body } => {
+                    self.substitute_decls(body, type_map);
                 }
                 _ => {}
             }
         }
     }
 }
+
+// ==================== 区域逃逸检查 ====================
+
+/// `region { ... }` 结束时一次释放块内分配的字符串与数组，块内构造的值
+/// 因此不能流到比区域活得久的地方。在单态化之后的 IR 上检查（此时每个
+/// 变量都有完整类型），拒绝：
+/// - 把可能引用区域内存的值赋给区域外的变量、字段或数组元素；
+/// - 向区域外的数组 `add`/`fill`/`copy_from` 这样的值；
+/// - 把区域外、能装下字符串或数组的数组与结构体交给用户函数或方法（被调方可能把区域内的值存进去）；
+/// - 在区域内返回可能引用区域内存的值。
+/// 区域外变量里的值本身不引用区域内存（它们从未被允许存入），读它们总是安全的
+pub fn check_regions(ir: &GobolIR) -> Vec<String> {
+    let mut check = RegionCheck {
+        returns: HashMap::new(),
+        fields: HashMap::new(),
+        function: String::new(),
+        floor: None,
+        errors: Vec::new(),
+    };
+    let methods = || ir.impls.iter().flat_map(|imp| imp.methods.iter());
+    for f in ir.functions.iter().chain(methods()) {
+        check.returns.insert(f.name.clone(), f.return_type.clone());
+    }
+    for st in &ir.structs {
+        check.fields.insert(st.name.clone(), st.fields.clone());
+    }
+    for f in ir.functions.iter().chain(methods()) {
+        if f.body.as_ref().map_or(false, RegionCheck::has_region) {
+            check.function(f);
+        }
+    }
+    check.errors
+}
+
+struct RegionCheck {
+    returns: HashMap<String, DataType>,
+    fields: HashMap<String, Vec<IRField>>,
+    function: String,
+    /// 最内层区域进入时的作用域层数；层数更低的变量比区域活得久
+    floor: Option<usize>,
+    errors: Vec<String>,
+}
+
+impl RegionCheck {
+    fn has_region(b: &IRBlock) -> bool {
+        b.statements.iter().any(|s| match s {
+            IRStmt::Region { .. } => true,
+            IRStmt::If { then_block, else_block, .. } => {
+                Self::has_region(then_block) || else_block.as_ref().map_or(false, Self::has_region)
+            }
+            IRStmt::While { body, .. } | IRStmt::For { body, .. } => Self::has_region(body),
+            _ => false,
+        })
+    }
+
+    fn function(&mut self, f: &IRFunction) {
+        self.function = f.name.clone();
+        // 方法里的裸字段名与 `self` 都在最外层
+        let mut outermost: HashMap<String, DataType> = HashMap::new();
+        if let Some(s) = f.struct_name.as_ref().filter(|_| f.is_method) {
+            for field in self.fields.get(s).into_iter().flatten() {
+                outermost.insert(field.name.clone(), field.ty.clone());
+            }
+            outermost.insert("self".to_string(), DataType::Struct(s.clone()));
+        }
+        let params = f.params.iter().map(|p| (p.name.clone(), p.ty.clone())).collect();
+        let mut scopes = vec![outermost, params];
+        if let Some(body) = &f.body {
+            self.block(body, &mut scopes);
+        }
+    }
+
+    fn block(&mut self, b: &IRBlock, scopes: &mut Vec<HashMap<String, DataType>>) {
+        scopes.push(HashMap::new());
+        for stmt in &b.statements {
+            match stmt {
+                IRStmt::Declaration { name, ty, init } => {
+                    let mut bound = ty.clone();
+                    if let Some(e) = init {
+                        self.expr(e, scopes);
+                        if matches!(bound, DataType::None_ | DataType::Unknown) {
+                            bound = self.type_of(e, scopes);
+                        }
+                    }
+                    if let Some(scope) = scopes.last_mut() {
+                        scope.insert(name.clone(), bound);
+                    }
+                }
+                IRStmt::Expression(e) => self.expr(e, scopes),
+                IRStmt::Return(Some(e)) => {
+                    self.expr(e, scopes);
+                    if self.floor.is_some() && !self.lasting(e, scopes) {
+                        self.error("cannot return a string or array built inside a region".to_string());
+                    }
+                }
+                IRStmt::If { cond, then_block, else_block } => {
+                    self.expr(cond, scopes);
+                    self.block(then_block, scopes);
+                    if let Some(eb) = else_block { self.block(eb, scopes); }
+                }
+                IRStmt::While { cond, body } => {
+                    self.expr(cond, scopes);
+                    self.block(body, scopes);
+                }
+                IRStmt::For { vars, iterable, body, .. } => {
+                    self.expr(iterable, scopes);
+                    let elem = match self.type_of(iterable, scopes) {
+                        DataType::Array(e) => *e,
+                        _ => DataType::Int,
+                    };
+                    let mut scope: HashMap<String, DataType> = vars.iter().map(|v| (v.clone(), DataType::Int)).collect();
+                    if let Some(last) = vars.last() {
+                        scope.insert(last.clone(), elem);
+                    }
+                    scopes.push(scope);
+                    self.block(body, scopes);
+                    scopes.pop();
+                }
+                IRStmt::Assignment { target, value } => {
+                    self.expr(target, scopes);
+                    self.expr(value, scopes);
+                    self.assign(target, value, scopes);
+                }
+                IRStmt::Call { func, args, .. } => {
+                    for a in args { self.expr(a, scopes); }
+                    self.call_args(func, args, scopes);
+                }
+                IRStmt::MethodCall { object, method, args, .. } => {
+                    self.expr(object, scopes);
+                    for a in args { self.expr(a, scopes); }
+                    self.method_call(object, method, args, scopes);
+                }
+                IRStmt::Region { body } => {
+                    let outer = self.floor.replace(scopes.len());
+                    self.block(body, scopes);
+                    self.floor = outer;
+                }
+                IRStmt::Return(None) | IRStmt::Break | IRStmt::Continue => {}
+            }
+        }
+        scopes.pop();
+    }
+
+    fn expr(&mut self, e: &IRExpr, scopes: &[HashMap<String, DataType>]) {
+        match e {
+            IRExpr::Assignment { target, value } => {
+                self.expr(target, scopes);
+                self.expr(value, scopes);
+                self.assign(target, value, scopes);
+            }
+            IRExpr::Call { func, args, .. } => {
+                for a in args { self.expr(a, scopes); }
+                self.call_args(func, args, scopes);
+            }
+            IRExpr::MethodCall { object, method, args, .. } => {
+                self.expr(object, scopes);
+                for a in args { self.expr(a, scopes); }
+                self.method_call(object, method, args, scopes);
+            }
+            IRExpr::Binary { left, right, .. } | IRExpr::ArrayIndex { array: left, index: right } => {
+                self.expr(left, scopes);
+                self.expr(right, scopes);
+            }
+            IRExpr::Unary { operand: x, .. } | IRExpr::Cast { expr: x, .. } | IRExpr::MemberAccess { object: x, .. } => {
+                self.expr(x, scopes);
+            }
+            IRExpr::ArrayLiteral(items) | IRExpr::ArrayNew { dims: items } => {
+                for x in items { self.expr(x, scopes); }
+            }
+            IRExpr::StructLiteral { fields, .. } => {
+                for (_, x) in fields { self.expr(x, scopes); }
+            }
+            IRExpr::Format(parts) => {
+                for p in parts {
+                    if let FormatPart::Expr(x) = p { self.expr(x, scopes); }
+                }
+            }
+            IRExpr::Literal(_) | IRExpr::Variable(_) | IRExpr::None => {}
+        }
+    }
+
+    fn assign(&mut self, target: &IRExpr, value: &IRExpr, scopes: &[HashMap<String, DataType>]) {
+        if self.outer_root(target, scopes) && !self.lasting(value, scopes) {
+            let name = Self::root(target).unwrap_or_default();
+            self.error(format!("'{}' outlives the region; a string or array built inside it can't be stored there", name));
+        }
+    }
+
+    fn call_args(&mut self, func: &str, args: &[IRExpr], scopes: &[HashMap<String, DataType>]) {
+        for a in args {
+            if self.outer_root(a, scopes) && self.shares_storage(&self.type_of(a, scopes)) {
+                let name = Self::root(a).unwrap_or_default();
+                self.error(format!("passing '{}' to '{}' inside a region could store region memory in it", name, func));
+            }
+        }
+    }
+
+    fn method_call(&mut self, object: &IRExpr, method: &str, args: &[IRExpr], scopes: &[HashMap<String, DataType>]) {
+        let outer = self.outer_root(object, scopes);
+        match self.type_of(object, scopes) {
+            DataType::Array(elem) => {
+                if !outer {
+                    return;
+                }
+                let escapes = match method {
+                    "add" | "fill" => args.first().map_or(false, |v| !self.lasting(v, scopes)),
+                    "copy_from" => self.holds_heap(&elem) && args.first().map_or(false, |v| !self.outer_root(v, scopes)),
+                    _ => false,
+                };
+                if escapes {
+                    let name = Self::root(object).unwrap_or_default();
+                    self.error(format!("'{}' outlives the region; '{}' can't store a string or array built inside it", name, method));
+                }
+            }
+            ty @ DataType::Struct(_) if outer && self.shares_storage(&ty) => {
+                let name = Self::root(object).unwrap_or_default();
+                self.error(format!("calling '{}' on '{}' inside a region could store region memory in it", method, name));
+            }
+            _ => self.call_args(method, args, scopes),
+        }
+    }
+
+    fn error(&mut self, msg: String) {
+        self.errors.push(format!("In function '{}': {}", self.function, msg));
+    }
+
+    fn type_of(&self, e: &IRExpr, scopes: &[HashMap<String, DataType>]) -> DataType {
+        Monomorphizer::expr_type(&self.returns, &self.fields, e, scopes)
+    }
+
+    /// 变量、字段与下标链的根变量名
+    fn root(e: &IRExpr) -> Option<String> {
+        match e {
+            IRExpr::Variable(n) => Some(n.clone()),
+            IRExpr::MemberAccess { object, .. } | IRExpr::ArrayIndex { array: object, .. } => Self::root(object),
+            _ => None,
+        }
+    }
+
+    /// `e` 是否是最内层区域之外的变量（或其字段、元素）；不在区域内时为 false
+    fn outer_root(&self, e: &IRExpr, scopes: &[HashMap<String, DataType>]) -> bool {
+        let (Some(floor), Some(name)) = (self.floor, Self::root(e)) else { return false };
+        scopes.iter().rposition(|s| s.contains_key(&name)).map_or(false, |i| i < floor)
+    }
+
+    /// `e` 的值是否一定不引用区域内存：字面量、常量、区域外的存储，或不含字符串与数组的类型
+    fn lasting(&self, e: &IRExpr, scopes: &[HashMap<String, DataType>]) -> bool {
+        match e {
+            IRExpr::Literal(_) | IRExpr::None => return true,
+            IRExpr::Variable(n) if !scopes.iter().any(|s| s.contains_key(n)) => return true,
+            IRExpr::MethodCall { object, method, .. } if method == "get" && self.outer_root(object, scopes) => return true,
+            _ => {}
+        }
+        self.outer_root(e, scopes) || !self.holds_heap(&self.type_of(e, scopes))
+    }
+
+    /// 类型的值是否可能引用字符串或数组；未知类型按可能处理
+    fn holds_heap(&self, ty: &DataType) -> bool {
+        self.holds_heap_in(ty, &mut HashSet::new())
+    }
+
+    fn holds_heap_in(&self, ty: &DataType, seen: &mut HashSet<String>) -> bool {
+        match ty {
+            DataType::Int | DataType::Float | DataType::Bool | DataType::None_ => false,
+            DataType::Nullable(inner) => self.holds_heap_in(inner, seen),
+            DataType::Struct(s) => {
+                if !seen.insert(s.clone()) {
+                    return false;
+                }
+                match self.fields.get(s) {
+                    Some(fs) => fs.iter().any(|f| self.holds_heap_in(&f.ty, seen)),
+                    None => true,
+                }
+            }
+            DataType::Str | DataType::Array(_) | DataType::Unknown => true,
+        }
+    }
+
+    /// 被调方能否经由这个值把区域内的字符串或数组存到调用方看得见的地方：
+    /// 元素会引用堆内存的数组，以及含字符串或数组字段的结构体
+    fn shares_storage(&self, ty: &DataType) -> bool {
+        match ty {
+            DataType::Array(elem) => self.holds_heap(elem),
+            DataType::Struct(_) | DataType::Unknown => self.holds_heap(ty),
+            _ => false,
+        }
+    }
+}
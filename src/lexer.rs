@@ -1,36 +1,43 @@
-use crate::token::{Token, TokenType};
-use std::collections::HashSet;
+use crate::token::{is_keyword, Span, Token, TokenType};
+use std::fs;
+use std::io;
+use std::path::Path;
 
+/// Scans the source bytes in place.  Tokens carry spans into the source
+/// rather than copies of their text; `into_source` hands the text to
+/// whoever resolves them (the AST builder).
 pub struct Lexer {
     source: String,
     current_position: usize,
     line: i32,
     col: i32,
-    keywords: HashSet<String>,
 }
 
 impl Lexer {
     pub fn new(source: impl Into<String>) -> Self {
-        let mut keywords = HashSet::new();
-        let kw = [
-            "if", "else", "for", "return", "int", "float", "str", "func", "var", "val",
-            "import", "in", "as", "true", "false", "while", "break", "continue",
-            "null", "self", "export", "struct", "impl", "constructor", "new", "match",
-            "convert", "operator",
-        ];
-        for k in &kw {
-            keywords.insert(k.to_string());
-        }
-
         Lexer {
             source: source.into(),
             current_position: 0,
             line: 1,
             col: 0,
-            keywords,
         }
     }
 
+    /// Lex a file, read into a single buffer without an intermediate copy.
+    pub fn from_file(path: impl AsRef<Path>) -> io::Result<Self> {
+        let bytes = fs::read(path)?;
+        let source = String::from_utf8(bytes).map_err(|e| io::Error::new(io::ErrorKind::InvalidData, e))?;
+        Ok(Lexer::new(source))
+    }
+
+    pub fn source(&self) -> &str {
+        &self.source
+    }
+
+    pub fn into_source(self) -> String {
+        self.source
+    }
+
     #[allow(dead_code)]
     pub fn reset_position(&mut self) {
         self.current_position = 0;
@@ -38,33 +45,29 @@ impl Lexer {
         self.col = 0;
     }
 
+    fn bytes(&self) -> &[u8] {
+        self.source.as_bytes()
+    }
+
     fn is_source_end(&self) -> bool {
         self.current_position >= self.source.len()
     }
 
-    fn peek(&self) -> char {
-        if self.is_source_end() {
-            '\0'
-        } else {
-            self.source.as_bytes()[self.current_position] as char
-        }
+    fn peek(&self) -> u8 {
+        self.bytes().get(self.current_position).copied().unwrap_or(0)
     }
 
-    fn peek_next(&self) -> char {
-        if self.current_position + 1 < self.source.len() {
-            self.source.as_bytes()[self.current_position + 1] as char
-        } else {
-            '\0'
-        }
+    fn peek_next(&self) -> u8 {
+        self.bytes().get(self.current_position + 1).copied().unwrap_or(0)
     }
 
-    fn consume(&mut self) -> char {
+    fn consume(&mut self) -> u8 {
         if self.is_source_end() {
-            return '\0';
+            return 0;
         }
-        let c = self.source.as_bytes()[self.current_position] as char;
+        let c = self.bytes()[self.current_position];
         self.current_position += 1;
-        if c == '\n' {
+        if c == b'\n' {
             self.line += 1;
             self.col = 0;
         } else {
@@ -73,8 +76,17 @@ impl Lexer {
         c
     }
 
+    /// Consume one character, including the continuation bytes of a
+    /// multi-byte UTF-8 sequence, so spans stay on character boundaries.
+    fn consume_char(&mut self) {
+        self.consume();
+        while self.peek() & 0xC0 == 0x80 {
+            self.consume();
+        }
+    }
+
     fn skip_line_comment(&mut self) {
-        while !self.is_source_end() && self.peek() != '\n' {
+        while !self.is_source_end() && self.peek() != b'\n' {
             self.consume();
         }
     }
@@ -82,7 +94,7 @@ impl Lexer {
     fn skip_block_comment(&mut self) -> bool {
         self.consume(); // skip '*'
         while !self.is_source_end() {
-            if self.peek() == '*' && self.peek_next() == '/' {
+            if self.peek() == b'*' && self.peek_next() == b'/' {
                 self.consume(); // skip '*'
                 self.consume(); // skip '/'
                 return true;
@@ -97,25 +109,31 @@ impl Lexer {
         self.consume(); // skip '['
         let mut depth = 1;
         while !self.is_source_end() && depth > 0 {
-            if self.peek() == '[' {
+            if self.peek() == b'[' {
                 depth += 1;
-            } else if self.peek() == ']' {
+            } else if self.peek() == b']' {
                 depth -= 1;
             }
             self.consume();
         }
     }
 
+    /// Identifier characters: ASCII letters, digits, '_' and any non-ASCII
+    /// byte (so a UTF-8 identifier is taken whole).
+    fn is_ident_byte(c: u8) -> bool {
+        c.is_ascii_alphanumeric() || c == b'_' || c >= 0x80
+    }
+
     fn parse_identifier(&mut self) -> Token {
         let start = self.current_position;
-        while !self.is_source_end() && (self.peek().is_alphanumeric() || self.peek() == '_') {
+        while !self.is_source_end() && Self::is_ident_byte(self.peek()) {
             self.consume();
         }
-        let identifier: String = self.source[start..self.current_position].to_string();
-        if self.keywords.contains(&identifier) {
-            Token::new(TokenType::Keyword, identifier)
+        let span = Span::new(start, self.current_position);
+        if is_keyword(&self.bytes()[start..self.current_position]) {
+            Token::new(TokenType::Keyword, span)
         } else {
-            Token::new(TokenType::Identifier, identifier)
+            Token::new(TokenType::Identifier, span)
         }
     }
 
@@ -127,8 +145,8 @@ impl Lexer {
             let c = self.peek();
             if c.is_ascii_digit() {
                 self.consume();
-            } else if c == '.' && !has_decimal {
-                if self.peek_next() == '\0' || !self.peek_next().is_ascii_digit() {
+            } else if c == b'.' && !has_decimal {
+                if !self.peek_next().is_ascii_digit() {
                     break;
                 }
                 has_decimal = true;
@@ -139,12 +157,11 @@ impl Lexer {
         }
 
         if self.current_position == start {
-            let c = self.consume();
-            return Token::new(TokenType::Unknown, c.to_string());
+            self.consume_char();
+            return Token::new(TokenType::Unknown, Span::new(start, self.current_position));
         }
 
-        let number: String = self.source[start..self.current_position].to_string();
-        Token::new(TokenType::Number, number)
+        Token::new(TokenType::Number, Span::new(start, self.current_position))
     }
 
     fn parse_string(&mut self) -> Token {
@@ -154,22 +171,22 @@ impl Lexer {
 
         while !self.is_source_end() {
             let c = self.peek();
-            if c == '"' {
+            if c == b'"' {
                 is_closed = true;
                 break;
             }
-            if c == '\\' && self.peek_next() != '\0' {
+            if c == b'\\' && self.peek_next() != 0 {
                 self.consume(); // skip backslash
             }
             self.consume();
         }
 
-        let s: String = self.source[start..self.current_position].to_string();
+        let span = Span::new(start, self.current_position);
         if is_closed {
             self.consume(); // skip closing '"'
-            Token::new(TokenType::String, s)
+            Token::new(TokenType::String, span)
         } else {
-            Token::new(TokenType::Unknown, s)
+            Token::new(TokenType::Unknown, span)
         }
     }
 
@@ -177,19 +194,19 @@ impl Lexer {
         // Skip whitespace and comments
         while !self.is_source_end() {
             let c = self.peek();
-            if c.is_ascii_whitespace() && c != '\n' {
+            if c.is_ascii_whitespace() && c != b'\n' {
                 self.consume();
                 continue;
             }
-            if c == '/' && self.peek_next() == '/' {
+            if c == b'/' && self.peek_next() == b'/' {
                 self.skip_line_comment();
                 continue;
             }
-            if c == '/' && self.peek_next() == '*' {
+            if c == b'/' && self.peek_next() == b'*' {
                 self.skip_block_comment();
                 continue;
             }
-            if c == '#' && self.peek_next() == '[' {
+            if c == b'#' && self.peek_next() == b'[' {
                 self.skip_attribute();
                 continue;
             }
@@ -199,19 +216,15 @@ impl Lexer {
         // Capture token start position
         let tok_line = self.line;
         let tok_col = self.col;
+        let start = self.current_position;
 
         if self.is_source_end() {
-            return Token::with_pos(TokenType::EndOfFile, "", tok_line, tok_col);
+            return Token::with_pos(TokenType::EndOfFile, Span::new(start, start), tok_line, tok_col);
         }
 
         let current_char = self.peek();
 
-        if current_char == '\n' {
-            self.consume();
-            return Token::with_pos(TokenType::EndOfLine, "\n", tok_line, tok_col);
-        }
-
-        if current_char.is_alphabetic() || current_char == '_' {
+        if current_char.is_ascii_alphabetic() || current_char == b'_' || current_char >= 0x80 {
             let mut tok = self.parse_identifier();
             tok.line = tok_line;
             tok.col = tok_col;
@@ -223,165 +236,52 @@ impl Lexer {
             tok.col = tok_col;
             return tok;
         }
-        if current_char == '"' {
+        if current_char == b'"' {
             let mut tok = self.parse_string();
             tok.line = tok_line;
             tok.col = tok_col;
             return tok;
         }
 
-        match current_char {
-            '+' => {
-                self.consume();
-                if self.peek() == '=' {
+        let r#type = match self.consume() {
+            b'\n' => TokenType::EndOfLine,
+            // `op` or `op=`
+            b'+' | b'-' | b'*' | b'/' | b'%' | b'=' | b'>' | b'<' | b'!' => {
+                if self.peek() == b'=' {
                     self.consume();
-                    return Token::with_pos(TokenType::Operator, "+=", tok_line, tok_col);
                 }
-                Token::with_pos(TokenType::Operator, "+", tok_line, tok_col)
+                TokenType::Operator
             }
-            '-' => {
-                self.consume();
-                if self.peek() == '=' {
+            b'(' | b')' | b'{' | b'}' | b'[' | b']' | b':' | b';' | b',' | b'?' => TokenType::Operator,
+            b'.' => {
+                if self.peek() == b'.' {
                     self.consume();
-                    return Token::with_pos(TokenType::Operator, "-=", tok_line, tok_col);
                 }
-                Token::with_pos(TokenType::Operator, "-", tok_line, tok_col)
+                TokenType::Operator
             }
-            '*' => {
-                self.consume();
-                if self.peek() == '=' {
+            c @ (b'&' | b'|') => {
+                if self.peek() == c {
                     self.consume();
-                    return Token::with_pos(TokenType::Operator, "*=", tok_line, tok_col);
+                    TokenType::Operator
+                } else {
+                    TokenType::Unknown
                 }
-                Token::with_pos(TokenType::Operator, "*", tok_line, tok_col)
             }
-            '/' => {
-                self.consume();
-                if self.peek() == '=' {
-                    self.consume();
-                    return Token::with_pos(TokenType::Operator, "/=", tok_line, tok_col);
-                }
-                Token::with_pos(TokenType::Operator, "/", tok_line, tok_col)
-            }
-            '%' => {
-                self.consume();
-                if self.peek() == '=' {
-                    self.consume();
-                    return Token::with_pos(TokenType::Operator, "%=", tok_line, tok_col);
+            b'@' => {
+                if self.peek() != b'"' {
+                    self.consume_char();
+                    return Token::with_pos(TokenType::Unknown, Span::new(start, start + 1), tok_line, tok_col);
                 }
-                Token::with_pos(TokenType::Operator, "%", tok_line, tok_col)
-            }
-            '(' => {
-                self.consume();
-                Token::with_pos(TokenType::Operator, "(", tok_line, tok_col)
-            }
-            ')' => {
-                self.consume();
-                Token::with_pos(TokenType::Operator, ")", tok_line, tok_col)
-            }
-            '{' => {
-                self.consume();
-                Token::with_pos(TokenType::Operator, "{", tok_line, tok_col)
-            }
-            '}' => {
-                self.consume();
-                Token::with_pos(TokenType::Operator, "}", tok_line, tok_col)
-            }
-            '[' => {
-                self.consume();
-                Token::with_pos(TokenType::Operator, "[", tok_line, tok_col)
+                let tok = self.parse_string();
+                return Token::with_pos(TokenType::FormatString, tok.span, tok_line, tok_col);
             }
-            ']' => {
-                self.consume();
-                Token::with_pos(TokenType::Operator, "]", tok_line, tok_col)
-            }
-            '=' => {
-                self.consume();
-                if self.peek() == '=' {
-                    self.consume();
-                    return Token::with_pos(TokenType::Operator, "==", tok_line, tok_col);
-                }
-                Token::with_pos(TokenType::Operator, "=", tok_line, tok_col)
-            }
-            ':' => {
-                self.consume();
-                Token::with_pos(TokenType::Operator, ":", tok_line, tok_col)
-            }
-            ';' => {
-                self.consume();
-                Token::with_pos(TokenType::Operator, ";", tok_line, tok_col)
-            }
-            '.' => {
-                self.consume();
-                if self.peek() == '.' {
-                    self.consume();
-                    return Token::with_pos(TokenType::Operator, "..", tok_line, tok_col);
-                }
-                Token::with_pos(TokenType::Operator, ".", tok_line, tok_col)
-            }
-            ',' => {
-                self.consume();
-                Token::with_pos(TokenType::Operator, ",", tok_line, tok_col)
-            }
-            '>' => {
-                self.consume();
-                if self.peek() == '=' {
-                    self.consume();
-                    return Token::with_pos(TokenType::Operator, ">=", tok_line, tok_col);
-                }
-                Token::with_pos(TokenType::Operator, ">", tok_line, tok_col)
-            }
-            '<' => {
-                self.consume();
-                if self.peek() == '=' {
-                    self.consume();
-                    return Token::with_pos(TokenType::Operator, "<=", tok_line, tok_col);
-                }
-                Token::with_pos(TokenType::Operator, "<", tok_line, tok_col)
-            }
-            '?' => {
-                self.consume();
-                Token::with_pos(TokenType::Operator, "?", tok_line, tok_col)
-            }
-            '&' => {
-                self.consume();
-                if self.peek() == '&' {
-                    self.consume();
-                    return Token::with_pos(TokenType::Operator, "&&", tok_line, tok_col);
-                }
-                Token::with_pos(TokenType::Unknown, "&", tok_line, tok_col)
-            }
-            '|' => {
-                self.consume();
-                if self.peek() == '|' {
-                    self.consume();
-                    return Token::with_pos(TokenType::Operator, "||", tok_line, tok_col);
-                }
-                Token::with_pos(TokenType::Unknown, "|", tok_line, tok_col)
-            }
-            '!' => {
-                self.consume();
-                if self.peek() == '=' {
-                    self.consume();
-                    return Token::with_pos(TokenType::Operator, "!=", tok_line, tok_col);
-                }
-                Token::with_pos(TokenType::Operator, "!", tok_line, tok_col)
-            }
-            '@' => {
-                self.consume();
-                if self.peek() != '"' {
+            _ => {
+                while self.peek() & 0xC0 == 0x80 {
                     self.consume();
-                    return Token::with_pos(TokenType::Unknown, "@", tok_line, tok_col);
                 }
-                let mut tok = self.parse_string();
-                tok.line = tok_line;
-                tok.col = tok_col;
-                Token::with_pos(TokenType::FormatString, tok.value, tok_line, tok_col)
+                TokenType::Unknown
             }
-            _ => {
-                let unknown = self.consume().to_string();
-                Token::with_pos(TokenType::Unknown, unknown, tok_line, tok_col)
-            }
-        }
+        };
+        Token::with_pos(r#type, Span::new(start, self.current_position), tok_line, tok_col)
     }
 }
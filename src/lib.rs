@@ -4,10 +4,15 @@ pub mod ast_printer;
 pub mod ccompiler;
 pub mod codegen_c;
 // pub mod executor;
+pub mod driver;
 pub mod ir;
 pub mod environment;
 pub mod error;
 pub mod lexer;
+pub mod module_graph;
+pub mod optimizer;
 pub mod semantic_analyzer;
+pub mod server;
+pub mod time_report;
 pub mod token;
 pub mod value;
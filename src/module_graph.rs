@@ -0,0 +1,314 @@
+// module_graph.rs — discovers a program's imports and runs the per-module
+// front end (Lexer → AstBuilder → IRBuilder) on a thread pool.
+//
+// Modules are discovered level by level: every module of one level is
+// parsed in parallel, then the imports they declare form the next level.
+// Results are keyed by resolved file path and collected in discovery
+// order, so the merge into GobolIR doesn't depend on thread timing.
+// A `ModuleCache` carried between loads skips modules whose file hasn't
+// changed since it was parsed.
+//
+// Usage:
+//   let modules = ModuleGraph::load(&roots, &lib_paths);
+//   analyzer.set_preparsed(modules.programs());
+//   let ir = modules.ir(&path);
+
+use crate::ast::*;
+use crate::ast_builder::AstBuilder;
+use crate::ir::{GobolIR, IRBuilder};
+use crate::lexer::Lexer;
+use crate::time_report::{thread_allocated, ModuleEntry};
+use std::collections::{HashMap, HashSet};
+use std::fs;
+use std::path::Path;
+use std::rc::Rc;
+use std::thread;
+use std::time::{Duration, Instant, SystemTime};
+
+/// One parsed module.  `program` is kept even when the parser reported
+/// errors; `ir` is only built for modules that parsed cleanly.
+#[derive(Clone)]
+pub struct LoadedModule {
+    pub path: String,
+    pub program: Option<Rc<Program>>,
+    pub has_error: bool,
+    pub ir: Option<Rc<GobolIR>>,
+    /// Time spent lexing, parsing and lowering the module (zero when it
+    /// came from the cache)
+    pub elapsed: Duration,
+    /// Bytes allocated meanwhile, when `CountingAlloc` is installed
+    pub allocated: Option<u64>,
+}
+
+/// What a worker thread hands back; shared ownership starts on the
+/// loading thread.
+struct Parsed {
+    path: String,
+    program: Option<Box<Program>>,
+    has_error: bool,
+    ir: Option<GobolIR>,
+    elapsed: Duration,
+    allocated: Option<u64>,
+}
+
+/// Modification time and length of a module file when it was parsed.
+pub type Stamp = (SystemTime, u64);
+
+pub fn stamp(path: &str) -> Option<Stamp> {
+    let meta = fs::metadata(path).ok()?;
+    Some((meta.modified().ok()?, meta.len()))
+}
+
+/// Parsed modules kept between loads, keyed by file path.
+#[derive(Default)]
+pub struct ModuleCache {
+    entries: HashMap<String, (Stamp, LoadedModule)>,
+}
+
+impl ModuleCache {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// The cached module at `path`, if the file is unchanged since.
+    fn get(&self, path: &str) -> Option<LoadedModule> {
+        let (stamped, module) = self.entries.get(path)?;
+        if stamp(path) != Some(*stamped) {
+            return None;
+        }
+        Some(LoadedModule { elapsed: Duration::ZERO, allocated: module.allocated.map(|_| 0), ..module.clone() })
+    }
+
+    fn insert(&mut self, stamped: Option<Stamp>, module: &LoadedModule) {
+        match stamped {
+            Some(s) => { self.entries.insert(module.path.clone(), (s, module.clone())); }
+            None => { self.entries.remove(&module.path); }
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.entries.len()
+    }
+}
+
+pub struct ModuleGraph {
+    modules: HashMap<String, LoadedModule>,
+    /// File paths in discovery order
+    order: Vec<String>,
+}
+
+impl ModuleGraph {
+    /// Load `roots` (module name, directory of the importing file) and
+    /// everything they import transitively.
+    pub fn load(roots: &[(String, Option<String>)], lib_paths: &[String]) -> Self {
+        Self::load_cached(roots, lib_paths, &mut ModuleCache::new())
+    }
+
+    /// `load`, reusing the modules in `cache` whose files are unchanged and
+    /// adding the ones parsed now.
+    pub fn load_cached(roots: &[(String, Option<String>)], lib_paths: &[String], cache: &mut ModuleCache) -> Self {
+        let mut graph = ModuleGraph { modules: HashMap::new(), order: Vec::new() };
+        let mut seen: HashSet<String> = HashSet::new();
+
+        let mut level: Vec<String> = Vec::new();
+        for (name, dir) in roots {
+            if let Some(path) = resolve_import(lib_paths, name, dir.as_deref()) {
+                if seen.insert(path.clone()) {
+                    level.push(path);
+                }
+            }
+        }
+
+        while !level.is_empty() {
+            // Stamp before parsing, so an edit made meanwhile isn't cached as seen
+            let mut cached: Vec<Option<LoadedModule>> = level.iter().map(|p| cache.get(p)).collect();
+            let stale: Vec<String> = level.iter().zip(&cached)
+                .filter(|(_, hit)| hit.is_none())
+                .map(|(p, _)| p.clone())
+                .collect();
+            let stamps: Vec<Option<Stamp>> = stale.iter().map(|p| stamp(p)).collect();
+            let mut parsed = parse_level(&stale).into_iter().zip(stamps);
+
+            let mut next: Vec<String> = Vec::new();
+            for slot in cached.iter_mut() {
+                let module = match slot.take() {
+                    Some(hit) => hit,
+                    None => {
+                        let (p, stamped) = parsed.next().expect("one parse per stale module");
+                        let module = LoadedModule {
+                            path: p.path,
+                            program: p.program.map(Rc::from),
+                            has_error: p.has_error,
+                            ir: p.ir.map(Rc::new),
+                            elapsed: p.elapsed,
+                            allocated: p.allocated,
+                        };
+                        cache.insert(stamped, &module);
+                        module
+                    }
+                };
+                let dir = Path::new(&module.path).parent().and_then(|p| p.to_str()).map(|s| s.to_string());
+                if let Some(prog) = &module.program {
+                    for name in imports_of(prog) {
+                        if let Some(path) = resolve_import(lib_paths, &name, dir.as_deref()) {
+                            if seen.insert(path.clone()) {
+                                next.push(path);
+                            }
+                        }
+                    }
+                }
+                graph.order.push(module.path.clone());
+                graph.modules.insert(module.path.clone(), module);
+            }
+            level = next;
+        }
+
+        graph
+    }
+
+    /// The parsed programs (e.g. for the semantic analyzer), keyed by path.
+    pub fn programs(&self) -> HashMap<String, Rc<Program>> {
+        self.order
+            .iter()
+            .filter_map(|path| Some((path.clone(), self.modules[path].program.clone()?)))
+            .collect()
+    }
+
+    /// IR of the module at `path`, if it was loaded and parsed cleanly.
+    pub fn ir(&self, path: &str) -> Option<Rc<GobolIR>> {
+        self.modules.get(path).filter(|m| !m.has_error).and_then(|m| m.ir.clone())
+    }
+
+    pub fn contains(&self, path: &str) -> bool {
+        self.modules.contains_key(path)
+    }
+
+    pub fn len(&self) -> usize {
+        self.order.len()
+    }
+
+    /// File paths of the loaded modules, in discovery order.
+    pub fn paths(&self) -> &[String] {
+        &self.order
+    }
+
+    /// Front-end time and allocations of every module, in discovery order.
+    pub fn timings(&self) -> Vec<ModuleEntry> {
+        self.order.iter().map(|p| {
+            let module = &self.modules[p];
+            ModuleEntry { path: p.clone(), wall: module.elapsed, alloc_kb: module.allocated.map(|b| b / 1024) }
+        }).collect()
+    }
+}
+
+/// Parse one level of modules, one thread per chunk.  Results come back in
+/// the order of `paths`.
+fn parse_level(paths: &[String]) -> Vec<Parsed> {
+    let workers = thread::available_parallelism().map_or(1, |n| n.get()).min(paths.len());
+    if workers <= 1 {
+        return paths.iter().map(|p| parse_module(p)).collect();
+    }
+    let chunk = paths.len().div_ceil(workers);
+    thread::scope(|s| {
+        let handles: Vec<_> = paths
+            .chunks(chunk)
+            .map(|part| s.spawn(move || part.iter().map(|p| parse_module(p)).collect::<Vec<_>>()))
+            .collect();
+        handles
+            .into_iter()
+            .flat_map(|h| h.join().unwrap_or_default())
+            .collect()
+    })
+}
+
+fn parse_module(path: &str) -> Parsed {
+    let start = Instant::now();
+    let allocated = thread_allocated();
+    let mut module = Parsed { path: path.to_string(), program: None, has_error: true, ir: None, elapsed: Duration::ZERO, allocated: None };
+    let lexer = match Lexer::from_file(path) {
+        Ok(l) => l,
+        Err(_) => return module,
+    };
+    let mut builder = AstBuilder::new(lexer);
+    let prog = builder.build();
+    module.has_error = builder.has_error();
+    if let Some(prog) = &prog {
+        if !module.has_error {
+            module.ir = IRBuilder::new().build(prog).ok();
+        }
+    }
+    module.program = prog;
+    module.elapsed = start.elapsed();
+    module.allocated = allocated.zip(thread_allocated()).map(|(before, after)| after - before);
+    module
+}
+
+fn imports_of(prog: &Program) -> Vec<String> {
+    prog.statement_nodes()
+        .filter_map(|s| s.as_import())
+        .map(|i| i.get_module_name())
+        .collect()
+}
+
+fn resolve_import(lib_paths: &[String], name: &str, base_dir: Option<&str>) -> Option<String> {
+    let parts: Vec<String> = name.split('.').map(|s| s.to_string()).collect();
+    resolve_module_path(lib_paths, &parts, base_dir)
+}
+
+/// Module search order shared with the semantic analyzer: the importing
+/// module's directory, then each lib path, then the working directory.
+pub fn resolve_module_path(lib_paths: &[String], path_parts: &[String], base_dir: Option<&str>) -> Option<String> {
+    let relative = path_parts.join("/") + ".gbl";
+
+    // First: check relative to the importing module's directory
+    if let Some(dir) = base_dir {
+        let rel_full = format!("{}/{}", dir, relative);
+        if Path::new(&rel_full).exists() {
+            return Some(rel_full);
+        }
+        let rel_setup = format!("{}/{}/__setup__.gbl", dir, path_parts.join("/"));
+        if Path::new(&rel_setup).exists() {
+            return Some(rel_setup);
+        }
+        // Also check in base_dir/lib/ (local lib directory)
+        let rel_lib = format!("{}/lib/{}", dir, relative);
+        if Path::new(&rel_lib).exists() {
+            return Some(rel_lib);
+        }
+    }
+
+    // Second: check each lib path
+    for lib_path in lib_paths {
+        // <lib_path>/<module>.gbl
+        let full = format!("{}/{}", lib_path, relative);
+        if Path::new(&full).exists() {
+            return Some(full);
+        }
+        // <lib_path>/<module>/__setup__.gbl
+        let setup_relative = format!("{}/__setup__.gbl", path_parts.join("/"));
+        let setup_full = format!("{}/{}", lib_path, setup_relative);
+        if Path::new(&setup_full).exists() {
+            return Some(setup_full);
+        }
+        // <lib_path>/src/<module>.gbl (for grape packages)
+        let src_full = format!("{}/src/{}", lib_path, relative);
+        if Path::new(&src_full).exists() {
+            return Some(src_full);
+        }
+        // <lib_path>/lib/<module>.gbl
+        let lib_full = format!("{}/lib/{}", lib_path, relative);
+        if Path::new(&lib_full).exists() {
+            return Some(lib_full);
+        }
+    }
+    // Third: try without lib prefix
+    let direct = format!("{}.gbl", path_parts.join("/"));
+    if Path::new(&direct).exists() {
+        return Some(direct);
+    }
+    let setup_direct = format!("{}/__setup__.gbl", path_parts.join("/"));
+    if Path::new(&setup_direct).exists() {
+        return Some(setup_direct);
+    }
+    None
+}
@@ -0,0 +1,847 @@
+// optimizer.rs
+use crate::environment::DataType;
+use crate::ir::*;
+use std::collections::{HashMap, HashSet};
+
+// ==================== Pass 框架 ====================
+
+/// 作用于 GobolIR 的一趟优化。每个函数体（含 impl 方法）各调用一次
+/// `run_function`，默认实现转交给 `run_block`
+pub trait Pass {
+    fn name(&self) -> &'static str;
+
+    /// 遍历函数前调用一次，用于收集模块级信息
+    fn prepare(&mut self, _ir: &GobolIR) {}
+
+    fn run_function(&mut self, func: &mut IRFunction) {
+        if let Some(body) = func.body.as_mut() {
+            self.run_block(body);
+        }
+    }
+
+    fn run_block(&mut self, block: &mut IRBlock);
+}
+
+pub struct PassManager {
+    passes: Vec<Box<dyn Pass>>,
+}
+
+impl PassManager {
+    pub fn new() -> Self {
+        PassManager { passes: Vec::new() }
+    }
+
+    /// 常量传播 → 内联 → 常量折叠 → 死分支消除
+    pub fn with_default_passes() -> Self {
+        let mut pm = PassManager::new();
+        pm.add(Box::new(ConstantPropagation::new()));
+        pm.add(Box::new(Inliner::new()));
+        pm.add(Box::new(ConstantFolding));
+        pm.add(Box::new(DeadBranchElimination));
+        pm
+    }
+
+    pub fn add(&mut self, pass: Box<dyn Pass>) {
+        self.passes.push(pass);
+    }
+
+    /// 去掉名为 `name` 的一趟
+    pub fn remove(&mut self, name: &str) {
+        self.passes.retain(|p| p.name() != name);
+    }
+
+    pub fn run(&mut self, ir: &mut GobolIR) {
+        for pass in self.passes.iter_mut() {
+            pass.prepare(ir);
+            for f in ir.functions.iter_mut() {
+                pass.run_function(f);
+            }
+            for imp in ir.impls.iter_mut() {
+                for m in imp.methods.iter_mut() {
+                    pass.run_function(m);
+                }
+            }
+        }
+    }
+}
+
+// ==================== 常量传播 ====================
+
+/// 把值为字面量的顶层 `val`（含导入模块的 `math.PI`）替换为字面量。
+/// 按作用域跟踪局部绑定，被同名参数或变量遮蔽处不替换
+pub struct ConstantPropagation {
+    constants: HashMap<String, IRExpr>,
+    /// 导入的 `math.area` 在自身模块内直接写 `PI`
+    module: Option<String>,
+    scopes: Vec<HashSet<String>>,
+}
+
+impl ConstantPropagation {
+    pub fn new() -> Self {
+        ConstantPropagation { constants: HashMap::new(), module: None, scopes: Vec::new() }
+    }
+
+    fn lookup(&self, e: &IRExpr) -> Option<IRExpr> {
+        let path = dotted_path(e)?;
+        let root = path.split('.').next().unwrap_or("");
+        if self.scopes.iter().any(|s| s.contains(root)) {
+            return None;
+        }
+        let value = self.constants.get(&path).or_else(|| match (&self.module, path.contains('.')) {
+            (Some(m), false) => self.constants.get(&format!("{}.{}", m, path)),
+            _ => None,
+        });
+        value.cloned()
+    }
+
+    fn substitute(&self, e: &mut IRExpr) {
+        rewrite_expr(e, &mut |x| {
+            if matches!(x, IRExpr::Variable(_) | IRExpr::MemberAccess { .. }) {
+                if let Some(v) = self.lookup(x) {
+                    *x = v;
+                }
+            }
+        });
+    }
+
+    fn bind(&mut self, name: &str) {
+        if let Some(scope) = self.scopes.last_mut() {
+            scope.insert(name.to_string());
+        }
+    }
+}
+
+impl Pass for ConstantPropagation {
+    fn name(&self) -> &'static str {
+        "const-prop"
+    }
+
+    fn prepare(&mut self, ir: &GobolIR) {
+        self.constants.clear();
+        for c in &ir.constants {
+            let mut value = c.value.clone();
+            rewrite_expr(&mut value, &mut fold_expr);
+            if let IRExpr::Literal(lit) = &value {
+                // `val X: float = 1` 仍按 float 参与运算
+                let value = match (lit, &c.ty) {
+                    (LitValue::Int(n), DataType::Float) => IRExpr::Literal(LitValue::Float(*n as f64)),
+                    _ => value.clone(),
+                };
+                self.constants.insert(c.name.clone(), value);
+            }
+        }
+    }
+
+    fn run_function(&mut self, func: &mut IRFunction) {
+        if self.constants.is_empty() {
+            return;
+        }
+        self.module = func.name.rsplit_once('.').map(|(m, _)| m.to_string());
+        self.scopes = vec![func.params.iter().map(|p| p.name.clone()).collect()];
+        if let Some(body) = func.body.as_mut() {
+            self.run_block(body);
+        }
+        self.scopes.clear();
+    }
+
+    fn run_block(&mut self, block: &mut IRBlock) {
+        self.scopes.push(HashSet::new());
+        for stmt in block.statements.iter_mut() {
+            match stmt {
+                IRStmt::Declaration { name, init, .. } => {
+                    if let Some(e) = init { self.substitute(e); }
+                    self.bind(name);
+                }
+                IRStmt::If { cond, then_block, else_block } => {
+                    self.substitute(cond);
+                    self.run_block(then_block);
+                    if let Some(b) = else_block { self.run_block(b); }
+                }
+                IRStmt::While { cond, body } => {
+                    self.substitute(cond);
+                    self.run_block(body);
+                }
+                IRStmt::Region { body } => self.run_block(body),
+                IRStmt::For { vars, iterable, body, .. } => {
+                    self.substitute(iterable);
+                    self.scopes.push(vars.iter().cloned().collect());
+                    self.run_block(body);
+                    self.scopes.pop();
+                }
+                other => rewrite_stmt(other, &mut |e| {
+                    if matches!(e, IRExpr::Variable(_) | IRExpr::MemberAccess { .. }) {
+                        if let Some(v) = self.lookup(e) {
+                            *e = v;
+                        }
+                    }
+                }),
+            }
+        }
+        self.scopes.pop();
+    }
+}
+
+// ==================== 常量折叠 ====================
+
+/// 折叠字面量上的算术、比较、逻辑运算与类型转换，
+/// 以及字面量字符串的 `+` 拼接和全字面量的格式字符串
+pub struct ConstantFolding;
+
+impl Pass for ConstantFolding {
+    fn name(&self) -> &'static str {
+        "const-fold"
+    }
+
+    fn run_block(&mut self, block: &mut IRBlock) {
+        rewrite_block(block, &mut fold_expr);
+    }
+}
+
+fn fold_expr(e: &mut IRExpr) {
+    let folded = match e {
+        IRExpr::Binary { op, left, right } => match (left.as_ref(), right.as_ref()) {
+            (IRExpr::Literal(l), IRExpr::Literal(r)) => fold_binary(op, l, r),
+            _ => None,
+        },
+        IRExpr::Unary { op, operand } => match operand.as_ref() {
+            IRExpr::Literal(v) => fold_unary(op, v),
+            _ => None,
+        },
+        IRExpr::Cast { expr, target } => match expr.as_ref() {
+            IRExpr::Literal(v) => fold_cast(v, target),
+            _ => None,
+        },
+        IRExpr::Format(parts) => {
+            fold_format(parts);
+            match parts.as_slice() {
+                [] => Some(LitValue::Str(String::new())),
+                [FormatPart::Lit(s)] => Some(LitValue::Str(s.clone())),
+                _ => None,
+            }
+        }
+        _ => None,
+    };
+    if let Some(v) = folded {
+        *e = IRExpr::Literal(v);
+    }
+}
+
+/// 拼接进字符串时的文本；浮点数的 `%g` 格式留给运行时
+fn lit_text(v: &LitValue) -> Option<String> {
+    match v {
+        LitValue::Str(s) => Some(s.clone()),
+        LitValue::Int(n) => Some(n.to_string()),
+        LitValue::Bool(b) => Some(b.to_string()),
+        _ => None,
+    }
+}
+
+fn as_float(v: &LitValue) -> Option<f64> {
+    match v {
+        LitValue::Int(n) => Some(*n as f64),
+        LitValue::Float(f) => Some(*f),
+        _ => None,
+    }
+}
+
+fn fold_binary(op: &str, l: &LitValue, r: &LitValue) -> Option<LitValue> {
+    use LitValue::{Bool, Float, Int, Str};
+    match (l, r) {
+        (Int(a), Int(b)) => {
+            let (a, b) = (*a, *b);
+            // 溢出与除零保留到运行时
+            match op {
+                "+" => a.checked_add(b).map(Int),
+                "-" => a.checked_sub(b).map(Int),
+                "*" => a.checked_mul(b).map(Int),
+                "/" if b != 0 => a.checked_div(b).map(Int),
+                "%" if b != 0 => a.checked_rem(b).map(Int),
+                "<" => Some(Bool(a < b)),
+                ">" => Some(Bool(a > b)),
+                "<=" => Some(Bool(a <= b)),
+                ">=" => Some(Bool(a >= b)),
+                "==" => Some(Bool(a == b)),
+                "!=" => Some(Bool(a != b)),
+                _ => None,
+            }
+        }
+        (Bool(a), Bool(b)) => match op {
+            "&&" => Some(Bool(*a && *b)),
+            "||" => Some(Bool(*a || *b)),
+            "==" => Some(Bool(a == b)),
+            "!=" => Some(Bool(a != b)),
+            _ => None,
+        },
+        (Str(_), _) | (_, Str(_)) if op == "+" => {
+            Some(Str(format!("{}{}", lit_text(l)?, lit_text(r)?)))
+        }
+        _ => {
+            let (a, b) = (as_float(l)?, as_float(r)?);
+            let v = match op {
+                "+" => Float(a + b),
+                "-" => Float(a - b),
+                "*" => Float(a * b),
+                "/" if b != 0.0 => Float(a / b),
+                "<" => Bool(a < b),
+                ">" => Bool(a > b),
+                "<=" => Bool(a <= b),
+                ">=" => Bool(a >= b),
+                "==" => Bool(a == b),
+                "!=" => Bool(a != b),
+                _ => return None,
+            };
+            match v {
+                Float(f) if !f.is_finite() => None,
+                v => Some(v),
+            }
+        }
+    }
+}
+
+fn fold_unary(op: &str, v: &LitValue) -> Option<LitValue> {
+    match (op, v) {
+        ("-", LitValue::Int(n)) => n.checked_neg().map(LitValue::Int),
+        ("-", LitValue::Float(f)) => Some(LitValue::Float(-f)),
+        ("+", LitValue::Int(_)) | ("+", LitValue::Float(_)) => Some(v.clone()),
+        ("!", LitValue::Bool(b)) => Some(LitValue::Bool(!b)),
+        _ => None,
+    }
+}
+
+fn fold_cast(v: &LitValue, target: &DataType) -> Option<LitValue> {
+    match (v, target) {
+        (LitValue::Int(n), DataType::Float) => Some(LitValue::Float(*n as f64)),
+        (LitValue::Int(_), DataType::Int) | (LitValue::Float(_), DataType::Float) => Some(v.clone()),
+        (LitValue::Float(f), DataType::Int) if f.is_finite() && f.abs() < 9.2e18 => Some(LitValue::Int(*f as i64)),
+        (LitValue::Int(_), DataType::Str) | (LitValue::Bool(_), DataType::Str) => lit_text(v).map(LitValue::Str),
+        _ => None,
+    }
+}
+
+/// 把字面量插值并入相邻的文本片段
+fn fold_format(parts: &mut Vec<FormatPart>) {
+    let mut out: Vec<FormatPart> = Vec::with_capacity(parts.len());
+    for p in parts.drain(..) {
+        let text = match &p {
+            FormatPart::Lit(s) => Some(s.clone()),
+            FormatPart::Expr(IRExpr::Literal(v)) => lit_text(v),
+            FormatPart::Expr(_) => None,
+        };
+        match (text, out.last_mut()) {
+            (Some(t), Some(FormatPart::Lit(prev))) => prev.push_str(&t),
+            (Some(t), _) => out.push(FormatPart::Lit(t)),
+            (None, _) => out.push(p),
+        }
+    }
+    *parts = out;
+}
+
+// ==================== 死分支消除 ====================
+
+/// 删除条件为常量的 `if` 中不可达的分支和 `while false`
+pub struct DeadBranchElimination;
+
+impl Pass for DeadBranchElimination {
+    fn name(&self) -> &'static str {
+        "dead-branch"
+    }
+
+    fn run_block(&mut self, block: &mut IRBlock) {
+        let mut out: Vec<IRStmt> = Vec::with_capacity(block.statements.len());
+        for mut stmt in block.statements.drain(..) {
+            match &mut stmt {
+                IRStmt::If { then_block, else_block, .. } => {
+                    self.run_block(then_block);
+                    if let Some(b) = else_block { self.run_block(b); }
+                }
+                IRStmt::While { body, .. } | IRStmt::For { body, .. } | IRStmt::Region { body } => self.run_block(body),
+                _ => {}
+            }
+            match stmt {
+                IRStmt::If { cond: IRExpr::Literal(ref c), then_block, else_block } if const_truth(c).is_some() => {
+                    let taken = if const_truth(c) == Some(true) { Some(then_block) } else { else_block };
+                    if let Some(taken) = taken {
+                        // 没有声明的分支直接展开；否则保留一层 C 作用域
+                        if taken.statements.iter().any(|s| matches!(s, IRStmt::Declaration { .. })) {
+                            out.push(IRStmt::If {
+                                cond: IRExpr::Literal(LitValue::Bool(true)),
+                                then_block: taken,
+                                else_block: None,
+                            });
+                        } else {
+                            out.extend(taken.statements);
+                        }
+                    }
+                }
+                IRStmt::While { cond: IRExpr::Literal(ref c), .. } if const_truth(c) == Some(false) => {}
+                stmt => out.push(stmt),
+            }
+        }
+        block.statements = out;
+    }
+}
+
+fn const_truth(v: &LitValue) -> Option<bool> {
+    match v {
+        LitValue::Bool(b) => Some(*b),
+        LitValue::Int(n) => Some(*n != 0),
+        _ => None,
+    }
+}
+
+// ==================== 内联 ====================
+
+/// 总是内联的函数体大小上限（表达式节点数）
+const INLINE_ALWAYS: usize = 12;
+/// 只有一处调用时内联的函数体大小上限
+const INLINE_ONCE: usize = 40;
+/// 候选函数体之间相互展开的轮数，限制嵌套深度
+const INLINE_ROUNDS: usize = 3;
+
+/// 函数体只有一个表达式（或一条调用语句）的函数，如 getter 与一行的包装函数
+struct Inlinee {
+    /// 方法的第一个参数是 `self`，由调用对象替换
+    params: Vec<IRParam>,
+    returns: DataType,
+    body: IRExpr,
+    size: usize,
+    /// 函数体内有调用或短路运算：带副作用的实参挪进函数体后求值顺序或次数会变
+    has_calls: bool,
+    /// 函数体引用的模块名（`fs._byte` 的 `fs`），调用处不能有同名局部变量
+    modules: HashSet<String>,
+}
+
+/// 在单态化后的 IR 上把小函数展开到调用处。CodeGenC 按模块生成各自的翻译
+/// 单元，跨单元的调用 C 编译器无法内联；getter 与包装函数在这里直接换成
+/// 函数体。按函数体大小与调用次数决定：不超过 INLINE_ALWAYS 的总是内联，
+/// 不超过 INLINE_ONCE 的只在全程序仅有一处调用时内联。
+/// 函数本身仍然生成，供未展开的调用（如 `sort_by` 的回调）使用
+pub struct Inliner {
+    inlinees: HashMap<String, Inlinee>,
+    /// 函数名 → 返回类型，用于推断局部变量的类型
+    returns: HashMap<String, DataType>,
+    /// 正在处理的函数，不向自身展开
+    current: String,
+    scopes: Vec<HashMap<String, DataType>>,
+}
+
+impl Inliner {
+    pub fn new() -> Self {
+        Inliner {
+            inlinees: HashMap::new(),
+            returns: HashMap::new(),
+            current: String::new(),
+            scopes: Vec::new(),
+        }
+    }
+
+    /// 函数体化为单个表达式；带 `self` 以外的隐式状态、赋值或需要上下文类型
+    /// 的（数组字面量、可空值）由 `analyze` 排除
+    fn body_expr(f: &IRFunction) -> Option<IRExpr> {
+        if f.is_main || !f.generic_params.is_empty() {
+            return None;
+        }
+        if matches!(f.return_type, DataType::Unknown | DataType::Nullable(_))
+            || f.params.iter().any(|p| matches!(p.ty, DataType::Unknown | DataType::Nullable(_)))
+        {
+            return None;
+        }
+        let void = f.return_type == DataType::None_;
+        Some(match f.body.as_ref()?.statements.as_slice() {
+            [IRStmt::Return(Some(e))] if !void => e.clone(),
+            [IRStmt::Expression(e)] if void => e.clone(),
+            [IRStmt::Call { func, args, generic_args }] if void => {
+                IRExpr::Call { func: func.clone(), args: args.clone(), generic_args: generic_args.clone() }
+            }
+            [IRStmt::MethodCall { object, method, args, generic_args }] if void => IRExpr::MethodCall {
+                object: object.clone(),
+                method: method.clone(),
+                args: args.clone(),
+                generic_args: generic_args.clone(),
+            },
+            _ => return None,
+        })
+    }
+
+    fn analyze(params: Vec<IRParam>, returns: DataType, body: IRExpr) -> Option<Inlinee> {
+        let names: HashSet<&str> = params.iter().map(|p| p.name.as_str()).collect();
+        // 结构体与数组参数只能读字段、下标与长度：交给别的调用可能被改写
+        let aggregates: HashSet<&str> = params.iter()
+            .filter(|p| matches!(p.ty, DataType::Struct(_) | DataType::Array(_)))
+            .map(|p| p.name.as_str())
+            .collect();
+        let mut ok = true;
+        let mut size = 0;
+        let mut has_calls = false;
+        let mut modules = HashSet::new();
+        let mut free = 0;
+        let mut module_uses = 0;
+        let mut aggregate_uses = 0;
+        let mut aggregate_reads = 0;
+        visit_expr(&body, &mut |x| {
+            size += 1;
+            let var = |e: &IRExpr| match e {
+                IRExpr::Variable(v) => Some(v.clone()),
+                _ => None,
+            };
+            match x {
+                IRExpr::Variable(v) if !names.contains(v.as_str()) => free += 1,
+                IRExpr::Variable(v) if aggregates.contains(v.as_str()) => aggregate_uses += 1,
+                IRExpr::MemberAccess { object, .. } | IRExpr::ArrayIndex { array: object, .. } => {
+                    if var(object).map_or(false, |v| aggregates.contains(v.as_str())) { aggregate_reads += 1; }
+                }
+                IRExpr::Call { .. } => has_calls = true,
+                IRExpr::Binary { op, .. } if op == "&&" || op == "||" => has_calls = true,
+                IRExpr::MethodCall { object, method, .. } => {
+                    has_calls = true;
+                    match dotted_path(object) {
+                        Some(path) if !names.contains(path.split('.').next().unwrap_or("")) => {
+                            modules.insert(path.split('.').next().unwrap_or("").to_string());
+                            module_uses += 1;
+                        }
+                        _ if method == "len" && var(object).map_or(false, |v| aggregates.contains(v.as_str())) => {
+                            aggregate_reads += 1;
+                        }
+                        _ => {}
+                    }
+                }
+                IRExpr::Assignment { .. } | IRExpr::ArrayLiteral(_) | IRExpr::ArrayNew { .. } | IRExpr::None => ok = false,
+                _ => {}
+            }
+        });
+        if !ok || free != module_uses || aggregate_uses != aggregate_reads {
+            return None;
+        }
+        Some(Inlinee { params, returns, body, size, has_calls, modules })
+    }
+
+    fn lookup(&self, name: &str) -> Option<&DataType> {
+        self.scopes.iter().rev().find_map(|s| s.get(name))
+    }
+
+    fn bind(&mut self, name: &str, ty: DataType) {
+        if let Some(scope) = self.scopes.last_mut() {
+            scope.insert(name.to_string(), ty);
+        }
+    }
+
+    /// 局部变量的类型：声明类型，或由初始化表达式推断
+    fn type_of(&self, e: &IRExpr) -> DataType {
+        let ret = |name: &str| self.returns.get(name).cloned().unwrap_or(DataType::Unknown);
+        match e {
+            IRExpr::Variable(v) => self.lookup(v).cloned().unwrap_or(DataType::Unknown),
+            IRExpr::StructLiteral { name, .. } => DataType::Struct(name.clone()),
+            IRExpr::Call { func, .. } => ret(func),
+            IRExpr::MethodCall { object, method, .. } => match self.callee(object, method) {
+                Some((name, _)) => ret(&name),
+                None => DataType::Unknown,
+            },
+            _ => DataType::Unknown,
+        }
+    }
+
+    /// 方法调用的目标函数名；第二项为真时调用对象充当 `self`
+    fn callee(&self, object: &IRExpr, method: &str) -> Option<(String, bool)> {
+        let path = dotted_path(object)?;
+        let root = path.split('.').next().unwrap_or("");
+        if self.lookup(root).is_none() {
+            // `Counter.new(3)` 与模块函数 `m.add(1, 2)`
+            return Some((format!("{}.{}", path, method), false));
+        }
+        match (object, self.lookup(root)) {
+            (IRExpr::Variable(_), Some(DataType::Struct(s))) => Some((format!("{}.{}", s, method), true)),
+            _ => None,
+        }
+    }
+
+    /// 调用 `e` 展开后的表达式；不满足内联条件时为 `None`
+    fn expand(&self, e: &IRExpr) -> Option<IRExpr> {
+        let (name, object, args) = match e {
+            IRExpr::Call { func, args, .. } => (func.clone(), None, args),
+            IRExpr::MethodCall { object, method, args, .. } => match self.callee(object, method)? {
+                (name, true) => (name, Some(object.as_ref()), args),
+                (name, false) => (name, None, args),
+            },
+            _ => return None,
+        };
+        if name == self.current {
+            return None;
+        }
+        let callee = self.inlinees.get(&name)?;
+        let params = match (object, callee.params.first()) {
+            (Some(_), Some(p)) if p.name == "self" => &callee.params[1..],
+            (None, Some(p)) if p.name == "self" => return None,
+            _ => &callee.params[..],
+        };
+        if params.len() != args.len() || callee.modules.iter().any(|m| self.lookup(m).is_some()) {
+            return None;
+        }
+
+        let mut map: HashMap<&str, IRExpr> = HashMap::new();
+        if let Some(obj) = object {
+            map.insert("self", obj.clone());
+        }
+        let mut effects = 0;
+        for (p, a) in params.iter().zip(args) {
+            let mut uses = 0;
+            visit_expr(&callee.body, &mut |x| {
+                if matches!(x, IRExpr::Variable(v) if *v == p.name) { uses += 1; }
+            });
+            if !is_simple(a) {
+                let pure = is_pure(a);
+                // 重复求值或丢掉实参都会改变语义，只有纯表达式可以只用一次以外的次数
+                if uses != 1 && !(pure && uses == 0) {
+                    return None;
+                }
+                if !pure {
+                    effects += 1;
+                }
+            }
+            // `half(3)` 的 3 在 C 调用时转换成 double
+            let arg = match (&p.ty, a) {
+                (DataType::Float, IRExpr::Literal(LitValue::Float(_))) => a.clone(),
+                (DataType::Float, _) => IRExpr::Cast { expr: Box::new(a.clone()), target: DataType::Float },
+                _ => a.clone(),
+            };
+            map.insert(p.name.as_str(), arg);
+        }
+        if effects > 1 || (effects == 1 && callee.has_calls) {
+            return None;
+        }
+
+        let mut body = callee.body.clone();
+        rewrite_expr(&mut body, &mut |x| {
+            if let IRExpr::Variable(v) = x {
+                if let Some(a) = map.get(v.as_str()) {
+                    *x = a.clone();
+                }
+            }
+        });
+        if callee.returns == DataType::Float && !matches!(body, IRExpr::Literal(LitValue::Float(_))) {
+            body = IRExpr::Cast { expr: Box::new(body), target: DataType::Float };
+        }
+        Some(body)
+    }
+
+    fn inline_expr(&self, e: &mut IRExpr) {
+        rewrite_expr(e, &mut |x| {
+            if let Some(body) = self.expand(x) {
+                *x = body;
+            }
+        });
+    }
+
+    /// 调用语句本身的展开：结果若仍是调用，保持调用语句的形式
+    fn expand_stmt(&self, stmt: &IRStmt) -> Option<IRStmt> {
+        let call = match stmt {
+            IRStmt::Call { func, args, generic_args } => {
+                IRExpr::Call { func: func.clone(), args: args.clone(), generic_args: generic_args.clone() }
+            }
+            IRStmt::MethodCall { object, method, args, generic_args } => IRExpr::MethodCall {
+                object: object.clone(),
+                method: method.clone(),
+                args: args.clone(),
+                generic_args: generic_args.clone(),
+            },
+            _ => return None,
+        };
+        Some(match self.expand(&call)? {
+            IRExpr::Call { func, args, generic_args } => IRStmt::Call { func, args, generic_args },
+            IRExpr::MethodCall { object, method, args, generic_args } => IRStmt::MethodCall { object, method, args, generic_args },
+            e => IRStmt::Expression(e),
+        })
+    }
+
+    fn enter(&mut self, f: &IRFunction) {
+        self.current = f.name.clone();
+        let mut params: HashMap<String, DataType> = f.params.iter().map(|p| (p.name.clone(), p.ty.clone())).collect();
+        if let (true, Some(s)) = (f.is_method, &f.struct_name) {
+            params.entry("self".to_string()).or_insert_with(|| DataType::Struct(s.clone()));
+        }
+        self.scopes = vec![params];
+    }
+}
+
+/// 可以原样复制到每个使用处的实参
+fn is_simple(e: &IRExpr) -> bool {
+    match e {
+        IRExpr::Literal(_) | IRExpr::Variable(_) => true,
+        IRExpr::MemberAccess { object, .. } => is_simple(object),
+        IRExpr::Unary { op, operand } => op == "-" && matches!(operand.as_ref(), IRExpr::Literal(_)),
+        _ => false,
+    }
+}
+
+/// 求值没有副作用
+fn is_pure(e: &IRExpr) -> bool {
+    let mut pure = true;
+    visit_expr(e, &mut |x| {
+        if matches!(x, IRExpr::Call { .. } | IRExpr::MethodCall { .. } | IRExpr::Assignment { .. }
+            | IRExpr::ArrayLiteral(_) | IRExpr::ArrayNew { .. }) {
+            pure = false;
+        }
+    });
+    pure
+}
+
+/// 全程序的调用次数：函数调用按函数名，方法调用按 `路径.方法名`，另按 `.方法名` 合计
+fn count_calls(block: &IRBlock, calls: &mut HashMap<String, usize>) {
+    fn count(object: Option<&IRExpr>, name: &str, calls: &mut HashMap<String, usize>) {
+        match object {
+            None => *calls.entry(name.to_string()).or_insert(0) += 1,
+            Some(o) => {
+                if let Some(path) = dotted_path(o) {
+                    *calls.entry(format!("{}.{}", path, name)).or_insert(0) += 1;
+                }
+                *calls.entry(format!(".{}", name)).or_insert(0) += 1;
+            }
+        }
+    }
+    let exprs = |e: &IRExpr, calls: &mut HashMap<String, usize>| visit_expr(e, &mut |x| match x {
+        IRExpr::Call { func, .. } => count(None, func, calls),
+        IRExpr::MethodCall { object, method, .. } => count(Some(object), method, calls),
+        _ => {}
+    });
+    for stmt in &block.statements {
+        match stmt {
+            IRStmt::Declaration { init: Some(e), .. } | IRStmt::Expression(e) | IRStmt::Return(Some(e)) => exprs(e, calls),
+            IRStmt::Assignment { target, value } => {
+                exprs(target, calls);
+                exprs(value, calls);
+            }
+            IRStmt::Call { func, args, .. } => {
+                count(None, func, calls);
+                for a in args { exprs(a, calls); }
+            }
+            IRStmt::MethodCall { object, method, args, .. } => {
+                count(Some(object), method, calls);
+                exprs(object, calls);
+                for a in args { exprs(a, calls); }
+            }
+            IRStmt::If { cond, then_block, else_block } => {
+                exprs(cond, calls);
+                count_calls(then_block, calls);
+                if let Some(b) = else_block { count_calls(b, calls); }
+            }
+            IRStmt::While { cond: e, body } | IRStmt::For { iterable: e, body, .. } => {
+                exprs(e, calls);
+                count_calls(body, calls);
+            }
+            IRStmt::Region { body } => count_calls(body, calls),
+            IRStmt::Declaration { .. } | IRStmt::Return(None) | IRStmt::Break | IRStmt::Continue => {}
+        }
+    }
+}
+
+impl Pass for Inliner {
+    fn name(&self) -> &'static str {
+        "inline"
+    }
+
+    fn prepare(&mut self, ir: &GobolIR) {
+        self.inlinees.clear();
+        self.returns.clear();
+        let functions: Vec<&IRFunction> = ir.functions.iter()
+            .chain(ir.impls.iter().flat_map(|imp| imp.methods.iter()))
+            .collect();
+        let mut calls = HashMap::new();
+        for f in &functions {
+            self.returns.insert(f.name.clone(), f.return_type.clone());
+            if let Some(body) = &f.body { count_calls(body, &mut calls); }
+        }
+        let bodies: Vec<(&IRFunction, IRExpr, bool)> = functions.iter()
+            .filter_map(|f| {
+                let key = match (f.is_method, f.name.rsplit_once('.')) {
+                    (true, Some((_, method))) => format!(".{}", method),
+                    _ => f.name.clone(),
+                };
+                let once = calls.get(&key).copied().unwrap_or(0) <= 1;
+                Self::body_expr(f).map(|body| (*f, body, once))
+            })
+            .collect();
+
+        // 每一轮用上一轮选出的函数展开候选函数体，`self.total() * k` 这样的
+        // 函数展开后才可内联，调用处也只需展开一层。展开后过大的保留原函数体
+        for _ in 0..=INLINE_ROUNDS {
+            let mut next = HashMap::new();
+            for (f, body, once) in &bodies {
+                let fits = |c: &Inlinee| c.size <= INLINE_ALWAYS || (*once && c.size <= INLINE_ONCE);
+                self.enter(f);
+                let mut expanded = body.clone();
+                self.inline_expr(&mut expanded);
+                let chosen = Self::analyze(f.params.clone(), f.return_type.clone(), expanded)
+                    .filter(|c| fits(c))
+                    .or_else(|| Self::analyze(f.params.clone(), f.return_type.clone(), body.clone()).filter(|c| fits(c)));
+                if let Some(c) = chosen {
+                    next.insert(f.name.clone(), c);
+                }
+            }
+            let same = next.len() == self.inlinees.len()
+                && next.iter().all(|(n, c)| self.inlinees.get(n).map_or(false, |old| old.size == c.size));
+            self.inlinees = next;
+            if same { break; }
+        }
+        self.scopes.clear();
+    }
+
+    fn run_function(&mut self, func: &mut IRFunction) {
+        if self.inlinees.is_empty() {
+            return;
+        }
+        self.enter(func);
+        if let Some(body) = func.body.as_mut() {
+            self.run_block(body);
+        }
+        self.scopes.clear();
+    }
+
+    fn run_block(&mut self, block: &mut IRBlock) {
+        self.scopes.push(HashMap::new());
+        for stmt in block.statements.iter_mut() {
+            match stmt {
+                IRStmt::Declaration { name, ty, init } => {
+                    let bound = match (ty, init.as_ref()) {
+                        (DataType::Unknown | DataType::None_, Some(e)) => self.type_of(e),
+                        (ty, _) => ty.clone(),
+                    };
+                    if let Some(e) = init { self.inline_expr(e); }
+                    self.bind(name, bound);
+                }
+                IRStmt::If { cond, then_block, else_block } => {
+                    self.inline_expr(cond);
+                    self.run_block(then_block);
+                    if let Some(b) = else_block { self.run_block(b); }
+                }
+                IRStmt::While { cond, body } => {
+                    self.inline_expr(cond);
+                    self.run_block(body);
+                }
+                IRStmt::Region { body } => self.run_block(body),
+                IRStmt::For { vars, iterable, body, .. } => {
+                    let elem = match self.type_of(iterable) {
+                        DataType::Array(inner) => *inner,
+                        _ => DataType::Unknown,
+                    };
+                    self.inline_expr(iterable);
+                    let mut scope: HashMap<String, DataType> = vars.iter().map(|v| (v.clone(), DataType::Int)).collect();
+                    if let Some(v) = vars.last() { scope.insert(v.clone(), elem); }
+                    self.scopes.push(scope);
+                    self.run_block(body);
+                    self.scopes.pop();
+                }
+                other => {
+                    let this = &*self;
+                    rewrite_stmt(other, &mut |x| {
+                        if let Some(body) = this.expand(x) {
+                            *x = body;
+                        }
+                    });
+                    if let Some(expanded) = self.expand_stmt(other) {
+                        *other = expanded;
+                    }
+                }
+            }
+        }
+        self.scopes.pop();
+    }
+}
@@ -5,10 +5,35 @@ use crate::ast_builder::AstBuilder;
 use crate::environment::*;
 use crate::error::ErrorFormatter;
 use crate::lexer::Lexer;
+use crate::module_graph;
 use std::collections::{HashMap, HashSet};
 use std::fs;
 use std::path::Path;
+use std::rc::Rc;
+
+/// A `parallel for` whose body is being checked.
+#[derive(Clone)]
+struct ParallelLoop {
+    /// Scope of the loop variables; anything declared below it is shared
+    /// by every iteration
+    scope: i32,
+    /// `loop_depth` inside the body, for `break`
+    loop_depth: i32,
+    /// Loop variables that differ between any two iterations
+    index_vars: Vec<String>,
+    reductions: Vec<String>,
+    /// Shared arrays the body writes, each at an element of its own
+    written: Vec<String>,
+    /// Shared arrays the body reads away from its own elements
+    foreign_reads: Vec<String>,
+}
+
+/// Array methods that change the array
+const ARRAY_MUTATORS: [&str; 7] = ["add", "fill", "copy_from", "sort", "sort_by", "partition", "map_add_scalar"];
 
+/// Clonable, so a driver can keep the state after `load_prelude` and
+/// start each compile from a copy.
+#[derive(Clone)]
 pub struct SemanticAnalyzer {
     env: Environment,
     errors: Vec<String>,
@@ -24,10 +49,30 @@ pub struct SemanticAnalyzer {
     current_impl_struct: Option<String>,
     lib_paths: Vec<String>,
     loaded_modules: HashSet<String>,
-    loaded_programs: Vec<Box<Program>>,
+    loaded_programs: Vec<Rc<Program>>,
+    /// Modules already parsed by the module graph, keyed by file path
+    preparsed: HashMap<String, Rc<Program>>,
     current_module_dir: Option<String>,
     module_aliases: HashMap<String, String>,
     current_generic_params: Vec<String>,
+    /// Enclosing `parallel for` loops of the function, innermost last
+    parallel_loops: Vec<ParallelLoop>,
+    /// What the functions write: `Struct.method` for a method assigning a
+    /// field of `self`, `func#i` for a function modifying its parameter `i`
+    writers: HashSet<String>,
+    /// (a, b): `a` writes whatever `b` does, as when a method calls
+    /// `self.m()` or a function passes its parameter on
+    writes_through: Vec<(String, String)>,
+    /// (`Struct.method` or `func#i`, error) for each call a `parallel for`
+    /// makes with a receiver or argument shared by its iterations; an error
+    /// once every function is seen
+    parallel_calls: Vec<(String, String)>,
+    /// Parameters of the function being analyzed and their scope
+    current_params: Vec<String>,
+    params_scope: i32,
+    /// Set while visiting the array of an `a[i][j]`, so only the outermost
+    /// index of a chain is taken as a read
+    in_index_chain: bool,
 }
 
 impl SemanticAnalyzer {
@@ -48,9 +93,17 @@ impl SemanticAnalyzer {
             lib_paths: vec!["lib".to_string()],
             loaded_modules: HashSet::new(),
             loaded_programs: Vec::new(),
+            preparsed: HashMap::new(),
             current_module_dir: None,
             module_aliases: HashMap::new(),
             current_generic_params: Vec::new(),
+            parallel_loops: Vec::new(),
+            writers: HashSet::new(),
+            writes_through: Vec::new(),
+            parallel_calls: Vec::new(),
+            current_params: Vec::new(),
+            params_scope: 0,
+            in_index_chain: false,
         }
     }
 
@@ -62,6 +115,10 @@ impl SemanticAnalyzer {
         self.lib_paths = paths;
     }
 
+    pub fn set_preparsed(&mut self, programs: HashMap<String, Rc<Program>>) {
+        self.preparsed = programs;
+    }
+
     pub fn set_main_file(&mut self, file_path: &str) {
         // Derive module name from filename (e.g. "math.gbl" → "math")
         if let Some(stem) = Path::new(file_path).file_stem().and_then(|s| s.to_str()) {
@@ -75,22 +132,29 @@ impl SemanticAnalyzer {
         }
     }
 
-    pub fn analyze(&mut self, program: &Program) -> bool {
+    /// Declare the compiler-provided functions and load std's `__setup__`
+    /// (io, range, ...).  Idempotent; `analyze` calls it first.
+    pub fn load_prelude(&mut self) {
         // Register built-in modules and compiler-provided functions
         self.env.declare_module("__builtins__");
         self.env.declare_function("_print", &DataType::None_, "__builtins__");
         self.env.declare_function("_read", &DataType::Str, "__builtins__");
+        self.env.declare_function("_flush", &DataType::None_, "__builtins__");
         self.env.declare_function("panic", &DataType::None_, "__builtins__");
         self.env.declare_function("exit", &DataType::None_, "__builtins__");
 
         // Auto-import __setup__ which loads io, range, etc. from lib/
         self.load_module("__setup__");
+    }
+
+    /// Check `program`; the errors are left in `get_errors` for the caller
+    /// to report.
+    pub fn analyze(&mut self, program: &Program) -> bool {
+        self.load_prelude();
 
         program.accept(self);
+        self.check_parallel_calls();
 
-        if self.has_error {
-            self.print_errors();
-        }
         #[cfg(debug_assertions)]
         if !self.has_error {
             self.print_errors();
@@ -119,6 +183,206 @@ impl SemanticAnalyzer {
         }
     }
 
+    /// Whether the call's only argument names a function, as in `a.sort_by(less)`.
+    fn is_function_argument(&self, ast: &Ast, node: &FunctionCall) -> bool {
+        let args = match node.get_arguments() {
+            Some(args) if args.len() == 1 => args,
+            _ => return false,
+        };
+        let name = match ast[args[0]].as_identifier() {
+            Some(id) => id.get_name(),
+            None => return false,
+        };
+        let full_name = format!("{}.{}", self.current_module, name);
+        self.env.lookup_symbol(&full_name)
+            .or_else(|| self.env.lookup_symbol(name))
+            .map_or(false, |s| s.symbol_type == SymbolType::Function)
+    }
+
+    /// Body of a `for`; the body of a `parallel for` is checked for writes
+    /// one iteration could make to another's data.
+    fn visit_loop_body(&mut self, ast: &Ast, node: &ForStatement, index_vars: Vec<String>) {
+        if node.is_parallel() {
+            self.parallel_loops.push(ParallelLoop {
+                scope: self.env.get_current_scope(),
+                loop_depth: self.loop_depth + 1,
+                index_vars,
+                reductions: node.get_reductions().iter().map(|(_, v)| v.clone()).collect(),
+                written: Vec::new(),
+                foreign_reads: Vec::new(),
+            });
+        }
+        self.loop_depth += 1;
+        if let Some(body) = node.get_body() {
+            self.visit_block(ast, body);
+        }
+        self.loop_depth -= 1;
+        if node.is_parallel() {
+            let p = self.parallel_loops.pop().unwrap();
+            let mut reported: Vec<&String> = Vec::new();
+            for name in p.foreign_reads.iter().filter(|n| p.written.contains(n)) {
+                if !reported.contains(&name) {
+                    reported.push(name);
+                    self.error(&format!(
+                        "Parallel for reads '{}' away from the loop variable's index while iterations write it",
+                        name
+                    ));
+                }
+            }
+        }
+    }
+
+    /// Whether `name` is a variable declared outside the innermost
+    /// `parallel for`, so every iteration sees the same one.
+    fn is_shared(&self, name: &str) -> bool {
+        let Some(p) = self.parallel_loops.last() else { return false };
+        self.env.lookup_symbol(name)
+            .map_or(false, |s| s.symbol_type == SymbolType::Variable && s.scope_level < p.scope)
+    }
+
+    /// An assignment to variable `name`: a shared variable may only be
+    /// written as one of the loop's reductions.
+    fn check_parallel_write(&mut self, name: &str) {
+        let reduced = self.parallel_loops.last().map_or(false, |p| p.reductions.iter().any(|r| r == name));
+        if self.is_shared(name) && !reduced {
+            self.error(&format!(
+                "Loop-carried write to '{}' in parallel for; declare it inside the loop or list it in reduce(...)",
+                name
+            ));
+        }
+    }
+
+    /// An assignment to a field of `self`, from the method being analyzed.
+    fn note_field_write(&mut self, field: &str) {
+        if let Some(s) = &self.current_impl_struct {
+            self.writers.insert(format!("{}.{}", s, self.current_function));
+        }
+        if !self.parallel_loops.is_empty() {
+            self.error(&format!("Parallel for writes field '{}' of 'self', shared by all iterations", field));
+        }
+    }
+
+    /// `arr[i0][i1]... = v`: iterations may only write a shared array at an
+    /// element of their own, one whose index is a loop variable.
+    fn check_parallel_index_write(&mut self, ast: &Ast, name: &str, indices: &[ExprId]) {
+        if !self.is_shared(name) {
+            return;
+        }
+        let own = self.parallel_loops.last().map_or(false, |p| {
+            indices.iter().any(|i| {
+                ast[*i].as_identifier().map_or(false, |id| p.index_vars.iter().any(|v| v == id.get_name()))
+            })
+        });
+        if !own {
+            self.error(&format!(
+                "Parallel for writes '{}[...]' at an index that is not a loop variable; iterations may write the same element",
+                name
+            ));
+        } else if let Some(p) = self.parallel_loops.last_mut() {
+            p.written.push(name.to_string());
+        }
+    }
+
+    /// A read of shared array `name`: at `indices`, or of the whole array
+    /// when there are none.  Unless one index is a loop variable it may see
+    /// an element another iteration writes.
+    fn note_parallel_read(&mut self, ast: &Ast, name: &str, indices: &[ExprId]) {
+        if !self.is_shared(name) {
+            return;
+        }
+        let Some(p) = self.parallel_loops.last_mut() else { return };
+        let own = indices.iter().any(|i| {
+            ast[*i].as_identifier().map_or(false, |id| p.index_vars.iter().any(|v| v == id.get_name()))
+        });
+        if !own {
+            p.foreign_reads.push(name.to_string());
+        }
+    }
+
+    /// What a call to `callee` (`Struct.method` or `module.func`; `None`
+    /// for an array method, written `shown` at the call) can do to the variables it is given: pass on a
+    /// parameter or `self` of the function being analyzed, or, from a
+    /// `parallel for`, modify or read an array or struct shared by all
+    /// iterations.
+    fn note_call_args(&mut self, ast: &Ast, callee: Option<&str>, shown: &str, node: &FunctionCall) {
+        let Some(args) = node.get_arguments() else { return };
+        for (i, arg) in args.iter().enumerate() {
+            let Some(id) = ast[*arg].as_identifier() else { continue };
+            let name = id.get_name();
+            let param = callee.map(|c| format!("{}#{}", c, i));
+            if let Some(param) = &param {
+                if name == "self" && self.current_impl_struct.is_some() {
+                    self.writes_through.push((self.current_callable(), param.clone()));
+                } else if let Some(key) = self.param_key(name) {
+                    self.writes_through.push((key, param.clone()));
+                }
+            }
+            if !self.is_shared(name) {
+                continue;
+            }
+            let Some((is_array, ty)) = self.env.lookup_symbol(name).map(|s| (s.is_array, s.data_type.clone())) else { continue };
+            if is_array {
+                self.note_parallel_read(ast, name, &[]);
+            }
+            let by_ref = is_array || matches!(&ty, DataType::Struct(s) if self.struct_fields.contains_key(s));
+            if let (Some(param), true) = (param, by_ref) {
+                let msg = format!(
+                    "Parallel for passes '{}' to '{}()', which modifies it, shared by all iterations",
+                    name,
+                    shown
+                );
+                self.parallel_calls.push((param, msg));
+            }
+        }
+    }
+
+    /// `func#i` for parameter `name` of the function being analyzed, unless
+    /// a local hides it.
+    fn param_key(&self, name: &str) -> Option<String> {
+        let i = self.current_params.iter().position(|p| p == name)?;
+        let sym = self.env.lookup_symbol(name)?;
+        if sym.scope_level != self.params_scope {
+            return None;
+        }
+        Some(format!("{}#{}", self.current_callable(), i))
+    }
+
+    /// The function being analyzed as `Struct.method` or `module.func`.
+    fn current_callable(&self) -> String {
+        let owner = self.current_impl_struct.as_ref().unwrap_or(&self.current_module);
+        format!("{}.{}", owner, self.current_function)
+    }
+
+    /// A write to variable `name`, recorded when it is a parameter.
+    fn note_param_write(&mut self, name: &str) {
+        if let Some(key) = self.param_key(name) {
+            self.writers.insert(key);
+        }
+    }
+
+    /// Calls a `parallel for` makes with a shared receiver or argument,
+    /// reported when the callee (or one it hands the value on to) modifies
+    /// it.
+    fn check_parallel_calls(&mut self) {
+        let mut writers = self.writers.clone();
+        loop {
+            let before = writers.len();
+            for (a, b) in &self.writes_through {
+                if writers.contains(b) {
+                    writers.insert(a.clone());
+                }
+            }
+            if writers.len() == before {
+                break;
+            }
+        }
+        for (callee, msg) in std::mem::take(&mut self.parallel_calls) {
+            if writers.contains(&callee) {
+                self.error(&msg);
+            }
+        }
+    }
+
     fn error(&mut self, msg: &str) {
         self.has_error = true;
         if let Some(ref f) = self.error_formatter {
@@ -129,18 +393,18 @@ impl SemanticAnalyzer {
         }
     }
 
-    fn get_data_type_from_ast(&mut self, tp: Option<&dyn Type>) -> DataType {
+    fn get_data_type_from_ast(&mut self, tp: Option<&Type>) -> DataType {
         let tp = match tp {
             Some(t) => t,
             None => return DataType::None_,
         };
 
         // Check for GenericType: vec<int> → array type, others → struct
-        if let Some(gt) = tp.as_type_any().downcast_ref::<GenericType>() {
+        if let Some(gt) = tp.as_generic() {
             let base = gt.get_base_name();
             if base == "vec" && !gt.get_type_args().is_empty() {
                 // vec<int> is an alias for int[]
-                let elem_type = self.get_data_type_from_ast(Some(&*gt.get_type_args()[0]));
+                let elem_type = self.get_data_type_from_ast(Some(&gt.get_type_args()[0]));
                 return elem_type; // treated as element type (array)
             }
             // Other generic types — treat as struct for now
@@ -148,15 +412,15 @@ impl SemanticAnalyzer {
         }
 
         // Check for NullableType
-        if let Some(nullable) = tp.as_type_any().downcast_ref::<NullableType>() {
+        if let Some(nullable) = tp.as_nullable() {
             let inner = self.get_data_type_from_ast(Some(nullable.get_inner_type()));
             return DataType::Nullable(Box::new(inner));
         }
 
-        // Check for ArrayType via downcast
-        if let Some(arr) = tp.as_type_any().downcast_ref::<ArrayType>() {
+        // Check for ArrayType
+        if let Some(arr) = tp.as_array() {
             let elem = arr.get_element_type();
-            if elem.as_type_any().downcast_ref::<ArrayType>().is_some() {
+            if elem.as_array().is_some() {
                 return self.get_data_type_from_ast(Some(elem));
             }
             return self.get_data_type_from_ast(Some(elem));
@@ -203,59 +467,7 @@ impl SemanticAnalyzer {
     }
 
     fn resolve_module_path(&self, path_parts: &[String], base_dir: Option<&str>) -> Option<String> {
-        let relative = path_parts.join("/") + ".gbl";
-
-        // First: check relative to the importing module's directory
-        if let Some(dir) = base_dir {
-            let rel_full = format!("{}/{}", dir, relative);
-            if Path::new(&rel_full).exists() {
-                return Some(rel_full);
-            }
-            let rel_setup = format!("{}/{}/__setup__.gbl", dir, path_parts.join("/"));
-            if Path::new(&rel_setup).exists() {
-                return Some(rel_setup);
-            }
-            // Also check in base_dir/lib/ (local lib directory)
-            let rel_lib = format!("{}/lib/{}", dir, relative);
-            if Path::new(&rel_lib).exists() {
-                return Some(rel_lib);
-            }
-        }
-
-        // Second: check each lib path
-        for lib_path in &self.lib_paths {
-            // <lib_path>/<module>.gbl
-            let full = format!("{}/{}", lib_path, relative);
-            if Path::new(&full).exists() {
-                return Some(full);
-            }
-            // <lib_path>/<module>/__setup__.gbl
-            let setup_relative = format!("{}/__setup__.gbl", path_parts.join("/"));
-            let setup_full = format!("{}/{}", lib_path, setup_relative);
-            if Path::new(&setup_full).exists() {
-                return Some(setup_full);
-            }
-            // <lib_path>/src/<module>.gbl (for grape packages)
-            let src_full = format!("{}/src/{}", lib_path, relative);
-            if Path::new(&src_full).exists() {
-                return Some(src_full);
-            }
-            // <lib_path>/lib/<module>.gbl
-            let lib_full = format!("{}/lib/{}", lib_path, relative);
-            if Path::new(&lib_full).exists() {
-                return Some(lib_full);
-            }
-        }
-        // Third: try without lib prefix
-        let direct = format!("{}.gbl", path_parts.join("/"));
-        if Path::new(&direct).exists() {
-            return Some(direct);
-        }
-        let setup_direct = format!("{}/__setup__.gbl", path_parts.join("/"));
-        if Path::new(&setup_direct).exists() {
-            return Some(setup_direct);
-        }
-        None
+        module_graph::resolve_module_path(&self.lib_paths, path_parts, base_dir)
     }
 
     fn load_module(&mut self, module_name: &str) {
@@ -276,16 +488,20 @@ impl SemanticAnalyzer {
             }
         };
 
-        let source = match fs::read_to_string(&file_path) {
-            Ok(s) => s,
-            Err(_) => return,
-        };
-
-        let lexer = Lexer::new(source);
-        let mut builder = AstBuilder::new(lexer);
-        let prog = match builder.build() {
+        let prog = match self.preparsed.remove(&file_path) {
             Some(p) => p,
-            None => return,
+            None => {
+                let source = match fs::read_to_string(&file_path) {
+                    Ok(s) => s,
+                    Err(_) => return,
+                };
+                let lexer = Lexer::new(source);
+                let mut builder = AstBuilder::new(lexer);
+                match builder.build() {
+                    Some(p) => Rc::from(p),
+                    None => return,
+                }
+            }
         };
 
         // Set current_module_dir for relative imports within this module
@@ -305,30 +521,31 @@ impl SemanticAnalyzer {
         self.env.declare_module(&self.current_module);
 
         // Only register declarations (imports, function signatures, structs)
-        for stmt in prog.get_statements() {
-            if let Some(import_stmt) = stmt.as_any().downcast_ref::<ImportStatement>() {
+        let ast = prog.get_ast();
+        for stmt in prog.statement_nodes() {
+            if let Some(import_stmt) = stmt.as_import() {
                 let name = import_stmt.get_module_name();
                 self.load_module(&name);
                 if let Some(alias) = import_stmt.get_alias() {
                     self.module_aliases.insert(alias.to_string(), name);
                 }
-            } else if let Some(func) = stmt.as_any().downcast_ref::<Function>() {
+            } else if let Some(func) = stmt.as_function() {
                 let func_name = func.get_name().to_string();
                 let prev_generic = self.current_generic_params.clone();
                 self.current_generic_params = func.get_generic_params().clone();
                 let return_type = self.get_data_type_from_ast(func.get_return_type());
                 self.env.declare_function(&func_name, &return_type, &self.current_module);
                 self.current_generic_params = prev_generic;
-            } else if let Some(struct_def) = stmt.as_any().downcast_ref::<StructDefinition>() {
+            } else if let Some(struct_def) = stmt.as_struct_definition() {
                 let struct_name = struct_def.get_name().to_string();
                 let mut fields = HashMap::new();
                 for field in struct_def.get_fields() {
-                    let field_type = self.get_data_type_from_ast(field.field_type.as_deref());
+                    let field_type = self.get_data_type_from_ast(field.field_type.as_ref());
                     fields.insert(field.name.clone(), field_type);
                 }
                 self.struct_fields.insert(struct_name.clone(), fields);
                 self.env.declare_module(&struct_name);
-            } else if let Some(impl_block) = stmt.as_any().downcast_ref::<ImplBlock>() {
+            } else if let Some(impl_block) = stmt.as_impl_block() {
                 let prev_impl = self.current_impl_struct.clone();
                 self.current_impl_struct = Some(impl_block.get_struct_name().to_string());
                 for item in impl_block.get_items() {
@@ -348,7 +565,21 @@ impl SemanticAnalyzer {
                     }
                 }
                 self.current_impl_struct = prev_impl;
-            } else if let Some(export_stmt) = stmt.as_any().downcast_ref::<ExportStatement>() {
+            } else if let Some(decl) = stmt.as_declaration() {
+                // Module constants such as math.PI
+                if decl.get_keyword() == "val" {
+                    let mut const_type = self.get_data_type_from_ast(decl.get_type());
+                    if const_type == DataType::None_ {
+                        if let Some(init) = decl.get_initializer() {
+                            self.visit_expr(ast, init);
+                            const_type = self.get_current_type();
+                            self.type_stack.pop();
+                        }
+                    }
+                    let full_name = format!("{}.{}", self.current_module, decl.get_name());
+                    self.env.declare_variable(&full_name, &const_type, false);
+                }
+            } else if let Some(export_stmt) = stmt.as_export() {
                 for name in export_stmt.get_names() {
                     let parts: Vec<&str> = name.split('.').collect();
                     let short = parts.last().unwrap_or(&"");
@@ -376,26 +607,20 @@ impl SemanticAnalyzer {
 }
 
 impl AstVisitor for SemanticAnalyzer {
-    fn visit_ast_node(&mut self, _node: &dyn AstNode) {}
-
-    fn visit_statement(&mut self, _node: &dyn Statement) {}
-
-    fn visit_expression(&mut self, _node: &dyn Expression) {}
-
-    fn visit_program(&mut self, node: &Program) {
-        for stmt in node.get_statements() {
-            stmt.accept(self);
+    fn visit_program(&mut self, ast: &Ast, node: &Program) {
+        for &stmt in node.get_statements() {
+            self.visit_stmt(ast, stmt);
         }
     }
 
-    fn visit_struct_definition(&mut self, node: &StructDefinition) {
+    fn visit_struct_definition(&mut self, _ast: &Ast, node: &StructDefinition) {
         let struct_name = node.get_name().to_string();
         #[cfg(debug_assertions)]
         println!("  Struct definition: {}", struct_name);
 
         let mut fields = HashMap::new();
         for field in node.get_fields() {
-            let field_type = self.get_data_type_from_ast(field.field_type.as_deref());
+            let field_type = self.get_data_type_from_ast(field.field_type.as_ref());
             fields.insert(field.name.clone(), field_type);
         }
         self.struct_fields.insert(struct_name.clone(), fields);
@@ -403,7 +628,7 @@ impl AstVisitor for SemanticAnalyzer {
         self.env.declare_module(&struct_name);
     }
 
-    fn visit_impl_block(&mut self, node: &ImplBlock) {
+    fn visit_impl_block(&mut self, ast: &Ast, node: &ImplBlock) {
         #[cfg(debug_assertions)]
         println!("  Impl block for: {}", node.get_struct_name());
 
@@ -413,7 +638,7 @@ impl AstVisitor for SemanticAnalyzer {
         for item in node.get_items() {
             match item {
                 ImplItem::Constructor(func) | ImplItem::Method(func) | ImplItem::Convert(func) => {
-                    func.accept(self);
+                    self.visit_function(ast, func);
                 }
             }
         }
@@ -421,12 +646,12 @@ impl AstVisitor for SemanticAnalyzer {
         self.current_impl_struct = prev_impl;
     }
 
-    fn visit_export_statement(&mut self, _node: &ExportStatement) {
+    fn visit_export_statement(&mut self, _ast: &Ast, _node: &ExportStatement) {
         // Export is a compile-time concept; no runtime effect
         // TODO: validate exported names are declared in current module
     }
 
-    fn visit_import_statement(&mut self, node: &ImportStatement) {
+    fn visit_import_statement(&mut self, _ast: &Ast, node: &ImportStatement) {
         let module_name = node.get_module_name();
         #[cfg(debug_assertions)]
         println!("  Import module: {} (alias: {:?})", module_name, node.get_alias());
@@ -437,7 +662,7 @@ impl AstVisitor for SemanticAnalyzer {
         }
     }
 
-    fn visit_function(&mut self, node: &Function) {
+    fn visit_function(&mut self, ast: &Ast, node: &Function) {
         let func_name = node.get_name().to_string();
         #[cfg(debug_assertions)]
         println!("  Function: {}", func_name);
@@ -470,32 +695,36 @@ impl AstVisitor for SemanticAnalyzer {
         self.current_function = func_name;
         self.current_function_return_type = return_type.clone();
         self.has_return_statement = false;
+        let prev_parallel = std::mem::take(&mut self.parallel_loops);
 
         self.env.enter_scope();
 
         // Parameters
+        let prev_params = std::mem::take(&mut self.current_params);
+        let prev_params_scope = self.params_scope;
+        self.params_scope = self.env.get_current_scope();
         if let Some(params) = node.get_parameters() {
             for param in params {
-                param.accept(self);
+                self.visit_parameter(ast, param);
+                self.current_params.push(param.get_name().to_string());
             }
         }
 
         // Body
         let mut has_tail_expr = false;
         if let Some(body) = node.get_body() {
-            body.accept(self);
+            self.visit_block(ast, body);
             // Check if last statement is a tail expression (implicit return)
             let stmts = body.get_statements();
-            if let Some(last) = stmts.last() {
-                if let Some(es) = last.as_any().downcast_ref::<ExpressionStatement>() {
+            if let Some(&last) = stmts.last() {
+                if let Some(es) = ast[last].as_expression_statement() {
                     if es.tail {
                         has_tail_expr = true;
                     }
                 }
-                // Also treat if/match/block expressions as implicit returns
-                if last.as_any().downcast_ref::<IfStatement>().is_some()
-                    || last.as_any().downcast_ref::<MatchExpression>().is_some()
-                {
+                // Also treat a trailing if as an implicit return; a match
+                // arrives as an expression statement
+                if ast[last].as_if().is_some() {
                     has_tail_expr = true;
                 }
             }
@@ -515,56 +744,64 @@ impl AstVisitor for SemanticAnalyzer {
         self.current_function_return_type = prev_return_type;
         self.has_return_statement = prev_has_return;
         self.current_generic_params = prev_generic_params;
+        self.parallel_loops = prev_parallel;
+        self.current_params = prev_params;
+        self.params_scope = prev_params_scope;
     }
 
-    fn visit_parameter(&mut self, node: &Parameter) {
+    fn visit_parameter(&mut self, _ast: &Ast, node: &Parameter) {
         let param_name = node.get_name();
         let param_type = self.get_data_type_from_ast(node.get_type());
 
         // Array parameters are always mutable (reference type)
-        let is_array = node.get_type().map_or(false, |t| t.as_type_any().downcast_ref::<ArrayType>().is_some());
+        let is_array = node.get_type().map_or(false, |t| t.as_array().is_some());
         self.env.declare_variable(param_name, &param_type, is_array);
         // Mark as array if the parameter type is an array
         if is_array {
+            let rank = node.get_type()
+                .and_then(|t| t.as_array())
+                .map_or(1, |a| a.get_dimension());
             if let Some(sym) = self.env.lookup_symbol_mut(param_name) {
                 sym.is_array = true;
+                // Parameter sizes come from the caller; only the rank is known
+                sym.dimensions = (0..rank).map(|_| ArrayDimension::new_constant(0)).collect();
             }
         }
         #[cfg(debug_assertions)]
         println!("    Parameter: {} : {}", param_name, data_type_to_string(param_type));
     }
 
-    fn visit_block(&mut self, node: &Block) {
+    fn visit_block(&mut self, ast: &Ast, node: &Block) {
         self.env.enter_scope();
         #[cfg(debug_assertions)]
         println!("    Block (scope {})", self.env.get_current_scope());
 
-        for stmt in node.get_statements() {
-            stmt.accept(self);
+        for &stmt in node.get_statements() {
+            self.visit_stmt(ast, stmt);
         }
 
         self.env.exit_scope();
     }
 
-    fn visit_declaration(&mut self, node: &Declaration) {
+    fn visit_declaration(&mut self, ast: &Ast, node: &Declaration) {
         let var_name = node.get_name().to_string();
         let is_mut = node.get_keyword() == "var";
 
         // Check for array type
         if let Some(tp) = node.get_type() {
-            if let Some(_array_type) = tp.as_type_any().downcast_ref::<ArrayType>() {
+            if tp.as_array().is_some() {
                 let mut constant_sizes: Vec<i32> = Vec::new();
-                let mut expr_sizes: Vec<Box<dyn Expression>> = Vec::new();
+                let mut expr_sizes: Vec<ExprId> = Vec::new();
                 let mut all_constant = true;
 
                 // Walk array dimensions
-                let mut current: Option<&dyn Type> = Some(tp);
-                let mut innermost: Option<&dyn Type> = None;
+                let mut current: Option<&Type> = Some(tp);
+                let mut innermost: Option<&Type> = None;
 
                 while let Some(c) = current {
-                    if let Some(arr) = c.as_type_any().downcast_ref::<ArrayType>() {
+                    if let Some(arr) = c.as_array() {
                         if let Some(size) = arr.get_size() {
-                            size.accept(self);
+                            self.visit_expr(ast, size);
                             let size_type = self.get_current_type();
                             self.type_stack.pop();
 
@@ -574,14 +811,13 @@ impl AstVisitor for SemanticAnalyzer {
                             }
 
                             // Check if size is constant
-                            if let Some(num) = (size as &dyn AstNode).as_any().downcast_ref::<NumberLiteral>() {
+                            if let Some(num) = ast[size].as_number() {
                                 constant_sizes.push(num.get_value() as i32);
-                                expr_sizes.push(Box::new(NumberLiteral::new(0.0))); // placeholder
                             } else {
                                 all_constant = false;
                                 constant_sizes.push(0);
-                                // Can't easily clone trait objects, skip expr
                             }
+                            expr_sizes.push(size);
                         }
                         current = Some(arr.get_element_type());
                     } else {
@@ -595,8 +831,8 @@ impl AstVisitor for SemanticAnalyzer {
                 if all_constant {
                     self.env.declare_array_constant(&var_name, &elem_type, &constant_sizes, is_mut);
                 } else {
-                    // For non-constant arrays
-                    self.env.declare_variable(&var_name, &elem_type, is_mut);
+                    // Sized at run time, e.g. `var m: int[n][n];`
+                    self.env.declare_array_expr(&var_name, &elem_type, expr_sizes, is_mut);
                 }
 
                 return;
@@ -608,7 +844,7 @@ impl AstVisitor for SemanticAnalyzer {
         let actual_type = if declared_type == DataType::None_ {
             // Infer type from initializer
             if let Some(init) = node.get_initializer() {
-                init.accept(self);
+                self.visit_expr(ast, init);
                 let init_type = self.get_current_type();
                 self.env.declare_variable(&var_name, &init_type, is_mut);
                 return;
@@ -622,7 +858,7 @@ impl AstVisitor for SemanticAnalyzer {
         };
 
         if let Some(init) = node.get_initializer() {
-            init.accept(self);
+            self.visit_expr(ast, init);
             let init_type = self.get_current_type();
             self.check_type_compatibility(
                 actual_type,
@@ -632,12 +868,12 @@ impl AstVisitor for SemanticAnalyzer {
         }
     }
 
-    fn visit_if_statement(&mut self, node: &IfStatement) {
+    fn visit_if_statement(&mut self, ast: &Ast, node: &IfStatement) {
         #[cfg(debug_assertions)]
         println!("    IfStatement");
 
         if let Some(cond) = node.get_condition() {
-            cond.accept(self);
+            self.visit_expr(ast, cond);
             let cond_type = self.get_current_type();
 
             if cond_type != DataType::Bool && !Environment::is_numeric_type(&cond_type) {
@@ -646,20 +882,20 @@ impl AstVisitor for SemanticAnalyzer {
         }
 
         if let Some(then_branch) = node.get_then_branch() {
-            then_branch.accept(self);
+            self.visit_stmt(ast, then_branch);
         }
 
         if let Some(else_branch) = node.get_else_branch() {
-            else_branch.accept(self);
+            self.visit_stmt(ast, else_branch);
         }
     }
 
-    fn visit_while_statement(&mut self, node: &WhileStatement) {
+    fn visit_while_statement(&mut self, ast: &Ast, node: &WhileStatement) {
         #[cfg(debug_assertions)]
         println!("    WhileStatement");
 
         if let Some(cond) = node.get_condition() {
-            cond.accept(self);
+            self.visit_expr(ast, cond);
             let cond_type = self.get_current_type();
 
             if cond_type != DataType::Bool && !Environment::is_numeric_type(&cond_type) {
@@ -670,30 +906,83 @@ impl AstVisitor for SemanticAnalyzer {
         self.loop_depth += 1;
 
         if let Some(body) = node.get_body() {
-            body.accept(self);
+            self.visit_stmt(ast, body);
         }
 
         self.loop_depth -= 1;
     }
 
-    fn visit_for_statement(&mut self, node: &ForStatement) {
+    fn visit_region_statement(&mut self, ast: &Ast, node: &RegionStatement) {
+        // What may escape the region is checked on the IR, where every
+        // variable has its full type
+        self.visit_block(ast, node.get_body());
+    }
+
+    fn visit_for_statement(&mut self, ast: &Ast, node: &ForStatement) {
         let loop_vars = node.get_loop_variables().clone();
 
+        if node.is_parallel() {
+            for (op, var) in node.get_reductions() {
+                if !matches!(op.as_str(), "sum" | "min" | "max") {
+                    self.error(&format!("Unknown reduction '{}' in reduce(...); expected sum, min or max", op));
+                }
+                let numeric = self.env.lookup_symbol(var)
+                    .filter(|s| s.symbol_type == SymbolType::Variable)
+                    .map(|s| (s.is_mut && !s.is_array, Environment::is_numeric_type(&s.data_type)));
+                match numeric {
+                    None => self.error(&format!("Undeclared variable '{}' in reduce(...)", var)),
+                    Some((false, _)) => self.error(&format!("Reduction variable '{}' must be a 'var'", var)),
+                    Some((true, false)) => self.error(&format!("Reduction variable '{}' must be an int or a float", var)),
+                    Some((true, true)) => {}
+                }
+            }
+        }
+
         self.env.enter_scope();
 
         // Declare index variable (first) as Int
         self.env.declare_variable(&loop_vars[0], &DataType::Int, false);
 
         if let Some(iter) = node.get_iterable() {
-            iter.accept(self);
+            self.visit_expr(ast, iter);
             let iter_type = self.get_current_type();
 
+            // Arrays yield their elements; an N-D array yields its rows
+            let array_sym = ast[iter].as_identifier()
+                .and_then(|id| self.env.lookup_symbol(id.get_name()))
+                .filter(|sym| sym.is_array)
+                .cloned();
+            if let Some(sym) = array_sym {
+                // An enclosing parallel for's iterations each walk all of it
+                if let Some(id) = ast[iter].as_identifier() {
+                    self.note_parallel_read(ast, id.get_name(), &[]);
+                }
+                let value_var = loop_vars.last().unwrap();
+                if loop_vars.len() >= 2 {
+                    self.env.declare_variable(value_var, &sym.data_type, false);
+                }
+                if let Some(v) = self.env.lookup_symbol_mut(value_var) {
+                    v.data_type = sym.data_type.clone();
+                    if sym.get_dimension() > 1 {
+                        v.is_array = true;
+                        v.dimensions = sym.dimensions[1..].to_vec();
+                    }
+                }
+                // The index tells iterations apart, the element doesn't
+                let index_vars = if loop_vars.len() >= 2 { vec![loop_vars[0].clone()] } else { Vec::new() };
+                self.visit_loop_body(ast, node, index_vars);
+                self.env.exit_scope();
+                return;
+            }
+
             let is_valid = matches!(iter_type, DataType::Int)
                 || matches!(&iter_type, DataType::Struct(s) if s == "range")
                 || matches!(iter_type, DataType::Str);
             if !is_valid {
                 // Also accept any array-like type (Struct, or if it's an array variable)
                 self.error("For loop iterable must be range, string, or array");
+            } else if node.is_parallel() && !matches!(&iter_type, DataType::Struct(s) if s == "range") {
+                self.error("Parallel for needs a range or an array to iterate over");
             }
 
             // Declare value variable (second) with appropriate type
@@ -707,19 +996,18 @@ impl AstVisitor for SemanticAnalyzer {
             }
         }
 
-        self.loop_depth += 1;
-
-        if let Some(body) = node.get_body() {
-            body.accept(self);
-        }
-
-        self.loop_depth -= 1;
+        // Both the counter and the value of a range differ per iteration
+        self.visit_loop_body(ast, node, loop_vars.clone());
         self.env.exit_scope();
     }
 
-    fn visit_return_statement(&mut self, node: &ReturnStatement) {
+    fn visit_return_statement(&mut self, ast: &Ast, node: &ReturnStatement) {
         self.has_return_statement = true;
 
+        if !self.parallel_loops.is_empty() {
+            self.error("'return' cannot leave a parallel for");
+        }
+
         if self.current_function.is_empty() {
             self.error("Return statement outside function");
             return;
@@ -738,7 +1026,7 @@ impl AstVisitor for SemanticAnalyzer {
         }
 
         if let Some(val) = node.get_value() {
-            val.accept(self);
+            self.visit_expr(ast, val);
             let return_type = self.get_current_type();
             let expected = self.current_function_return_type.clone();
 
@@ -750,25 +1038,27 @@ impl AstVisitor for SemanticAnalyzer {
         }
     }
 
-    fn visit_break_statement(&mut self, _node: &BreakStatement) {
+    fn visit_break_statement(&mut self, _ast: &Ast, _node: &BreakStatement) {
         if self.loop_depth == 0 {
             self.error("Break statement outside loop");
+        } else if self.parallel_loops.last().map_or(false, |p| p.loop_depth == self.loop_depth) {
+            self.error("'break' cannot leave a parallel for");
         }
     }
 
-    fn visit_continue_statement(&mut self, _node: &ContinueStatement) {
+    fn visit_continue_statement(&mut self, _ast: &Ast, _node: &ContinueStatement) {
         if self.loop_depth == 0 {
             self.error("Continue statement outside loop");
         }
     }
 
-    fn visit_expression_statement(&mut self, node: &ExpressionStatement) {
+    fn visit_expression_statement(&mut self, ast: &Ast, node: &ExpressionStatement) {
         if let Some(expr) = node.get_expression() {
-            expr.accept(self);
+            self.visit_expr(ast, expr);
         }
     }
 
-    fn visit_identifier(&mut self, node: &Identifier) {
+    fn visit_identifier(&mut self, _ast: &Ast, node: &Identifier) {
         let name = node.get_name();
 
         // Check for 'self' inside an impl block
@@ -810,7 +1100,7 @@ impl AstVisitor for SemanticAnalyzer {
         }
     }
 
-    fn visit_number_literal(&mut self, node: &NumberLiteral) {
+    fn visit_number_literal(&mut self, _ast: &Ast, node: &NumberLiteral) {
         let value = node.get_value();
         if value == (value as i64) as f64 {
             self.type_stack.push(DataType::Int);
@@ -819,19 +1109,19 @@ impl AstVisitor for SemanticAnalyzer {
         }
     }
 
-    fn visit_string_literal(&mut self, _node: &StringLiteral) {
+    fn visit_string_literal(&mut self, _ast: &Ast, _node: &StringLiteral) {
         self.type_stack.push(DataType::Str);
     }
 
-    fn visit_null_literal(&mut self, _node: &NullLiteral) {
+    fn visit_null_literal(&mut self, _ast: &Ast, _node: &NullLiteral) {
         self.type_stack.push(DataType::None_);
     }
 
-    fn visit_array_literal(&mut self, node: &ArrayLiteral) {
+    fn visit_array_literal(&mut self, ast: &Ast, node: &ArrayLiteral) {
         let mut first = true;
         let mut elem_type = DataType::Unknown;
         for elem in node.get_elements() {
-            elem.accept(self);
+            self.visit_expr(ast, *elem);
             let et = self.get_current_type();
             self.type_stack.pop();
             if first {
@@ -848,14 +1138,14 @@ impl AstVisitor for SemanticAnalyzer {
         self.type_stack.push(elem_type);
     }
 
-    fn visit_boolean_literal(&mut self, _node: &BooleanLiteral) {
+    fn visit_boolean_literal(&mut self, _ast: &Ast, _node: &BooleanLiteral) {
         self.type_stack.push(DataType::Bool);
     }
 
-    fn visit_format_string(&mut self, node: &FormatString) {
+    fn visit_format_string(&mut self, ast: &Ast, node: &FormatString) {
         for var in node.get_variables() {
-            if let Some(ref val) = var.value {
-                val.accept(self);
+            if let Some(val) = var.value {
+                self.visit_expr(ast, val);
                 self.type_stack.pop();
             } else {
                 self.error("Invalid expression in format string");
@@ -864,15 +1154,15 @@ impl AstVisitor for SemanticAnalyzer {
         self.type_stack.push(DataType::Str);
     }
 
-    fn visit_binary_expression(&mut self, node: &BinaryExpression) {
+    fn visit_binary_expression(&mut self, ast: &Ast, node: &BinaryExpression) {
         if let Some(left) = node.get_left() {
-            left.accept(self);
+            self.visit_expr(ast, left);
         }
         let left_type = self.get_current_type();
         self.type_stack.pop();
 
         if let Some(right) = node.get_right() {
-            right.accept(self);
+            self.visit_expr(ast, right);
         }
         let right_type = self.get_current_type();
         self.type_stack.pop();
@@ -883,7 +1173,7 @@ impl AstVisitor for SemanticAnalyzer {
             let mut is_assignable = false;
 
             if let Some(left) = node.get_left() {
-                if let Some(id) = left.as_any().downcast_ref::<Identifier>() {
+                if let Some(id) = ast[left].as_identifier() {
                     let name = id.get_name();
                     // Check if it's a struct field in the current impl block
                     if let Some(ref struct_name) = self.current_impl_struct {
@@ -893,19 +1183,21 @@ impl AstVisitor for SemanticAnalyzer {
                             }
                         }
                     }
-                    if !is_assignable {
-                        if let Some(sym) = self.env.lookup_symbol(name) {
-                            if sym.is_mut {
-                                is_assignable = true;
-                            } else {
-                                self.error(&format!("Cannot assign to constant variable '{}'", name));
-                            }
+                    if is_assignable {
+                        self.note_field_write(name);
+                    } else if let Some(sym) = self.env.lookup_symbol(name) {
+                        if sym.is_mut {
+                            is_assignable = true;
+                            self.check_parallel_write(name);
+                            self.note_param_write(name);
+                        } else {
+                            self.error(&format!("Cannot assign to constant variable '{}'", name));
                         }
                     }
-                } else if let Some(member) = left.as_any().downcast_ref::<MemberAccess>() {
+                } else if let Some(member) = ast[left].as_member() {
                     // Check for self.field assignment inside impl block
                     if let Some(obj) = member.get_object() {
-                        if let Some(obj_id) = obj.as_any().downcast_ref::<Identifier>() {
+                        if let Some(obj_id) = ast[obj].as_identifier() {
                             if obj_id.get_name() == "self" {
                                 if let Some(ref struct_name) = self.current_impl_struct {
                                     if let Some(fields) = self.struct_fields.get(struct_name) {
@@ -917,10 +1209,15 @@ impl AstVisitor for SemanticAnalyzer {
                             }
                         }
                     }
-                } else if let Some(arr_idx) = left.as_any().downcast_ref::<ArrayIndex>() {
+                    if is_assignable {
+                        self.note_field_write(member.get_member());
+                    }
+                } else if ast[left].as_index().is_some() {
                     // Walk nested array indices
-                    let mut array: &dyn Expression = arr_idx as &dyn Expression;
-                    while let Some(nested) = array.as_any().downcast_ref::<ArrayIndex>() {
+                    let mut array: ExprId = left;
+                    let mut indices: Vec<ExprId> = Vec::new();
+                    while let Some(nested) = ast[array].as_index() {
+                        indices.extend(nested.get_index());
                         if let Some(a) = nested.get_array() {
                             array = a;
                         } else {
@@ -928,7 +1225,7 @@ impl AstVisitor for SemanticAnalyzer {
                         }
                     }
 
-                    if let Some(arr_id) = array.as_any().downcast_ref::<Identifier>() {
+                    if let Some(arr_id) = ast[array].as_identifier() {
                         if let Some(sym) = self.env.lookup_symbol(arr_id.get_name()) {
                             if !sym.is_mut {
                                 self.error(&format!("Cannot assign to constant array '{}'", arr_id.get_name()));
@@ -936,6 +1233,8 @@ impl AstVisitor for SemanticAnalyzer {
                                 self.error(&format!("Cannot index non-array variable '{}'", arr_id.get_name()));
                             } else {
                                 is_assignable = true;
+                                self.check_parallel_index_write(ast, arr_id.get_name(), &indices);
+                                self.note_param_write(arr_id.get_name());
                             }
                         }
                     }
@@ -988,7 +1287,7 @@ impl AstVisitor for SemanticAnalyzer {
             let mut var_name = String::new();
 
             if let Some(left) = node.get_left() {
-                if let Some(id) = left.as_any().downcast_ref::<Identifier>() {
+                if let Some(id) = ast[left].as_identifier() {
                     var_name = id.get_name().to_string();
                     // Check if it's a bare struct field first
                     let is_field = self.current_impl_struct.as_ref().map_or(false, |s| {
@@ -996,9 +1295,11 @@ impl AstVisitor for SemanticAnalyzer {
                     });
                     if is_field {
                         is_assignable = true;
+                        self.note_field_write(&var_name);
                     } else if let Some(sym) = self.env.lookup_symbol(&var_name) {
                         if sym.is_mut {
                             is_assignable = true;
+                            self.check_parallel_write(&var_name);
                         } else {
                             self.error(&format!("Cannot assign to constant variable '{}'", var_name));
                         }
@@ -1066,17 +1367,17 @@ impl AstVisitor for SemanticAnalyzer {
         self.type_stack.push(DataType::Unknown);
     }
 
-    fn visit_cast_expression(&mut self, node: &CastExpression) {
+    fn visit_cast_expression(&mut self, ast: &Ast, node: &CastExpression) {
         if let Some(expr) = node.get_expression() {
-            expr.accept(self);
+            self.visit_expr(ast, expr);
         }
         let target_type = self.get_data_type_from_ast(Some(node.get_target_type()));
         self.type_stack.push(target_type);
     }
 
-    fn visit_unary_expression(&mut self, node: &UnaryExpression) {
+    fn visit_unary_expression(&mut self, ast: &Ast, node: &UnaryExpression) {
         if let Some(operand) = node.get_operand() {
-            operand.accept(self);
+            self.visit_expr(ast, operand);
         }
         let operand_type = self.get_current_type();
         let op = node.get_operator();
@@ -1097,16 +1398,16 @@ impl AstVisitor for SemanticAnalyzer {
         }
     }
 
-    fn visit_function_call(&mut self, node: &FunctionCall) {
+    fn visit_function_call(&mut self, ast: &Ast, node: &FunctionCall) {
         let mut func_name = String::new();
         let mut module_name = self.current_module.clone();
 
         if let Some(callee) = node.get_callee() {
-            if let Some(id) = callee.as_any().downcast_ref::<Identifier>() {
+            if let Some(id) = ast[callee].as_identifier() {
                 func_name = id.get_name().to_string();
-            } else if let Some(member) = callee.as_any().downcast_ref::<MemberAccess>() {
+            } else if let Some(member) = ast[callee].as_member() {
                 if let Some(obj) = member.get_object() {
-                    if let Some(obj_id) = obj.as_any().downcast_ref::<Identifier>() {
+                    if let Some(obj_id) = ast[obj].as_identifier() {
                         module_name = obj_id.get_name().to_string();
                         func_name = member.get_member().to_string();
                     }
@@ -1114,11 +1415,53 @@ impl AstVisitor for SemanticAnalyzer {
             }
         }
 
+        // What a call can change: the receiver of a method, for the
+        // `parallel for` checks
+        let receiver = self.env.lookup_symbol(&module_name)
+            .filter(|s| s.symbol_type == SymbolType::Variable)
+            .map(|s| (s.is_array, s.data_type.clone()));
+        if module_name == "self" {
+            if let Some(s) = &self.current_impl_struct {
+                self.writes_through.push((self.current_callable(), format!("{}.{}", s, func_name)));
+            }
+        } else if let Some(key) = self.param_key(&module_name) {
+            match &receiver {
+                Some((true, _)) if ARRAY_MUTATORS.contains(&func_name.as_str()) => {
+                    self.writers.insert(key);
+                }
+                Some((false, DataType::Struct(s))) if self.struct_fields.contains_key(s) => {
+                    self.writes_through.push((key, format!("{}.{}", s, func_name)));
+                }
+                _ => {}
+            }
+        }
+        if module_name != "self" && module_name != self.current_module && self.is_shared(&module_name) {
+            match receiver {
+                Some((true, _)) if ARRAY_MUTATORS.contains(&func_name.as_str()) => {
+                    self.error(&format!(
+                        "Parallel for calls '{}.{}()' on an array shared by all iterations",
+                        module_name, func_name
+                    ));
+                }
+                Some((true, _)) if func_name != "len" => self.note_parallel_read(ast, &module_name, &[]),
+                Some((false, DataType::Struct(s))) if self.struct_fields.contains_key(&s) => {
+                    let msg = format!(
+                        "Parallel for calls '{}.{}()', which modifies '{}', shared by all iterations",
+                        module_name, func_name, module_name
+                    );
+                    self.parallel_calls.push((format!("{}.{}", s, func_name), msg));
+                }
+                _ => {}
+            }
+        }
+
+        let shown = if module_name == self.current_module { func_name.clone() } else { format!("{}.{}", module_name, func_name) };
+
         // Check if it's a struct constructor call (e.g. Point(1, 2))
         if self.struct_fields.contains_key(&func_name) {
             if let Some(args) = node.get_arguments() {
                 for arg in args {
-                    arg.accept(self);
+                    self.visit_expr(ast, *arg);
                     self.type_stack.pop();
                 }
             }
@@ -1131,15 +1474,32 @@ impl AstVisitor for SemanticAnalyzer {
             .cloned()
             .unwrap_or_else(|| module_name.clone());
 
+        // `_`-prefixed functions are a module's own, such as the raw C
+        // helpers behind a standard library type
+        let is_module = self.env.lookup_symbol(&resolved_module)
+            .map_or(true, |s| s.symbol_type == SymbolType::Module);
+        if func_name.starts_with('_') && is_module && module_name != "self"
+            && resolved_module != self.current_module && resolved_module != "__builtins__"
+        {
+            self.error(&format!("'{}' is private to module '{}'", func_name, resolved_module));
+        }
+
         // Build lookup name. For method calls (obj.method), resolve via struct type
         let full_name = if resolved_module != self.current_module {
             // Check if resolved_module is a variable (not a module) → method dispatch
-            let is_var = self.env.lookup_symbol(&resolved_module)
-                .map_or(false, |s| s.symbol_type != SymbolType::Module);
-            if is_var {
-                // For struct types, look up method in current module
+            let var_type = self.env.lookup_symbol(&resolved_module)
+                .filter(|s| s.symbol_type != SymbolType::Module)
+                .map(|s| (s.data_type.clone(), s.is_array));
+            if let Some((var_type, is_array)) = var_type {
+                // Methods of a struct the variable holds, which may come from
+                // an imported module, are declared under the struct's name.
                 // For arrays, the method is handled by the executor
-                format!("{}.{}", self.current_module, func_name)
+                match var_type {
+                    DataType::Struct(ref s) if !is_array && self.env.lookup_symbol(&format!("{}.{}", s, func_name)).is_some() => {
+                        format!("{}.{}", s, func_name)
+                    }
+                    _ => format!("{}.{}", self.current_module, func_name),
+                }
             } else {
                 format!("{}.{}", resolved_module, func_name)
             }
@@ -1155,40 +1515,55 @@ impl AstVisitor for SemanticAnalyzer {
         // If not found but it's a method call on a variable (e.g. arr.len, arr.add),
         // allow it with sensible return types
         if sym_data_type.is_none() && module_name != self.current_module {
-            if let Some(var_sym) = self.env.lookup_symbol(&module_name) {
-                if var_sym.is_array {
-                    // Array methods: len() -> Int, add() -> None_
-                    if func_name == "len" {
-                        // Process explicit arguments (none expected)
-                        if let Some(args) = node.get_arguments() {
-                            for arg in args {
-                                arg.accept(self);
-                                self.type_stack.pop();
-                            }
+            let array = self.env.lookup_symbol(&module_name)
+                .filter(|s| s.is_array)
+                .map(|s| (s.data_type.clone(), s.dimensions.len()));
+            if let Some((elem, rank)) = array {
+                // Array methods: len()/find() -> Int, add()/fill()/... -> None_,
+                // the reductions -> the element type
+                let numeric = matches!(elem, DataType::Int | DataType::Float);
+                let comparable = !matches!(elem, DataType::Struct(_));
+                let bulk = !matches!(func_name.as_str(), "len" | "add");
+                let result = match func_name.as_str() {
+                    "len" => Some(DataType::Int),
+                    "find" | "binary_search" if comparable => Some(DataType::Int),
+                    "add" | "fill" | "copy_from" => Some(DataType::None_),
+                    "sort" if comparable => Some(DataType::None_),
+                    // sort_by(less) / partition(keep) take a function name
+                    "sort_by" | "partition" => {
+                        if !self.is_function_argument(ast, node) {
+                            self.error(&format!("Array method '{}' expects the name of a function", func_name));
                         }
-                        self.type_stack.push(DataType::Int);
-                        return;
+                        Some(if func_name == "partition" { DataType::Int } else { DataType::None_ })
                     }
-                    if func_name == "add" {
-                        if let Some(args) = node.get_arguments() {
-                            for arg in args {
-                                arg.accept(self);
-                                self.type_stack.pop();
-                            }
+                    "map_add_scalar" if numeric => Some(DataType::None_),
+                    "sum" | "min" | "max" | "dot" if numeric => Some(elem),
+                    _ => None,
+                };
+                if let Some(result) = result {
+                    if bulk && rank > 1 {
+                        self.error(&format!("Array method '{}' needs a one-dimensional array", func_name));
+                    }
+                    self.note_call_args(ast, None, &shown, node);
+                    if let Some(args) = node.get_arguments() {
+                        for arg in args {
+                            self.visit_expr(ast, *arg);
+                            self.type_stack.pop();
                         }
-                        self.type_stack.push(DataType::None_);
-                        return;
                     }
+                    self.type_stack.push(result);
+                    return;
                 }
             }
         }
 
         match sym_data_type {
             Some(dt) => {
+                self.note_call_args(ast, Some(&full_name), &shown, node);
                 // Process arguments
                 if let Some(args) = node.get_arguments() {
                     for arg in args {
-                        arg.accept(self);
+                        self.visit_expr(ast, *arg);
                         self.type_stack.pop();
                     }
                 }
@@ -1201,14 +1576,15 @@ impl AstVisitor for SemanticAnalyzer {
         }
     }
 
-    fn visit_match_expression(&mut self, node: &MatchExpression) {
+    fn visit_match_expression(&mut self, ast: &Ast, node: &MatchExpression) {
         // Type-check scrutinee
         if let Some(scrut) = node.get_scrutinee() {
-            scrut.accept(self);
+            self.visit_expr(ast, scrut);
             let scrut_type = self.get_current_type();
             self.type_stack.pop();
 
-            // For each arm, type-check the body and collect return types
+            // For each arm, type-check the body and collect the types of the
+            // arms that end in a value
             let mut result_type: Option<DataType> = None;
             for arm in node.get_arms() {
                 // For variable patterns, declare the variable in a scope
@@ -1217,17 +1593,25 @@ impl AstVisitor for SemanticAnalyzer {
                     self.env.declare_variable(name, &scrut_type, false);
                 }
 
-                if let Some(ref body) = arm.body {
-                    body.accept(self);
-                    let arm_type = self.get_current_type();
-                    self.type_stack.pop();
+                if let Some(body) = arm.body {
+                    let depth = self.type_stack.len();
+                    self.visit_stmt(ast, body);
+                    let ends_in_value = ast[body].as_block()
+                        .and_then(|b| b.get_statements().last())
+                        .map_or(false, |&last| ast[last].as_expression_statement().is_some());
+                    let arm_type = if ends_in_value && self.type_stack.len() > depth {
+                        self.get_current_type()
+                    } else {
+                        DataType::None_
+                    };
+                    self.type_stack.truncate(depth);
 
                     match &result_type {
+                        _ if matches!(arm_type, DataType::None_ | DataType::Unknown) => {}
                         None => result_type = Some(arm_type.clone()),
                         Some(existing) => {
                             if !Environment::is_type_compatible(existing, &arm_type)
                                 && !Environment::is_type_compatible(&arm_type, existing)
-                                && arm_type != DataType::Unknown
                                 && *existing != DataType::Unknown
                             {
                                 self.error("Match arms have incompatible types");
@@ -1249,7 +1633,7 @@ impl AstVisitor for SemanticAnalyzer {
         }
     }
 
-    fn visit_struct_literal(&mut self, node: &StructLiteral) {
+    fn visit_struct_literal(&mut self, ast: &Ast, node: &StructLiteral) {
         let type_name = node.get_type_name().to_string();
 
         // Look up struct definition
@@ -1292,7 +1676,7 @@ impl AstVisitor for SemanticAnalyzer {
                     covered.insert(name.clone());
 
                     // Type-check the value
-                    value.accept(self);
+                    self.visit_expr(ast, *value);
                     let value_type = self.get_current_type();
                     self.type_stack.pop();
 
@@ -1308,7 +1692,7 @@ impl AstVisitor for SemanticAnalyzer {
                 StructFieldInit::Positional(value) => {
                     // Check if it's a spread (identifier of same struct type)
                     let mut is_spread = false;
-                    if let Some(id) = value.as_any().downcast_ref::<Identifier>() {
+                    if let Some(id) = ast[*value].as_identifier() {
                         let id_name = id.get_name();
                         let full_name = format!("{}.{}", self.current_module, id_name);
                         if let Some(sym) = self.env.lookup_symbol(&full_name)
@@ -1324,7 +1708,7 @@ impl AstVisitor for SemanticAnalyzer {
 
                     if is_spread {
                         // Spread: all unassigned fields are filled from this struct
-                        value.accept(self);
+                        self.visit_expr(ast, *value);
                         let _spread_type = self.get_current_type();
                         self.type_stack.pop();
                         // Mark all fields as covered (but NOT named_assigned, so named inits can override)
@@ -1333,7 +1717,7 @@ impl AstVisitor for SemanticAnalyzer {
                         }
                     } else {
                         // Positional: match to next uncovered field
-                        value.accept(self);
+                        self.visit_expr(ast, *value);
                         let value_type = self.get_current_type();
                         self.type_stack.pop();
 
@@ -1373,15 +1757,15 @@ impl AstVisitor for SemanticAnalyzer {
         self.type_stack.push(DataType::Struct(type_name));
     }
 
-    fn visit_member_access(&mut self, node: &MemberAccess) {
+    fn visit_member_access(&mut self, ast: &Ast, node: &MemberAccess) {
         if let Some(obj) = node.get_object() {
-            obj.accept(self);
+            self.visit_expr(ast, obj);
         }
         let obj_type = self.get_current_type();
         self.type_stack.pop();
 
         if let Some(obj) = node.get_object() {
-            if let Some(id) = obj.as_any().downcast_ref::<Identifier>() {
+            if let Some(id) = ast[obj].as_identifier() {
                 let obj_name = id.get_name();
                 let member = node.get_member();
 
@@ -1445,9 +1829,9 @@ impl AstVisitor for SemanticAnalyzer {
         self.type_stack.push(DataType::Unknown);
     }
 
-    fn visit_range_expression(&mut self, node: &RangeExpression) {
+    fn visit_range_expression(&mut self, ast: &Ast, node: &RangeExpression) {
         for arg in node.get_arguments() {
-            arg.accept(self);
+            self.visit_expr(ast, *arg);
             let arg_type = self.get_current_type();
             self.type_stack.pop();
 
@@ -1458,18 +1842,18 @@ impl AstVisitor for SemanticAnalyzer {
         self.type_stack.push(DataType::Int);
     }
 
-    fn visit_grouped_expression(&mut self, node: &GroupedExpression) {
+    fn visit_grouped_expression(&mut self, ast: &Ast, node: &GroupedExpression) {
         if let Some(expr) = node.get_expression() {
-            expr.accept(self);
+            self.visit_expr(ast, expr);
         }
     }
 
-    fn visit_basic_type(&mut self, _node: &BasicType) {}
-    fn visit_type(&mut self, _node: &dyn Type) {}
+    fn visit_basic_type(&mut self, _ast: &Ast, _node: &BasicType) {}
+    fn visit_type(&mut self, _ast: &Ast, _node: &Type) {}
 
-    fn visit_array_type(&mut self, node: &ArrayType) {
+    fn visit_array_type(&mut self, ast: &Ast, node: &ArrayType) {
         if let Some(size) = node.get_size() {
-            size.accept(self);
+            self.visit_expr(ast, size);
             let size_type = self.get_current_type();
             self.type_stack.pop();
 
@@ -1479,15 +1863,28 @@ impl AstVisitor for SemanticAnalyzer {
         }
     }
 
-    fn visit_array_index(&mut self, node: &ArrayIndex) {
+    fn visit_array_index(&mut self, ast: &Ast, node: &ArrayIndex) {
+        // The outermost index of `a[i][j]` reads `a` at every index of the chain
+        if !std::mem::replace(&mut self.in_index_chain, false) && !self.parallel_loops.is_empty() {
+            let mut indices: Vec<ExprId> = node.get_index().into_iter().collect();
+            let mut array = node.get_array();
+            while let Some(nested) = array.and_then(|a| ast[a].as_index()) {
+                indices.extend(nested.get_index());
+                array = nested.get_array();
+            }
+            if let Some(id) = array.and_then(|a| ast[a].as_identifier()) {
+                self.note_parallel_read(ast, id.get_name(), &indices);
+            }
+        }
         if let Some(arr) = node.get_array() {
-            arr.accept(self);
+            self.in_index_chain = ast[arr].as_index().is_some();
+            self.visit_expr(ast, arr);
         }
         let array_type = self.get_current_type();
         self.type_stack.pop();
 
         if let Some(idx) = node.get_index() {
-            idx.accept(self);
+            self.visit_expr(ast, idx);
         }
         let index_type = self.get_current_type();
         self.type_stack.pop();
@@ -1499,7 +1896,7 @@ impl AstVisitor for SemanticAnalyzer {
         }
 
         if let Some(arr) = node.get_array() {
-            if let Some(id) = arr.as_any().downcast_ref::<Identifier>() {
+            if let Some(id) = ast[arr].as_identifier() {
                 if let Some(sym) = self.env.lookup_symbol(id.get_name()) {
                     if !sym.is_array {
                         self.error(&format!("Variable '{}' is not an array", id.get_name()));
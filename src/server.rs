@@ -0,0 +1,384 @@
+// server.rs — `gobol --server`: a compile server on a local socket, and
+// the client side used by `gobol --remote`.
+//
+// The server compiles every request through one `driver::Session`, so the
+// standard library is parsed, lowered and analyzed once for the life of
+// the process instead of once per build.  Requests are served one at a
+// time; for each the server changes into the client's working directory
+// and takes on the client's build environment (`FORWARDED_ENV`), so
+// relative paths and settings like `CC` mean the same on both sides.
+//
+// Only the user running the server may use it: the default socket lives
+// in a directory of that user's with mode 0700, and both ends check that
+// the socket and the process at the other end belong to that same user
+// before anything is sent.
+//
+// Protocol, one request per connection, UTF-8 lines:
+//   client:  cwd <dir>
+//            env <name>=<value>      (one per variable of FORWARDED_ENV set)
+//            arg <argument>          (one per command-line argument)
+//            <empty line>
+//   server:  status <exit code>
+//            binary <path>           (on success)
+//            <empty line>
+//            diagnostics and the time report, as text, until EOF
+//
+// Unix domain sockets only; elsewhere `serve` and `request` fail and
+// `gobol --remote` compiles in-process.
+
+use crate::driver::{CompileOptions, Session};
+use std::env;
+use std::io;
+use std::path::{Path, PathBuf};
+
+/// The variables the driver, the C compiler and a `--pgo` training run
+/// read.  Each request carries the client's values; one the client
+/// doesn't set is unset for that compile.
+const FORWARDED_ENV: &[&str] = &[
+    "CC",
+    "CFLAGS",
+    "AR",
+    "LLVM_PROFDATA",
+    "GOBOL_LTO",
+    "GOBOL_CACHE_DIR",
+    "GOBOL_DEBUG",
+    "GOBOL_RUNTIME_DIR",
+    "GOBOL_THREADS",
+    "GOBOL_PROFILE",
+];
+
+/// What the server answered.
+pub struct Response {
+    pub status: i32,
+    pub binary: Option<String>,
+    /// Diagnostics and report text, for the client's stderr
+    pub output: String,
+}
+
+/// `$GOBOL_SERVER_SOCKET`, or `server.sock` in a private directory:
+/// `$XDG_RUNTIME_DIR/gobol`, else `gobol-<uid>` in the temp directory.
+pub fn default_socket() -> PathBuf {
+    if let Ok(path) = env::var("GOBOL_SERVER_SOCKET") {
+        return PathBuf::from(path);
+    }
+    private_dir().join("server.sock")
+}
+
+#[cfg(unix)]
+fn private_dir() -> PathBuf {
+    match env::var_os("XDG_RUNTIME_DIR") {
+        Some(dir) if !dir.is_empty() => PathBuf::from(dir).join("gobol"),
+        _ => env::temp_dir().join(format!("gobol-{}", imp::my_uid())),
+    }
+}
+
+#[cfg(not(unix))]
+fn private_dir() -> PathBuf {
+    env::temp_dir().join("gobol")
+}
+
+/// Compile one request's arguments; the exit status, binary and text
+/// sent back.
+fn compile_request(session: &mut Session, args: &[String]) -> (i32, Option<String>, String) {
+    let options = CompileOptions::from_args(args);
+    let json = args.iter().any(|a| a == "--time-report=json");
+    let render = |report: Option<&crate::time_report::TimeReport>| {
+        report.map_or(String::new(), |r| if json { r.to_json() } else { r.to_text() })
+    };
+    if options.input.is_empty() {
+        return (1, None, "Error: No filename provided\n".to_string());
+    }
+    match session.compile(&options) {
+        Ok(artifact) => (0, Some(artifact.binary), render(artifact.report.as_ref())),
+        Err(failure) => {
+            let mut text: String = failure.messages.iter().map(|m| format!("{}\n", m)).collect();
+            text.push_str(&render(failure.report.as_ref()));
+            (failure.exit_code, None, text)
+        }
+    }
+}
+
+#[cfg(unix)]
+mod imp {
+    use super::*;
+    use std::fs::{self, DirBuilder};
+    use std::io::{BufRead, BufReader, Read, Write};
+    use std::os::unix::fs::{DirBuilderExt, FileTypeExt, MetadataExt, PermissionsExt};
+    use std::os::unix::io::AsRawFd;
+    use std::os::unix::net::{UnixListener, UnixStream};
+    use std::panic::{self, AssertUnwindSafe};
+    use std::time::Duration;
+
+    /// How long a client may take to send its request, or to take the
+    /// answer, before the server gives up on it and serves the next one
+    const STREAM_TIMEOUT: Duration = Duration::from_secs(30);
+
+    pub fn my_uid() -> u32 {
+        // SAFETY: geteuid has no preconditions and cannot fail
+        unsafe { libc::geteuid() }
+    }
+
+    fn denied(what: String) -> io::Error {
+        io::Error::new(io::ErrorKind::PermissionDenied, what)
+    }
+
+    /// The user of the process at the other end of `stream`.
+    #[cfg(any(target_os = "linux", target_os = "android"))]
+    fn peer_uid(stream: &UnixStream) -> io::Result<u32> {
+        let mut cred = libc::ucred { pid: 0, uid: 0, gid: 0 };
+        let mut len = std::mem::size_of::<libc::ucred>() as libc::socklen_t;
+        // SAFETY: `cred` and `len` are valid for writes of the sizes passed
+        let rc = unsafe {
+            libc::getsockopt(
+                stream.as_raw_fd(),
+                libc::SOL_SOCKET,
+                libc::SO_PEERCRED,
+                &mut cred as *mut libc::ucred as *mut libc::c_void,
+                &mut len,
+            )
+        };
+        if rc != 0 {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(cred.uid)
+    }
+
+    #[cfg(not(any(target_os = "linux", target_os = "android")))]
+    fn peer_uid(stream: &UnixStream) -> io::Result<u32> {
+        let mut uid: libc::uid_t = 0;
+        let mut gid: libc::gid_t = 0;
+        // SAFETY: `uid` and `gid` are valid for writes
+        if unsafe { libc::getpeereid(stream.as_raw_fd(), &mut uid, &mut gid) } != 0 {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(uid)
+    }
+
+    /// Refuse to talk to a process run by another user.
+    fn check_peer(stream: &UnixStream) -> io::Result<()> {
+        let uid = peer_uid(stream)?;
+        if uid != my_uid() {
+            return Err(denied(format!("peer runs as uid {}, not {}", uid, my_uid())));
+        }
+        Ok(())
+    }
+
+    /// `path` must be a socket of ours, not one planted by another user.
+    fn check_socket(path: &Path) -> io::Result<()> {
+        let meta = fs::symlink_metadata(path)?;
+        if !meta.file_type().is_socket() {
+            return Err(denied(format!("{} is not a socket", path.display())));
+        }
+        if meta.uid() != my_uid() {
+            return Err(denied(format!("{} belongs to uid {}", path.display(), meta.uid())));
+        }
+        Ok(())
+    }
+
+    /// Create the default socket's directory, or check the one there: a
+    /// real directory of ours that nobody else can enter.
+    fn ensure_private_dir(dir: &Path) -> io::Result<()> {
+        match DirBuilder::new().mode(0o700).create(dir) {
+            Err(e) if e.kind() != io::ErrorKind::AlreadyExists => return Err(e),
+            _ => {}
+        }
+        check_private_dir(dir)
+    }
+
+    fn check_private_dir(dir: &Path) -> io::Result<()> {
+        let meta = fs::symlink_metadata(dir)?;
+        if !meta.is_dir() || meta.uid() != my_uid() || meta.mode() & 0o077 != 0 {
+            return Err(denied(format!("{} must be a directory of uid {} with mode 0700", dir.display(), my_uid())));
+        }
+        Ok(())
+    }
+
+    /// The default socket's directory when `socket` is in it; a socket
+    /// named by `--socket` or `$GOBOL_SERVER_SOCKET` lives wherever the
+    /// user put it.
+    fn default_dir_of(socket: &Path) -> Option<PathBuf> {
+        let dir = private_dir();
+        (env::var_os("GOBOL_SERVER_SOCKET").is_none() && socket.parent() == Some(dir.as_path())).then_some(dir)
+    }
+
+    pub fn serve(socket: &Path) -> io::Result<()> {
+        if let Some(dir) = default_dir_of(socket) {
+            ensure_private_dir(&dir)?;
+        }
+        if fs::symlink_metadata(socket).is_ok() {
+            check_socket(socket)?;
+            if UnixStream::connect(socket).is_ok() {
+                return Err(io::Error::new(io::ErrorKind::AddrInUse, format!("a server is already listening on {}", socket.display())));
+            }
+            // Left behind by a server that didn't shut down cleanly
+            fs::remove_file(socket)?;
+        }
+        let listener = UnixListener::bind(socket)?;
+        fs::set_permissions(socket, fs::Permissions::from_mode(0o600))?;
+        // Diagnostics go over the socket, not to a terminal
+        colored::control::set_override(false);
+        let mut session = Session::new();
+        for stream in listener.incoming() {
+            let result = stream.and_then(|s| handle(&mut session, s));
+            if let Err(e) = result {
+                eprintln!("gobol server: {}", e);
+            }
+        }
+        Ok(())
+    }
+
+    fn handle(session: &mut Session, stream: UnixStream) -> io::Result<()> {
+        // The request names a directory to enter and files to compile and
+        // run there: only our own user may make one
+        check_peer(&stream)?;
+        stream.set_read_timeout(Some(STREAM_TIMEOUT))?;
+        stream.set_write_timeout(Some(STREAM_TIMEOUT))?;
+        let mut reader = BufReader::new(&stream);
+        let mut cwd: Option<String> = None;
+        let mut vars: Vec<(String, String)> = Vec::new();
+        let mut args: Vec<String> = Vec::new();
+        loop {
+            let mut line = String::new();
+            if reader.read_line(&mut line)? == 0 {
+                break;
+            }
+            let line = line.strip_suffix('\n').unwrap_or(&line);
+            if line.is_empty() {
+                break;
+            }
+            if let Some(dir) = line.strip_prefix("cwd ") {
+                cwd = Some(dir.to_string());
+            } else if let Some((name, value)) = line.strip_prefix("env ").and_then(|v| v.split_once('=')) {
+                if FORWARDED_ENV.contains(&name) {
+                    vars.push((name.to_string(), value.to_string()));
+                }
+            } else if let Some(arg) = line.strip_prefix("arg ") {
+                args.push(arg.to_string());
+            }
+        }
+
+        let (status, binary, text) = match cwd.as_deref().map(env::set_current_dir) {
+            Some(Err(e)) => (1, None, format!("cannot enter {}: {}\n", cwd.unwrap_or_default(), e)),
+            _ => {
+                let saved = set_forwarded_env(&vars);
+                let answer = match panic::catch_unwind(AssertUnwindSafe(|| compile_request(session, &args))) {
+                    Ok(answer) => answer,
+                    Err(_) => {
+                        // Nothing cached by a compile that went wrong can be trusted
+                        *session = Session::new();
+                        (101, None, "internal compiler error\n".to_string())
+                    }
+                };
+                set_forwarded_env(&saved);
+                answer
+            }
+        };
+
+        let mut out = &stream;
+        writeln!(out, "status {}", status)?;
+        if let Some(binary) = binary {
+            writeln!(out, "binary {}", binary)?;
+        }
+        writeln!(out)?;
+        out.write_all(text.as_bytes())?;
+        out.flush()
+    }
+
+    /// Give each of `FORWARDED_ENV` its value in `vars`, unsetting those
+    /// not there; the values they had before, to put back the same way.
+    fn set_forwarded_env(vars: &[(String, String)]) -> Vec<(String, String)> {
+        let mut saved = Vec::new();
+        for &name in FORWARDED_ENV {
+            if let Ok(old) = env::var(name) {
+                saved.push((name.to_string(), old));
+            }
+            // SAFETY: requests are served one at a time on the main thread,
+            // and every thread a compile starts has been joined by the time
+            // it returns, so nothing else reads the environment meanwhile
+            match vars.iter().find(|(n, _)| n == name) {
+                Some((_, value)) => unsafe { env::set_var(name, value) },
+                None => unsafe { env::remove_var(name) },
+            }
+        }
+        saved
+    }
+
+    pub fn request(socket: &Path, args: &[String]) -> io::Result<Response> {
+        if args.iter().any(|a| a.contains('\n')) {
+            return Err(io::Error::new(io::ErrorKind::InvalidInput, "argument contains a newline"));
+        }
+        if let Some(dir) = default_dir_of(socket) {
+            check_private_dir(&dir)?;
+        }
+        check_socket(socket)?;
+        let stream = UnixStream::connect(socket)?;
+        check_peer(&stream)?;
+        let cwd = env::current_dir()?;
+        let mut message = format!("cwd {}\n", cwd.display());
+        for &name in FORWARDED_ENV {
+            match env::var(name) {
+                Ok(value) if !value.contains('\n') => message.push_str(&format!("env {}={}\n", name, value)),
+                Ok(_) => return Err(io::Error::new(io::ErrorKind::InvalidInput, format!("${} contains a newline", name))),
+                Err(_) => {}
+            }
+        }
+        for arg in args {
+            message.push_str(&format!("arg {}\n", arg));
+        }
+        message.push('\n');
+        (&stream).write_all(message.as_bytes())?;
+
+        let mut reader = BufReader::new(&stream);
+        let mut response = Response { status: 1, binary: None, output: String::new() };
+        let mut got_status = false;
+        loop {
+            let mut line = String::new();
+            if reader.read_line(&mut line)? == 0 {
+                break;
+            }
+            let line = line.strip_suffix('\n').unwrap_or(&line);
+            if line.is_empty() {
+                break;
+            }
+            if let Some(code) = line.strip_prefix("status ") {
+                response.status = code.parse().unwrap_or(1);
+                got_status = true;
+            } else if let Some(binary) = line.strip_prefix("binary ") {
+                response.binary = Some(binary.to_string());
+            }
+        }
+        if !got_status {
+            return Err(io::Error::new(io::ErrorKind::UnexpectedEof, "server closed the connection"));
+        }
+        reader.read_to_string(&mut response.output)?;
+        Ok(response)
+    }
+}
+
+#[cfg(not(unix))]
+mod imp {
+    use super::*;
+
+    fn unsupported() -> io::Error {
+        io::Error::new(io::ErrorKind::Unsupported, "the compile server needs Unix domain sockets")
+    }
+
+    pub fn serve(_socket: &Path) -> io::Result<()> {
+        let _ = (compile_request, FORWARDED_ENV);
+        Err(unsupported())
+    }
+
+    pub fn request(_socket: &Path, _args: &[String]) -> io::Result<Response> {
+        Err(unsupported())
+    }
+}
+
+/// Accept compile requests on `socket` until the process is stopped.
+pub fn serve(socket: &Path) -> io::Result<()> {
+    imp::serve(socket)
+}
+
+/// Send the `gobol` arguments `args` to the server on `socket`.
+pub fn request(socket: &Path, args: &[String]) -> io::Result<Response> {
+    imp::request(socket, args)
+}
@@ -0,0 +1,318 @@
+// time_report.rs — per-phase build timings for `gobol --time-report`.
+//
+// Records wall time and peak resident memory for each compiler phase,
+// the front-end time and allocations of every imported module, the size
+// of the C emitted for each function and the C compiler's own timing
+// report.  Rendered as a text table or as JSON.
+//
+// A phase's memory is the compiler's own peak over that phase (the peak is
+// reset on Linux before each one), except for `cc` and `run`, which report
+// the largest child process that did the work.  Module allocations are
+// counted per thread by `CountingAlloc`, which the `gobol` binary installs.
+//
+// Usage:
+//   let mut report = TimeReport::new();
+//   let t = Instant::now();
+//   ... run a phase ...
+//   report.record("semantic", t);
+//   eprint!("{}", report.to_text());
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::cell::Cell;
+use std::fmt::Write;
+use std::fs;
+use std::io::{self, Read};
+use std::process::{Child, Command, ExitStatus, Output, Stdio};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::time::{Duration, Instant};
+
+/// One recorded phase.
+pub struct Phase {
+    pub name: String,
+    pub wall: Duration,
+    /// Peak resident set size during the phase, in KiB
+    pub peak_rss_kb: Option<u64>,
+}
+
+/// Front end of one imported module.
+pub struct ModuleEntry {
+    pub path: String,
+    pub wall: Duration,
+    /// KiB allocated while lexing, parsing and lowering it; zero when it
+    /// came from the cache, `None` without `CountingAlloc`
+    pub alloc_kb: Option<u64>,
+}
+
+pub struct TimeReport {
+    pub phases: Vec<Phase>,
+    /// Front-end cost per imported module, in discovery order
+    pub modules: Vec<ModuleEntry>,
+    /// Bytes of C emitted per function
+    pub functions: Vec<(String, usize)>,
+    /// What the C compiler printed for `-ftime-report` (`/Bt+` with MSVC)
+    pub cc_report: String,
+    start: Instant,
+}
+
+/// Functions listed in the text report; the JSON report lists all.
+const TEXT_FUNCTIONS: usize = 10;
+
+impl TimeReport {
+    pub fn new() -> Self {
+        reset_peak_rss();
+        TimeReport {
+            phases: Vec::new(),
+            modules: Vec::new(),
+            functions: Vec::new(),
+            cc_report: String::new(),
+            start: Instant::now(),
+        }
+    }
+
+    /// Record phase `name` as having run from `since` until now, with this
+    /// process's peak memory since the previous phase.
+    pub fn record(&mut self, name: &str, since: Instant) {
+        let peak = peak_rss_kb();
+        self.record_with_peak(name, since, peak);
+        reset_peak_rss();
+    }
+
+    /// Record a phase whose work ran in child processes, with their peak.
+    pub fn record_children(&mut self, name: &str, since: Instant, peak_rss_kb: Option<u64>) {
+        self.record_with_peak(name, since, peak_rss_kb);
+        reset_peak_rss();
+    }
+
+    fn record_with_peak(&mut self, name: &str, since: Instant, peak_rss_kb: Option<u64>) {
+        self.phases.push(Phase {
+            name: name.to_string(),
+            wall: since.elapsed(),
+            peak_rss_kb,
+        });
+    }
+
+    pub fn total(&self) -> Duration {
+        self.start.elapsed()
+    }
+
+    fn largest_functions(&self) -> Vec<&(String, usize)> {
+        let mut by_size: Vec<&(String, usize)> = self.functions.iter().collect();
+        by_size.sort_by(|a, b| b.1.cmp(&a.1).then_with(|| a.0.cmp(&b.0)));
+        by_size
+    }
+
+    pub fn to_text(&self) -> String {
+        let mut out = String::new();
+        let _ = writeln!(out, "===== Time report =====");
+        let _ = writeln!(out, "{:<16} {:>10} {:>12}", "phase", "wall ms", "peak RSS KiB");
+        for p in &self.phases {
+            let rss = p.peak_rss_kb.map_or("-".to_string(), |kb| kb.to_string());
+            let _ = writeln!(out, "{:<16} {:>10.3} {:>12}", p.name, ms(p.wall), rss);
+        }
+        let _ = writeln!(out, "{:<16} {:>10.3}", "total", ms(self.total()));
+
+        if !self.modules.is_empty() {
+            let _ = writeln!(out);
+            let _ = writeln!(out, "{:<48} {:>10} {:>10}", "module", "front ms", "alloc KiB");
+            for m in &self.modules {
+                let alloc = m.alloc_kb.map_or("-".to_string(), |kb| kb.to_string());
+                let _ = writeln!(out, "{:<48} {:>10.3} {:>10}", m.path, ms(m.wall), alloc);
+            }
+        }
+
+        if !self.functions.is_empty() {
+            let total: usize = self.functions.iter().map(|(_, n)| n).sum();
+            let _ = writeln!(out);
+            let _ = writeln!(out, "{:<48} {:>10}", "function (largest C)", "bytes");
+            for (name, bytes) in self.largest_functions().into_iter().take(TEXT_FUNCTIONS) {
+                let _ = writeln!(out, "{:<48} {:>10}", name, bytes);
+            }
+            let _ = writeln!(out, "{:<48} {:>10}", format!("all {} functions", self.functions.len()), total);
+        }
+
+        if !self.cc_report.trim().is_empty() {
+            let _ = writeln!(out);
+            let _ = writeln!(out, "===== C compiler report =====");
+            out.push_str(&self.cc_report);
+        }
+        out
+    }
+
+    pub fn to_json(&self) -> String {
+        let mut out = String::from("{\n  \"phases\": [");
+        for (i, p) in self.phases.iter().enumerate() {
+            let rss = p.peak_rss_kb.map_or("null".to_string(), |kb| kb.to_string());
+            let _ = write!(out, "{}\n    {{\"name\": {}, \"wall_ms\": {:.3}, \"peak_rss_kb\": {}}}",
+                if i == 0 { "" } else { "," }, json_str(&p.name), ms(p.wall), rss);
+        }
+        let _ = write!(out, "\n  ],\n  \"total_ms\": {:.3},\n  \"modules\": [", ms(self.total()));
+        for (i, m) in self.modules.iter().enumerate() {
+            let alloc = m.alloc_kb.map_or("null".to_string(), |kb| kb.to_string());
+            let _ = write!(out, "{}\n    {{\"path\": {}, \"wall_ms\": {:.3}, \"alloc_kb\": {}}}",
+                if i == 0 { "" } else { "," }, json_str(&m.path), ms(m.wall), alloc);
+        }
+        out.push_str("\n  ],\n  \"functions\": [");
+        for (i, (name, bytes)) in self.largest_functions().into_iter().enumerate() {
+            let _ = write!(out, "{}\n    {{\"name\": {}, \"c_bytes\": {}}}",
+                if i == 0 { "" } else { "," }, json_str(name), bytes);
+        }
+        let _ = write!(out, "\n  ],\n  \"cc_report\": {}\n}}\n", json_str(&self.cc_report));
+        out
+    }
+}
+
+fn ms(d: Duration) -> f64 {
+    d.as_secs_f64() * 1000.0
+}
+
+fn json_str(s: &str) -> String {
+    let mut out = String::with_capacity(s.len() + 2);
+    out.push('"');
+    for c in s.chars() {
+        match c {
+            '"' => out.push_str("\\\""),
+            '\\' => out.push_str("\\\\"),
+            '\n' => out.push_str("\\n"),
+            '\r' => out.push_str("\\r"),
+            '\t' => out.push_str("\\t"),
+            c if (c as u32) < 0x20 => { let _ = write!(out, "\\u{:04x}", c as u32); }
+            c => out.push(c),
+        }
+    }
+    out.push('"');
+    out
+}
+
+/// `VmHWM` from /proc/self/status: the peak since the last
+/// `reset_peak_rss`.  `None` where that isn't available.
+fn peak_rss_kb() -> Option<u64> {
+    let status = fs::read_to_string("/proc/self/status").ok()?;
+    let line = status.lines().find(|l| l.starts_with("VmHWM:"))?;
+    line.split_whitespace().nth(1)?.parse().ok()
+}
+
+/// Start a new `VmHWM` from the current resident set (Linux 4.0+).
+fn reset_peak_rss() {
+    let _ = fs::write("/proc/self/clear_refs", "5");
+}
+
+/// `Command::output`, also returning the child's peak resident set size
+/// in KiB (Unix only).
+pub fn output_with_peak(cmd: &mut Command) -> io::Result<(Output, Option<u64>)> {
+    let mut child = cmd.stdin(Stdio::null()).stdout(Stdio::piped()).stderr(Stdio::piped()).spawn()?;
+    let mut stderr_pipe = child.stderr.take();
+    let reader = std::thread::spawn(move || {
+        let mut buf = Vec::new();
+        if let Some(pipe) = stderr_pipe.as_mut() {
+            let _ = pipe.read_to_end(&mut buf);
+        }
+        buf
+    });
+    let mut stdout = Vec::new();
+    if let Some(pipe) = child.stdout.as_mut() {
+        pipe.read_to_end(&mut stdout)?;
+    }
+    let stderr = reader.join().unwrap_or_default();
+    let (status, peak) = wait_with_peak(child)?;
+    Ok((Output { status, stdout, stderr }, peak))
+}
+
+/// `Command::status`, also returning the child's peak resident set size
+/// in KiB (Unix only).
+pub fn status_with_peak(cmd: &mut Command) -> io::Result<(ExitStatus, Option<u64>)> {
+    wait_with_peak(cmd.spawn()?)
+}
+
+/// Reap `child` with wait4, whose rusage is the child's own.
+#[cfg(unix)]
+fn wait_with_peak(child: Child) -> io::Result<(ExitStatus, Option<u64>)> {
+    use std::os::unix::process::ExitStatusExt;
+    let pid = child.id() as libc::pid_t;
+    let mut status: libc::c_int = 0;
+    let mut usage: libc::rusage = unsafe { std::mem::zeroed() };
+    loop {
+        if unsafe { libc::wait4(pid, &mut status, 0, &mut usage) } == pid {
+            break;
+        }
+        let e = io::Error::last_os_error();
+        if e.kind() != io::ErrorKind::Interrupted {
+            return Err(e);
+        }
+    }
+    // ru_maxrss is in KiB, except on macOS, where it is in bytes
+    let maxrss = usage.ru_maxrss.max(0) as u64;
+    let kb = if cfg!(target_os = "macos") { maxrss / 1024 } else { maxrss };
+    Ok((ExitStatus::from_raw(status), Some(kb)))
+}
+
+#[cfg(not(unix))]
+fn wait_with_peak(mut child: Child) -> io::Result<(ExitStatus, Option<u64>)> {
+    Ok((child.wait()?, None))
+}
+
+// ==================== Per-thread allocation counting ====================
+
+/// Global allocator that counts the bytes each thread allocates, so a
+/// module's front end, which runs on one worker thread, can be measured on
+/// its own.
+pub struct CountingAlloc;
+
+static COUNTING: AtomicBool = AtomicBool::new(false);
+
+thread_local! {
+    static ALLOCATED: Cell<u64> = const { Cell::new(0) };
+}
+
+fn count(bytes: usize) {
+    if !COUNTING.load(Ordering::Relaxed) {
+        COUNTING.store(true, Ordering::Relaxed);
+    }
+    let _ = ALLOCATED.try_with(|n| n.set(n.get() + bytes as u64));
+}
+
+unsafe impl GlobalAlloc for CountingAlloc {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        count(layout.size());
+        unsafe { System.alloc(layout) }
+    }
+
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        count(layout.size());
+        unsafe { System.alloc_zeroed(layout) }
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        count(new_size.saturating_sub(layout.size()));
+        unsafe { System.realloc(ptr, layout, new_size) }
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        unsafe { System.dealloc(ptr, layout) }
+    }
+}
+
+/// Bytes allocated on this thread so far; `None` unless `CountingAlloc` is
+/// the global allocator.
+pub fn thread_allocated() -> Option<u64> {
+    COUNTING.load(Ordering::Relaxed).then(|| ALLOCATED.with(|n| n.get()))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_json_escapes_and_lists_every_section() {
+        let mut report = TimeReport::new();
+        report.record("parse", Instant::now());
+        report.modules.push(ModuleEntry { path: "std/io.gbl".to_string(), wall: Duration::from_millis(2), alloc_kb: Some(40) });
+        report.functions.push(("main".to_string(), 120));
+        report.cc_report = "Time \"variable\"\n".to_string();
+        let json = report.to_json();
+        assert!(json.contains("\"name\": \"parse\""));
+        assert!(json.contains("\"path\": \"std/io.gbl\""));
+        assert!(json.contains("\"alloc_kb\": 40"));
+        assert!(json.contains("\"c_bytes\": 120"));
+        assert!(json.contains("Time \\\"variable\\\"\\n"));
+    }
+}
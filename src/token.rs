@@ -1,6 +1,6 @@
 use std::fmt;
 
-#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
 pub enum TokenType {
     Identifier,
     Keyword,
@@ -30,32 +30,70 @@ impl fmt::Display for TokenType {
     }
 }
 
-#[derive(Debug, Clone, PartialEq, Eq)]
+/// Byte range of a token's text in the source it was lexed from.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct Span {
+    pub start: usize,
+    pub end: usize,
+}
+
+impl Span {
+    pub fn new(start: usize, end: usize) -> Self {
+        Span { start, end }
+    }
+
+    pub fn len(&self) -> usize {
+        self.end - self.start
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.start == self.end
+    }
+}
+
+/// A token refers to its text by span instead of owning a copy; use
+/// `text(source)` with the source the lexer ran over.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
 pub struct Token {
     pub r#type: TokenType,
-    pub value: String,
+    pub span: Span,
     pub line: i32,
     pub col: i32,
 }
 
 impl Token {
-    pub fn new(r#type: TokenType, value: impl Into<String>) -> Self {
+    pub fn new(r#type: TokenType, span: Span) -> Self {
         Token {
             r#type,
-            value: value.into(),
+            span,
             line: 0,
             col: 0,
         }
     }
 
-    pub fn with_pos(r#type: TokenType, value: impl Into<String>, line: i32, col: i32) -> Self {
+    pub fn with_pos(r#type: TokenType, span: Span, line: i32, col: i32) -> Self {
         Token {
             r#type,
-            value: value.into(),
+            span,
             line,
             col,
         }
     }
+
+    pub fn text<'s>(&self, source: &'s str) -> &'s str {
+        &source[self.span.start..self.span.end]
+    }
+}
+
+/// Reserved words, matched without building a lookup table.
+pub fn is_keyword(word: &[u8]) -> bool {
+    matches!(
+        word,
+        b"if" | b"else" | b"for" | b"return" | b"int" | b"float" | b"str" | b"func" | b"var" | b"val"
+            | b"import" | b"in" | b"as" | b"true" | b"false" | b"while" | b"break" | b"continue"
+            | b"null" | b"self" | b"export" | b"struct" | b"impl" | b"constructor" | b"new" | b"match"
+            | b"convert" | b"operator" | b"region" | b"parallel"
+    )
 }
 
 #[allow(dead_code)]
@@ -6,75 +6,1575 @@
 //   func print(value: str)    →  void print(const char* value)
 //   func println(value: str)  →  void println(const char* value)
 //   func read(): str          →  char* read(void)
+//   func flush()              →  void flush(void)
+//
+// std/fs.gbl (file handles travel as ints; a view is a map handle, an
+// offset and a length, checked against what is still mapped)
+//   func _map(path: str): int                →  int64_t fs__map(const char* path)
+//   func _map_size(m: int): int              →  int64_t fs__map_size(int64_t m)
+//   func _is_mapped(m: int): bool            →  bool fs__is_mapped(int64_t m)
+//   func _unmap(m: int)                      →  void fs__unmap(int64_t m)
+//   func _byte(m: int, i: int): int          →  int64_t fs__byte(int64_t m, int64_t i)
+//   func _line_end(m: int, at: int, n: int): int → int64_t fs__line_end(int64_t m, int64_t at, int64_t n)
+//   func _find(m: int, at: int, n: int, s: str): int → int64_t fs__find(int64_t m, int64_t at, int64_t n, const char* s)
+//   func _count(m: int, at: int, n: int, b: int): int → int64_t fs__count(int64_t m, int64_t at, int64_t n, int64_t b)
+//   func _equal(m: int, at: int, n: int, s: str): bool → bool fs__equal(int64_t m, int64_t at, int64_t n, const char* s)
+//   func _has_prefix(m: int, at: int, n: int, s: str): bool → bool fs__has_prefix(int64_t m, int64_t at, int64_t n, const char* s)
+//   func _has_suffix(m: int, at: int, n: int, s: str): bool → bool fs__has_suffix(int64_t m, int64_t at, int64_t n, const char* s)
+//   func _to_int(m: int, at: int, n: int): int → int64_t fs__to_int(int64_t m, int64_t at, int64_t n)
+//   func _to_float(m: int, at: int, n: int): float → double fs__to_float(int64_t m, int64_t at, int64_t n)
+//   func _text(m: int, at: int, n: int): str → char* fs__text(int64_t m, int64_t at, int64_t n)
+//   func _create(path: str, append: bool): int →  int64_t fs__create(const char* path, bool append)
+//   func _write(w: int, s: str)              →  void fs__write(int64_t w, const char* s)
+//   func _write_bytes(w: int, m: int, at: int, n: int) → void fs__write_bytes(int64_t w, int64_t m, int64_t at, int64_t n)
+//   func _flush(w: int)                      →  void fs__flush(int64_t w)
+//   func _close(w: int)                      →  void fs__close(int64_t w)
+//   func remove(path: str): bool             →  bool fs_remove(const char* path)
 //
 // Helpers:
-//   gobol_str_int(i64)   — converts int to static string buffer
-//   gobol_str_float(f64) — converts float to static string buffer
+//   gobol_str_int(i64)          — converts int to an arena string
+//   gobol_str_float(f64)        — converts float to an arena string
+//   gobol_str_cat(str, str)     — concatenates into a fresh arena string
+//   gobol_str_len(str)          — O(1) for arena strings, strlen otherwise
+//   gobol_str_format(n, pieces) — builds a format string in one allocation
+//   gobol_arena_mark/release    — scope the arena around a statement
+//   gobol_region_enter/leave    — scope of a `region { ... }` block
+//   gobol_array_reserve(...)    — growth path for the generated array types
+//   gobol_array_zeroed(n, size) — storage for fixed-size and N-D arrays
+//   gobol_array_free(data, cap) — scope-exit release of a local array
+//   gobol_index_error(i, len)   — reports a failed array bounds check
+//   gobol_kernel_*_i64/_f64     — bulk array operations (sum, dot, fill, ...)
+//   gobol_sort_i64/_f64(a, n)   — radix sort for int and float arrays
+//   gobol_prof_enter/leave      — function hooks of `gobol --instrument` builds
+//   gobol_parallel_for(n, f, e) — runs the chunks of a `parallel for` on the pool
+//   gobol_parallel_lock/unlock  — guards the merge of a chunk's reductions
+
+// posix_madvise() for fs.map(); -std=c11 hides everything beyond C
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+
+// ---- threads ----
+//
+// `parallel for` runs its chunks on a pool of threads (see "parallel for"
+// below).  The allocators keep their state per thread, so generated code
+// needs no locking; only stdio, which all threads share, takes a lock, and
+// only while a parallel loop is running.
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define GOBOL_TLS __declspec(thread)
+#elif defined(__GNUC__)
+// The runtime is linked into the executable, so even -fPIC code can use
+// the static TLS block instead of calling __tls_get_addr
+#define GOBOL_TLS _Thread_local __attribute__((tls_model("initial-exec")))
+#else
+#define GOBOL_TLS _Thread_local
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <malloc.h>
+typedef CRITICAL_SECTION gobol_mutex_t;
+typedef CONDITION_VARIABLE gobol_cond_t;
+#define gobol_mutex_init(m) InitializeCriticalSection(m)
+#define gobol_mutex_lock(m) EnterCriticalSection(m)
+#define gobol_mutex_unlock(m) LeaveCriticalSection(m)
+#define gobol_cond_init(c) InitializeConditionVariable(c)
+#define gobol_cond_wait(c, m) SleepConditionVariableCS((c), (m), INFINITE)
+#define gobol_cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t gobol_mutex_t;
+typedef pthread_cond_t gobol_cond_t;
+#define gobol_mutex_init(m) pthread_mutex_init((m), NULL)
+#define gobol_mutex_lock(m) pthread_mutex_lock(m)
+#define gobol_mutex_unlock(m) pthread_mutex_unlock(m)
+#define gobol_cond_init(c) pthread_cond_init((c), NULL)
+#define gobol_cond_wait(c, m) pthread_cond_wait((c), (m))
+#define gobol_cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+// Set by the thread that started a parallel loop until every chunk is done
+static int gobol_par_running = 0;
+static gobol_mutex_t gobol_io_lock;
+
+#define GOBOL_IO_LOCK() do { if (gobol_par_running) gobol_mutex_lock(&gobol_io_lock); } while (0)
+#define GOBOL_IO_UNLOCK() do { if (gobol_par_running) gobol_mutex_unlock(&gobol_io_lock); } while (0)
+
+// ---- string arena ----
+//
+// Every string built at runtime lives in a bump arena and carries a
+// gobol_str_hdr_t in front of its bytes, so its length is known in O(1).
+// The pointer handed to gobol code still points at the characters, so arena
+// strings and C literals can be mixed freely.  Generated code brackets
+// statements with gobol_arena_mark()/gobol_arena_release() to drop their
+// temporaries in one step.
+
+typedef struct { int64_t len; } gobol_str_hdr_t;
+
+typedef struct gobol_arena_chunk {
+    struct gobol_arena_chunk* prev;
+    size_t cap;
+    size_t used;
+    char* data;
+} gobol_arena_chunk_t;
+
+typedef struct { gobol_arena_chunk_t* chunk; size_t used; } gobol_arena_mark_t;
+
+#define GOBOL_ARENA_CHUNK_SIZE (64 * 1024)
+#define GOBOL_ARENA_BLOCK_SHIFT 16  // log2(GOBOL_ARENA_CHUNK_SIZE)
+
+// Chunks are allocated aligned to GOBOL_ARENA_CHUNK_SIZE and sized in whole
+// blocks of it, so every block of the address space belongs to at most one
+// chunk.  An arena keeps the block numbers (address >> BLOCK_SHIFT) of its
+// chunks in an open-addressing hash set: whether it owns a pointer is one
+// probe, and never reads the memory around the pointer.  0 is an empty slot.
+typedef struct { uintptr_t* slots; size_t cap; size_t len; } gobol_block_set_t;
+
+typedef struct { gobol_arena_chunk_t* top; gobol_arena_chunk_t* spare; gobol_block_set_t blocks; } gobol_arena_t;
+
+// Strings, and the arrays allocated inside `region` blocks, per thread
+static GOBOL_TLS gobol_arena_t gobol_strings = { NULL, NULL, { NULL, 0, 0 } };
+static GOBOL_TLS gobol_arena_t gobol_region_arrays = { NULL, NULL, { NULL, 0, 0 } };
+
+static size_t gobol_block_slot(const gobol_block_set_t* s, uintptr_t b) {
+    return (size_t)(((uint64_t)b * 0x9E3779B97F4A7C15ull) >> 32) & (s->cap - 1);
+}
+
+static int gobol_block_has(const gobol_block_set_t* s, uintptr_t b) {
+    if (s->cap == 0) return 0;
+    for (size_t i = gobol_block_slot(s, b);; i = (i + 1) & (s->cap - 1)) {
+        if (s->slots[i] == b) return 1;
+        if (s->slots[i] == 0) return 0;
+    }
+}
+
+static void gobol_block_put(gobol_block_set_t* s, uintptr_t b);
+
+static void gobol_block_rehash(gobol_block_set_t* s) {
+    gobol_block_set_t old = *s;
+    s->cap = old.cap ? old.cap * 2 : 16;
+    s->len = 0;
+    s->slots = calloc(s->cap, sizeof(uintptr_t));
+    if (!s->slots) { fputs("gobol: out of memory\n", stderr); exit(2); }
+    for (size_t i = 0; i < old.cap; i++) {
+        if (old.slots[i]) gobol_block_put(s, old.slots[i]);
+    }
+    free(old.slots);
+}
+
+static void gobol_block_put(gobol_block_set_t* s, uintptr_t b) {
+    if ((s->len + 1) * 2 > s->cap) gobol_block_rehash(s);
+    size_t i = gobol_block_slot(s, b);
+    while (s->slots[i]) i = (i + 1) & (s->cap - 1);
+    s->slots[i] = b;
+    s->len++;
+}
+
+// Linear probing delete: later entries of the run move back into the hole
+// unless that would put them in front of their home slot
+static void gobol_block_del(gobol_block_set_t* s, uintptr_t b) {
+    size_t mask = s->cap - 1;
+    size_t i = gobol_block_slot(s, b);
+    while (s->slots[i] != b) {
+        if (s->slots[i] == 0) return;
+        i = (i + 1) & mask;
+    }
+    for (size_t j = (i + 1) & mask; s->slots[j]; j = (j + 1) & mask) {
+        size_t home = gobol_block_slot(s, s->slots[j]);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            s->slots[i] = s->slots[j];
+            i = j;
+        }
+    }
+    s->slots[i] = 0;
+    s->len--;
+}
+
+static gobol_arena_chunk_t* gobol_chunk_alloc(gobol_arena_t* a, size_t min_size) {
+    size_t block = GOBOL_ARENA_CHUNK_SIZE;
+    size_t total = (sizeof(gobol_arena_chunk_t) + min_size + block - 1) & ~(block - 1);
+    void* p = NULL;
+#ifdef _WIN32
+    p = _aligned_malloc(total, block);
+#else
+    if (posix_memalign(&p, block, total) != 0) p = NULL;
+#endif
+    if (!p) { fputs("gobol: out of memory\n", stderr); exit(2); }
+    gobol_arena_chunk_t* c = p;
+    c->prev = NULL;
+    c->cap = total - sizeof(gobol_arena_chunk_t);
+    c->used = 0;
+    c->data = (char*)(c + 1);
+    for (uintptr_t b = (uintptr_t)c >> GOBOL_ARENA_BLOCK_SHIFT, n = total / block; n > 0; b++, n--) {
+        gobol_block_put(&a->blocks, b);
+    }
+    return c;
+}
+
+static void gobol_chunk_free(gobol_arena_t* a, gobol_arena_chunk_t* c) {
+    if (!c) return;
+    size_t total = sizeof(gobol_arena_chunk_t) + c->cap;
+    for (uintptr_t b = (uintptr_t)c >> GOBOL_ARENA_BLOCK_SHIFT, n = total / GOBOL_ARENA_CHUNK_SIZE; n > 0; b++, n--) {
+        gobol_block_del(&a->blocks, b);
+    }
+#ifdef _WIN32
+    _aligned_free(c);
+#else
+    free(c);
+#endif
+}
+
+static gobol_arena_chunk_t* gobol_arena_new_chunk(gobol_arena_t* a, size_t min_size) {
+    if (a->spare && a->spare->cap >= min_size) {
+        gobol_arena_chunk_t* c = a->spare;
+        a->spare = NULL;
+        c->used = 0;
+        return c;
+    }
+    return gobol_chunk_alloc(a, min_size);
+}
+
+static void* gobol_arena_alloc_in(gobol_arena_t* a, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    if (!a->top || a->top->cap - a->top->used < size) {
+        gobol_arena_chunk_t* c = gobol_arena_new_chunk(a, size);
+        c->prev = a->top;
+        a->top = c;
+    }
+    void* p = a->top->data + a->top->used;
+    a->top->used += size;
+    return p;
+}
+
+// Whether `s` points into one of the arena's chunks (live or spare)
+static int gobol_arena_owns_in(const gobol_arena_t* a, const char* s) {
+    return gobol_block_has(&a->blocks, (uintptr_t)s >> GOBOL_ARENA_BLOCK_SHIFT);
+}
+
+static gobol_arena_mark_t gobol_arena_mark_in(const gobol_arena_t* a) {
+    gobol_arena_mark_t m;
+    m.chunk = a->top;
+    m.used = a->top ? a->top->used : 0;
+    return m;
+}
+
+static void gobol_arena_release_in(gobol_arena_t* a, gobol_arena_mark_t m) {
+    while (a->top && a->top != m.chunk) {
+        gobol_arena_chunk_t* c = a->top;
+        a->top = c->prev;
+        // keep the largest released chunk around so a hot loop doesn't malloc
+        if (!a->spare || a->spare->cap < c->cap) {
+            gobol_chunk_free(a, a->spare);
+            a->spare = c;
+        } else {
+            gobol_chunk_free(a, c);
+        }
+    }
+    if (a->top) a->top->used = m.used;
+}
+
+static void* gobol_arena_alloc(size_t size) { return gobol_arena_alloc_in(&gobol_strings, size); }
+static int gobol_arena_owns(const char* s) { return gobol_arena_owns_in(&gobol_strings, s); }
+
+gobol_arena_mark_t gobol_arena_mark(void) { return gobol_arena_mark_in(&gobol_strings); }
+void gobol_arena_release(gobol_arena_mark_t m) { gobol_arena_release_in(&gobol_strings, m); }
+
+// Counted for the --instrument report (on the main thread)
+static GOBOL_TLS uint64_t gobol_prof_str_allocs = 0;
+static GOBOL_TLS uint64_t gobol_prof_array_grows = 0;
+
+// Allocates room for `len` characters plus the terminating NUL.
+char* gobol_str_alloc(int64_t len) {
+    gobol_prof_str_allocs++;
+    gobol_str_hdr_t* h = gobol_arena_alloc(sizeof(gobol_str_hdr_t) + (size_t)len + 1);
+    h->len = len;
+    char* s = (char*)(h + 1);
+    s[len] = '\0';
+    return s;
+}
+
+int64_t gobol_str_len(const char* s) {
+    if (gobol_arena_owns(s)) return ((const gobol_str_hdr_t*)s - 1)->len;
+    return (int64_t)strlen(s);
+}
+
+// ---- buffered stdio ----
+//
+// print/println append to one large user-space buffer; the bytes reach
+// stdout in a single fwrite when the buffer fills, when flush() is called,
+// and at exit.  When stdout is a terminal the buffer is also flushed after
+// any write containing a newline so interactive output stays line-timely.
+// unistd.h is not included because its read() clashes with ours.
+
+#ifdef _WIN32
+int _isatty(int fd);
+int _fileno(FILE* f);
+#define gobol_isatty(f) _isatty(_fileno(f))
+#else
+int isatty(int fd);
+int fileno(FILE* f);
+#define gobol_isatty(f) isatty(fileno(f))
+#endif
+
+#define GOBOL_OUT_CAP ((size_t)1 << 16)
+
+static char gobol_out_buf[GOBOL_OUT_CAP];
+static size_t gobol_out_used = 0;
+static int gobol_out_tty = -1;  // -1 until the first write
+
+static void gobol_out_drain(void) {
+    if (gobol_out_used > 0) {
+        fwrite(gobol_out_buf, 1, gobol_out_used, stdout);
+        gobol_out_used = 0;
+    }
+}
+
+static void gobol_out_flush(void) {
+    gobol_out_drain();
+    fflush(stdout);
+}
+
+void flush(void) {
+    GOBOL_IO_LOCK();
+    gobol_out_flush();
+    GOBOL_IO_UNLOCK();
+}
+
+static void gobol_out_init(void) {
+    gobol_out_tty = gobol_isatty(stdout) ? 1 : 0;
+    atexit(flush);
+}
+
+static void gobol_out_write(const char* s, size_t n) {
+    if (gobol_out_tty < 0) gobol_out_init();
+    if (n > GOBOL_OUT_CAP - gobol_out_used) {
+        gobol_out_drain();
+        // Too big to buffer: hand it straight to stdio.
+        if (n >= GOBOL_OUT_CAP) { fwrite(s, 1, n, stdout); return; }
+    }
+    memcpy(gobol_out_buf + gobol_out_used, s, n);
+    gobol_out_used += n;
+}
+
+// Line reader: grows one reused buffer, so lines have no length limit.
+// The returned string is only valid until the next read().
+static char* gobol_line_buf = NULL;
+static size_t gobol_line_cap = 0;
+
+static char* gobol_read_line(void);
 
 // ---- public API (matches gobol signatures) ----
 
 void print(const char* value) {
-    printf("%s", value);
+    size_t n = (size_t)gobol_str_len(value);
+    GOBOL_IO_LOCK();
+    gobol_out_write(value, n);
+    if (gobol_out_tty == 1 && memchr(value, '\n', n)) gobol_out_flush();
+    GOBOL_IO_UNLOCK();
 }
 
 void println(const char* value) {
-    printf("%s\n", value);
+    size_t n = (size_t)gobol_str_len(value);
+    GOBOL_IO_LOCK();
+    gobol_out_write(value, n);
+    gobol_out_write("\n", 1);
+    if (gobol_out_tty == 1) gobol_out_flush();
+    GOBOL_IO_UNLOCK();
 }
 
+// Inside a parallel loop the returned line is only valid until the next
+// read() on any thread.
 char* read(void) {
-    static char buf[4096];
-    if (fgets(buf, sizeof(buf), stdin)) {
-        size_t len = strlen(buf);
-        if (len > 0 && buf[len-1] == '\n') buf[len-1] = '\0';
-        return buf;
+    GOBOL_IO_LOCK();
+    char* line = gobol_read_line();
+    GOBOL_IO_UNLOCK();
+    return line;
+}
+
+static char* gobol_read_line(void) {
+    // Make a pending prompt visible before blocking on the terminal.
+    if (gobol_out_tty == 1) gobol_out_flush();
+    if (gobol_line_buf == NULL) {
+        gobol_line_cap = 256;
+        gobol_line_buf = malloc(gobol_line_cap);
+        if (!gobol_line_buf) return "";
+    }
+    size_t len = 0;
+    gobol_line_buf[0] = '\0';
+    for (;;) {
+        if (gobol_line_cap - len < 2) {
+            char* grown = realloc(gobol_line_buf, gobol_line_cap * 2);
+            if (!grown) break;
+            gobol_line_buf = grown;
+            gobol_line_cap *= 2;
+        }
+        if (!fgets(gobol_line_buf + len, (int)(gobol_line_cap - len), stdin)) break;
+        len += strlen(gobol_line_buf + len);
+        if (len > 0 && gobol_line_buf[len - 1] == '\n') {
+            gobol_line_buf[--len] = '\0';
+            if (len > 0 && gobol_line_buf[len - 1] == '\r') gobol_line_buf[--len] = '\0';
+            break;
+        }
+    }
+    return gobol_line_buf;
+}
+
+// ---- files (std/fs.gbl) ----
+//
+// fs.map() maps a file read-only and hands gobol its address as an int;
+// views and lines are (address, length) pairs into the mapping, so
+// scanning a file copies nothing until a view's text() is asked for.
+// Without mmap (Windows) the file is read into one buffer in large
+// blocks instead.  Writers keep their own 1 MB buffer and go to the file
+// in block-sized fwrites; writes bigger than the buffer bypass it.
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+int close(int fd);
+#endif
+
+typedef struct {
+    char* data;
+    int64_t size;
+    int mapped;  // 0: malloc'ed copy
+} gobol_fs_map_t;
+
+#define GOBOL_FS_BLOCK ((size_t)1 << 20)
+
+// Handles of open maps and writers.  The low 32 bits are 1 + a slot index
+// and the high 32 the slot's generation, which closing bumps, so a stale
+// handle stops matching instead of reaching freed memory.  Slot blocks are
+// never moved or freed: a lookup needs no lock.  A map's slot keeps its
+// bytes and size, so a read looks at the slot alone.
+#define GOBOL_FS_BLOCK_SLOTS 1024
+#define GOBOL_FS_MAX_BLOCKS 4096
+
+enum { GOBOL_FS_FREE, GOBOL_FS_MAP, GOBOL_FS_WRITER };
+
+typedef struct {
+    void* obj;
+    const char* data;
+    int64_t size;
+    int kind;
+    uint32_t gen;
+    uint32_t next_free;  // 1 + index of the next free slot, or 0
+} gobol_fs_slot_t;
+
+static gobol_fs_slot_t* gobol_fs_blocks[GOBOL_FS_MAX_BLOCKS];
+static uint32_t gobol_fs_slots = 0;      // slots handed out so far
+static uint32_t gobol_fs_free_head = 0;  // 1 + index of a free slot, or 0
+
+static inline gobol_fs_slot_t* gobol_fs_slot_at(uint32_t i) {
+    gobol_fs_slot_t* block = i / GOBOL_FS_BLOCK_SLOTS < GOBOL_FS_MAX_BLOCKS
+        ? gobol_fs_blocks[i / GOBOL_FS_BLOCK_SLOTS] : NULL;
+    return block ? &block[i % GOBOL_FS_BLOCK_SLOTS] : NULL;
+}
+
+// A handle for `obj`, or 0 when every slot is taken
+static int64_t gobol_fs_open(int kind, void* obj) {
+    GOBOL_IO_LOCK();
+    uint32_t i;
+    if (gobol_fs_free_head) {
+        i = gobol_fs_free_head - 1;
+        gobol_fs_free_head = gobol_fs_slot_at(i)->next_free;
+    } else {
+        i = gobol_fs_slots;
+        if (i / GOBOL_FS_BLOCK_SLOTS >= GOBOL_FS_MAX_BLOCKS) { GOBOL_IO_UNLOCK(); return 0; }
+        if (!gobol_fs_blocks[i / GOBOL_FS_BLOCK_SLOTS]) {
+            gobol_fs_blocks[i / GOBOL_FS_BLOCK_SLOTS] = calloc(GOBOL_FS_BLOCK_SLOTS, sizeof(gobol_fs_slot_t));
+            if (!gobol_fs_blocks[i / GOBOL_FS_BLOCK_SLOTS]) { GOBOL_IO_UNLOCK(); return 0; }
+        }
+        gobol_fs_slots++;
+    }
+    gobol_fs_slot_t* slot = gobol_fs_slot_at(i);
+    slot->obj = obj;
+    if (kind == GOBOL_FS_MAP) {
+        slot->data = ((gobol_fs_map_t*)obj)->data;
+        slot->size = ((gobol_fs_map_t*)obj)->size;
+    }
+    slot->kind = kind;
+    GOBOL_IO_UNLOCK();
+    return (int64_t)((uint64_t)slot->gen << 32 | (uint64_t)(i + 1));
+}
+
+// The slot of handle `h` of `kind`, or NULL once it is closed
+static inline const gobol_fs_slot_t* gobol_fs_lookup(int64_t h, int kind) {
+    uint32_t i = (uint32_t)h;
+    gobol_fs_slot_t* slot = i ? gobol_fs_slot_at(i - 1) : NULL;
+    if (!slot || slot->kind != kind || slot->gen != (uint32_t)((uint64_t)h >> 32)) return NULL;
+    return slot;
+}
+
+static void* gobol_fs_get(int64_t h, int kind) {
+    const gobol_fs_slot_t* slot = gobol_fs_lookup(h, kind);
+    return slot ? slot->obj : NULL;
+}
+
+static void gobol_fs_release(int64_t h) {
+    GOBOL_IO_LOCK();
+    uint32_t i = (uint32_t)h - 1;
+    gobol_fs_slot_t* slot = gobol_fs_slot_at(i);
+    slot->obj = NULL;
+    slot->data = NULL;
+    slot->size = 0;
+    slot->kind = GOBOL_FS_FREE;
+    slot->gen++;
+    slot->next_free = gobol_fs_free_head;
+    gobol_fs_free_head = i + 1;
+    GOBOL_IO_UNLOCK();
+}
+
+static gobol_fs_map_t* gobol_fs_read_all(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+    gobol_fs_map_t* m = calloc(1, sizeof *m);
+    if (!m) { fclose(f); return NULL; }
+    size_t cap = 0;
+    for (;;) {
+        if (cap - (size_t)m->size < GOBOL_FS_BLOCK) {
+            size_t grown_cap = cap ? cap * 2 : GOBOL_FS_BLOCK;
+            char* grown = realloc(m->data, grown_cap);
+            // Out of memory: fail like an unreadable file, not a short one
+            if (!grown) { free(m->data); free(m); fclose(f); return NULL; }
+            m->data = grown;
+            cap = grown_cap;
+        }
+        size_t got = fread(m->data + m->size, 1, cap - (size_t)m->size, f);
+        m->size += (int64_t)got;
+        if (got == 0) break;
+    }
+    fclose(f);
+    return m;
+}
+
+static gobol_fs_map_t* gobol_fs_load(const char* path) {
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        gobol_fs_map_t* m = calloc(1, sizeof *m);
+        if (!m) { close(fd); return NULL; }
+        m->size = (int64_t)st.st_size;
+        m->mapped = 1;
+        if (m->size > 0) {
+            void* p = mmap(NULL, (size_t)m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                free(m);
+                close(fd);
+                return gobol_fs_read_all(path);
+            }
+            // Log scans read front to back: let the kernel read ahead
+            posix_madvise(p, (size_t)m->size, POSIX_MADV_SEQUENTIAL);
+            m->data = p;
+        }
+        close(fd);
+        return m;
+    }
+    close(fd);
+#endif
+    // Pipes, devices and platforms without mmap
+    return gobol_fs_read_all(path);
+}
+
+static void gobol_fs_free_map(gobol_fs_map_t* m) {
+#ifndef _WIN32
+    if (m->mapped && m->size > 0) munmap(m->data, (size_t)m->size);
+#endif
+    if (!m->mapped) free(m->data);
+    free(m);
+}
+
+int64_t fs__map(const char* path) {
+    gobol_fs_map_t* m = gobol_fs_load(path);
+    if (!m) return 0;
+    int64_t h = gobol_fs_open(GOBOL_FS_MAP, m);
+    if (!h) gobol_fs_free_map(m);
+    return h;
+}
+
+int64_t fs__map_size(int64_t h) {
+    gobol_fs_map_t* m = gobol_fs_get(h, GOBOL_FS_MAP);
+    return m ? m->size : 0;
+}
+
+bool fs__is_mapped(int64_t h) {
+    return gobol_fs_get(h, GOBOL_FS_MAP) != NULL;
+}
+
+void fs__unmap(int64_t h) {
+    gobol_fs_map_t* m = gobol_fs_get(h, GOBOL_FS_MAP);
+    if (!m) return;
+    gobol_fs_release(h);
+    gobol_fs_free_map(m);
+}
+
+// Bytes [at, at + *n) of a map's slot, with *n cut to what is mapped:
+// none once the map is closed or when `at` is outside it
+static inline const char* gobol_fs_span_in(const gobol_fs_slot_t* m, int64_t at, int64_t* n) {
+    if (!m || !m->data || at < 0 || at > m->size || *n < 0) { *n = 0; return ""; }
+    if (*n > m->size - at) *n = m->size - at;
+    return m->data + at;
+}
+
+static inline const char* gobol_fs_span(int64_t h, int64_t at, int64_t* n) {
+    return gobol_fs_span_in(gobol_fs_lookup(h, GOBOL_FS_MAP), at, n);
+}
+
+// The byte at `i`, or -1 outside the map
+int64_t fs__byte(int64_t h, int64_t i) {
+    int64_t n = 1;
+    const char* p = gobol_fs_span(h, i, &n);
+    return n == 1 ? (unsigned char)*p : -1;
+}
+
+// Offset of the first '\n' in [at, at + n), the length of the span when
+// there is none, or -1 when none of it is mapped
+int64_t fs__line_end(int64_t h, int64_t at, int64_t n) {
+    const gobol_fs_slot_t* m = gobol_fs_lookup(h, GOBOL_FS_MAP);
+    if (!m && n > 0) return -1;
+    const char* p = gobol_fs_span_in(m, at, &n);
+    const char* nl = n > 0 ? memchr(p, '\n', (size_t)n) : NULL;
+    return nl ? (int64_t)(nl - p) : n;
+}
+
+int64_t fs__find(int64_t h, int64_t at, int64_t n, const char* s) {
+    const char* hay = gobol_fs_span(h, at, &n);
+    size_t k = (size_t)gobol_str_len(s);
+    if (k == 0) return 0;
+    if ((int64_t)k > n) return -1;
+    const char* end = hay + n - k + 1;
+    for (const char* c = hay; c < end; c++) {
+        c = memchr(c, s[0], (size_t)(end - c));
+        if (!c) break;
+        if (memcmp(c, s, k) == 0) return (int64_t)(c - hay);
+    }
+    return -1;
+}
+
+int64_t fs__count(int64_t h, int64_t at, int64_t n, int64_t b) {
+    const char* c = gobol_fs_span(h, at, &n);
+    const char* end = c + n;
+    int64_t count = 0;
+    while (c < end && (c = memchr(c, (int)b, (size_t)(end - c)))) {
+        count++;
+        c++;
+    }
+    return count;
+}
+
+bool fs__equal(int64_t h, int64_t at, int64_t n, const char* s) {
+    const char* p = gobol_fs_span(h, at, &n);
+    return gobol_str_len(s) == n && memcmp(p, s, (size_t)n) == 0;
+}
+
+bool fs__has_prefix(int64_t h, int64_t at, int64_t n, const char* s) {
+    const char* p = gobol_fs_span(h, at, &n);
+    int64_t k = gobol_str_len(s);
+    return k <= n && memcmp(p, s, (size_t)k) == 0;
+}
+
+bool fs__has_suffix(int64_t h, int64_t at, int64_t n, const char* s) {
+    const char* p = gobol_fs_span(h, at, &n);
+    int64_t k = gobol_str_len(s);
+    return k <= n && memcmp(p + n - k, s, (size_t)k) == 0;
+}
+
+// Leading blanks and an optional sign, then digits; stops at anything else
+int64_t fs__to_int(int64_t h, int64_t at, int64_t n) {
+    const char* c = gobol_fs_span(h, at, &n);
+    const char* end = c + n;
+    while (c < end && (*c == ' ' || *c == '\t')) c++;
+    int neg = c < end && *c == '-';
+    if (c < end && (*c == '-' || *c == '+')) c++;
+    uint64_t v = 0;
+    while (c < end && *c >= '0' && *c <= '9') v = v * 10 + (uint64_t)(*c++ - '0');
+    return neg ? -(int64_t)v : (int64_t)v;
+}
+
+double fs__to_float(int64_t h, int64_t at, int64_t n) {
+    const char* p = gobol_fs_span(h, at, &n);
+    char tmp[64];
+    size_t k = n < (int64_t)sizeof(tmp) - 1 ? (size_t)n : sizeof(tmp) - 1;
+    memcpy(tmp, p, k);
+    tmp[k] = '\0';
+    return strtod(tmp, NULL);
+}
+
+char* fs__text(int64_t h, int64_t at, int64_t n) {
+    const char* p = gobol_fs_span(h, at, &n);
+    char* s = gobol_str_alloc(n);
+    memcpy(s, p, (size_t)n);
+    return s;
+}
+
+typedef struct {
+    FILE* file;
+    size_t used;
+    char buf[GOBOL_FS_BLOCK];
+} gobol_fs_writer_t;
+
+static void gobol_fs_drain(gobol_fs_writer_t* w) {
+    if (w->used > 0) {
+        fwrite(w->buf, 1, w->used, w->file);
+        w->used = 0;
     }
-    return "";
+}
+
+// Writers still open at exit keep their data, like stdout's buffer
+static void gobol_fs_drain_all(void) {
+    for (uint32_t i = 0; i < gobol_fs_slots; i++) {
+        gobol_fs_slot_t* slot = gobol_fs_slot_at(i);
+        if (slot->kind == GOBOL_FS_WRITER) {
+            gobol_fs_drain(slot->obj);
+            fflush(((gobol_fs_writer_t*)slot->obj)->file);
+        }
+    }
+}
+
+int64_t fs__create(const char* path, bool append) {
+    static int registered = 0;
+    FILE* f = fopen(path, append ? "ab" : "wb");
+    if (!f) return 0;
+    gobol_fs_writer_t* w = malloc(sizeof *w);
+    if (!w) { fclose(f); return 0; }
+    // Our buffer already batches; stdio's would only copy again
+    setvbuf(f, NULL, _IONBF, 0);
+    w->file = f;
+    w->used = 0;
+    int64_t h = gobol_fs_open(GOBOL_FS_WRITER, w);
+    if (!h) { fclose(f); free(w); return 0; }
+    if (!registered) {
+        registered = 1;
+        atexit(gobol_fs_drain_all);
+    }
+    return h;
+}
+
+static void gobol_fs_put(int64_t h, const char* p, int64_t n) {
+    gobol_fs_writer_t* w = gobol_fs_get(h, GOBOL_FS_WRITER);
+    if (!w || n <= 0) return;
+    if ((size_t)n > GOBOL_FS_BLOCK - w->used) {
+        gobol_fs_drain(w);
+        if ((size_t)n >= GOBOL_FS_BLOCK) { fwrite(p, 1, (size_t)n, w->file); return; }
+    }
+    memcpy(w->buf + w->used, p, (size_t)n);
+    w->used += (size_t)n;
+}
+
+void fs__write_bytes(int64_t h, int64_t m, int64_t at, int64_t n) {
+    const char* p = gobol_fs_span(m, at, &n);
+    gobol_fs_put(h, p, n);
+}
+
+void fs__write(int64_t h, const char* s) {
+    gobol_fs_put(h, s, gobol_str_len(s));
+}
+
+void fs__flush(int64_t h) {
+    gobol_fs_writer_t* w = gobol_fs_get(h, GOBOL_FS_WRITER);
+    if (!w) return;
+    gobol_fs_drain(w);
+    fflush(w->file);
+}
+
+void fs__close(int64_t h) {
+    gobol_fs_writer_t* w = gobol_fs_get(h, GOBOL_FS_WRITER);
+    if (!w) return;
+    gobol_fs_release(h);
+    gobol_fs_drain(w);
+    fclose(w->file);
+    free(w);
+}
+
+bool fs_remove(const char* path) {
+    return remove(path) == 0;
 }
 
 // ---- conversion helpers (called by generated code) ----
 
 char* gobol_str_int(int64_t n) {
-    static char buf[32];
-    snprintf(buf, sizeof(buf), "%ld", n);
-    return buf;
+    char tmp[32];
+    int len = snprintf(tmp, sizeof(tmp), "%" PRId64, n);
+    char* s = gobol_str_alloc(len);
+    memcpy(s, tmp, (size_t)len);
+    return s;
 }
 
 char* gobol_str_float(double f) {
-    static char buf[64];
-    snprintf(buf, sizeof(buf), "%g", f);
-    return buf;
+    char tmp[64];
+    int len = snprintf(tmp, sizeof(tmp), "%g", f);
+    char* s = gobol_str_alloc(len);
+    memcpy(s, tmp, (size_t)len);
+    return s;
 }
 
 char* gobol_str_cat(const char* a, const char* b) {
-    static char buf[8192];
-    snprintf(buf, sizeof(buf), "%s%s", a, b);
-    return buf;
+    int64_t la = gobol_str_len(a);
+    int64_t lb = gobol_str_len(b);
+    char* s = gobol_str_alloc(la + lb);
+    memcpy(s, a, (size_t)la);
+    memcpy(s + la, b, (size_t)lb);
+    return s;
+}
+
+// ---- format strings ----
+//
+// `@"x = {x}\n"` compiles to one gobol_str_format call over an array of
+// pieces. The first pass measures every piece (stashing the length in the
+// piece), the second writes each one exactly once into a single allocation.
+
+typedef struct { int kind; int64_t len; union { const char* s; int64_t i; double f; } v; } gobol_fmt_piece_t;
+
+enum { GOBOL_FMT_STR = 0, GOBOL_FMT_INT = 1, GOBOL_FMT_FLOAT = 2 };
+
+static int gobol_int_width(int64_t n) {
+    uint64_t u = n < 0 ? (uint64_t)0 - (uint64_t)n : (uint64_t)n;
+    int w = n < 0 ? 2 : 1;
+    while (u >= 10) { u /= 10; w++; }
+    return w;
+}
+
+static void gobol_write_int(char* dst, int64_t n, int width) {
+    uint64_t u = n < 0 ? (uint64_t)0 - (uint64_t)n : (uint64_t)n;
+    char* p = dst + width;
+    do { *--p = (char)('0' + u % 10); u /= 10; } while (u);
+    if (n < 0) *--p = '-';
+}
+
+char* gobol_str_format(int64_t n, gobol_fmt_piece_t* pieces) {
+    int64_t total = 0;
+    for (int64_t k = 0; k < n; k++) {
+        gobol_fmt_piece_t* p = &pieces[k];
+        switch (p->kind) {
+            case GOBOL_FMT_INT:   p->len = gobol_int_width(p->v.i); break;
+            case GOBOL_FMT_FLOAT: p->len = snprintf(NULL, 0, "%g", p->v.f); break;
+            default:              if (p->len < 0) p->len = gobol_str_len(p->v.s); break;
+        }
+        total += p->len;
+    }
+    char* s = gobol_str_alloc(total);
+    char* out = s;
+    for (int64_t k = 0; k < n; k++) {
+        gobol_fmt_piece_t* p = &pieces[k];
+        switch (p->kind) {
+            case GOBOL_FMT_INT:   gobol_write_int(out, p->v.i, (int)p->len); break;
+            case GOBOL_FMT_FLOAT: snprintf(out, (size_t)p->len + 1, "%g", p->v.f); break;
+            default:              memcpy(out, p->v.s, (size_t)p->len); break;
+        }
+        out += p->len;
+    }
+    return s;
 }
 
 // ---- array runtime ----
 
-typedef struct { int64_t* data; int64_t len; int64_t cap; } gobol_array_t;
+// Array types and their accessors are generated per element type and rank
+// by the code generator (gobol_array_<T>_t, gobol_array<N>_<T>_t, static
+// inline get/set).  Only the allocation paths live here.
+
+_Noreturn void gobol_size_error(int64_t n);
+
+// ---- regions ----
+//
+// `region { ... }` brackets its body with gobol_region_enter() and
+// gobol_region_leave(): strings built inside go to the string arena as
+// usual, arrays created inside get their storage from a second bump arena,
+// and leaving the region drops both back to where they stood on entry in
+// one step.  Released chunks are recycled like the string arena's, so a
+// region in a loop settles on a fixed working set.
+//
+// An array remembers the region depth it was created at through its empty
+// storage pointer (gobol_array_seed(), one byte of gobol_array_seeds per
+// depth).  It only grows inside the region that created it; an array from
+// outside the current region grows on the heap, and storage of an
+// enclosing region moves to the heap when it has to grow.
+
+#define GOBOL_REGION_MAX_DEPTH 64
+
+typedef struct { gobol_arena_mark_t strings; gobol_arena_mark_t arrays; gobol_arena_mark_t outer; } gobol_region_t;
 
-void gobol_array_add(gobol_array_t* arr, int64_t val) {
-    if (arr->len >= arr->cap) {
-        int64_t new_cap = arr->cap ? arr->cap * 2 : 8;
-        arr->data = realloc(arr->data, new_cap * sizeof(int64_t));
-        arr->cap = new_cap;
+// Every thread has its own regions; the seeds are shared, so an empty
+// array handed to another thread is still recognized
+GOBOL_TLS int gobol_region_depth = 0;
+char gobol_array_seeds[GOBOL_REGION_MAX_DEPTH + 1];
+
+// Where the innermost region's arrays start
+static GOBOL_TLS gobol_arena_mark_t gobol_region_base = { NULL, 0 };
+
+gobol_region_t gobol_region_enter(void) {
+    gobol_region_t r;
+    r.strings = gobol_arena_mark_in(&gobol_strings);
+    r.arrays = gobol_arena_mark_in(&gobol_region_arrays);
+    r.outer = gobol_region_base;
+    gobol_region_base = r.arrays;
+    gobol_region_depth++;
+    return r;
+}
+
+void gobol_region_leave(gobol_region_t r) {
+    gobol_arena_release_in(&gobol_region_arrays, r.arrays);
+    gobol_arena_release_in(&gobol_strings, r.strings);
+    gobol_region_base = r.outer;
+    gobol_region_depth--;
+}
+
+static void* gobol_array_seed_here(void) {
+    if (gobol_region_depth == 0) return NULL;
+    return gobol_array_seeds + (gobol_region_depth < GOBOL_REGION_MAX_DEPTH ? gobol_region_depth : GOBOL_REGION_MAX_DEPTH);
+}
+
+// Region depth an empty array was created at, or -1 for real storage
+static int gobol_array_seed_depth(const char* p) {
+    uintptr_t at = (uintptr_t)p - (uintptr_t)gobol_array_seeds;
+    return at <= GOBOL_REGION_MAX_DEPTH ? (int)at : -1;
+}
+
+static int gobol_region_owns(const char* p) {
+    for (gobol_arena_chunk_t* c = gobol_region_arrays.top; c; c = c->prev) {
+        size_t from = c == gobol_region_base.chunk ? gobol_region_base.used : 0;
+        if (p >= c->data + from && p < c->data + c->used) return 1;
+        if (c == gobol_region_base.chunk) break;
     }
-    arr->data[arr->len++] = val;
+    return 0;
 }
 
-int64_t gobol_array_len(gobol_array_t* arr) { return arr->len; }
+static void* gobol_region_grow(char* old, size_t old_size, size_t new_size) {
+    int depth = gobol_array_seed_depth(old);
+    if (depth >= 0) {
+        int here = depth > 0 && depth == gobol_region_depth && depth < GOBOL_REGION_MAX_DEPTH;
+        return here ? gobol_arena_alloc_in(&gobol_region_arrays, new_size) : malloc(new_size);
+    }
+    if (!old || !gobol_arena_owns_in(&gobol_region_arrays, old)) return realloc(old, new_size);
+    void* p;
+    if (gobol_region_owns(old)) {
+        // The newest allocation grows in place
+        gobol_arena_chunk_t* top = gobol_region_arrays.top;
+        size_t end = (old_size + 7) & ~(size_t)7;
+        int newest = old >= top->data && old < top->data + top->used
+            && (size_t)(old - top->data) + end == top->used;
+        size_t at = newest ? (size_t)(old - top->data) : 0;
+        if (newest && top->cap - at >= new_size) {
+            top->used = at + ((new_size + 7) & ~(size_t)7);
+            return old;
+        }
+        p = gobol_arena_alloc_in(&gobol_region_arrays, new_size);
+    } else {
+        // Storage of an enclosing region can't grow past the current one
+        p = malloc(new_size);
+    }
+    if (p) memcpy(p, old, old_size);
+    return p;
+}
 
-int64_t gobol_array_get(gobol_array_t* arr, int64_t i) { return arr->data[i]; }
+// Growth path of 1-D arrays.  cap < 0 marks storage the array doesn't own.
+void gobol_array_reserve(void** data, int64_t* cap, int64_t need, size_t elem_size) {
+    if (*cap < 0) {
+        fputs("gobol: cannot grow a fixed-size array\n", stderr);
+        exit(2);
+    }
+    if (need <= *cap) return;
+    gobol_prof_array_grows++;
+    int64_t new_cap = *cap ? *cap * 2 : 8;
+    while (new_cap < need) new_cap *= 2;
+    size_t old_size = (size_t)*cap * elem_size;
+    size_t new_size = (size_t)new_cap * elem_size;
+    void* grown = gobol_region_arrays.top || *data
+        ? gobol_region_grow(*data, old_size, new_size)
+        : malloc(new_size);
+    if (!grown) { fputs("gobol: out of memory\n", stderr); exit(2); }
+    *data = grown;
+    *cap = new_cap;
+}
 
-void gobol_array_set(gobol_array_t* arr, int64_t i, int64_t val) { arr->data[i] = val; }
+// Zeroed storage for n elements of a fixed-size array.
+void* gobol_array_zeroed(int64_t n, size_t elem_size) {
+    if (n < 0) gobol_size_error(n);
+    if (n == 0) return gobol_array_seed_here();
+    void* p;
+    if (gobol_region_depth > 0 && gobol_region_depth < GOBOL_REGION_MAX_DEPTH) {
+        p = gobol_arena_alloc_in(&gobol_region_arrays, (size_t)n * elem_size);
+        memset(p, 0, (size_t)n * elem_size);
+    } else {
+        p = calloc((size_t)n, elem_size);
+    }
+    if (!p) { fputs("gobol: out of memory\n", stderr); exit(2); }
+    return p;
+}
+
+// Scope-exit release of an array that didn't escape its block.  Region
+// storage is left to its region; borrowed and empty storage isn't owned.
+void gobol_array_free(void* data, int64_t cap) {
+    if (cap <= 0 || !data) return;
+    if (gobol_region_arrays.top && gobol_arena_owns_in(&gobol_region_arrays, data)) return;
+    free(data);
+}
 
-// 2D helpers: flat indexing with stride
-int64_t gobol_array_get_flat(gobol_array_t* arr, int64_t i, int64_t j) { return arr->data[i + j]; }
-void gobol_array_set_flat(gobol_array_t* arr, int64_t i, int64_t j, int64_t val) { arr->data[i + j] = val; }
+_Noreturn void gobol_size_error(int64_t n) {
+    flush();
+    fprintf(stderr, "gobol: invalid array size %" PRId64 "\n", n);
+    exit(2);
+}
+
+// Called by the generated accessors' bounds check (GOBOL_BOUNDS_CHECK).
+_Noreturn void gobol_index_error(int64_t i, int64_t len) {
+    flush();
+    fprintf(stderr, "gobol: index %" PRId64 " out of bounds for length %" PRId64 "\n", i, len);
+    exit(2);
+}
+
+_Noreturn void gobol_length_error(int64_t a, int64_t b) {
+    flush();
+    fprintf(stderr, "gobol: array lengths differ (%" PRId64 " and %" PRId64 ")\n", a, b);
+    exit(2);
+}
+
+// ---- bulk array kernels ----
+//
+// Loops over contiguous storage, unrolled by four with independent partial
+// results so GCC and Clang vectorize them at -O2.  On x86-64 glibc each
+// kernel is also built for AVX2 and the best clone is picked when the
+// program loads.  Float sums add their four partial sums last, so a
+// result can differ in the last bits from a left-to-right loop.  The
+// generated accessors check lengths; min and max never see an empty array.
+
+#if defined(__x86_64__) && defined(__GLIBC__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define GOBOL_KERNEL __attribute__((target_clones("avx2", "default")))
+#endif
+#endif
+#ifndef GOBOL_KERNEL
+#define GOBOL_KERNEL
+#endif
+
+#define GOBOL_MIN(x, y) ((y) < (x) ? (y) : (x))
+#define GOBOL_MAX(x, y) ((y) > (x) ? (y) : (x))
+
+// One set of kernels per element type T, named gobol_kernel_<op>_<S>.
+#define GOBOL_ARRAY_KERNELS(T, S)                                               \
+GOBOL_KERNEL T gobol_kernel_sum_##S(const T* a, int64_t n) {                    \
+    T s0 = 0, s1 = 0, s2 = 0, s3 = 0;                                           \
+    int64_t i = 0;                                                              \
+    for (; i + 4 <= n; i += 4) {                                                \
+        s0 += a[i]; s1 += a[i + 1]; s2 += a[i + 2]; s3 += a[i + 3];             \
+    }                                                                           \
+    for (; i < n; i++) s0 += a[i];                                              \
+    return (s0 + s1) + (s2 + s3);                                               \
+}                                                                               \
+GOBOL_KERNEL T gobol_kernel_dot_##S(const T* a, const T* b, int64_t n) {        \
+    T s0 = 0, s1 = 0, s2 = 0, s3 = 0;                                           \
+    int64_t i = 0;                                                              \
+    for (; i + 4 <= n; i += 4) {                                                \
+        s0 += a[i] * b[i]; s1 += a[i + 1] * b[i + 1];                           \
+        s2 += a[i + 2] * b[i + 2]; s3 += a[i + 3] * b[i + 3];                   \
+    }                                                                           \
+    for (; i < n; i++) s0 += a[i] * b[i];                                       \
+    return (s0 + s1) + (s2 + s3);                                               \
+}                                                                               \
+GOBOL_KERNEL T gobol_kernel_min_##S(const T* a, int64_t n) {                    \
+    T m0 = a[0], m1 = a[0], m2 = a[0], m3 = a[0];                               \
+    int64_t i = 0;                                                              \
+    for (; i + 4 <= n; i += 4) {                                                \
+        m0 = GOBOL_MIN(m0, a[i]); m1 = GOBOL_MIN(m1, a[i + 1]);                 \
+        m2 = GOBOL_MIN(m2, a[i + 2]); m3 = GOBOL_MIN(m3, a[i + 3]);             \
+    }                                                                           \
+    for (; i < n; i++) m0 = GOBOL_MIN(m0, a[i]);                                \
+    return GOBOL_MIN(GOBOL_MIN(m0, m1), GOBOL_MIN(m2, m3));                     \
+}                                                                               \
+GOBOL_KERNEL T gobol_kernel_max_##S(const T* a, int64_t n) {                    \
+    T m0 = a[0], m1 = a[0], m2 = a[0], m3 = a[0];                               \
+    int64_t i = 0;                                                              \
+    for (; i + 4 <= n; i += 4) {                                                \
+        m0 = GOBOL_MAX(m0, a[i]); m1 = GOBOL_MAX(m1, a[i + 1]);                 \
+        m2 = GOBOL_MAX(m2, a[i + 2]); m3 = GOBOL_MAX(m3, a[i + 3]);             \
+    }                                                                           \
+    for (; i < n; i++) m0 = GOBOL_MAX(m0, a[i]);                                \
+    return GOBOL_MAX(GOBOL_MAX(m0, m1), GOBOL_MAX(m2, m3));                     \
+}                                                                               \
+GOBOL_KERNEL void gobol_kernel_add_scalar_##S(T* a, int64_t n, T k) {           \
+    int64_t i = 0;                                                              \
+    for (; i + 4 <= n; i += 4) {                                                \
+        a[i] += k; a[i + 1] += k; a[i + 2] += k; a[i + 3] += k;                 \
+    }                                                                           \
+    for (; i < n; i++) a[i] += k;                                               \
+}                                                                               \
+GOBOL_KERNEL void gobol_kernel_fill_##S(T* a, int64_t n, T v) {                 \
+    int64_t i = 0;                                                              \
+    for (; i + 4 <= n; i += 4) {                                                \
+        a[i] = v; a[i + 1] = v; a[i + 2] = v; a[i + 3] = v;                     \
+    }                                                                           \
+    for (; i < n; i++) a[i] = v;                                                \
+}                                                                               \
+GOBOL_KERNEL int64_t gobol_kernel_find_##S(const T* a, int64_t n, T v) {        \
+    int64_t i = 0;                                                              \
+    for (; i + 4 <= n; i += 4) {                                                \
+        if ((a[i] == v) | (a[i + 1] == v) | (a[i + 2] == v) | (a[i + 3] == v))  \
+            break;                                                              \
+    }                                                                           \
+    for (; i < n; i++) {                                                        \
+        if (a[i] == v) return i;                                                \
+    }                                                                           \
+    return -1;                                                                  \
+}
+
+GOBOL_ARRAY_KERNELS(int64_t, i64)
+GOBOL_ARRAY_KERNELS(double, f64)
+
+// ---- sorting ----
+//
+// Int and float arrays are radix sorted: keys are mapped to unsigned
+// integers in the same order and sorted by their 8-bit digits, least
+// significant first, skipping digits every key shares.  Short arrays use
+// insertion sort.  Negative NaNs sort first and positive NaNs last.
+
+#define GOBOL_SORT_SMALL 64
+
+static void gobol_radix_sort_u64(uint64_t* a, int64_t n) {
+    uint64_t* tmp = malloc((size_t)n * sizeof(uint64_t));
+    if (!tmp) { fputs("gobol: out of memory\n", stderr); exit(2); }
+    size_t counts[8][256] = {{0}};
+    for (int64_t i = 0; i < n; i++) {
+        uint64_t k = a[i];
+        for (int d = 0; d < 8; d++) counts[d][(k >> (8 * d)) & 0xff]++;
+    }
+    uint64_t* src = a;
+    uint64_t* dst = tmp;
+    for (int d = 0; d < 8; d++) {
+        size_t* c = counts[d];
+        int shift = 8 * d;
+        if (c[(src[0] >> shift) & 0xff] == (size_t)n) continue;
+        size_t sum = 0;
+        for (int b = 0; b < 256; b++) {
+            size_t t = c[b];
+            c[b] = sum;
+            sum += t;
+        }
+        for (int64_t i = 0; i < n; i++) dst[c[(src[i] >> shift) & 0xff]++] = src[i];
+        uint64_t* t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != a) memcpy(a, src, (size_t)n * sizeof(uint64_t));
+    free(tmp);
+}
+
+void gobol_sort_i64(int64_t* a, int64_t n) {
+    if (n <= GOBOL_SORT_SMALL) {
+        for (int64_t i = 1; i < n; i++) {
+            int64_t x = a[i], j = i;
+            for (; j > 0 && x < a[j - 1]; j--) a[j] = a[j - 1];
+            a[j] = x;
+        }
+        return;
+    }
+    // Flipping the sign bit puts signed values in unsigned order
+    uint64_t* u = (uint64_t*)a;
+    for (int64_t i = 0; i < n; i++) u[i] ^= UINT64_C(1) << 63;
+    gobol_radix_sort_u64(u, n);
+    for (int64_t i = 0; i < n; i++) u[i] ^= UINT64_C(1) << 63;
+}
+
+// Negative values reverse their bits, the rest set the sign bit
+static inline uint64_t gobol_f64_key(double x) {
+    uint64_t k;
+    memcpy(&k, &x, sizeof(k));
+    return (k >> 63) ? ~k : k | (UINT64_C(1) << 63);
+}
+
+static inline double gobol_f64_unkey(uint64_t k) {
+    k = (k >> 63) ? k & ~(UINT64_C(1) << 63) : ~k;
+    double x;
+    memcpy(&x, &k, sizeof(x));
+    return x;
+}
+
+// Both paths order the keys, so NaNs and -0.0 < +0.0 land the same way
+void gobol_sort_f64(double* a, int64_t n) {
+    uint64_t small[GOBOL_SORT_SMALL];
+    uint64_t* keys = n <= GOBOL_SORT_SMALL ? small : malloc((size_t)n * sizeof(uint64_t));
+    if (!keys) { fputs("gobol: out of memory\n", stderr); exit(2); }
+    for (int64_t i = 0; i < n; i++) keys[i] = gobol_f64_key(a[i]);
+    if (n <= GOBOL_SORT_SMALL) {
+        for (int64_t i = 1; i < n; i++) {
+            uint64_t x = keys[i];
+            int64_t j = i;
+            for (; j > 0 && x < keys[j - 1]; j--) keys[j] = keys[j - 1];
+            keys[j] = x;
+        }
+    } else {
+        gobol_radix_sort_u64(keys, n);
+    }
+    for (int64_t i = 0; i < n; i++) a[i] = gobol_f64_unkey(keys[i]);
+    if (keys != small) free(keys);
+}
+
+// ---- parallel for ----
+//
+// `parallel for` outlines its body into a chunk function f(env, lo, hi)
+// that runs iterations [lo, hi) and merges its reductions under
+// gobol_parallel_lock().  gobol_parallel_for splits [0, n) into one slice
+// per thread; each thread takes chunks from the front of its own slice
+// and, once that is empty, steals chunks from the others, so uneven
+// iterations still keep every core busy.  The pool starts on first use
+// with GOBOL_THREADS threads (default: one per CPU), counting the thread
+// that started the loop, which works through its own slice too.  A
+// parallel loop inside a running one, or over a single iteration, runs on
+// the calling thread.
+
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+#elif defined(__linux__)
+#include <sys/sysinfo.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define gobol_fetch_add(p, n) InterlockedExchangeAdd64((volatile LONG64*)(p), (n))
+#else
+#define gobol_fetch_add(p, n) __atomic_fetch_add((p), (n), __ATOMIC_RELAXED)
+#endif
+
+typedef void (*gobol_par_body_t)(void* env, int64_t lo, int64_t hi);
+
+// One cache line per slice, so stealing doesn't slow the owner down
+typedef struct { int64_t next; int64_t end; char pad[48]; } gobol_par_slice_t;
+
+static struct {
+    int threads;            // 0 until the pool has started
+    gobol_mutex_t lock;
+    gobol_cond_t wake, done;
+    uint64_t job;           // bumped for every loop handed to the pool
+    int busy;               // pool threads still working on it
+    gobol_par_body_t body;
+    void* env;
+    int64_t grain;
+    gobol_par_slice_t* slices;
+    gobol_mutex_t reduce;
+} gobol_pool;
+
+// Chunks being run on this thread; non-zero inside a parallel loop
+static GOBOL_TLS int gobol_par_depth = 0;
+// Set on the pool's own threads
+static GOBOL_TLS int gobol_par_worker = 0;
+
+static void gobol_par_run(int self) {
+    int n = gobol_pool.threads;
+    int64_t grain = gobol_pool.grain;
+    gobol_par_depth++;
+    for (int k = 0; k < n; k++) {
+        gobol_par_slice_t* s = &gobol_pool.slices[(self + k) % n];
+        for (;;) {
+            int64_t lo = gobol_fetch_add(&s->next, grain);
+            if (lo >= s->end) break;
+            gobol_pool.body(gobol_pool.env, lo, s->end - lo > grain ? lo + grain : s->end);
+        }
+    }
+    gobol_par_depth--;
+}
+
+static void gobol_par_serve(int self) {
+    gobol_par_worker = 1;
+    uint64_t seen = 0;
+    for (;;) {
+        gobol_mutex_lock(&gobol_pool.lock);
+        while (gobol_pool.job == seen) gobol_cond_wait(&gobol_pool.wake, &gobol_pool.lock);
+        seen = gobol_pool.job;
+        gobol_mutex_unlock(&gobol_pool.lock);
+        gobol_par_run(self);
+        gobol_mutex_lock(&gobol_pool.lock);
+        if (--gobol_pool.busy == 0) gobol_cond_broadcast(&gobol_pool.done);
+        gobol_mutex_unlock(&gobol_pool.lock);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI gobol_par_thread(LPVOID arg) {
+    gobol_par_serve((int)(intptr_t)arg);
+    return 0;
+}
+#else
+static void* gobol_par_thread(void* arg) {
+    gobol_par_serve((int)(intptr_t)arg);
+    return NULL;
+}
+#endif
+
+static int gobol_par_cpus(void) {
+    const char* env = getenv("GOBOL_THREADS");
+    if (env && atoi(env) > 0) return atoi(env);
+#if defined(_WIN32)
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return (int)si.dwNumberOfProcessors;
+#elif defined(__APPLE__)
+    int n = 1;
+    size_t len = sizeof n;
+    if (sysctlbyname("hw.activecpu", &n, &len, NULL, 0) != 0) n = 1;
+    return n;
+#elif defined(__linux__)
+    return get_nprocs();
+#else
+    return 1;
+#endif
+}
+
+static void gobol_par_start(void) {
+    int want = gobol_par_cpus();
+    if (want < 1) want = 1;
+    if (want > 256) want = 256;
+    gobol_mutex_init(&gobol_pool.lock);
+    gobol_mutex_init(&gobol_pool.reduce);
+    gobol_mutex_init(&gobol_io_lock);
+    gobol_cond_init(&gobol_pool.wake);
+    gobol_cond_init(&gobol_pool.done);
+    gobol_pool.slices = calloc((size_t)want, sizeof(gobol_par_slice_t));
+    if (!gobol_pool.slices) { fputs("gobol: out of memory\n", stderr); exit(2); }
+    // The calling thread is worker 0; a thread that fails to start is
+    // simply not counted
+    int started = 1;
+    for (int i = 1; i < want; i++) {
+#ifdef _WIN32
+        HANDLE t = CreateThread(NULL, 0, gobol_par_thread, (LPVOID)(intptr_t)started, 0, NULL);
+        if (!t) break;
+        CloseHandle(t);
+#else
+        pthread_t t;
+        if (pthread_create(&t, NULL, gobol_par_thread, (void*)(intptr_t)started) != 0) break;
+        pthread_detach(t);
+#endif
+        started++;
+    }
+    gobol_mutex_lock(&gobol_pool.lock);
+    gobol_pool.threads = started;
+    gobol_mutex_unlock(&gobol_pool.lock);
+}
+
+void gobol_parallel_for(int64_t n, gobol_par_body_t body, void* env) {
+    if (n <= 0) return;
+    if (!gobol_pool.threads) gobol_par_start();
+    int t = gobol_pool.threads;
+    if (t == 1 || n == 1 || gobol_par_depth > 0) {
+        gobol_par_depth++;
+        body(env, 0, n);
+        gobol_par_depth--;
+        return;
+    }
+    // About eight chunks per thread: enough to even out the load without
+    // a merge per iteration
+    int64_t grain = n / ((int64_t)t * 8);
+    if (grain < 1) grain = 1;
+    int64_t per = n / t, extra = n % t, at = 0;
+    for (int i = 0; i < t; i++) {
+        gobol_pool.slices[i].next = at;
+        at += per + (i < extra ? 1 : 0);
+        gobol_pool.slices[i].end = at;
+    }
+    gobol_mutex_lock(&gobol_pool.lock);
+    gobol_pool.body = body;
+    gobol_pool.env = env;
+    gobol_pool.grain = grain;
+    gobol_pool.busy = t - 1;
+    gobol_pool.job++;
+    gobol_par_running = 1;
+    gobol_cond_broadcast(&gobol_pool.wake);
+    gobol_mutex_unlock(&gobol_pool.lock);
+
+    gobol_par_run(0);
+
+    gobol_mutex_lock(&gobol_pool.lock);
+    while (gobol_pool.busy > 0) gobol_cond_wait(&gobol_pool.done, &gobol_pool.lock);
+    gobol_par_running = 0;
+    gobol_mutex_unlock(&gobol_pool.lock);
+}
+
+void gobol_parallel_lock(void) {
+    gobol_mutex_lock(&gobol_pool.reduce);
+}
+
+void gobol_parallel_unlock(void) {
+    gobol_mutex_unlock(&gobol_pool.reduce);
+}
+
+// ---- instrumentation (gobol --instrument) ----
+//
+// Instrumented builds bracket every function body with GOBOL_PROF_BEGIN /
+// GOBOL_PROF_END, which call gobol_prof_enter/leave with one static site
+// per function.  Calls are recorded in a calling-context tree: one node
+// per distinct call stack, holding its call count and its time with and
+// without callees.  At exit the tree is written as folded stacks ("main;f;g
+// <self ns>" per node, the input of flamegraph.pl and inferno) to
+// $GOBOL_PROFILE (default gobol.folded) and a per-function summary goes to
+// stderr.  Only the thread that runs main() is profiled; the pool threads
+// of `parallel for` skip the hooks.
+
+typedef struct gobol_prof_site {
+    const char* name;
+    const char* file;
+    int line;
+    // Totals over every node of the site, filled in by the report
+    uint64_t calls, self, total;
+    int active, seen;
+} gobol_prof_site_t;
+
+typedef struct gobol_prof_node {
+    gobol_prof_site_t* site;
+    struct gobol_prof_node* parent;
+    struct gobol_prof_node* child;
+    struct gobol_prof_node* next;
+    uint64_t calls, total, callees, start;
+} gobol_prof_node_t;
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define gobol_prof_ticks() __rdtsc()
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <x86intrin.h>
+#define gobol_prof_ticks() __rdtsc()
+#else
+#define gobol_prof_ticks() gobol_prof_ns()
+#endif
+
+static gobol_prof_node_t gobol_prof_root;
+static gobol_prof_node_t* gobol_prof_cur = NULL;
+static uint64_t gobol_prof_tick0, gobol_prof_ns0;
+
+static uint64_t gobol_prof_ns(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void gobol_prof_report(void);
+
+int gobol_prof_enter(gobol_prof_site_t* site) {
+    if (gobol_par_worker) return 0;
+    if (!gobol_prof_cur) {
+        gobol_prof_cur = &gobol_prof_root;
+        gobol_prof_ns0 = gobol_prof_ns();
+        gobol_prof_tick0 = gobol_prof_ticks();
+        atexit(gobol_prof_report);
+    }
+    gobol_prof_node_t* parent = gobol_prof_cur;
+    gobol_prof_node_t** link = &parent->child;
+    gobol_prof_node_t* n = *link;
+    while (n && n->site != site) {
+        link = &n->next;
+        n = *link;
+    }
+    if (!n) {
+        n = calloc(1, sizeof *n);
+        if (!n) { fputs("gobol: out of memory\n", stderr); exit(2); }
+        n->site = site;
+        n->parent = parent;
+        n->next = parent->child;
+        parent->child = n;
+    } else if (n != parent->child) {
+        // Move to front, so the hottest callee is found first
+        *link = n->next;
+        n->next = parent->child;
+        parent->child = n;
+    }
+    n->calls++;
+    gobol_prof_cur = n;
+    n->start = gobol_prof_ticks();
+    return 0;
+}
+
+// `frame` is the cleanup variable GOBOL_PROF_BEGIN declares; unused.
+void gobol_prof_leave(int* frame) {
+    (void)frame;
+    if (gobol_par_worker) return;
+    gobol_prof_node_t* n = gobol_prof_cur;
+    if (!n || n == &gobol_prof_root) return;
+    uint64_t t = gobol_prof_ticks() - n->start;
+    n->total += t;
+    n->parent->callees += t;
+    gobol_prof_cur = n->parent;
+}
+
+static char* gobol_prof_path = NULL;
+static size_t gobol_prof_path_cap = 0;
+static gobol_prof_site_t** gobol_prof_sites = NULL;
+static size_t gobol_prof_nsites = 0;
+
+// Folds the subtree of `n` into `out`; gobol_prof_path[0..len) holds the
+// frames above it.  Also sums every node into its site.
+static void gobol_prof_fold(FILE* out, gobol_prof_node_t* n, size_t len, double ns_per_tick) {
+    gobol_prof_site_t* site = n->site;
+    char frame[512];
+    int w = snprintf(frame, sizeof frame, "%s%s (%s:%d)", len ? ";" : "", site->name, site->file, site->line);
+    size_t flen = w < 0 ? 0 : (size_t)w < sizeof frame ? (size_t)w : sizeof frame - 1;
+    if (len + flen + 1 > gobol_prof_path_cap) {
+        size_t cap = gobol_prof_path_cap ? gobol_prof_path_cap * 2 : 4096;
+        while (cap < len + flen + 1) cap *= 2;
+        char* grown = realloc(gobol_prof_path, cap);
+        if (!grown) return;
+        gobol_prof_path = grown;
+        gobol_prof_path_cap = cap;
+    }
+    memcpy(gobol_prof_path + len, frame, flen);
+    len += flen;
+
+    uint64_t self = n->total > n->callees ? n->total - n->callees : 0;
+    if (out && self) {
+        fprintf(out, "%.*s %" PRIu64 "\n", (int)len, gobol_prof_path, (uint64_t)(self * ns_per_tick));
+    }
+    if (!site->seen) {
+        gobol_prof_site_t** grown = realloc(gobol_prof_sites, (gobol_prof_nsites + 1) * sizeof *grown);
+        if (grown) {
+            gobol_prof_sites = grown;
+            gobol_prof_sites[gobol_prof_nsites++] = site;
+            site->seen = 1;
+        }
+    }
+    site->calls += n->calls;
+    site->self += self;
+    // A recursive call's time is already inside its outermost frame
+    if (!site->active) site->total += n->total;
+    site->active++;
+    for (gobol_prof_node_t* c = n->child; c; c = c->next) gobol_prof_fold(out, c, len, ns_per_tick);
+    site->active--;
+}
+
+static int gobol_prof_by_self(const void* a, const void* b) {
+    uint64_t x = (*(gobol_prof_site_t* const*)a)->self;
+    uint64_t y = (*(gobol_prof_site_t* const*)b)->self;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void gobol_prof_report(void) {
+    // Frames still open when the program calls exit()
+    while (gobol_prof_cur && gobol_prof_cur != &gobol_prof_root) gobol_prof_leave(NULL);
+    uint64_t ticks = gobol_prof_ticks() - gobol_prof_tick0;
+    uint64_t ns = gobol_prof_ns() - gobol_prof_ns0;
+    double ns_per_tick = ticks ? (double)ns / (double)ticks : 1.0;
+
+    const char* path = getenv("GOBOL_PROFILE");
+    if (!path || !*path) path = "gobol.folded";
+    FILE* out = fopen(path, "w");
+    for (gobol_prof_node_t* c = gobol_prof_root.child; c; c = c->next) gobol_prof_fold(out, c, 0, ns_per_tick);
+    if (out) fclose(out);
+
+    flush();
+    fprintf(stderr, "gobol profile: %zu functions, %" PRIu64 " array grows, %" PRIu64 " string allocations; stacks in %s\n",
+            gobol_prof_nsites, gobol_prof_array_grows, gobol_prof_str_allocs, out ? path : "(not written)");
+    fprintf(stderr, "%12s %12s %12s  %s\n", "calls", "self ms", "total ms", "function");
+    if (gobol_prof_nsites) qsort(gobol_prof_sites, gobol_prof_nsites, sizeof *gobol_prof_sites, gobol_prof_by_self);
+    for (size_t i = 0; i < gobol_prof_nsites; i++) {
+        gobol_prof_site_t* s = gobol_prof_sites[i];
+        fprintf(stderr, "%12" PRIu64 " %12.3f %12.3f  %s (%s:%d)\n", s->calls,
+                s->self * ns_per_tick / 1e6, s->total * ns_per_tick / 1e6, s->name, s->file, s->line);
+    }
+}
@@ -133,6 +133,15 @@ fn test_errors_type_mismatch() {
     result.assert_failure(ExitCode::CompileError);
 }
 
+/// 用例：errors/uninferable_type_arg.gbl | 预期编译失败
+#[test]
+fn test_errors_uninferable_type_arg() {
+    let path = fixture_path("fixtures/errors/uninferable_type_arg.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_failure(ExitCode::CompileError);
+    assert!(result.stderr.contains("cannot infer type argument 'T' for 'count'"), "stderr: {}", result.stderr);
+}
+
 /// 用例：errors/undefined_variable.gbl | 预期编译失败
 #[test]
 fn test_errors_undefined_variable() {
@@ -268,3 +277,244 @@ fn test_types_println() {
     let result = run_gobol(path.to_str().unwrap(), false);
     result.assert_success();
 }
+
+/// 用例：types/string_concat.gbl | 预期正常运行
+#[test]
+fn test_types_string_concat() {
+    let path = fixture_path("fixtures/types/string_concat.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+}
+
+/// 用例：types/format_string.gbl | 预期正常运行
+#[test]
+fn test_types_format_string() {
+    let path = fixture_path("fixtures/types/format_string.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+}
+
+/// 用例：basic/buffered_output.gbl | 预期正常运行
+#[test]
+fn test_basic_buffered_output() {
+    let path = fixture_path("fixtures/basic/buffered_output.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+}
+
+/// 用例：arrays/typed_arrays.gbl | 预期正常运行
+#[test]
+fn test_arrays_typed_arrays() {
+    let path = fixture_path("fixtures/arrays/typed_arrays.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+}
+
+/// 用例：errors/index_out_of_bounds.gbl | 预期运行时越界退出
+#[test]
+fn test_errors_index_out_of_bounds() {
+    let path = fixture_path("fixtures/errors/index_out_of_bounds.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_failure(ExitCode::RuntimePanic);
+}
+
+/// 用例：arrays/matrix.gbl | 预期正常运行
+#[test]
+fn test_arrays_matrix() {
+    let path = fixture_path("fixtures/arrays/matrix.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+}
+
+/// 用例：expressions/constant_fold.gbl | 预期正常运行
+#[test]
+fn test_expressions_constant_fold() {
+    let path = fixture_path("fixtures/expressions/constant_fold.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+    result.assert_stdout_contains("Hello, Gobol\n13\n7.06858\nab7\nlimit=12 tau=6.28319\nbig\n2\n");
+}
+
+/// 用例：functions/generic_instances.gbl | 预期正常运行
+#[test]
+fn test_functions_generic_instances() {
+    let path = fixture_path("fixtures/functions/generic_instances.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+}
+
+/// 用例：expressions/format_escapes.gbl | 预期正常运行
+#[test]
+fn test_expressions_format_escapes() {
+    let path = fixture_path("fixtures/expressions/format_escapes.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+    result.assert_stdout_contains("a\tb5c\n\"gobol\" scored 5 \\ 5!\né5ügobol\n");
+}
+
+/// 用例：control_flow/range_forms.gbl | 预期正常运行
+#[test]
+fn test_control_flow_range_forms() {
+    let path = fixture_path("fixtures/control_flow/range_forms.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+}
+
+/// 用例：structs/mutating_methods.gbl | 预期正常运行
+#[test]
+fn test_structs_mutating_methods() {
+    let path = fixture_path("fixtures/structs/mutating_methods.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+}
+
+/// 用例：arrays/bulk_ops.gbl | 预期正常运行
+#[test]
+fn test_arrays_bulk_ops() {
+    let path = fixture_path("fixtures/arrays/bulk_ops.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+}
+
+/// 用例：arrays/sort_search.gbl | 预期正常运行
+#[test]
+fn test_arrays_sort_search() {
+    let path = fixture_path("fixtures/arrays/sort_search.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+    result.assert_stdout_contains("-8 -3 0 9 at7 = 6 at4 = -1");
+    result.assert_stdout_contains("desc: 9 -8");
+    result.assert_stdout_contains("evens = 3 first = 2");
+    result.assert_stdout_contains("big sorted = true min = -500");
+    result.assert_stdout_contains("f = -1 3.25");
+    result.assert_stdout_contains("s = apple pear fig at 1");
+    result.assert_stdout_contains("items = 2 1");
+    result.assert_stdout_contains("g = -nan -2 -0 0 1 nan");
+    result.assert_stdout_contains("h = 104 -nan -48.5 -0 0 0.5 nan");
+}
+
+/// 用例：advanced/region_memory.gbl | 预期正常运行
+#[test]
+fn test_advanced_region_memory() {
+    let path = fixture_path("fixtures/advanced/region_memory.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+}
+
+/// 用例：errors/region_escape.gbl | 预期编译失败
+#[test]
+fn test_errors_region_escape() {
+    let path = fixture_path("fixtures/errors/region_escape.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_failure(ExitCode::CompileError);
+}
+
+/// 用例：advanced/region_ctor_return.gbl | 预期正常运行
+#[test]
+fn test_advanced_region_ctor_return() {
+    let path = fixture_path("fixtures/advanced/region_ctor_return.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+    result.assert_stdout_contains("names = 3\nsum = 5000 small = 300\n");
+}
+
+/// 用例：advanced/parallel_for.gbl | 预期正常运行
+#[test]
+fn test_advanced_parallel_for() {
+    let path = fixture_path("fixtures/advanced/parallel_for.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+    result.assert_stdout_contains("total = 1834604 longest = 278 shortest = 0");
+    result.assert_stdout_contains("steps[27] = 111 steps[9999] = 91");
+    result.assert_stdout_contains("1:0 7:16 total = 1854604");
+    result.assert_stdout_contains("corner = 15376");
+    result.assert_stdout_contains("fsum = 256");
+    result.assert_stdout_contains("uneven = 2016 serial = 2016 few = 6");
+    result.assert_stdout_contains("grid = 2999983");
+}
+
+/// 用例：errors/parallel_carried_write.gbl | 预期编译失败
+#[test]
+fn test_errors_parallel_carried_write() {
+    let path = fixture_path("fixtures/errors/parallel_carried_write.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_failure(ExitCode::CompileError);
+}
+
+/// 用例：types/nullable_inline.gbl | 预期正常运行
+#[test]
+fn test_types_nullable_inline() {
+    let path = fixture_path("fixtures/types/nullable_inline.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+    result.assert_stdout_contains("opt is null\nopt is 0\nat = 2 miss = none\np is set\nq is null\nhint = none 3 f = 2.5\n");
+}
+
+/// 用例：expressions/match_switch.gbl | 预期正常运行
+#[test]
+fn test_expressions_match_switch() {
+    let path = fixture_path("fixtures/expressions/match_switch.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+    result.assert_stdout_contains("grade: B\npush\nacc = 82 add ?\nw = 2\n");
+}
+
+/// 用例：basic/file_io.gbl | 预期正常运行
+#[test]
+fn test_basic_file_io() {
+    let path = fixture_path("fixtures/basic/file_io.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+}
+
+/// 用例：functions/inline_small.gbl | 预期正常运行
+#[test]
+fn test_functions_inline_small() {
+    let path = fixture_path("fixtures/functions/inline_small.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+}
+
+/// 用例：arrays/grow_in_callee.gbl | 预期正常运行
+#[test]
+fn test_arrays_grow_in_callee() {
+    let path = fixture_path("fixtures/arrays/grow_in_callee.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+    result.assert_stdout_contains("len after keep = 1\nlen after grow = 10001 last = 9999\n");
+    result.assert_stdout_contains("len = 20002 total = 99990006\nfirst = 42\n");
+    result.assert_stdout_contains("literal total = 6\n");
+    result.assert_stdout_contains("bag = 49995000 0\n");
+}
+
+/// 用例：structs/store_formatted.gbl | 预期正常运行
+#[test]
+fn test_structs_store_formatted() {
+    let path = fixture_path("fixtures/structs/store_formatted.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_success();
+}
+
+/// 用例：errors/parallel_neighbour_read.gbl | 预期编译失败
+#[test]
+fn test_errors_parallel_neighbour_read() {
+    let path = fixture_path("fixtures/errors/parallel_neighbour_read.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_failure(ExitCode::CompileError);
+}
+
+/// 用例：errors/parallel_callee_write.gbl | 预期编译失败
+#[test]
+fn test_errors_parallel_callee_write() {
+    let path = fixture_path("fixtures/errors/parallel_callee_write.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_failure(ExitCode::CompileError);
+}
+
+/// 用例：errors/private_module_call.gbl | 预期编译失败
+#[test]
+fn test_errors_private_module_call() {
+    let path = fixture_path("fixtures/errors/private_module_call.gbl");
+    let result = run_gobol(path.to_str().unwrap(), false);
+    result.assert_failure(ExitCode::CompileError);
+}